@@ -8,6 +8,10 @@
 #include <functional>
 #include <cstdint>
 
+namespace hypershare::storage {
+    class ParallelHasher;
+}
+
 namespace hypershare::crypto {
 
 class FileVerifier {
@@ -28,11 +32,17 @@ public:
     std::string calculate_file_hash(const std::filesystem::path& file_path);
     Blake3Hash calculate_file_hash_raw(const std::filesystem::path& file_path);
     
+    // File hash computed the way metadata.file_hash was (see FileHashScheme)
+    std::string calculate_file_hash(const std::filesystem::path& file_path,
+                                    const hypershare::storage::FileMetadata& metadata);
+    
     // Metadata verification
     bool verify_file_metadata(const std::filesystem::path& file_path, 
                               const hypershare::storage::FileMetadata& metadata);
     
-    // Multi-chunk verification
+    // Multi-chunk verification. Streams the file through ParallelHasher, so
+    // memory stays bounded whatever the file size, and stops at the first
+    // mismatch.
     bool verify_all_chunks(const std::filesystem::path& file_path,
                            const std::vector<std::string>& chunk_hashes,
                            uint32_t chunk_size);
@@ -45,12 +55,20 @@ public:
         std::string details;
     };
     
+    // Called before each chunk is read; false skips the chunk
+    using ChunkFilter = std::function<bool(size_t chunk_index, uint32_t chunk_size)>;
+    
+    // With chunk hashes every chunk is checked on its own and the bad ones
+    // are listed, chunks missing from a truncated or deleted file included.
+    // Without them only the file hash is compared.
     CorruptionReport check_file_integrity(const std::filesystem::path& file_path,
-                                          const hypershare::storage::FileMetadata& metadata);
+                                          const hypershare::storage::FileMetadata& metadata,
+                                          ChunkFilter filter = nullptr);
     
     // Performance verification for large files
     struct VerificationProgress {
         uint64_t chunks_verified;
+        uint64_t chunks_failed;
         uint64_t total_chunks;
         double percentage_complete;
         std::chrono::milliseconds elapsed_time;
@@ -59,14 +77,24 @@ public:
     
     using ProgressCallback = std::function<void(const VerificationProgress&)>;
     
+    // Checks every chunk against metadata.chunk_hashes, hashing on a worker
+    // pool. The callback runs once per hashed block (4MB), on worker threads
+    // but never concurrently. Without stop_at_first_mismatch the whole file is
+    // hashed and chunks_failed counts every bad chunk. Metadata without chunk
+    // hashes falls back to verify_file_metadata, reporting only at the end.
     bool verify_file_with_progress(const std::filesystem::path& file_path,
                                    const hypershare::storage::FileMetadata& metadata,
-                                   ProgressCallback callback = nullptr);
+                                   ProgressCallback callback = nullptr,
+                                   bool stop_at_first_mismatch = true);
     
 private:
     // Internal helpers
-    std::vector<std::vector<uint8_t>> split_file_into_chunks(const std::filesystem::path& file_path,
-                                                             uint32_t chunk_size);
+    bool verify_chunk_stream(const std::filesystem::path& file_path,
+                             hypershare::storage::ParallelHasher& hasher,
+                             const std::vector<Blake3Hash>& expected,
+                             ProgressCallback callback,
+                             bool stop_at_first_mismatch,
+                             Blake3Hash* root = nullptr);
     
     bool compare_hashes(const std::string& hash1, const std::string& hash2);
     bool compare_hashes(const Blake3Hash& hash1, const Blake3Hash& hash2);
@@ -34,6 +34,14 @@ public:
     void send_message(const MessageHeader& header, const std::vector<std::uint8_t>& payload);
     void send_raw(MessageType type, const std::vector<std::uint8_t>& payload);
     
+    // Sends prefix + body + suffix as one message without copying body. keepalive
+    // owns the memory behind body and is released once the write has completed.
+    void send_message_view(MessageType type,
+                           std::vector<std::uint8_t> prefix,
+                           std::span<const std::uint8_t> body,
+                           std::vector<std::uint8_t> suffix,
+                           std::shared_ptr<const void> keepalive);
+    
     template<MessagePayload T>
     void send_message(MessageType type, const T& payload) {
         auto payload_data = payload.serialize();
@@ -74,7 +82,16 @@ private:
     std::array<std::uint8_t, MESSAGE_HEADER_SIZE> read_header_buffer_;
     std::vector<std::uint8_t> read_payload_buffer_;
     
-    std::queue<std::vector<std::uint8_t>> write_queue_;
+    struct OutgoingMessage {
+        std::vector<std::uint8_t> head;      // Message header and any serialized payload
+        std::span<const std::uint8_t> body;  // Borrowed payload bytes, sent after head
+        std::vector<std::uint8_t> tail;
+        std::shared_ptr<const void> keepalive;
+    };
+    
+    void enqueue_write(OutgoingMessage message);
+    
+    std::queue<OutgoingMessage> write_queue_;
     bool write_in_progress_;
 };
 
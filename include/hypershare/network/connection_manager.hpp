@@ -9,6 +9,7 @@
 
 namespace hypershare::storage {
     class FileIndex;
+    struct ChunkView;
 }
 
 namespace hypershare::network {
@@ -73,10 +74,21 @@ public:
         return false;
     }
     
+    // Serves a chunk straight from a mapped view, the mapping stays alive until the write completes.
+    // proof is the chunk's sibling path (ChunkManager::get_chunk_proof) for manifest-only receivers.
+    bool send_chunk_data(std::uint32_t peer_id, const std::string& file_id, std::uint64_t chunk_index,
+                         const hypershare::storage::ChunkView& chunk, const std::string& chunk_hash,
+                         std::span<const hypershare::crypto::Blake3Hash> proof = {});
+    
     void set_handshake_timeout(std::chrono::milliseconds timeout) { handshake_timeout_ = timeout; }
     void set_heartbeat_interval(std::chrono::milliseconds interval) { heartbeat_interval_ = interval; }
     void set_connection_timeout(std::chrono::milliseconds timeout) { connection_timeout_ = timeout; }
     
+    // Offer zstd chunk compression in handshakes (StorageConfig::enable_compression).
+    // Takes effect for handshakes sent after the call.
+    void set_compression_enabled(bool enabled) { compression_enabled_ = enabled; }
+    std::uint32_t get_local_capabilities() const;
+    
     void initialize_file_announcer(std::shared_ptr<hypershare::storage::FileIndex> file_index);
     std::shared_ptr<FileAnnouncer> get_file_announcer() const { return file_announcer_; }
     
@@ -124,6 +136,7 @@ private:
     std::uint32_t local_peer_id_;
     std::string local_peer_name_;
     std::uint16_t local_tcp_port_;
+    bool compression_enabled_;
     
     std::chrono::milliseconds handshake_timeout_;
     std::chrono::milliseconds heartbeat_interval_;
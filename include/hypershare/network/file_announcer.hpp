@@ -33,6 +33,7 @@ public:
     
     void announce_files();
     void announce_file(const hypershare::storage::FileMetadata& metadata);
+    void announce_file(const hypershare::storage::FileMetadataView& metadata);
     
     std::vector<RemoteFileInfo> get_remote_files() const;
     std::vector<RemoteFileInfo> get_remote_files_from_peer(std::uint32_t peer_id) const;
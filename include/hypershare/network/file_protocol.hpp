@@ -41,7 +41,7 @@ struct FileResponseMessage : public FileProtocolMessage {
     std::string file_id;
     bool accepted;
     std::string error_message;
-    hypershare::storage::FileMetadata metadata; // Only set if accepted
+    hypershare::storage::FileMetadata metadata; // Only set if accepted, sent as a manifest
     
     std::vector<uint8_t> serialize() const override;
     static FileResponseMessage deserialize(const std::vector<uint8_t>& data);
@@ -63,6 +63,7 @@ struct ChunkDataMessage : public FileProtocolMessage {
     uint64_t chunk_index;
     std::vector<uint8_t> data;
     std::string chunk_hash;
+    std::vector<hypershare::crypto::Blake3Hash> proof; // Sibling path to the chunk tree root
     
     std::vector<uint8_t> serialize() const override;
     static ChunkDataMessage deserialize(const std::vector<uint8_t>& data);
@@ -5,6 +5,8 @@
 #include <vector>
 #include <span>
 #include <concepts>
+#include <initializer_list>
+#include "hypershare/crypto/crypto_types.hpp"
 
 namespace hypershare::network {
 
@@ -46,6 +48,20 @@ enum class MessageFlags : std::uint8_t {
     PRIORITY        = 0x08
 };
 
+constexpr bool has_flag(MessageFlags flags, MessageFlags flag) {
+    return (static_cast<std::uint8_t>(flags) & static_cast<std::uint8_t>(flag)) != 0;
+}
+
+// Bits of HandshakeMessage::capabilities, a feature is used only when both peers set it
+enum class PeerCapability : std::uint32_t {
+    NONE             = 0x00,
+    ZSTD_COMPRESSION = 0x01  // Accepts COMPRESSED messages (zstd frame payloads)
+};
+
+constexpr bool has_capability(std::uint32_t capabilities, PeerCapability capability) {
+    return (capabilities & static_cast<std::uint32_t>(capability)) != 0;
+}
+
 struct MessageHeader {
     std::uint32_t magic;           // Protocol magic number
     std::uint16_t version;         // Protocol version
@@ -61,6 +77,7 @@ struct MessageHeader {
     
     bool is_valid() const;
     void calculate_checksum(std::span<const std::uint8_t> payload);
+    void calculate_checksum(std::initializer_list<std::span<const std::uint8_t>> payload_parts);
     bool verify_checksum(std::span<const std::uint8_t> payload) const;
     
     std::vector<std::uint8_t> serialize() const;
@@ -130,8 +147,16 @@ struct ChunkDataMessage {
     std::vector<std::uint8_t> data;
     std::string chunk_hash;
     
+    // Sibling path to the file's chunk tree root (FileHashScheme::CHUNK_TREE),
+    // lets the receiver verify the chunk without the full list of chunk hashes
+    std::vector<hypershare::crypto::Blake3Hash> proof = {};
+    
     std::vector<std::uint8_t> serialize() const;
     static ChunkDataMessage deserialize(std::span<const std::uint8_t> data);
+    
+    // Wire bytes before and after the chunk body, so the body can be sent from a mapped view
+    std::vector<std::uint8_t> serialize_prefix(std::uint32_t data_size) const;
+    std::vector<std::uint8_t> serialize_suffix() const;
 };
 
 struct ErrorMessage {
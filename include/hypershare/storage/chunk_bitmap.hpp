@@ -0,0 +1,100 @@
+#pragma once
+
+#include <bit>
+#include <optional>
+#include <span>
+#include <vector>
+#include <cstdint>
+
+namespace hypershare::storage {
+
+// Compressed set of chunk indexes, laid out like a roaring bitmap: indexes are
+// grouped by their upper bits into containers of 65536, each held as a sorted
+// array while sparse and as a plain bitmap once dense. Serialized containers
+// additionally collapse into runs, so a stretch of 65536 completed chunks
+// stores in about twenty bytes.
+class ChunkBitmap {
+public:
+    // True if the index was not already set
+    bool insert(uint64_t index);
+    bool erase(uint64_t index);
+    bool contains(uint64_t index) const;
+
+    // [first, last); dense spans are set a word at a time
+    void insert_range(uint64_t first, uint64_t last);
+    void erase_range(uint64_t first, uint64_t last);
+
+    uint64_t cardinality() const { return cardinality_; }
+    bool empty() const { return cardinality_ == 0; }
+    void clear();
+
+    // Smallest index at or after from that is not set
+    uint64_t next_missing(uint64_t from = 0) const;
+
+    std::vector<uint64_t> missing(uint64_t total) const;
+
+    // Visits set indexes in ascending order
+    template <typename Visitor>
+    void for_each(Visitor&& visitor) const {
+        for (const auto& container : containers_) {
+            uint64_t base = container.key << CONTAINER_BITS;
+            container.for_each_low([&](uint16_t low) { visitor(base | low); });
+        }
+    }
+
+    std::vector<uint8_t> serialize() const;
+
+    // Empty if data is not a serialized bitmap
+    static std::optional<ChunkBitmap> deserialize(std::span<const uint8_t> data);
+
+    bool operator==(const ChunkBitmap& other) const;
+
+private:
+    static constexpr unsigned CONTAINER_BITS = 16;
+    static constexpr size_t CONTAINER_SIZE = size_t{1} << CONTAINER_BITS;
+    static constexpr size_t BITMAP_WORDS = CONTAINER_SIZE / 64;
+    // Past this an array takes more room than the bitmap
+    static constexpr size_t ARRAY_MAX = 4096;
+
+    struct Container {
+        uint64_t key = 0;
+        uint32_t cardinality = 0;
+        std::vector<uint16_t> array;  // sorted, used while words is empty
+        std::vector<uint64_t> words;  // BITMAP_WORDS once dense
+
+        bool contains(uint16_t low) const;
+        bool insert(uint16_t low);
+        bool erase(uint16_t low);
+        // Smallest unset value at or after low, CONTAINER_SIZE if none
+        size_t next_missing(size_t low) const;
+        // [first, last) within the container, last <= CONTAINER_SIZE
+        void insert_range(size_t first, size_t last);
+        void erase_range(size_t first, size_t last);
+        void to_bitmap();
+        void to_array();
+
+        template <typename Visitor>
+        void for_each_low(Visitor&& visitor) const {
+            if (words.empty()) {
+                for (uint16_t low : array) {
+                    visitor(low);
+                }
+                return;
+            }
+            for (size_t w = 0; w < words.size(); ++w) {
+                for (uint64_t word = words[w]; word != 0; word &= word - 1) {
+                    visitor(static_cast<uint16_t>(w * 64 + std::countr_zero(word)));
+                }
+            }
+        }
+    };
+
+    std::vector<Container> containers_;  // sorted by key
+    uint64_t cardinality_ = 0;
+
+    Container* find(uint64_t key);
+    const Container* find(uint64_t key) const;
+    Container& find_or_insert(uint64_t key);
+};
+
+} // namespace hypershare::storage
@@ -4,25 +4,46 @@
 #include <vector>
 #include <filesystem>
 #include <fstream>
+#include <list>
 #include <memory>
 #include <cstdint>
 #include <optional>
+#include <mutex>
+#include <unordered_map>
+#include <functional>
 #include "storage_config.hpp"
 #include "file_metadata.hpp"
+#include "mapped_file_cache.hpp"
+#include "disk_engine.hpp"
+#include "parallel_hasher.hpp"
+#include "chunk_store.hpp"
+#include "hash_tree.hpp"
+#include "hash_cache.hpp"
+#include "storage_accountant.hpp"
+#include "write_back_buffer.hpp"
+#include "direct_io.hpp"
 #include "../crypto/crypto_types.hpp"
 
 namespace hypershare::storage {
 
+class FileIndex;
+
 class ChunkManager {
 public:
     static constexpr size_t DEFAULT_CHUNK_SIZE = 65536; // 64KB
     
+    using ReadHandler = std::function<void(hypershare::crypto::CryptoResult, std::vector<uint8_t>)>;
+    using WriteHandler = std::function<void(hypershare::crypto::CryptoResult)>;
+    using DurableHandler = std::function<void(const std::string& file_hash, const std::vector<size_t>& chunks)>;
+    using EvictionHandler = std::function<void(const std::string& file_hash)>;
+    
     ChunkManager(size_t chunk_size = DEFAULT_CHUNK_SIZE);
     explicit ChunkManager(const StorageConfig& config);
+    ~ChunkManager();
     
     std::vector<std::vector<uint8_t>> split_file(const std::filesystem::path& file_path);
     
-    std::vector<std::string> get_chunk_hashes(const std::filesystem::path& file_path);
+    std::vector<hypershare::crypto::Blake3Hash> get_chunk_hashes(const std::filesystem::path& file_path);
     
     hypershare::crypto::CryptoResult chunk_file(const std::string& file_path, FileMetadata& metadata);
     
@@ -30,6 +51,9 @@ public:
                                                   size_t chunk_index,
                                                   const std::vector<uint8_t>& chunk_data);
     
+    // Reads from metadata.file_path when it is set and exists, otherwise from
+    // the download target. A target only serves chunks written to it since it
+    // was opened; others are FILE_NOT_FOUND rather than the preallocated zeros.
     hypershare::crypto::CryptoResult read_chunk(const FileMetadata& metadata,
                                                  size_t chunk_index,
                                                  std::vector<uint8_t>& chunk_data);
@@ -43,17 +67,102 @@ public:
                                     const std::string& file_hash,
                                     size_t chunk_index);
     
+    // Read of a shared file's chunk that stays valid while it is sent. Chunks
+    // are copied out with pread unless the file is below an immutable root.
+    std::optional<ChunkView> read_chunk_view(const FileMetadata& metadata, size_t chunk_index);
+    
+    void set_mapped_file_cache(std::shared_ptr<MappedFileCache> cache) { mapped_files_ = std::move(cache); }
+    
+    // Files below these roots never change while they are served, so
+    // read_chunk_view hands out zero-copy views of cached mappings. Any other
+    // file may be truncated by its owner, and touching a mapping past the new
+    // end of file raises SIGBUS. Set before serving.
+    void set_immutable_roots(std::vector<std::filesystem::path> roots);
+    
+    // Sibling path proving a chunk against file_hash, sent along with the chunk.
+    // Empty unless the file uses FileHashScheme::CHUNK_TREE. The tree of each
+    // served file is built once and cached.
+    std::vector<hypershare::crypto::Blake3Hash> get_chunk_proof(const FileMetadata& metadata, size_t chunk_index);
+    
+    // Chunk I/O through the disk engine, handlers run on the engine's io_context.
+    // Without an engine (or for legacy per-chunk files) the synchronous path is used
+    // and the handler is invoked before returning. All writes for a file must have
+    // completed before finalize_download or abort_download is called, and all
+    // writes before the ChunkManager is destroyed.
+    void async_read_chunk(const FileMetadata& metadata, size_t chunk_index, ReadHandler handler);
+    
+    void async_write_chunk(const FileMetadata& metadata, size_t chunk_index,
+                           std::vector<uint8_t> chunk_data, WriteHandler handler);
+    
+    void set_disk_engine(std::shared_ptr<DiskEngine> engine) { disk_engine_ = std::move(engine); }
+    
+    // Writes to a preallocated target succeed once the chunk is buffered; the
+    // handler is told when chunks are durable under StorageConfig::durability.
+    // Resume state should record chunks from here, not from write results.
+    // Async writes that buffer or sync do so on a disk engine worker, so the
+    // handler may be called from one of its threads.
+    void set_durable_handler(DurableHandler handler) { durable_handler_ = std::move(handler); }
+    
+    // With deduplication on and per-chunk downloads (no preallocation), downloaded
+    // chunks live in the content-addressed store instead of per-file chunk files.
+    // Preallocated downloads are written once, to their target, and share chunks
+    // through the FileIndex once completed.
+    void set_chunk_store(std::shared_ptr<ChunkStore> store) { chunk_store_ = std::move(store); }
+    
+    // chunk_file takes the hashes of files unchanged since they were last
+    // hashed from the cache instead of reading them
+    void set_hash_cache(std::shared_ptr<HashCache> cache) { hash_cache_ = std::move(cache); }
+    
+    // Downloads reserve their size before prepare_download succeeds, and
+    // incomplete downloads not in progress may be discarded to make room
+    void set_storage_accountant(std::shared_ptr<StorageAccountant> accountant);
+    
+    // Told when an incomplete download was discarded to make room, so state
+    // recorded about its durable chunks can be dropped along with them
+    void set_eviction_handler(EvictionHandler handler) { eviction_handler_ = std::move(handler); }
+    
+    // After prepare_download, takes back the chunks an interrupted run of the
+    // download made durable in its target, so they are served and not fetched
+    // again. Chunks with a known hash are read back and checked first; the
+    // ones kept are appended to restored.
+    hypershare::crypto::CryptoResult resume_download(const FileMetadata& metadata,
+                                                     const std::vector<size_t>& durable,
+                                                     std::vector<size_t>& restored);
+    
+    // Fills chunks of a download from data already on this machine: the chunk
+    // store first, then any indexed file holding a chunk with the same hash.
+    // Chunks already in a preallocated target are skipped. Every imported
+    // chunk is verified and its index appended to imported.
+    hypershare::crypto::CryptoResult import_local_chunks(const FileMetadata& metadata,
+                                                         FileIndex& index,
+                                                         std::vector<size_t>& imported);
+    
+    // Assembles chunk files written by write_chunk into output_path with
+    // kernel-side copies: reflinks where the filesystem shares extents, then
+    // copy_file_range, then a buffered copy
     bool merge_chunks(const std::filesystem::path& base_path,
                       const std::string& file_hash,
                       const std::filesystem::path& output_path,
                       size_t total_chunks);
     
+    // Preallocated download target: chunks are written in place with pwrite and
+    // the finished file is renamed into place instead of merged
+    hypershare::crypto::CryptoResult prepare_download(const FileMetadata& metadata);
+    
+    hypershare::crypto::CryptoResult finalize_download(const FileMetadata& metadata,
+                                                        const std::filesystem::path& output_path);
+    
+    void abort_download(const FileMetadata& metadata);
+    
     bool verify_chunk(const std::vector<uint8_t>& chunk_data, 
                       const std::string& expected_hash);
     
     bool verify_chunk_hash(const std::vector<uint8_t>& chunk_data, 
                            const std::string& expected_hash);
     
+    bool verify_chunk_hash(const std::vector<uint8_t>& chunk_data,
+                           const hypershare::crypto::Blake3Hash& expected_hash);
+    
     size_t get_chunk_size() const { return chunk_size_; }
     
     void set_chunk_size(size_t new_size) { chunk_size_ = new_size; }
@@ -65,6 +174,92 @@ public:
 private:
     size_t chunk_size_;
     std::optional<StorageConfig> config_;
+    std::shared_ptr<MappedFileCache> mapped_files_;
+    std::vector<std::filesystem::path> immutable_roots_;
+    std::shared_ptr<DiskEngine> disk_engine_;
+    std::shared_ptr<ChunkStore> chunk_store_;
+    std::shared_ptr<HashCache> hash_cache_;
+    std::shared_ptr<StorageAccountant> accountant_;
+    DurableHandler durable_handler_;
+    EvictionHandler eviction_handler_;
+    
+    // Aligned buffers for O_DIRECT I/O, set when the config enables it. Declared
+    // before everything holding its buffers so it is destroyed last.
+    std::unique_ptr<AlignedBufferPool> direct_buffers_;
+    
+    using LruList = std::list<std::string>;
+    
+    // O_DIRECT readers of recently served large files, keyed by path, the
+    // least recently used dropped first
+    struct CachedReader {
+        std::shared_ptr<DirectFileReader> reader;
+        LruList::iterator lru_position;
+    };
+    static constexpr size_t MAX_DIRECT_READERS = 16;
+    LruList direct_reader_lru_;
+    std::unordered_map<std::string, CachedReader> direct_readers_;
+    std::mutex direct_readers_mutex_;
+    
+    // Hash trees of recently served files, keyed by file hash, the least
+    // recently used dropped first
+    struct CachedTree {
+        std::shared_ptr<const hash_tree::Tree> tree;
+        LruList::iterator lru_position;
+    };
+    static constexpr size_t MAX_CACHED_TREES = 16;
+    LruList hash_tree_lru_;
+    std::unordered_map<std::string, CachedTree> hash_trees_;
+    std::mutex hash_trees_mutex_;
+    
+    // Open descriptors of preallocated download targets and their write-back
+    // buffers, keyed by file hash
+    std::unordered_map<std::string, int> partial_files_;
+    std::unordered_map<std::string, std::shared_ptr<WriteBackBuffer>> write_back_;
+    // O_DIRECT descriptors of the targets, used by their write-back buffers
+    std::unordered_map<std::string, int> direct_partial_files_;
+    std::mutex partial_files_mutex_;
+    
+    int get_partial_fd(const FileMetadata& metadata, bool create);
+    // Closing drops whatever is still buffered for the target
+    void close_partial_fd(const std::string& file_hash);
+    std::shared_ptr<WriteBackBuffer> get_write_back(const FileMetadata& metadata, int fd);
+    // Chunks of a download target that may be read back; the rest is zeros
+    bool has_written_chunk(const std::string& file_hash, size_t chunk_index);
+    // Writes out buffered chunks so reads of the target see them
+    bool flush_write_back(const std::string& file_hash);
+    void report_durable(const std::string& file_hash, const std::vector<size_t>& chunks);
+    // Buffers a checked chunk of a preallocated target; runs on a disk engine
+    // worker for async writes
+    hypershare::crypto::CryptoResult write_to_target(const std::string& file_hash, WriteBackBuffer& write_back,
+                                                     size_t chunk_index, uint64_t offset,
+                                                     const std::vector<uint8_t>& chunk_data);
+    // The disk engine writes chunks only when nothing needs buffering or syncing
+    bool writes_through_engine(const FileMetadata& metadata) const;
+    
+    bool uses_direct_io(const FileMetadata& metadata) const;
+    // Cached reader of the shared file, null if it cannot be read with O_DIRECT
+    std::shared_ptr<DirectFileReader> get_direct_reader(const FileMetadata& metadata);
+    uint64_t get_chunk_offset(const FileMetadata& metadata, size_t chunk_index) const;
+    
+    bool is_below_immutable_root(const std::filesystem::path& path) const;
+    
+    bool uses_chunk_store() const;
+    
+    // Deletes everything held for a download: target, chunk files, stored chunks
+    void discard_download(const std::string& file_hash);
+    
+    // Writes the stored chunks of a download into its preallocated target
+    hypershare::crypto::CryptoResult assemble_from_chunk_store(const FileMetadata& metadata);
+    
+    // Single streaming pass: per-chunk hashes and the chunk tree root as file hash
+    hypershare::crypto::CryptoResult hash_file_chunks(const std::filesystem::path& file_path,
+                                                      ParallelHasher::Result& result);
+    
+    // Set when the config asks for content-defined chunks
+    std::optional<ContentChunker> content_chunker() const;
+    
+    // Whether metadata was chunked the way chunk_file would chunk it now
+    bool matches_chunking(const FileMetadata& metadata) const;
     
     std::string compute_chunk_hash(const std::vector<uint8_t>& chunk_data);
 };
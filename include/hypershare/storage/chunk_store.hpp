@@ -0,0 +1,79 @@
+#pragma once
+
+#include "storage_accountant.hpp"
+#include "../crypto/crypto_types.hpp"
+#include <string>
+#include <vector>
+#include <span>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+
+struct sqlite3;
+
+namespace hypershare::storage {
+
+// Content-addressed chunk store. Each distinct chunk is kept once on disk under
+// its hash; chunk_refs records which (file, chunk index) slots use it and
+// chunk_store.ref_count mirrors the number of such slots. A chunk is deleted when
+// its last reference is released. With compression on, chunks that shrink are
+// kept as zstd frames next to where the plain chunk would be.
+class ChunkStore {
+public:
+    ChunkStore(const std::filesystem::path& store_directory, const std::filesystem::path& db_path,
+               bool compress_chunks = false);
+    ~ChunkStore();
+
+    ChunkStore(const ChunkStore&) = delete;
+    ChunkStore& operator=(const ChunkStore&) = delete;
+
+    bool initialize();
+
+    // Reports stored and deleted chunk files, and lets the accountant evict
+    // the chunks held for a download by releasing it. Call after initialize.
+    void set_storage_accountant(std::shared_ptr<StorageAccountant> accountant);
+
+    // Stores the chunk unless an identical one is already present, and records
+    // the reference from file_hash/chunk_index. Data must match chunk_hash.
+    hypershare::crypto::CryptoResult put(const std::string& chunk_hash,
+                                         std::span<const uint8_t> data,
+                                         const std::string& file_hash,
+                                         size_t chunk_index);
+
+    // Adds a reference to a chunk that is already stored
+    bool add_ref(const std::string& chunk_hash, const std::string& file_hash, size_t chunk_index);
+
+    hypershare::crypto::CryptoResult get(const std::string& chunk_hash, std::vector<uint8_t>& data);
+
+    bool contains(const std::string& chunk_hash);
+
+    uint32_t ref_count(const std::string& chunk_hash);
+
+    // Drops every reference held by a file; returns how many chunks were deleted
+    size_t release_file(const std::string& file_hash);
+
+    size_t chunk_count();
+
+    uint64_t stored_bytes();
+
+    // Location of a plain stored chunk, and of one kept compressed
+    std::filesystem::path chunk_path(const std::string& chunk_hash) const;
+    std::filesystem::path compressed_chunk_path(const std::string& chunk_hash) const;
+
+private:
+    std::filesystem::path store_directory_;
+    std::filesystem::path db_path_;
+    sqlite3* db_;
+    bool compress_chunks_;
+    std::mutex mutex_;
+    std::shared_ptr<StorageAccountant> accountant_;
+
+    bool create_tables();
+    bool insert_ref(const std::string& chunk_hash, const std::string& file_hash, size_t chunk_index);
+    bool chunk_row_exists(const std::string& chunk_hash);
+    bool chunk_file_exists(const std::string& chunk_hash) const;
+    bool write_chunk_file(const std::filesystem::path& path, std::span<const uint8_t> data);
+};
+
+} // namespace hypershare::storage
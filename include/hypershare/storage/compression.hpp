@@ -0,0 +1,40 @@
+#pragma once
+
+#include <span>
+#include <vector>
+#include <optional>
+#include <cstdint>
+#include "../crypto/crypto_types.hpp"
+
+namespace hypershare::storage::compression {
+
+// Per-chunk zstd compression for the wire and the chunk store. Everything here
+// degrades to "not compressed" when the build has no zstd.
+constexpr int DEFAULT_LEVEL = 3;
+
+// Data smaller than this is never worth a frame header
+constexpr size_t MIN_COMPRESS_SIZE = 512;
+
+// Sampled entropy above this (bits per byte) means already compressed or encrypted
+constexpr double MAX_COMPRESSIBLE_ENTROPY = 7.5;
+
+// Upper bound accepted when decompressing, guards against decompression bombs
+constexpr size_t MAX_DECOMPRESSED_SIZE = 64 * 1024 * 1024;
+
+bool available();
+
+// Shannon entropy in bits per byte over a few evenly spaced windows of data
+double sample_entropy(std::span<const uint8_t> data);
+
+// Cheap pre-check before spending CPU on an actual compression attempt
+bool worth_compressing(std::span<const uint8_t> data);
+
+// zstd frame of data, or nullopt when the data fails the pre-check, the codec is
+// unavailable, or the frame would not save at least 1/16 of the input
+std::optional<std::vector<uint8_t>> compress(std::span<const uint8_t> data, int level = DEFAULT_LEVEL);
+
+hypershare::crypto::CryptoResult decompress(std::span<const uint8_t> frame,
+                                            std::vector<uint8_t>& output,
+                                            size_t max_size = MAX_DECOMPRESSED_SIZE);
+
+} // namespace hypershare::storage::compression
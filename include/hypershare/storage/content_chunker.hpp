@@ -0,0 +1,49 @@
+#pragma once
+
+#include <span>
+#include <cstdint>
+#include <cstddef>
+
+namespace hypershare::storage {
+
+enum class ChunkingMode : uint8_t {
+    FIXED = 0,            // chunk_size boundaries
+    CONTENT_DEFINED = 1   // FastCDC boundaries, see ContentChunker
+};
+
+// FastCDC-style content-defined chunker. A gear rolling hash over the bytes after
+// min_size picks cut points, with a stricter mask before avg_size and a looser one
+// after it (normalized chunking) to keep sizes close to the average. Boundaries
+// depend only on nearby content, so an insertion only changes the chunks around it.
+// The gear table is fixed: every peer must cut the same file the same way.
+class ContentChunker {
+public:
+    static constexpr uint32_t DEFAULT_MIN_SIZE = 16 * 1024;
+    static constexpr uint32_t DEFAULT_AVG_SIZE = 64 * 1024;
+    static constexpr uint32_t DEFAULT_MAX_SIZE = 256 * 1024;
+
+    ContentChunker(uint32_t min_size = DEFAULT_MIN_SIZE,
+                   uint32_t avg_size = DEFAULT_AVG_SIZE,
+                   uint32_t max_size = DEFAULT_MAX_SIZE);
+
+    // Length of the chunk starting at data[0]. Never more than max_size; if no
+    // cut point is found the whole input (up to max_size) is one chunk, so a
+    // caller that has not reached end of file and passes fewer than max_size
+    // bytes must treat a result equal to data.size() as "need more data".
+    size_t next_boundary(std::span<const uint8_t> data) const;
+
+    uint32_t min_size() const { return min_size_; }
+    uint32_t avg_size() const { return avg_size_; }
+    uint32_t max_size() const { return max_size_; }
+
+    static bool valid_sizes(uint32_t min_size, uint32_t avg_size, uint32_t max_size);
+
+private:
+    uint32_t min_size_;
+    uint32_t avg_size_;
+    uint32_t max_size_;
+    uint64_t mask_small_;
+    uint64_t mask_large_;
+};
+
+} // namespace hypershare::storage
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+namespace hypershare::storage {
+
+// Fixed-size buffers aligned for O_DIRECT, recycled rather than reallocated
+// for every read or write. The pool must outlive the buffers it hands out.
+class AlignedBufferPool {
+public:
+    // O_DIRECT needs offsets, lengths and memory aligned to the logical
+    // block size; 4KB covers the disks we run on
+    static constexpr size_t ALIGNMENT = 4096;
+    static constexpr size_t DEFAULT_MAX_POOLED = 16;
+
+    class Buffer {
+    public:
+        Buffer() = default;
+        Buffer(Buffer&& other) noexcept;
+        Buffer& operator=(Buffer&& other) noexcept;
+        ~Buffer();
+
+        uint8_t* data() const { return data_; }
+        size_t size() const { return size_; }
+        explicit operator bool() const { return data_ != nullptr; }
+
+    private:
+        friend class AlignedBufferPool;
+        Buffer(AlignedBufferPool* pool, uint8_t* data, size_t size);
+
+        AlignedBufferPool* pool_ = nullptr;
+        uint8_t* data_ = nullptr;
+        size_t size_ = 0;
+    };
+
+    // buffer_size is rounded up to a multiple of ALIGNMENT
+    explicit AlignedBufferPool(size_t buffer_size, size_t max_pooled = DEFAULT_MAX_POOLED);
+    ~AlignedBufferPool();
+
+    AlignedBufferPool(const AlignedBufferPool&) = delete;
+    AlignedBufferPool& operator=(const AlignedBufferPool&) = delete;
+
+    // Empty buffer if memory could not be allocated
+    Buffer acquire();
+
+    size_t buffer_size() const { return buffer_size_; }
+
+    static uint64_t align_down(uint64_t value) { return value & ~static_cast<uint64_t>(ALIGNMENT - 1); }
+    static uint64_t align_up(uint64_t value) { return align_down(value + ALIGNMENT - 1); }
+
+private:
+    size_t buffer_size_;
+    size_t max_pooled_;
+    std::mutex mutex_;
+    std::vector<uint8_t*> free_;
+
+    void release(uint8_t* data);
+};
+
+// Reads one file with O_DIRECT, bypassing the page cache. The kernel does no
+// read-ahead for O_DIRECT, so a read that misses fetches a whole pool buffer
+// from the requested offset on, and the chunks that follow are copied out of
+// that window instead of each costing a disk read.
+//
+// Each read works in a pool buffer of its own, so reads of one file run in
+// parallel. The last window is parked for the next read to pick up; while
+// one read holds it, others fill fresh buffers.
+class DirectFileReader {
+public:
+    // Null if the file cannot be opened with O_DIRECT, e.g. on tmpfs. The pool
+    // must outlive the reader.
+    static std::unique_ptr<DirectFileReader> open(const std::filesystem::path& path, AlignedBufferPool& pool);
+    ~DirectFileReader();
+
+    DirectFileReader(const DirectFileReader&) = delete;
+    DirectFileReader& operator=(const DirectFileReader&) = delete;
+
+    // Fills out from offset; false with errno set on error or end of file.
+    // Safe to call from several threads at once.
+    bool read(uint64_t offset, std::span<uint8_t> out);
+
+    uint64_t file_size() const { return file_size_; }
+
+private:
+    struct Window {
+        AlignedBufferPool::Buffer buffer;
+        uint64_t offset = 0;
+        size_t length = 0;
+    };
+
+    DirectFileReader(int fd, uint64_t file_size, AlignedBufferPool& pool);
+
+    int fd_;
+    uint64_t file_size_;
+    AlignedBufferPool& pool_;
+    // Window of the last read, null while a read has taken it
+    std::atomic<Window*> parked_{nullptr};
+};
+
+// O_DIRECT descriptor for writing, -1 if the filesystem does not support it
+int open_direct_for_write(const std::filesystem::path& path);
+
+} // namespace hypershare::storage
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <span>
+#include <memory>
+#include <functional>
+#include <system_error>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <vector>
+#include <cstdint>
+
+namespace boost::asio {
+    class io_context;
+}
+
+namespace hypershare::storage {
+
+// Called on the io_context with the number of bytes transferred. A read that hits
+// end of file completes successfully with fewer bytes than requested.
+using DiskCompletion = std::function<void(const std::error_code& error, size_t bytes)>;
+
+// Asynchronous positional I/O. Buffers must stay valid until the completion runs.
+class DiskEngine {
+public:
+    virtual ~DiskEngine() = default;
+
+    virtual void async_read(int fd, uint64_t offset, std::span<uint8_t> buffer,
+                            DiskCompletion handler) = 0;
+
+    virtual void async_write(int fd, uint64_t offset, std::span<const uint8_t> buffer,
+                             DiskCompletion handler) = 0;
+
+    virtual void async_fsync(int fd, DiskCompletion handler) = 0;
+
+    // Runs blocking work that is more than one operation, such as flushing a
+    // write-back buffer and syncing it, off the io_context. work returns 0 or
+    // an errno value, which the handler receives along with 0 bytes.
+    virtual void async_run(std::function<int()> work, DiskCompletion handler) = 0;
+
+    virtual const char* name() const = 0;
+};
+
+// Portable engine: blocking pread/pwrite on a small worker pool
+class ThreadPoolDiskEngine : public DiskEngine {
+public:
+    ThreadPoolDiskEngine(boost::asio::io_context& io_context, size_t thread_count = 4);
+    ~ThreadPoolDiskEngine() override;
+
+    void async_read(int fd, uint64_t offset, std::span<uint8_t> buffer,
+                    DiskCompletion handler) override;
+
+    void async_write(int fd, uint64_t offset, std::span<const uint8_t> buffer,
+                     DiskCompletion handler) override;
+
+    void async_fsync(int fd, DiskCompletion handler) override;
+
+    void async_run(std::function<int()> work, DiskCompletion handler) override;
+
+    const char* name() const override { return "threadpool"; }
+
+private:
+    boost::asio::io_context& io_context_;
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopping_;
+
+    void submit(std::function<void()> task);
+    void worker_loop();
+    void complete(DiskCompletion handler, int error, size_t bytes);
+};
+
+#ifdef HYPERSHARE_HAVE_LIBURING
+// Submits reads and writes to an io_uring; completions are signalled through an
+// eventfd watched by the io_context, so no thread blocks on disk
+class IoUringDiskEngine : public DiskEngine {
+public:
+    static std::unique_ptr<IoUringDiskEngine> create(boost::asio::io_context& io_context,
+                                                     unsigned queue_depth = 256);
+    ~IoUringDiskEngine() override;
+
+    void async_read(int fd, uint64_t offset, std::span<uint8_t> buffer,
+                    DiskCompletion handler) override;
+
+    void async_write(int fd, uint64_t offset, std::span<const uint8_t> buffer,
+                     DiskCompletion handler) override;
+
+    void async_fsync(int fd, DiskCompletion handler) override;
+
+    // The ring has no way to run arbitrary work, so this goes to a helper thread
+    void async_run(std::function<int()> work, DiskCompletion handler) override;
+
+    const char* name() const override { return "io_uring"; }
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+
+    explicit IoUringDiskEngine(std::unique_ptr<Impl> impl);
+};
+#endif
+
+// io_uring when requested and supported by the kernel, otherwise the thread pool
+std::shared_ptr<DiskEngine> make_disk_engine(boost::asio::io_context& io_context,
+                                             bool prefer_io_uring = true,
+                                             size_t thread_count = 4);
+
+} // namespace hypershare::storage
@@ -1,37 +1,78 @@
 #pragma once
 
 #include "file_metadata.hpp"
+#include "metadata_cache.hpp"
+#include "chunk_bitmap.hpp"
 #include "../crypto/crypto_types.hpp"
 #include <string>
 #include <vector>
 #include <optional>
 #include <filesystem>
 #include <memory>
+#include <array>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
 
 struct sqlite3;
+struct sqlite3_stmt;
 
 namespace hypershare::storage {
 
+// An indexed file slot holding a chunk with a given hash
+struct ChunkLocation {
+    std::string file_hash;
+    size_t chunk_index;
+};
+
+// The database runs in WAL mode. Writes go through a single writer
+// connection, while lookups borrow one of a small pool of read-only
+// connections, so list_files, get_file and search_files keep going during a
+// bulk add_files.
 class FileIndex {
 public:
-    explicit FileIndex(const std::filesystem::path& db_path);
+    static constexpr size_t DEFAULT_READ_CONNECTIONS = 4;
+    
+    explicit FileIndex(const std::filesystem::path& db_path,
+                       size_t read_connections = DEFAULT_READ_CONNECTIONS);
     ~FileIndex();
     
+    FileIndex(const FileIndex&) = delete;
+    FileIndex& operator=(const FileIndex&) = delete;
+    
     bool initialize();
     
     bool add_file(const FileMetadata& metadata);
     
+    // Adds every file and its chunk rows in a single transaction
+    bool add_files(const std::vector<FileMetadata>& files);
+    
     bool update_file(const FileMetadata& metadata);
     
     hypershare::crypto::CryptoResult remove_file(const std::string& file_hash);
     
     std::optional<FileMetadata> get_file(const std::string& file_hash);
     
+    // Served from the metadata cache when possible, without copying. Writes
+    // through this index invalidate the cached entry.
+    std::shared_ptr<const FileMetadata> get_file_shared(const std::string& file_hash);
+    
     hypershare::crypto::CryptoResult get_file(const std::string& file_id, FileMetadata& metadata);
     
     std::vector<FileMetadata> list_files();
     
-    std::vector<FileMetadata> search_files(const std::string& query);
+    // Visits files in list_files order, reading each stored blob in place
+    // instead of building a FileMetadata. The view is only valid during the
+    // call. Holds a read connection throughout, so a visitor calling back into
+    // the index needs a pool of more than one.
+    void for_each_file(const std::function<void(const FileMetadataView&)>& visitor);
+    
+    // Full-text search over filename, file type, description and tags. Every
+    // term must match a word prefix; results are ranked best first, filename
+    // hits weighing most. limit 0 returns every match. Falls back to substring
+    // matching when SQLite was built without FTS5.
+    std::vector<FileMetadata> search_files(const std::string& query, size_t limit = 0);
     
     bool file_exists(const std::string& file_hash);
     
@@ -39,26 +80,139 @@ public:
     
     uint64_t get_total_size();
     
+    // Availability is a bitmap per file; the hash is also recorded for
+    // find_chunk_locations unless chunk hash rows are disabled. False if the
+    // file is not indexed.
+    bool update_chunk_progress(const std::string& file_hash, 
+                               size_t chunk_index, 
+                               const hypershare::crypto::Blake3Hash& chunk_hash);
+    
+    // Hex form; identifiers that are not hex hashes are stored as their raw bytes
     bool update_chunk_progress(const std::string& file_hash, 
                                size_t chunk_index, 
                                const std::string& chunk_hash);
     
+    // [first, first + count) in one update
+    bool mark_chunks_available(const std::string& file_hash, size_t first, size_t count);
+    bool mark_chunks_missing(const std::string& file_hash, size_t first, size_t count);
+    
+    ChunkBitmap get_available_chunks(const std::string& file_hash);
+    
     std::vector<size_t> get_missing_chunks(const std::string& file_hash);
     
+    // First chunk at or after from that is not available, empty once the file
+    // is complete from there on or is not indexed
+    std::optional<size_t> next_missing_chunk(const std::string& file_hash, size_t from = 0);
+    
+    // Per-chunk hash rows only serve find_chunk_locations. Without them chunk
+    // tracking is a single bitmap per file, the table stays empty for new files.
+    void set_index_chunk_hashes(bool enabled) { index_chunk_hashes_ = enabled; }
+    
+    // Available copies of a chunk in any indexed file, looked up by content hash
+    std::vector<ChunkLocation> find_chunk_locations(const hypershare::crypto::Blake3Hash& chunk_hash,
+                                                    size_t limit = 8);
+    
     void cleanup_incomplete_files(const std::chrono::system_clock::time_point& cutoff_time);
     
     bool vacuum_database();
+    
+    const MetadataCache& metadata_cache() const { return metadata_cache_; }
 
 private:
+    // Statements prepared once per connection and reused for every call. The
+    // writer prepares the write statements, each reader the read statements.
+    enum Statement : size_t {
+        INSERT_FILE,
+        INSERT_CHUNK,
+        DELETE_FILE,
+        DELETE_CHUNKS,
+        LOAD_AVAILABILITY,
+        STORE_AVAILABILITY,
+        SET_CHUNK_ROWS_AVAILABLE,
+        CLEANUP_CANDIDATES,
+        DELETE_SEARCH_ENTRY,
+        INSERT_SEARCH_ENTRY,
+        SELECT_FILE,
+        LIST_FILES,
+        SEARCH_FILES,
+        SEARCH_FILES_FTS,
+        FILE_EXISTS,
+        FILE_COUNT,
+        TOTAL_SIZE,
+        SELECT_AVAILABILITY,
+        FIND_CHUNK_LOCATIONS,
+        STATEMENT_COUNT,
+        FIRST_READ_STATEMENT = SELECT_FILE
+    };
+    
+    using Statements = std::array<sqlite3_stmt*, STATEMENT_COUNT>;
+    
+    struct ChunkProgress {
+        size_t total_chunks = 0;
+        ChunkBitmap available;
+    };
+    
+    struct ReadConnection {
+        sqlite3* db = nullptr;
+        Statements statements{};
+    };
+    
+    // Returns its connection to the pool when destroyed
+    class ReadLease;
+    
     std::filesystem::path db_path_;
     sqlite3* db_;
+    Statements statements_{};
+    bool fts_available_ = false;
+    std::atomic<bool> index_chunk_hashes_{true};
+    
+    // Writer statements are shared, so every write runs under this lock
+    std::mutex mutex_;
+    
+    size_t max_readers_;
+    size_t open_readers_ = 0;
+    std::vector<std::unique_ptr<ReadConnection>> idle_readers_;
+    std::mutex readers_mutex_;
+    std::condition_variable readers_cv_;
+    
+    MetadataCache metadata_cache_;
     
     bool create_tables();
-    bool prepare_statements();
-    void cleanup_statements();
+    bool migrate_chunk_hashes();
+    bool migrate_metadata_blobs();
+    bool migrate_chunk_availability();
+    bool create_search_index();
+    bool rebuild_search_index();
+    bool configure_connection(sqlite3* db, bool writer);
+    bool prepare_statements(sqlite3* db, Statements& statements, size_t first, size_t last);
+    void cleanup_statements(Statements& statements);
+    
+    // Reuses an idle reader, opens a new one below max_readers_, or waits
+    ReadLease acquire_reader();
+    void release_reader(std::unique_ptr<ReadConnection> reader);
+    void close_reader(ReadConnection& reader);
+    
+    // Callers hold mutex_ and an open transaction
+    bool insert_file(const FileMetadata& metadata);
+    bool insert_chunk(const std::string& file_hash, size_t chunk_index, const void* chunk_hash, size_t hash_size);
+    bool delete_search_entry(const std::string& file_hash);
+    bool insert_search_entry(const FileMetadata& metadata);
+    bool delete_file_rows(const std::string& file_hash);
+    // Empty if the file is not indexed
+    std::optional<ChunkBitmap> load_availability(const std::string& file_hash);
+    bool store_availability(const std::string& file_hash, const ChunkBitmap& available);
+    
+    // Take mutex_ and run their own transaction
+    bool record_chunk(const std::string& file_hash, size_t chunk_index, const void* chunk_hash, size_t hash_size);
+    bool set_chunk_range(const std::string& file_hash, size_t first, size_t count, bool available);
+    
+    std::optional<ChunkProgress> load_progress(const std::string& file_hash);
+    
+    std::optional<FileMetadata> load_file(ReadConnection& reader, const std::string& file_hash);
+    std::vector<FileMetadata> collect_files(sqlite3_stmt* stmt);
     
     std::vector<uint8_t> serialize_metadata(const FileMetadata& metadata);
-    FileMetadata deserialize_metadata(const std::vector<uint8_t>& data);
+    FileMetadata deserialize_metadata(std::span<const uint8_t> data);
 };
 
 } // namespace hypershare::storage
\ No newline at end of file
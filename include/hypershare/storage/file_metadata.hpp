@@ -4,11 +4,21 @@
 #include <vector>
 #include <chrono>
 #include <filesystem>
+#include <optional>
+#include <span>
+#include <string_view>
 #include <cstdint>
+#include "content_chunker.hpp"
 #include "../crypto/crypto_types.hpp"
 
 namespace hypershare::storage {
 
+// How file_hash was derived from the file contents
+enum class FileHashScheme : uint8_t {
+    SEQUENTIAL = 0,  // BLAKE3 over the whole file
+    CHUNK_TREE = 1   // hash_tree root over chunk_hashes
+};
+
 struct FileMetadata {
     std::string file_id;
     std::string file_hash;
@@ -17,22 +27,43 @@ struct FileMetadata {
     uint64_t file_size;
     std::chrono::system_clock::time_point created_at;
     std::chrono::system_clock::time_point modified_at;
-    std::vector<std::string> chunk_hashes;
+    // Raw chunk hashes, hex only where they leave the process (logs, file names)
+    std::vector<hypershare::crypto::Blake3Hash> chunk_hashes;
     uint32_t chunk_size;
     uint32_t chunk_count;
     std::string file_type;
     std::string description;
     std::vector<std::string> tags;
+    FileHashScheme file_hash_scheme = FileHashScheme::SEQUENTIAL;
+    
+    // Content-defined chunks have variable sizes: chunk_size is then the maximum
+    // and chunk_offsets holds the start of every chunk
+    ChunkingMode chunking_mode = ChunkingMode::FIXED;
+    uint32_t cdc_min_size = 0;
+    uint32_t cdc_avg_size = 0;
+    std::vector<uint64_t> chunk_offsets;
     
     FileMetadata() = default;
     
     FileMetadata(const std::string& hash, const std::string& name, uint64_t size);
     
+    // Flat little-endian layout with a fixed header of offsets, readable in
+    // place through FileMetadataView
     std::vector<uint8_t> serialize() const;
     
-    static FileMetadata deserialize(const std::vector<uint8_t>& data);
+    // Form sent to peers: chunk tree files leave out chunk_hashes, since the root
+    // (file_hash) plus a proof shipped with each chunk verifies every chunk
+    std::vector<uint8_t> serialize_manifest() const;
+    
+    // Also reads the stream layout written before the flat one
+    static FileMetadata deserialize(std::span<const uint8_t> data);
+    
+    void add_chunk_hash(const hypershare::crypto::Blake3Hash& hash);
+    
+    // Hex form, ignored unless it parses as a hash
+    void add_chunk_hash(const std::string& hex_hash);
     
-    void add_chunk_hash(const std::string& hash);
+    std::string chunk_hash_hex(size_t chunk_index) const;
     
     bool is_complete() const;
     
@@ -44,8 +75,64 @@ struct FileMetadata {
     
     uint32_t get_chunk_size(size_t chunk_index) const;
     
+    uint64_t get_chunk_offset(size_t chunk_index) const;
+    
+    bool is_content_defined() const { return chunking_mode == ChunkingMode::CONTENT_DEFINED; }
+    
     bool operator==(const FileMetadata& other) const;
     bool operator!=(const FileMetadata& other) const;
+    
+private:
+    std::vector<uint8_t> serialize_fields(bool include_chunk_hashes) const;
+};
+
+// Read-only accessors over a serialized FileMetadata. Fields are read straight
+// from the underlying buffer (a SQLite column, an mmap) without allocating; the
+// buffer must outlive the view.
+class FileMetadataView {
+public:
+    // Empty unless data holds a complete blob in the current layout. Every
+    // offset is bounds checked here, accessors do not check again.
+    static std::optional<FileMetadataView> parse(std::span<const uint8_t> data);
+    
+    std::string_view file_id() const;
+    std::string_view file_hash() const;
+    std::string_view filename() const;
+    std::string_view file_path() const;
+    std::string_view file_type() const;
+    std::string_view description() const;
+    
+    uint64_t file_size() const;
+    std::chrono::system_clock::time_point created_at() const;
+    std::chrono::system_clock::time_point modified_at() const;
+    uint32_t chunk_size() const;
+    uint32_t chunk_count() const;
+    FileHashScheme file_hash_scheme() const;
+    ChunkingMode chunking_mode() const;
+    uint32_t cdc_min_size() const;
+    uint32_t cdc_avg_size() const;
+    
+    // Out of range indexes read as empty
+    size_t tag_count() const;
+    std::string_view tag(size_t index) const;
+    
+    size_t chunk_hash_count() const;
+    hypershare::crypto::Blake3Hash chunk_hash(size_t index) const;
+    
+    size_t chunk_offset_count() const;
+    uint64_t chunk_offset(size_t index) const;
+    
+    // Same as FileMetadata::total_chunks
+    size_t total_chunks() const;
+    
+    FileMetadata to_metadata() const;
+    
+private:
+    explicit FileMetadataView(std::span<const uint8_t> data) : data_(data) {}
+    
+    std::string_view string_at(size_t ref_offset) const;
+    
+    std::span<const uint8_t> data_;
 };
 
 } // namespace hypershare::storage
\ No newline at end of file
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "file_metadata.hpp"
+#include <chrono>
+#include <filesystem>
+#include <optional>
+#include <mutex>
+#include <cstdint>
+
+struct sqlite3;
+struct sqlite3_stmt;
+
+namespace hypershare::storage {
+
+// Identity of a file's contents as far as the filesystem tells: an entry is
+// only reused while device, inode, size and mtime all still match
+struct FileStamp {
+    uint64_t device = 0;
+    uint64_t inode = 0;
+    uint64_t file_size = 0;
+    int64_t mtime_ns = 0;
+
+    // Empty if the path cannot be stat'ed or is not a regular file
+    static std::optional<FileStamp> of(const std::filesystem::path& path);
+
+    bool operator==(const FileStamp& other) const = default;
+};
+
+// Chunk hashes of local files keyed by FileStamp, so sharing a file that has
+// not changed since it was last hashed skips reading it. Entries are replaced
+// when their inode is hashed again. Shares the database with FileIndex.
+class HashCache {
+public:
+    // Files modified this shortly before hashing started are not cached: a
+    // later write within the same timestamp tick would leave the mtime as is
+    static constexpr std::chrono::seconds TIMESTAMP_GRANULARITY{2};
+
+    explicit HashCache(const std::filesystem::path& db_path);
+    ~HashCache();
+
+    HashCache(const HashCache&) = delete;
+    HashCache& operator=(const HashCache&) = delete;
+
+    bool initialize();
+
+    // The metadata the file was hashed into, if its stamp still matches.
+    // Callers check that the chunking parameters are the ones they want.
+    std::optional<FileMetadata> lookup(const FileStamp& stamp);
+
+    // Records metadata for a file stamped before hashing it at hashed_at.
+    // False if the entry was not stored.
+    bool store(const FileStamp& stamp, const FileMetadata& metadata,
+               std::chrono::system_clock::time_point hashed_at);
+
+    size_t entry_count();
+
+private:
+    std::filesystem::path db_path_;
+    sqlite3* db_;
+    sqlite3_stmt* lookup_stmt_;
+    sqlite3_stmt* store_stmt_;
+    std::mutex mutex_;
+};
+
+} // namespace hypershare::storage
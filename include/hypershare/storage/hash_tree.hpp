@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "../crypto/crypto_types.hpp"
+
+namespace hypershare::storage::hash_tree {
+
+// Binary hash tree over chunk hashes. Every node is hashed under its own prefix
+// so no node can stand in for another kind: a leaf is BLAKE3(0x00 || chunk_hash),
+// a parent is BLAKE3(0x01 || left || right) and an odd node at the end of a level
+// is promoted unchanged. The root commits to the shape of the file as
+// BLAKE3(0x02 || file_size || leaf_count || tree_root), sizes as little-endian
+// u64, so a manifest announcing another size or chunk count cannot reuse it.
+hypershare::crypto::Blake3Hash leaf(const hypershare::crypto::Blake3Hash& chunk_hash);
+
+hypershare::crypto::Blake3Hash combine(const hypershare::crypto::Blake3Hash& left,
+                                       const hypershare::crypto::Blake3Hash& right);
+
+// Root of the tree over the chunk hashes of a file of file_size bytes. With no
+// chunks the tree root is BLAKE3 of the empty input.
+hypershare::crypto::Blake3Hash root(std::span<const hypershare::crypto::Blake3Hash> chunk_hashes,
+                                    uint64_t file_size);
+
+// Checks a chunk hash against the root using its sibling path. Levels where the
+// node is the promoted odd one out have no sibling; leaf_count tells which those are.
+bool verify(const hypershare::crypto::Blake3Hash& chunk_hash,
+            size_t index,
+            size_t leaf_count,
+            uint64_t file_size,
+            std::span<const hypershare::crypto::Blake3Hash> proof,
+            const hypershare::crypto::Blake3Hash& root);
+
+// All levels of the tree kept in memory (about twice the leaves), so proofs for
+// a file being served are a lookup per level instead of a rebuild
+class Tree {
+public:
+    Tree(std::span<const hypershare::crypto::Blake3Hash> chunk_hashes, uint64_t file_size);
+
+    const hypershare::crypto::Blake3Hash& root() const { return root_; }
+
+    size_t leaf_count() const { return leaf_count_; }
+
+    // Sibling path from leaf index up to the root, empty if index is out of range
+    std::vector<hypershare::crypto::Blake3Hash> proof(size_t index) const;
+
+private:
+    size_t leaf_count_;
+    hypershare::crypto::Blake3Hash root_;
+    std::vector<std::vector<hypershare::crypto::Blake3Hash>> levels_;
+};
+
+} // namespace hypershare::storage::hash_tree
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "file_metadata.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace hypershare::storage {
+
+class FileIndex;
+
+// Walks the shared files in the index in the background and checks every
+// available chunk against its hash, reading at most bytes_per_second so the
+// scrub does not compete with transfers for the disk. Bad chunks are marked
+// missing in the index, so peers see exactly which chunks to re-fetch instead
+// of the whole file. After a full pass it waits pass_interval before the next.
+class IntegrityScrubber {
+public:
+    static constexpr uint64_t DEFAULT_BYTES_PER_SECOND = 16ULL * 1024 * 1024;
+    static constexpr std::chrono::seconds DEFAULT_PASS_INTERVAL{24 * 60 * 60};
+
+    // Runs on the scrubber thread after the chunks were marked missing
+    using CorruptionHandler = std::function<void(const FileMetadata& metadata,
+                                                 const std::vector<uint64_t>& corrupted_chunks)>;
+
+    struct Stats {
+        uint64_t passes_completed = 0;
+        uint64_t files_scrubbed = 0;
+        uint64_t chunks_verified = 0;
+        uint64_t bytes_read = 0;
+        uint64_t chunks_corrupted = 0;
+    };
+
+    IntegrityScrubber(std::shared_ptr<FileIndex> file_index,
+                      uint64_t bytes_per_second = DEFAULT_BYTES_PER_SECOND,
+                      std::chrono::seconds pass_interval = DEFAULT_PASS_INTERVAL);
+    ~IntegrityScrubber();
+
+    IntegrityScrubber(const IntegrityScrubber&) = delete;
+    IntegrityScrubber& operator=(const IntegrityScrubber&) = delete;
+
+    bool start();
+    void stop();
+    bool is_running() const { return running_; }
+
+    // Scrubs every shared file once on the calling thread, at the same rate.
+    // Returns the number of corrupted chunks found.
+    uint64_t scrub_pass();
+
+    // Checks the available chunks of one indexed file and marks the bad ones
+    // missing. Returns the corrupted chunks.
+    std::vector<uint64_t> scrub_file(const std::string& file_hash);
+
+    void set_corruption_handler(CorruptionHandler handler);
+
+    Stats stats() const;
+
+private:
+    std::shared_ptr<FileIndex> file_index_;
+    uint64_t bytes_per_second_;
+    std::chrono::seconds pass_interval_;
+
+    std::thread scrub_thread_;
+    std::atomic<bool> running_{false};
+
+    mutable std::mutex mutex_;
+    std::condition_variable stop_cv_;
+    bool stopping_ = false;
+    CorruptionHandler corruption_handler_;
+    Stats stats_;
+
+    // When the next chunk may be read to stay within bytes_per_second_
+    std::chrono::steady_clock::time_point next_read_at_;
+
+    void scrub_loop();
+
+    // Sleeps until bytes may be read; false once stop() was called
+    bool pace(uint64_t bytes);
+};
+
+} // namespace hypershare::storage
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <cstdint>
+#include <ctime>
+
+namespace hypershare::storage {
+
+// Read-only mapping of a shared file. Lives as long as any ChunkView references it.
+class MappedFile {
+public:
+    static std::shared_ptr<MappedFile> open(const std::filesystem::path& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    std::span<const uint8_t> data() const {
+        return std::span<const uint8_t>(static_cast<const uint8_t*>(address_), size_);
+    }
+
+    uint64_t size() const { return size_; }
+    const std::filesystem::path& path() const { return path_; }
+
+    // True if the file on disk no longer matches what was mapped
+    bool is_stale() const;
+
+private:
+    MappedFile(const std::filesystem::path& path, void* address, size_t size,
+               uint64_t inode, struct timespec mtime);
+
+    std::filesystem::path path_;
+    void* address_;
+    size_t size_;
+    uint64_t inode_;
+    struct timespec mtime_;
+};
+
+// Chunk served straight from the page cache, or from a private copy for files
+// that may shrink under a mapping. The span stays valid while the view, or a
+// copy of its owner pointer, is alive - e.g. until an async write completes.
+struct ChunkView {
+    std::span<const uint8_t> data;
+    std::shared_ptr<const void> owner; // The MappedFile or the copied bytes
+
+    bool empty() const { return data.empty(); }
+    size_t size() const { return data.size(); }
+};
+
+class MappedFileCache {
+public:
+    static constexpr size_t DEFAULT_MAX_MAPPINGS = 64;
+
+    explicit MappedFileCache(size_t max_mappings = DEFAULT_MAX_MAPPINGS);
+
+    std::shared_ptr<const MappedFile> acquire(const std::filesystem::path& path);
+
+    void invalidate(const std::filesystem::path& path);
+    void clear();
+
+    size_t size() const;
+
+private:
+    using LruList = std::list<std::string>;
+
+    struct Entry {
+        std::shared_ptr<MappedFile> mapping;
+        LruList::iterator lru_position;
+    };
+
+    size_t max_mappings_;
+    LruList lru_;
+    std::unordered_map<std::string, Entry> entries_;
+    mutable std::mutex mutex_;
+
+    void evict_if_needed();
+};
+
+} // namespace hypershare::storage
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "file_metadata.hpp"
+#include <memory>
+#include <string>
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <cstdint>
+
+namespace hypershare::storage {
+
+// Deserialized metadata of recently used files, kept in front of FileIndex so
+// that serving chunks of a hot file does not query SQLite. Entries are shared
+// and immutable; an update replaces the entry rather than changing it.
+// Bounded by entry count and by the approximate bytes the entries hold,
+// since the chunk hashes of one large file can outweigh many small ones.
+class MetadataCache {
+public:
+    static constexpr size_t DEFAULT_MAX_ENTRIES = 1024;
+    static constexpr size_t DEFAULT_MAX_BYTES = 64 * 1024 * 1024; // 64MB
+
+    explicit MetadataCache(size_t max_entries = DEFAULT_MAX_ENTRIES, size_t max_bytes = DEFAULT_MAX_BYTES);
+
+    // Counts a hit or a miss
+    std::shared_ptr<const FileMetadata> get(const std::string& file_hash);
+
+    // Bumped by every invalidation. A loader reads it before going to the
+    // database and passes it to put, which drops the entry if an invalidation
+    // happened in between, so a stale row never overwrites a newer one.
+    uint64_t generation() const { return generation_.load(std::memory_order_acquire); }
+
+    void put(std::shared_ptr<const FileMetadata> metadata, uint64_t generation);
+
+    void invalidate(const std::string& file_hash);
+    void clear();
+
+    size_t size() const;
+    // Approximate memory held by the cached metadata
+    size_t bytes() const;
+
+    uint64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+    uint64_t misses() const { return misses_.load(std::memory_order_relaxed); }
+
+private:
+    using LruList = std::list<std::string>;
+
+    struct Entry {
+        std::shared_ptr<const FileMetadata> metadata;
+        LruList::iterator lru_position;
+        size_t bytes;
+    };
+
+    size_t max_entries_;
+    size_t max_bytes_;
+    size_t bytes_ = 0;
+    LruList lru_;
+    std::unordered_map<std::string, Entry> entries_;
+    mutable std::mutex mutex_;
+
+    std::atomic<uint64_t> generation_{0};
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+
+    void evict_if_needed();
+    static size_t approximate_size(const FileMetadata& metadata);
+};
+
+} // namespace hypershare::storage
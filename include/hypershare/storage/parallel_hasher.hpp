@@ -0,0 +1,64 @@
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <span>
+#include <vector>
+#include <cstdint>
+#include "content_chunker.hpp"
+#include "../crypto/crypto_types.hpp"
+
+namespace hypershare::storage {
+
+// Pipelined file hasher: the calling thread does large sequential reads into a
+// small pool of block buffers and finds the chunk boundaries, while worker
+// threads hash the chunks of each block. The file hash is the hash_tree root of
+// the chunk hashes, so it does not depend on how many threads did the work.
+class ParallelHasher {
+public:
+    static constexpr size_t DEFAULT_BLOCK_SIZE = 4 * 1024 * 1024; // 4MB reads
+
+    struct Result {
+        std::vector<hypershare::crypto::Blake3Hash> chunk_hashes;
+        std::vector<uint64_t> chunk_offsets;
+        hypershare::crypto::Blake3Hash root{};
+        uint64_t bytes_hashed = 0;
+    };
+
+    // Runs on a worker thread once the chunks of a block are hashed, so it
+    // may be called concurrently and for blocks out of order. bytes is the
+    // size of the block's chunks. Returning false stops hashing early.
+    using BlockHandler = std::function<bool(size_t first_chunk,
+                                            std::span<const hypershare::crypto::Blake3Hash> chunk_hashes,
+                                            uint64_t bytes)>;
+
+    // Fixed-size chunks; thread_count 0 uses one worker per hardware thread
+    explicit ParallelHasher(size_t chunk_size, size_t thread_count = 0,
+                            size_t block_size = DEFAULT_BLOCK_SIZE);
+
+    // Content-defined chunks
+    explicit ParallelHasher(const ContentChunker& chunker, size_t thread_count = 0,
+                            size_t block_size = DEFAULT_BLOCK_SIZE);
+
+    // VERIFICATION_FAILED if the block handler stopped it
+    hypershare::crypto::CryptoResult hash_file(const std::filesystem::path& file_path, Result& result);
+
+    void set_block_handler(BlockHandler handler) { block_handler_ = std::move(handler); }
+
+    size_t thread_count() const { return thread_count_; }
+
+    static size_t hardware_threads();
+
+private:
+    size_t chunk_size_;  // exact size for fixed chunks, upper bound for content-defined
+    size_t thread_count_;
+    size_t block_size_;
+    std::optional<ContentChunker> chunker_;
+    BlockHandler block_handler_;
+
+    // Length of the next chunk in data, 0 if more input is needed to decide
+    size_t next_chunk(std::span<const uint8_t> data, bool end_of_file) const;
+};
+
+} // namespace hypershare::storage
@@ -1,31 +1,49 @@
 #pragma once
 
+#include "chunk_bitmap.hpp"
 #include "../transfer/performance_monitor.hpp"
 #include <string>
 #include <vector>
-#include <set>
+#include <array>
 #include <chrono>
 #include <filesystem>
 #include <memory>
 #include <optional>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 struct sqlite3;
+struct sqlite3_stmt;
 
 namespace hypershare::storage {
 
 struct ResumeInfo {
     std::string file_id;
     std::string session_id;
-    std::set<uint64_t> completed_chunks;
+    ChunkBitmap completed_chunks;
     std::chrono::system_clock::time_point last_activity;
     hypershare::transfer::SessionStats stats;
 };
 
+// Persists per-transfer progress so an interrupted download resumes where it
+// stopped. Explicit saves and removals are written through; chunk completions
+// and activity updates only mark the in-memory state dirty and are written by a
+// background group commit every commit_interval, or once MAX_PENDING_UPDATES
+// accumulate. A crash loses at most that window, whose chunks are fetched again.
 class ResumeManager {
 public:
-    explicit ResumeManager(const std::filesystem::path& database_path);
+    static constexpr std::chrono::milliseconds DEFAULT_COMMIT_INTERVAL{1000};
+    static constexpr size_t MAX_PENDING_UPDATES = 4096;
+    
+    explicit ResumeManager(const std::filesystem::path& database_path,
+                           std::chrono::milliseconds commit_interval = DEFAULT_COMMIT_INTERVAL);
     ~ResumeManager();
     
+    ResumeManager(const ResumeManager&) = delete;
+    ResumeManager& operator=(const ResumeManager&) = delete;
+    
     // Database operations
     bool initialize();
     
@@ -37,17 +55,20 @@ public:
     bool remove_resume_state(const std::string& file_id);
     bool remove_resume_state_by_session(const std::string& session_id);
     
-    // Chunk progress tracking
+    // Chunk progress tracking, false if the transfer has no saved state
     bool update_chunk_completed(const std::string& file_id, uint64_t chunk_index);
     bool update_chunk_completed_by_session(const std::string& session_id, uint64_t chunk_index);
     
-    std::set<uint64_t> get_completed_chunks(const std::string& file_id);
+    ChunkBitmap get_completed_chunks(const std::string& file_id);
     std::vector<uint64_t> get_missing_chunks(const std::string& file_id, uint64_t total_chunks);
     
     // Activity tracking
     bool update_last_activity(const std::string& file_id);
     bool update_last_activity_by_session(const std::string& session_id);
     
+    // Writes every pending update now
+    bool flush();
+    
     // Cleanup operations
     void cleanup_old_resume_states(std::chrono::hours max_age = std::chrono::hours(72));
     std::vector<ResumeInfo> list_resumable_transfers();
@@ -57,19 +78,57 @@ public:
     bool is_resumable(const std::string& file_id) const;
     
 private:
+    enum Statement : size_t {
+        UPSERT_STATE,
+        SELECT_BY_FILE,
+        SELECT_FILE_BY_SESSION,
+        SELECT_ALL,
+        DELETE_BY_FILE,
+        DELETE_OLDER_THAN,
+        COUNT_STATES,
+        STATEMENT_COUNT
+    };
+    
+    struct TrackedState {
+        ResumeInfo info;
+        bool dirty = false;
+    };
+    
     std::filesystem::path db_path_;
     sqlite3* db_;
+    std::array<sqlite3_stmt*, STATEMENT_COUNT> statements_{};
+    std::chrono::milliseconds commit_interval_;
+    
+    // Lock order: db_mutex_ before state_mutex_. Holding db_mutex_ from
+    // snapshot to commit keeps an older snapshot from overwriting a newer save.
+    mutable std::mutex db_mutex_;
+    mutable std::mutex state_mutex_;
+    std::unordered_map<std::string, TrackedState> states_;
+    std::unordered_map<std::string, std::string> session_files_;
+    size_t pending_updates_ = 0;
+    
+    std::thread commit_thread_;
+    std::condition_variable commit_cv_;
+    bool stopping_ = false;
     
     bool create_tables();
     bool prepare_statements();
     void cleanup_statements();
     
-    // Serialization helpers
-    std::vector<uint8_t> serialize_completed_chunks(const std::set<uint64_t>& chunks);
-    std::set<uint64_t> deserialize_completed_chunks(const std::vector<uint8_t>& data);
+    void commit_loop();
+    // Caller holds db_mutex_
+    bool flush_locked();
+    bool write_state(const ResumeInfo& info);
+    std::optional<ResumeInfo> read_state(sqlite3_stmt* stmt);
+    
+    // Loads the state into states_ on first use. Caller holds state_mutex_,
+    // which is released while the database is read.
+    TrackedState* track(std::unique_lock<std::mutex>& state_lock, const std::string& file_id);
+    std::optional<std::string> file_for_session(const std::string& session_id);
+    void mark_dirty(TrackedState& state);
     
     std::vector<uint8_t> serialize_session_stats(const hypershare::transfer::SessionStats& stats);
-    hypershare::transfer::SessionStats deserialize_session_stats(const std::vector<uint8_t>& data);
+    hypershare::transfer::SessionStats deserialize_session_stats(std::span<const uint8_t> data);
 };
 
 } // namespace hypershare::storage
\ No newline at end of file
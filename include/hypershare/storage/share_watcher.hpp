@@ -0,0 +1,129 @@
+#pragma once
+
+#include "file_metadata.hpp"
+#include "storage_config.hpp"
+#include "chunk_manager.hpp"
+#include "../crypto/crypto_types.hpp"
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace hypershare::storage {
+
+class FileIndex;
+
+// Keeps the files below a set of share roots indexed as they change. inotify
+// events are collected per path, and a file is only processed once it has been
+// quiet for the debounce interval, so a file being written is hashed once the
+// writer is done rather than on every write.
+//
+// A change in size or modification time rehashes every chunk of the file:
+// inotify does not say which bytes a write touched, and any sampling of the
+// old contents can miss an edit. The new chunk hashes are compared with the
+// indexed ones, so the stats show which chunks the change really touched.
+// Files already indexed and unchanged at startup are only stat'ed.
+class ShareWatcher {
+public:
+    static constexpr std::chrono::milliseconds DEFAULT_DEBOUNCE{2000};
+
+    using UpdateHandler = std::function<void(const FileMetadata&)>;
+    using RemoveHandler = std::function<void(const std::string& file_hash)>;
+
+    struct Stats {
+        uint64_t files_hashed = 0;     // first seen
+        uint64_t files_updated = 0;    // rehashed after a change
+        uint64_t files_removed = 0;
+        // Fixed-size chunks of updated files whose hash did or did not change
+        uint64_t chunks_changed = 0;
+        uint64_t chunks_unchanged = 0;
+    };
+
+    ShareWatcher(std::shared_ptr<FileIndex> file_index, const StorageConfig& config,
+                 std::chrono::milliseconds debounce = DEFAULT_DEBOUNCE);
+    ~ShareWatcher();
+
+    ShareWatcher(const ShareWatcher&) = delete;
+    ShareWatcher& operator=(const ShareWatcher&) = delete;
+
+    // Watches every directory below root and indexes the files that are new or
+    // were modified since they were last indexed
+    hypershare::crypto::CryptoResult add_root(const std::filesystem::path& root);
+
+    bool start();
+    void stop();
+    bool is_running() const { return running_; }
+
+    // Handlers run on the watcher thread (or in add_root) and must not call
+    // back into the watcher. A file whose content changed is reported as the
+    // removal of its old hash followed by an update.
+    void set_update_handler(UpdateHandler handler);
+    void set_remove_handler(RemoveHandler handler);
+
+    // Full hashes of files unchanged since they were last hashed come from
+    // the cache. Set before adding roots.
+    void set_hash_cache(std::shared_ptr<HashCache> cache) { chunk_manager_.set_hash_cache(std::move(cache)); }
+
+    Stats stats() const;
+
+private:
+    struct TrackedFile {
+        std::string file_hash;
+        std::string file_id;
+        uint64_t file_size = 0;
+        std::chrono::system_clock::time_point modified_at;
+    };
+
+    // Index writes collected over one batch of settled paths
+    struct Batch {
+        std::vector<FileMetadata> updated;
+        std::unordered_set<std::string> removed;
+    };
+
+    std::shared_ptr<FileIndex> file_index_;
+    StorageConfig config_;
+    ChunkManager chunk_manager_;
+    std::chrono::milliseconds debounce_;
+
+    int inotify_fd_ = -1;
+    std::thread watch_thread_;
+    std::atomic<bool> running_{false};
+
+    mutable std::mutex mutex_;
+    std::vector<std::filesystem::path> roots_;
+    std::unordered_map<int, std::filesystem::path> watches_;
+    std::unordered_map<std::string, TrackedFile> tracked_;
+    // Tracked paths per file hash; identical files share one index row
+    std::unordered_map<std::string, size_t> hash_refs_;
+    // Changed paths and when they are considered settled
+    std::unordered_map<std::string, std::chrono::steady_clock::time_point> pending_;
+    UpdateHandler update_handler_;
+    RemoveHandler remove_handler_;
+    Stats stats_;
+
+    void watch_loop();
+
+    // The helpers below expect mutex_ to be held
+    void read_events();
+    void watch_tree(const std::filesystem::path& directory, bool mark_files);
+    void unwatch_tree(const std::filesystem::path& directory);
+    void mark_pending(const std::string& path, std::chrono::steady_clock::time_point settled_at);
+    void process_settled();
+    void commit(Batch& batch);
+
+    // Re-reads a changed path and queues its index update
+    void refresh(const std::string& path, Batch& batch);
+    bool hash_in_full(const std::string& path, TrackedFile& tracked,
+                      std::chrono::system_clock::time_point modified_at, FileMetadata& metadata);
+    void track(const std::string& path, TrackedFile tracked);
+    void untrack(const std::string& path, Batch& batch);
+};
+
+} // namespace hypershare::storage
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "storage_config.hpp"
+#include <array>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
+
+namespace hypershare::storage {
+
+enum class StorageArea : uint8_t {
+    DOWNLOADS = 0,    // completed downloads in download_directory
+    INCOMPLETE = 1,   // partial files and per-chunk files of downloads
+    CHUNK_STORE = 2   // content-addressed chunks held for downloads
+};
+
+// Bytes kept on disk per area, checked against StorageConfig::max_storage_size.
+// The directories are walked once by scan(); after that ChunkManager and
+// ChunkStore report every write and deletion, so checks are counter reads.
+//
+// Downloads reserve their full size before they start, so one that does not
+// fit is refused up front instead of failing on a later write. To make room,
+// entries that are not pinned by a download in progress are evicted: chunk
+// store entries before incomplete downloads, least recently used first.
+class StorageAccountant {
+public:
+    static constexpr size_t AREA_COUNT = 3;
+
+    // Deletes the data of an entry and reports it through release() or
+    // remove() like any other deletion. False if nothing could be deleted.
+    using Evictor = std::function<bool(const std::string& key)>;
+
+    explicit StorageAccountant(const StorageConfig& config);
+
+    // Measures every area, replacing what was reported so far. Files left in
+    // the incomplete directory become evictable entries, keyed by file hash.
+    void scan();
+
+    uint64_t used(StorageArea area) const;
+    uint64_t total_used() const;
+    uint64_t budget() const { return budget_; }
+
+    void charge(StorageArea area, uint64_t bytes);
+    void release(StorageArea area, uint64_t bytes);
+
+    // Grows the entry for key, creating it unpinned, and charges the area
+    void charge_entry(StorageArea area, const std::string& key, uint64_t bytes);
+    // Registers an entry for bytes the area already counts
+    void track_entry(StorageArea area, const std::string& key, uint64_t bytes,
+                     std::chrono::system_clock::time_point last_used);
+    // Releases everything charged to the entry and drops it
+    void remove(StorageArea area, const std::string& key);
+    // Drops the entry, for callers that release the actual bytes themselves
+    void forget(StorageArea area, const std::string& key);
+
+    // Marks the entries of key as just used
+    void touch(const std::string& key);
+    void unpin(const std::string& key);
+
+    // Admission for a download: pins key and grows its incomplete entry to
+    // bytes, evicting other entries if the budget needs it. False, with
+    // nothing charged or pinned, if it fits neither the budget nor the disk.
+    bool reserve(const std::string& key, uint64_t bytes);
+
+    void set_evictor(StorageArea area, Evictor evictor);
+
+    // Evicts until bytes more fit within the budget
+    bool make_room(uint64_t bytes);
+
+private:
+    struct Entry {
+        uint64_t bytes = 0;
+        std::chrono::system_clock::time_point last_used;
+    };
+
+    StorageConfig config_;
+    uint64_t budget_;
+
+    mutable std::mutex mutex_;
+    std::array<uint64_t, AREA_COUNT> used_{};
+    std::array<std::unordered_map<std::string, Entry>, AREA_COUNT> entries_;
+    std::unordered_set<std::string> pinned_;
+    std::array<Evictor, AREA_COUNT> evictors_;
+
+    // Serializes reservations, so two cannot both claim the same free space
+    std::mutex reserve_mutex_;
+
+    // Least recently used unpinned entry, in eviction order; caller holds mutex_
+    bool next_victim(StorageArea& area, std::string& key) const;
+};
+
+} // namespace hypershare::storage
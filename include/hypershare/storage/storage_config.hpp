@@ -3,6 +3,8 @@
 #include <filesystem>
 #include <string>
 #include <cstdint>
+#include "content_chunker.hpp"
+#include "write_back_buffer.hpp"
 
 namespace hypershare::storage {
 
@@ -10,6 +12,7 @@ struct StorageConfig {
     std::filesystem::path download_directory;
     std::filesystem::path incomplete_directory;
     std::filesystem::path database_path;
+    std::filesystem::path chunk_store_directory;
     
     uint64_t max_storage_size = 10ULL * 1024 * 1024 * 1024; // 10GB default
     uint32_t default_chunk_size = 65536; // 64KB
@@ -18,9 +21,44 @@ struct StorageConfig {
     bool auto_cleanup_incomplete = true;
     std::chrono::hours incomplete_cleanup_after{24}; // 24 hours
     
+    // zstd per chunk on the wire (when the peer supports it) and in the chunk store;
+    // chunks that sample as high entropy are sent and stored as-is
     bool enable_compression = false;
     bool enable_deduplication = true;
     
+    // Content-defined chunking keeps most chunk hashes stable across edits, so
+    // re-shared or modified files reuse chunks peers already have
+    ChunkingMode chunking_mode = ChunkingMode::FIXED;
+    uint32_t cdc_min_chunk_size = ContentChunker::DEFAULT_MIN_SIZE;
+    uint32_t cdc_avg_chunk_size = ContentChunker::DEFAULT_AVG_SIZE;
+    uint32_t cdc_max_chunk_size = ContentChunker::DEFAULT_MAX_SIZE;
+    
+    // Download into one preallocated file and write chunks in place, instead of
+    // one file per chunk that has to be merged at the end
+    bool preallocate_downloads = true;
+    
+    // Adjacent chunks written to a preallocated target are coalesced into
+    // writes of up to write_back_bytes; 0 writes every chunk as it arrives
+    uint32_t write_back_bytes = 4 * 1024 * 1024;
+    DurabilityPolicy durability = DurabilityPolicy::PER_INTERVAL;
+    uint64_t sync_interval_bytes = 64ULL * 1024 * 1024;
+    
+    // Files of at least direct_io_threshold bytes are served and downloaded
+    // with O_DIRECT, so streaming them does not push everything else out of
+    // the page cache. Reads fetch read_ahead_chunks chunks past the one asked
+    // for, since the kernel does no read-ahead for O_DIRECT.
+    bool direct_io = false;
+    uint64_t direct_io_threshold = 1ULL << 30; // 1GB
+    uint32_t read_ahead_chunks = 8;
+    
+    // Asynchronous chunk I/O: io_uring when available, else a pread/pwrite thread pool
+    bool use_io_uring = true;
+    uint32_t disk_io_threads = 4;
+    
+    // Hash chunks on a worker pool while sharing; 0 threads = one per hardware thread
+    bool parallel_hashing = true;
+    uint32_t hash_threads = 0;
+    
     StorageConfig() = default;
     
     explicit StorageConfig(const std::filesystem::path& base_dir);
@@ -37,6 +75,8 @@ struct StorageConfig {
     
     std::filesystem::path get_incomplete_path(const std::string& file_hash) const;
     
+    std::filesystem::path get_partial_path(const std::string& file_hash) const;
+    
     void set_base_directory(const std::filesystem::path& base_dir);
 };
 
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "direct_io.hpp"
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <span>
+#include <vector>
+
+namespace hypershare::storage {
+
+// When chunks written to a download target are made durable
+enum class DurabilityPolicy : uint8_t {
+    PER_CHUNK,      // fdatasync after every chunk, nothing is coalesced
+    PER_INTERVAL,   // fdatasync once sync_interval bytes were written since the last one
+    ON_COMPLETION   // only when the download is finalized
+};
+
+// Gathers the chunks written to one preallocated download target and writes
+// adjacent chunks as one sequential pwrite, so chunks arriving in order reach
+// the disk in large writes rather than one write per chunk. Writes and syncs
+// return the chunks that became durable with them; only those may be recorded
+// as completed in resume state. Chunks of a failed write are dropped, never
+// reported durable, and so fetched again.
+class WriteBackBuffer {
+public:
+    // fd stays owned by the caller and must outlive the buffer
+    WriteBackBuffer(int fd, DurabilityPolicy policy, size_t capacity, uint64_t sync_interval);
+
+    WriteBackBuffer(const WriteBackBuffer&) = delete;
+    WriteBackBuffer& operator=(const WriteBackBuffer&) = delete;
+
+    // Writes the aligned part of each run through an O_DIRECT descriptor of
+    // the same file, staged in buffers from pool. The unaligned tail of the
+    // file still goes through fd. Both must outlive the buffer.
+    void set_direct(int direct_fd, AlignedBufferPool* pool);
+
+    // Buffers the chunk, writing everything out once capacity is reached.
+    // False with errno set if writing or syncing failed.
+    bool write(size_t chunk_index, uint64_t offset, std::span<const uint8_t> data,
+               std::vector<size_t>& durable);
+
+    // Accounts for a chunk written around the buffer, such as by the disk
+    // engine; it becomes durable with the next sync
+    void add_written(size_t chunk_index, size_t size);
+
+    // Accounts for a chunk made durable in the target before this buffer was
+    // created, such as by an interrupted run of the same download
+    void add_durable(size_t chunk_index);
+
+    // Writes out everything buffered; syncs only if the policy asks for it
+    bool flush(std::vector<size_t>& durable);
+
+    // Writes out everything buffered and makes all of it durable
+    bool sync(std::vector<size_t>& durable);
+
+    size_t buffered_bytes() const;
+
+    // Whether the chunk was written to the target, buffered or not. Chunks of
+    // a failed write or sync no longer count.
+    bool contains(size_t chunk_index) const;
+
+private:
+    // Adjacent buffered chunks, keyed by start offset in runs_
+    struct Run {
+        std::vector<uint8_t> data;
+        std::vector<size_t> chunks;
+    };
+
+    int fd_;
+    int direct_fd_ = -1;
+    AlignedBufferPool* pool_ = nullptr;
+    DurabilityPolicy policy_;
+    size_t capacity_;
+    uint64_t sync_interval_;
+
+    mutable std::mutex mutex_;
+    std::map<uint64_t, Run> runs_;
+    size_t buffered_bytes_ = 0;
+    // Written but not yet synced
+    std::vector<size_t> unsynced_chunks_;
+    uint64_t unsynced_bytes_ = 0;
+    std::vector<bool> written_;
+
+    // Caller holds mutex_
+    bool flush_locked(std::vector<size_t>& durable);
+    bool sync_locked(std::vector<size_t>& durable);
+    bool write_run(uint64_t offset, const std::vector<uint8_t>& data);
+    bool overlaps_locked(uint64_t offset, size_t size) const;
+    void set_written_locked(size_t chunk_index, bool written);
+};
+
+} // namespace hypershare::storage
@@ -8,6 +8,13 @@
 #include <memory>
 #include <unordered_map>
 #include <mutex>
+#include <span>
+
+namespace hypershare::storage {
+    class ChunkManager;
+    class ResumeManager;
+    class FileIndex;
+}
 
 namespace hypershare::transfer {
 
@@ -28,8 +35,27 @@ public:
     explicit TransferManager(const hypershare::storage::StorageConfig& config);
     ~TransferManager();
     
+    // Downloads started with their metadata are written through this
+    // ChunkManager: prepared when they start, which checks them against its
+    // storage budget, and finalized into the download directory once complete
+    void set_chunk_manager(std::shared_ptr<hypershare::storage::ChunkManager> chunk_manager);
+    
+    // Records the chunks of those downloads as completed once the chunk
+    // manager reports them durable, never on the write alone, keyed by file
+    // hash. A download started again after a restart takes those chunks back
+    // from its target and only requests the rest. The state of a download the
+    // storage accountant evicts is dropped with its target.
+    void set_resume_manager(std::shared_ptr<hypershare::storage::ResumeManager> resume_manager);
+    
+    // Completed downloads are indexed here, and new ones start with every
+    // chunk an indexed file already holds copied in instead of fetched
+    void set_file_index(std::shared_ptr<hypershare::storage::FileIndex> file_index);
+    
     // Session management
     std::string start_download(const std::string& file_id, uint32_t peer_id);
+    // Empty if the transfer limit is reached, the metadata has no chunk size
+    // or the download cannot be prepared
+    std::string start_download(const hypershare::storage::FileMetadata& metadata, uint32_t peer_id);
     std::string start_upload(const std::string& file_id, uint32_t peer_id);
     
     bool has_session(const std::string& session_id);
@@ -47,6 +73,12 @@ public:
     hypershare::crypto::CryptoResult handle_chunk_received(const std::string& session_id,
                                                             uint32_t chunk_index,
                                                             const std::vector<uint8_t>& chunk_data);
+    // With the proof from ChunkDataMessage, for manifests that carry only the
+    // chunk tree root
+    hypershare::crypto::CryptoResult handle_chunk_received(const std::string& session_id,
+                                                            uint32_t chunk_index,
+                                                            const std::vector<uint8_t>& chunk_data,
+                                                            std::span<const hypershare::crypto::Blake3Hash> proof);
     
     // Configuration
     void set_max_concurrent_transfers(uint32_t max_transfers);
@@ -62,6 +94,12 @@ private:
     std::unordered_map<std::string, std::unique_ptr<TransferSession>> active_sessions_;
     mutable std::mutex sessions_mutex_;
     
+    std::shared_ptr<hypershare::storage::ChunkManager> chunk_manager_;
+    std::shared_ptr<hypershare::storage::ResumeManager> resume_manager_;
+    std::shared_ptr<hypershare::storage::FileIndex> file_index_;
+    // Metadata of downloads written through chunk_manager_, by session id
+    std::unordered_map<std::string, hypershare::storage::FileMetadata> downloads_;
+    
     uint32_t max_concurrent_transfers_;
     uint64_t global_bandwidth_limit_;
     uint64_t total_bytes_transferred_;
@@ -70,6 +108,15 @@ private:
     std::string generate_session_id();
     void cleanup_completed_sessions();
     bool can_start_new_transfer() const;
+    // Caller holds sessions_mutex_
+    void install_chunk_handlers();
+    // Marks chunks restored from an interrupted run as received in session
+    void track_download(const std::string& session_id, TransferSession& session,
+                        const hypershare::storage::FileMetadata& metadata);
+    void untrack_download(const hypershare::storage::FileMetadata& metadata, bool keep_resume_state);
+    // Moves a download whose chunks have all arrived into the download directory
+    hypershare::crypto::CryptoResult complete_download(const std::string& session_id, TransferSession& session);
+    std::filesystem::path download_path(const hypershare::storage::FileMetadata& metadata) const;
     TransferSessionStats create_session_stats(const TransferSession& session);
 };
 
@@ -7,6 +7,7 @@
 #include <bitset>
 #include <chrono>
 #include <cstdint>
+#include <span>
 
 namespace hypershare::transfer {
 
@@ -40,6 +41,16 @@ public:
     hypershare::crypto::CryptoResult handle_chunk_received(uint32_t chunk_index, 
                                                            const std::vector<uint8_t>& chunk_data);
     
+    // For manifests without chunk_hashes the chunk is checked against the chunk
+    // tree root (file_hash) using the proof that came with it
+    hypershare::crypto::CryptoResult handle_chunk_received(uint32_t chunk_index,
+                                                           const std::vector<uint8_t>& chunk_data,
+                                                           std::span<const hypershare::crypto::Blake3Hash> proof);
+    
+    // For a chunk already on disk, e.g. copied from a local file or durable
+    // from an earlier run: counts towards completion without being requested
+    void mark_chunk_received(uint32_t chunk_index);
+    
     // Chunk status queries
     std::bitset<1024> get_requested_chunks() const { return requested_chunks_; }
     std::bitset<1024> get_received_chunks() const { return received_chunks_; }
@@ -74,7 +85,8 @@ private:
     std::chrono::steady_clock::time_point start_time_;
     
     void update_progress();
-    bool validate_chunk(uint32_t chunk_index, const std::vector<uint8_t>& chunk_data);
+    bool validate_chunk(uint32_t chunk_index, const std::vector<uint8_t>& chunk_data,
+                        std::span<const hypershare::crypto::Blake3Hash> proof);
 };
 
 } // namespace hypershare::transfer
\ No newline at end of file
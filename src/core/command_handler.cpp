@@ -2,15 +2,25 @@
 #include "hypershare/core/logger.hpp"
 #include "hypershare/core/config.hpp"
 #include "hypershare/storage/chunk_manager.hpp"
+#include "hypershare/storage/chunk_store.hpp"
+#include "hypershare/storage/resume_manager.hpp"
 #include "hypershare/storage/file_metadata.hpp"
 #include "hypershare/storage/file_index.hpp"
 #include "hypershare/storage/storage_config.hpp"
+#include "hypershare/storage/share_watcher.hpp"
+#include "hypershare/storage/storage_accountant.hpp"
+#include "hypershare/storage/integrity_scrubber.hpp"
+#include "hypershare/storage/hash_cache.hpp"
 #include "hypershare/network/connection_manager.hpp"
 #include "hypershare/network/file_announcer.hpp"
 #include "hypershare/core/ipc_server.hpp"
 #include "hypershare/core/ipc_client.hpp"
+#include "hypershare/core/utils.hpp"
 #include "hypershare/transfer/performance_monitor.hpp"
 #include "hypershare/transfer/transfer_manager.hpp"
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+#include <algorithm>
 #include <filesystem>
 #include <iostream>
 #include <thread>
@@ -38,6 +48,13 @@ CommandResult ShareCommandHandler::execute(const std::vector<std::string>& args)
     }
     
     try {
+        auto& config = hypershare::core::Config::instance();
+        storage_config_->parallel_hashing = config.get_bool("storage.parallel_hashing", true);
+        storage_config_->hash_threads = static_cast<uint32_t>(std::max(0, config.get_int("storage.hash_threads", 0)));
+        if (config.get_string("storage.chunking", "fixed") == "cdc") {
+            storage_config_->chunking_mode = hypershare::storage::ChunkingMode::CONTENT_DEFINED;
+        }
+        
         hypershare::storage::ChunkManager chunk_manager(*storage_config_);
         hypershare::storage::FileIndex file_index(storage_config_->database_path);
         
@@ -46,6 +63,12 @@ CommandResult ShareCommandHandler::execute(const std::vector<std::string>& args)
             return CommandResult::error("Failed to initialize file database");
         }
         
+        // Re-sharing an unchanged file reuses its hashes
+        auto hash_cache = std::make_shared<hypershare::storage::HashCache>(storage_config_->database_path);
+        if (hash_cache->initialize()) {
+            chunk_manager.set_hash_cache(hash_cache);
+        }
+        
         // Create file metadata
         hypershare::storage::FileMetadata metadata;
         
@@ -72,7 +95,12 @@ CommandResult ShareCommandHandler::execute(const std::vector<std::string>& args)
         std::cout << "  File ID: " << metadata.file_id << "\n";
         std::cout << "  Size: " << metadata.file_size << " bytes\n";
         std::cout << "  Chunks: " << metadata.chunk_count << "\n";
-        std::cout << "  Chunk size: " << metadata.chunk_size << " bytes\n";
+        if (metadata.is_content_defined()) {
+            std::cout << "  Chunk size: " << metadata.cdc_min_size << "-" << metadata.chunk_size
+                      << " bytes (content-defined)\n";
+        } else {
+            std::cout << "  Chunk size: " << metadata.chunk_size << " bytes\n";
+        }
         std::cout << "\nFile is now available for download by peers.\n";
         std::cout << "Use 'hypershare start' to begin accepting connections.\n";
         
@@ -112,6 +140,11 @@ CommandResult ConnectCommandHandler::execute(const std::vector<std::string>& arg
         auto file_index = std::make_shared<hypershare::storage::FileIndex>(storage_config->database_path);
         file_index->initialize();
         
+        storage_config->enable_compression = config.get_bool("storage.compression", false);
+        connection_manager->set_compression_enabled(storage_config->enable_compression);
+        storage_config->enable_deduplication = config.get_bool("storage.deduplication", true);
+        file_index->set_index_chunk_hashes(storage_config->enable_deduplication);
+        
         // Set up file announcer to receive remote file announcements
         connection_manager->initialize_file_announcer(file_index);
         
@@ -273,7 +306,6 @@ CommandResult StatusCommandHandler::execute(const std::vector<std::string>& args
             // Daemon not running, fall back to local data
             hypershare::storage::FileIndex file_index(storage_config_->database_path);
             file_index.initialize();
-            auto shared_files = file_index.list_files();
             auto file_count = file_index.get_file_count();
             auto total_size = file_index.get_total_size();
             
@@ -285,13 +317,13 @@ CommandResult StatusCommandHandler::execute(const std::vector<std::string>& args
             std::cout << "Storage location: " << storage_config_->download_directory << "\n";
             std::cout << "Database: " << storage_config_->database_path << "\n";
             
-            if (!shared_files.empty()) {
+            if (file_count > 0) {
                 std::cout << "\nShared files:\n";
-                for (const auto& file : shared_files) {
-                    std::cout << "  - " << file.filename << " (" << file.file_size << " bytes)\n";
-                    std::cout << "    File ID: " << file.file_id << "\n";
-                    std::cout << "    File Hash: " << file.file_hash << "\n";
-                }
+                file_index.for_each_file([](const hypershare::storage::FileMetadataView& file) {
+                    std::cout << "  - " << file.filename() << " (" << file.file_size() << " bytes)\n";
+                    std::cout << "    File ID: " << file.file_id() << "\n";
+                    std::cout << "    File Hash: " << file.file_hash() << "\n";
+                });
             }
             
             std::cout << "\nNetwork: Ready for connections (use 'hypershare start' to start daemon)\n";
@@ -394,13 +426,11 @@ CommandResult DownloadCommandHandler::execute(const std::vector<std::string>& ar
         
         // If not found by hash, search through all files for matching file_id
         if (!metadata_opt) {
-            auto all_files = file_index.list_files();
-            for (const auto& file : all_files) {
-                if (file.file_id == file_id) {
-                    metadata_opt = file;
-                    break;
+            file_index.for_each_file([&](const hypershare::storage::FileMetadataView& file) {
+                if (!metadata_opt && file.file_id() == file_id) {
+                    metadata_opt = file.to_metadata();
                 }
-            }
+            });
         }
         
         if (!metadata_opt) {
@@ -473,9 +503,121 @@ CommandResult StartCommandHandler::execute(const std::vector<std::string>& args)
     auto file_index = std::make_shared<hypershare::storage::FileIndex>(storage_config->database_path);
     file_index->initialize();
     
+    storage_config->enable_compression = config.get_bool("storage.compression", false);
+    connection_manager->set_compression_enabled(storage_config->enable_compression);
+    storage_config->enable_deduplication = config.get_bool("storage.deduplication", true);
+    file_index->set_index_chunk_hashes(storage_config->enable_deduplication);
+    
+    // Measure what is already on disk against the storage budget
+    storage_config->max_storage_size =
+        static_cast<uint64_t>(std::max(1, config.get_int("storage.max_size_mb", 10240))) * 1024 * 1024;
+    auto storage_accountant = std::make_shared<hypershare::storage::StorageAccountant>(*storage_config);
+    storage_accountant->scan();
+    LOG_INFO("Storage: {} of {} bytes used", storage_accountant->total_used(), storage_accountant->budget());
+    if (storage_accountant->total_used() > storage_accountant->budget()) {
+        LOG_WARN("Storage is over budget, incomplete downloads will be evicted as new ones start");
+    }
+    
     // Set up file announcer
     connection_manager->initialize_file_announcer(file_index);
     
+    // Keep the configured share roots indexed and announce files as they change
+    std::unique_ptr<hypershare::storage::ShareWatcher> share_watcher;
+    auto watch_roots = config.get_string("storage.watch_roots", "");
+    if (!watch_roots.empty()) {
+        storage_config->parallel_hashing = config.get_bool("storage.parallel_hashing", true);
+        storage_config->hash_threads = static_cast<uint32_t>(std::max(0, config.get_int("storage.hash_threads", 0)));
+        if (config.get_string("storage.chunking", "fixed") == "cdc") {
+            storage_config->chunking_mode = hypershare::storage::ChunkingMode::CONTENT_DEFINED;
+        }
+        
+        share_watcher = std::make_unique<hypershare::storage::ShareWatcher>(file_index, *storage_config);
+        auto hash_cache = std::make_shared<hypershare::storage::HashCache>(storage_config->database_path);
+        if (hash_cache->initialize()) {
+            share_watcher->set_hash_cache(hash_cache);
+        }
+        auto file_announcer = connection_manager->get_file_announcer();
+        share_watcher->set_update_handler([file_announcer](const hypershare::storage::FileMetadata& metadata) {
+            if (file_announcer) {
+                file_announcer->announce_file(metadata);
+            }
+        });
+        
+        for (const auto& entry : utils::StringUtils::split(watch_roots, ',')) {
+            auto root = utils::StringUtils::trim(entry);
+            if (root.empty()) {
+                continue;
+            }
+            auto result = share_watcher->add_root(root);
+            if (!result.success()) {
+                LOG_WARN("Not watching {}: {}", root, result.message);
+            }
+        }
+        share_watcher->start();
+    }
+    
+    // Check shared files for silent corruption; bad chunks are marked missing
+    // so they are fetched again from peers. A rate of 0 turns scrubbing off.
+    std::unique_ptr<hypershare::storage::IntegrityScrubber> integrity_scrubber;
+    int scrub_rate_mb = config.get_int("storage.scrub_rate_mb", 16);
+    if (scrub_rate_mb > 0) {
+        integrity_scrubber = std::make_unique<hypershare::storage::IntegrityScrubber>(
+            file_index, static_cast<uint64_t>(scrub_rate_mb) * 1024 * 1024,
+            std::chrono::hours(std::max(1, config.get_int("storage.scrub_interval_hours", 24))));
+        integrity_scrubber->start();
+    }
+    
+    // Downloads are written through one ChunkManager charged to the accountant,
+    // so a download that does not fit the budget is refused when it starts.
+    // Preallocated downloads are written once, to their target; the chunk
+    // store only holds per-chunk downloads.
+    storage_config->use_io_uring = config.get_bool("storage.io_uring", true);
+    storage_config->disk_io_threads = static_cast<uint32_t>(std::max(1, config.get_int("storage.disk_io_threads", 4)));
+    auto download_chunks = std::make_shared<hypershare::storage::ChunkManager>(*storage_config);
+    download_chunks->set_storage_accountant(storage_accountant);
+    
+    // Async chunk I/O completes on an io_context of its own; the network's
+    // belongs to its TCP server. It runs for the life of the daemon.
+    auto disk_io_context = std::make_shared<boost::asio::io_context>();
+    std::thread([disk_io_context, work = boost::asio::make_work_guard(*disk_io_context)]() {
+        disk_io_context->run();
+    }).detach();
+    download_chunks->set_disk_engine(hypershare::storage::make_disk_engine(
+        *disk_io_context, storage_config->use_io_uring, storage_config->disk_io_threads));
+    
+    // Chunks of local files are copied out, since their owners may truncate
+    // them; only files under roots configured as immutable are mapped
+    std::vector<std::filesystem::path> immutable_roots;
+    for (const auto& entry : utils::StringUtils::split(config.get_string("storage.immutable_roots", ""), ',')) {
+        auto root = utils::StringUtils::trim(entry);
+        if (!root.empty()) {
+            immutable_roots.emplace_back(root);
+        }
+    }
+    download_chunks->set_immutable_roots(std::move(immutable_roots));
+    if (storage_config->enable_deduplication) {
+        auto chunk_store = std::make_shared<hypershare::storage::ChunkStore>(
+            storage_config->chunk_store_directory, storage_config->database_path, storage_config->enable_compression);
+        if (chunk_store->initialize()) {
+            chunk_store->set_storage_accountant(storage_accountant);
+            download_chunks->set_chunk_store(chunk_store);
+        } else {
+            LOG_WARN("Chunk store unavailable, downloads will not share chunks");
+        }
+    }
+    auto transfer_manager = std::make_shared<hypershare::transfer::TransferManager>(*storage_config);
+    transfer_manager->set_chunk_manager(download_chunks);
+    // Completed downloads are indexed, so later ones copy matching chunks from them
+    transfer_manager->set_file_index(file_index);
+    
+    // Resume state follows the chunks that reached the disk, not the writes
+    auto resume_manager = std::make_shared<hypershare::storage::ResumeManager>(storage_config->database_path);
+    if (resume_manager->initialize()) {
+        transfer_manager->set_resume_manager(resume_manager);
+    } else {
+        LOG_WARN("Resume state unavailable, interrupted downloads will start over");
+    }
+    
     // Set up performance monitor
     auto performance_monitor = std::make_shared<hypershare::transfer::PerformanceMonitor>();
     
@@ -92,6 +92,18 @@ void Config::set_defaults() {
     values_["discovery.port"] = "8081";
     values_["transfer.chunk_size"] = "65536";
     values_["transfer.max_parallel"] = "4";
+    values_["storage.parallel_hashing"] = "true";
+    values_["storage.hash_threads"] = "0";
+    values_["storage.chunking"] = "fixed";
+    values_["storage.compression"] = "false";
+    values_["storage.deduplication"] = "true";
+    values_["storage.watch_roots"] = "";
+    values_["storage.immutable_roots"] = "";
+    values_["storage.io_uring"] = "true";
+    values_["storage.disk_io_threads"] = "4";
+    values_["storage.max_size_mb"] = "10240";
+    values_["storage.scrub_rate_mb"] = "16";
+    values_["storage.scrub_interval_hours"] = "24";
     values_["log.level"] = "info";
     values_["log.file"] = "hypershare.log";
 }
@@ -252,16 +252,14 @@ IPCResponse IPCServer::handle_files_command(const IPCRequest& request) {
     
     try {
         if (file_index_) {
-            auto files = file_index_->list_files();
-            response.data["file_count"] = std::to_string(files.size());
-            
+            size_t file_count = 0;
             std::stringstream files_info;
-            for (size_t i = 0; i < files.size(); ++i) {
-                const auto& file = files[i];
-                if (i > 0) files_info << ";";
-                files_info << file.file_id << ":" << file.filename << ":" 
-                          << file.file_size << ":" << file.file_hash;
-            }
+            file_index_->for_each_file([&](const hypershare::storage::FileMetadataView& file) {
+                if (file_count++ > 0) files_info << ";";
+                files_info << file.file_id() << ":" << file.filename() << ":" 
+                          << file.file_size() << ":" << file.file_hash();
+            });
+            response.data["file_count"] = std::to_string(file_count);
             response.data["files"] = files_info.str();
         } else {
             response.data["file_count"] = "0";
@@ -1,9 +1,22 @@
 #include "hypershare/crypto/file_verification.hpp"
 #include "hypershare/crypto/hash.hpp"
+#include "hypershare/storage/parallel_hasher.hpp"
 #include <fstream>
+#include <mutex>
 
 namespace hypershare::crypto {
 
+namespace {
+    // Chunks the file the way metadata was chunked
+    hypershare::storage::ParallelHasher make_hasher(const hypershare::storage::FileMetadata& metadata) {
+        if (metadata.is_content_defined()) {
+            hypershare::storage::ContentChunker chunker(metadata.cdc_min_size, metadata.cdc_avg_size, metadata.chunk_size);
+            return hypershare::storage::ParallelHasher(chunker);
+        }
+        return hypershare::storage::ParallelHasher(metadata.chunk_size);
+    }
+}
+
 FileVerifier::FileVerifier() {
 }
 
@@ -48,6 +61,20 @@ Blake3Hash FileVerifier::calculate_file_hash_raw(const std::filesystem::path& fi
     return result;
 }
 
+std::string FileVerifier::calculate_file_hash(const std::filesystem::path& file_path,
+                                              const hypershare::storage::FileMetadata& metadata) {
+    if (metadata.file_hash_scheme != hypershare::storage::FileHashScheme::CHUNK_TREE) {
+        return calculate_file_hash(file_path);
+    }
+    
+    hypershare::storage::ParallelHasher::Result result;
+    auto status = make_hasher(metadata).hash_file(file_path, result);
+    if (!status) {
+        return std::string();
+    }
+    return hash_utils::hash_to_hex(result.root);
+}
+
 bool FileVerifier::verify_file_metadata(const std::filesystem::path& file_path, 
                                         const hypershare::storage::FileMetadata& metadata) {
     // Check file size
@@ -61,37 +88,44 @@ bool FileVerifier::verify_file_metadata(const std::filesystem::path& file_path,
     }
     
     // Check file hash
-    auto calculated_hash = calculate_file_hash(file_path);
+    auto calculated_hash = calculate_file_hash(file_path, metadata);
     return compare_hashes(calculated_hash, metadata.file_hash);
 }
 
 bool FileVerifier::verify_all_chunks(const std::filesystem::path& file_path,
                                      const std::vector<std::string>& chunk_hashes,
                                      uint32_t chunk_size) {
-    auto chunks = split_file_into_chunks(file_path, chunk_size);
-    
-    if (chunks.size() != chunk_hashes.size()) {
-        return false;
-    }
-    
-    for (size_t i = 0; i < chunks.size(); ++i) {
-        if (!verify_chunk(chunks[i], chunk_hashes[i])) {
+    std::vector<Blake3Hash> expected;
+    expected.reserve(chunk_hashes.size());
+    for (const auto& chunk_hash : chunk_hashes) {
+        auto parsed = hash_utils::hash_from_hex(chunk_hash);
+        if (!parsed) {
             return false;
         }
+        expected.push_back(*parsed);
     }
     
-    return true;
+    hypershare::storage::ParallelHasher hasher(chunk_size);
+    return verify_chunk_stream(file_path, hasher, expected, nullptr, true);
 }
 
 FileVerifier::CorruptionReport FileVerifier::check_file_integrity(const std::filesystem::path& file_path,
-                                                                  const hypershare::storage::FileMetadata& metadata) {
+                                                                  const hypershare::storage::FileMetadata& metadata,
+                                                                  ChunkFilter filter) {
     CorruptionReport report;
     report.is_corrupted = false;
     
+    bool per_chunk = metadata.is_complete();
+    
     // Check if file exists
     if (!std::filesystem::exists(file_path)) {
         report.is_corrupted = true;
         report.details = "File does not exist";
+        if (per_chunk) {
+            for (size_t i = 0; i < metadata.chunk_hashes.size(); ++i) {
+                report.corrupted_chunks.push_back(i);
+            }
+        }
         return report;
     }
     
@@ -101,7 +135,9 @@ FileVerifier::CorruptionReport FileVerifier::check_file_integrity(const std::fil
         if (actual_size != metadata.file_size) {
             report.is_corrupted = true;
             report.details = "File size mismatch";
-            return report;
+            if (!per_chunk) {
+                return report;
+            }
         }
     } catch (const std::filesystem::filesystem_error& e) {
         report.is_corrupted = true;
@@ -109,8 +145,37 @@ FileVerifier::CorruptionReport FileVerifier::check_file_integrity(const std::fil
         return report;
     }
     
+    if (per_chunk) {
+        std::ifstream file(file_path, std::ios::binary);
+        std::vector<uint8_t> chunk;
+        for (size_t i = 0; i < metadata.chunk_hashes.size(); ++i) {
+            uint32_t chunk_size = metadata.get_chunk_size(i);
+            if (filter && !filter(i, chunk_size)) {
+                continue;
+            }
+            
+            // A chunk cut short by truncation is as bad as a changed one
+            chunk.resize(chunk_size);
+            file.clear();
+            file.seekg(static_cast<std::streamoff>(metadata.get_chunk_offset(i)));
+            file.read(reinterpret_cast<char*>(chunk.data()), chunk_size);
+            if (file.gcount() != static_cast<std::streamsize>(chunk_size) ||
+                !verify_chunk(chunk, metadata.chunk_hashes[i])) {
+                report.corrupted_chunks.push_back(i);
+            }
+        }
+        
+        if (!report.corrupted_chunks.empty()) {
+            report.is_corrupted = true;
+            if (report.details.empty()) {
+                report.details = std::to_string(report.corrupted_chunks.size()) + " corrupted chunks";
+            }
+        }
+        return report;
+    }
+    
     // Check file hash
-    auto calculated_hash = calculate_file_hash(file_path);
+    auto calculated_hash = calculate_file_hash(file_path, metadata);
     if (!compare_hashes(calculated_hash, metadata.file_hash)) {
         report.is_corrupted = true;
         report.file_hash_mismatch = calculated_hash;
@@ -122,32 +187,107 @@ FileVerifier::CorruptionReport FileVerifier::check_file_integrity(const std::fil
 
 bool FileVerifier::verify_file_with_progress(const std::filesystem::path& file_path,
                                              const hypershare::storage::FileMetadata& metadata,
-                                             ProgressCallback callback) {
-    // Implementation stub - for now just verify without progress
-    return verify_file_metadata(file_path, metadata);
+                                             ProgressCallback callback,
+                                             bool stop_at_first_mismatch) {
+    auto started = std::chrono::steady_clock::now();
+    
+    if (!metadata.is_complete()) {
+        bool verified = verify_file_metadata(file_path, metadata);
+        if (callback) {
+            VerificationProgress progress{};
+            progress.chunks_verified = verified ? metadata.total_chunks() : 0;
+            progress.chunks_failed = verified ? 0 : metadata.total_chunks();
+            progress.total_chunks = metadata.total_chunks();
+            progress.percentage_complete = 100.0;
+            progress.elapsed_time = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - started);
+            progress.estimated_remaining = std::chrono::milliseconds(0);
+            callback(progress);
+        }
+        return verified;
+    }
+    
+    std::error_code ec;
+    auto actual_size = std::filesystem::file_size(file_path, ec);
+    if (ec || actual_size != metadata.file_size) {
+        return false;
+    }
+    
+    auto hasher = make_hasher(metadata);
+    Blake3Hash root{};
+    if (!verify_chunk_stream(file_path, hasher, metadata.chunk_hashes, std::move(callback),
+                             stop_at_first_mismatch, &root)) {
+        return false;
+    }
+    
+    // Chunk tree files are also checked against the root they were shared under
+    return metadata.file_hash_scheme != hypershare::storage::FileHashScheme::CHUNK_TREE ||
+           hash_utils::hash_to_hex(root) == metadata.file_hash;
 }
 
-std::vector<std::vector<uint8_t>> FileVerifier::split_file_into_chunks(const std::filesystem::path& file_path,
-                                                                       uint32_t chunk_size) {
-    std::vector<std::vector<uint8_t>> chunks;
-    
-    std::ifstream file(file_path, std::ios::binary);
-    if (!file.is_open()) {
-        return chunks;
+bool FileVerifier::verify_chunk_stream(const std::filesystem::path& file_path,
+                                       hypershare::storage::ParallelHasher& hasher,
+                                       const std::vector<Blake3Hash>& expected,
+                                       ProgressCallback callback,
+                                       bool stop_at_first_mismatch,
+                                       Blake3Hash* root) {
+    std::error_code ec;
+    uint64_t file_size = std::filesystem::file_size(file_path, ec);
+    if (ec) {
+        return false;
     }
     
-    std::vector<uint8_t> buffer(chunk_size);
-    while (file.good()) {
-        file.read(reinterpret_cast<char*>(buffer.data()), chunk_size);
-        std::streamsize bytes_read = file.gcount();
+    auto started = std::chrono::steady_clock::now();
+    std::mutex progress_mutex;
+    uint64_t chunks_done = 0;
+    uint64_t chunks_failed = 0;
+    uint64_t bytes_done = 0;
+    
+    hasher.set_block_handler([&](size_t first_chunk, std::span<const Blake3Hash> chunk_hashes, uint64_t bytes) {
+        uint64_t failed = 0;
+        for (size_t i = 0; i < chunk_hashes.size(); ++i) {
+            size_t chunk_index = first_chunk + i;
+            if (chunk_index >= expected.size() || !compare_hashes(chunk_hashes[i], expected[chunk_index])) {
+                ++failed;
+            }
+        }
+        
+        std::lock_guard<std::mutex> lock(progress_mutex);
+        chunks_done += chunk_hashes.size();
+        chunks_failed += failed;
+        bytes_done += bytes;
         
-        if (bytes_read > 0) {
-            std::vector<uint8_t> chunk(buffer.begin(), buffer.begin() + bytes_read);
-            chunks.push_back(std::move(chunk));
+        if (callback) {
+            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - started);
+            VerificationProgress progress{};
+            progress.chunks_verified = chunks_done;
+            progress.chunks_failed = chunks_failed;
+            progress.total_chunks = expected.size();
+            progress.percentage_complete = file_size == 0 ? 100.0
+                : 100.0 * static_cast<double>(bytes_done) / static_cast<double>(file_size);
+            progress.elapsed_time = elapsed;
+            // Assumes the rest of the file hashes at the rate seen so far
+            progress.estimated_remaining = std::chrono::milliseconds(bytes_done == 0 ? 0
+                : static_cast<int64_t>(static_cast<double>(elapsed.count()) *
+                                       static_cast<double>(file_size - bytes_done) / static_cast<double>(bytes_done)));
+            callback(progress);
         }
+        
+        return failed == 0 || !stop_at_first_mismatch;
+    });
+    
+    hypershare::storage::ParallelHasher::Result result;
+    bool hashed = hasher.hash_file(file_path, result).success();
+    hasher.set_block_handler(nullptr);
+    if (!hashed || chunks_failed > 0 || result.chunk_hashes.size() != expected.size()) {
+        return false;
     }
     
-    return chunks;
+    if (root) {
+        *root = result.root;
+    }
+    return true;
 }
 
 bool FileVerifier::compare_hashes(const std::string& hash1, const std::string& hash2) {
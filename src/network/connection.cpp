@@ -64,15 +64,43 @@ void Connection::send_message(const MessageHeader& header, const std::vector<std
     message.insert(message.end(), header_data.begin(), header_data.end());
     message.insert(message.end(), payload.begin(), payload.end());
     
+    enqueue_write(OutgoingMessage{std::move(message), {}, {}, nullptr});
+    
+    LOG_DEBUG("Queued message type {} ({} bytes) for {}", 
+              static_cast<int>(header.type), payload.size(), remote_endpoint_);
+}
+
+void Connection::send_message_view(MessageType type,
+                                   std::vector<std::uint8_t> prefix,
+                                   std::span<const std::uint8_t> body,
+                                   std::vector<std::uint8_t> suffix,
+                                   std::shared_ptr<const void> keepalive) {
+    if (state_ != ConnectionState::CONNECTED && state_ != ConnectionState::AUTHENTICATED) {
+        LOG_WARN("Attempted to send message on inactive connection to {}", remote_endpoint_);
+        return;
+    }
+    
+    auto payload_size = prefix.size() + body.size() + suffix.size();
+    MessageHeader header(type, static_cast<std::uint32_t>(payload_size));
+    header.calculate_checksum({prefix, body, suffix});
+    
+    // Only the small header and prefix are copied, body is written from the caller's memory
+    auto head = header.serialize();
+    head.insert(head.end(), prefix.begin(), prefix.end());
+    
+    enqueue_write(OutgoingMessage{std::move(head), body, std::move(suffix), std::move(keepalive)});
+    
+    LOG_DEBUG("Queued message type {} ({} bytes, {} borrowed) for {}", 
+              static_cast<int>(type), payload_size, body.size(), remote_endpoint_);
+}
+
+void Connection::enqueue_write(OutgoingMessage message) {
     bool write_was_empty = write_queue_.empty();
     write_queue_.push(std::move(message));
     
     if (write_was_empty && !write_in_progress_) {
         do_write();
     }
-    
-    LOG_DEBUG("Queued message type {} ({} bytes) for {}", 
-              static_cast<int>(header.type), payload.size(), remote_endpoint_);
 }
 
 void Connection::send_raw(MessageType type, const std::vector<std::uint8_t>& payload) {
@@ -183,9 +211,15 @@ void Connection::do_write() {
     write_in_progress_ = true;
     auto& message = write_queue_.front();
     
+    std::array<boost::asio::const_buffer, 3> buffers{
+        boost::asio::buffer(message.head),
+        boost::asio::buffer(message.body.data(), message.body.size()),
+        boost::asio::buffer(message.tail)
+    };
+    
     auto self = shared_from_this();
     boost::asio::async_write(socket_,
-        boost::asio::buffer(message),
+        buffers,
         [this, self](boost::system::error_code ec, std::size_t length) {
             write_in_progress_ = false;
             
@@ -1,5 +1,7 @@
 #include "hypershare/network/connection_manager.hpp"
 #include "hypershare/network/file_announcer.hpp"
+#include "hypershare/storage/mapped_file_cache.hpp"
+#include "hypershare/storage/compression.hpp"
 #include "hypershare/core/logger.hpp"
 #include <random>
 
@@ -8,6 +10,7 @@ namespace hypershare::network {
 ConnectionManager::ConnectionManager()
     : local_peer_id_(0)
     , local_tcp_port_(0)
+    , compression_enabled_(false)
     , handshake_timeout_(std::chrono::seconds(10))
     , heartbeat_interval_(std::chrono::seconds(30))
     , connection_timeout_(std::chrono::minutes(2))
@@ -157,6 +160,55 @@ void ConnectionManager::set_local_info(std::uint32_t peer_id, const std::string&
     LOG_INFO("Updated local peer info: ID={}, name='{}'", peer_id, peer_name);
 }
 
+bool ConnectionManager::send_chunk_data(std::uint32_t peer_id, const std::string& file_id,
+                                        std::uint64_t chunk_index,
+                                        const hypershare::storage::ChunkView& chunk,
+                                        const std::string& chunk_hash,
+                                        std::span<const hypershare::crypto::Blake3Hash> proof) {
+    auto info = get_connection_info(peer_id);
+    if (!info || info->handshake_state != HandshakeState::COMPLETED) {
+        return false;
+    }
+    
+    ChunkDataMessage message;
+    message.file_id = file_id;
+    message.chunk_index = chunk_index;
+    message.chunk_hash = chunk_hash;
+    message.proof.assign(proof.begin(), proof.end());
+    
+    // Compressed chunks need a contiguous payload anyway, so they are copied out
+    // of the mapping; chunks that fail the entropy check keep the zero-copy path
+    bool compress = has_capability(info->capabilities & get_local_capabilities(),
+                                   PeerCapability::ZSTD_COMPRESSION);
+    if (compress && hypershare::storage::compression::worth_compressing(chunk.data)) {
+        message.data.assign(chunk.data.begin(), chunk.data.end());
+        auto payload = message.serialize();
+        if (auto frame = hypershare::storage::compression::compress(payload)) {
+            MessageHeader header(MessageType::CHUNK_DATA, static_cast<std::uint32_t>(frame->size()));
+            header.flags = MessageFlags::COMPRESSED;
+            header.calculate_checksum(*frame);
+            info->connection->send_message(header, *frame);
+            return true;
+        }
+        message.data.clear();
+    }
+    
+    info->connection->send_message_view(MessageType::CHUNK_DATA,
+                                        message.serialize_prefix(static_cast<std::uint32_t>(chunk.size())),
+                                        chunk.data,
+                                        message.serialize_suffix(),
+                                        chunk.owner);
+    return true;
+}
+
+std::uint32_t ConnectionManager::get_local_capabilities() const {
+    std::uint32_t capabilities = static_cast<std::uint32_t>(PeerCapability::NONE);
+    if (compression_enabled_ && hypershare::storage::compression::available()) {
+        capabilities |= static_cast<std::uint32_t>(PeerCapability::ZSTD_COMPRESSION);
+    }
+    return capabilities;
+}
+
 void ConnectionManager::initialize_file_announcer(std::shared_ptr<hypershare::storage::FileIndex> file_index) {
     file_announcer_ = std::make_shared<FileAnnouncer>(shared_from_this(), file_index);
     
@@ -332,7 +384,7 @@ void ConnectionManager::handle_handshake(std::shared_ptr<Connection> connection,
             local_peer_id_,
             local_tcp_port_,
             local_peer_name_,
-            0 // TODO: Define capability flags
+            get_local_capabilities()
         };
         
         connection->send_message(MessageType::HANDSHAKE_ACK, response);
@@ -400,7 +452,7 @@ void ConnectionManager::send_handshake(std::shared_ptr<Connection> connection) {
         local_peer_id_,
         local_tcp_port_,
         local_peer_name_,
-        0 // TODO: Define capability flags
+        get_local_capabilities()
     };
     
     connection->send_message(MessageType::HANDSHAKE, handshake);
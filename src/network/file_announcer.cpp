@@ -58,13 +58,14 @@ void FileAnnouncer::announce_files() {
     }
     
     try {
-        auto local_files = file_index_->list_files();
-        
-        LOG_DEBUG("Announcing {} files to peers", local_files.size());
-        
-        for (const auto& file : local_files) {
+        // Straight from the stored blobs, chunk lists are never decoded
+        size_t announced = 0;
+        file_index_->for_each_file([&](const hypershare::storage::FileMetadataView& file) {
             announce_file(file);
-        }
+            ++announced;
+        });
+        
+        LOG_DEBUG("Announced {} files to peers", announced);
         
         last_announcement_ = std::chrono::steady_clock::now();
         
@@ -91,6 +92,30 @@ void FileAnnouncer::announce_file(const hypershare::storage::FileMetadata& metad
     LOG_DEBUG("Announced file: {} ({})", metadata.filename, metadata.file_id);
 }
 
+void FileAnnouncer::announce_file(const hypershare::storage::FileMetadataView& metadata) {
+    if (!running_ || !connection_manager_) {
+        return;
+    }
+    
+    std::vector<std::string> tags;
+    tags.reserve(metadata.tag_count());
+    for (size_t i = 0; i < metadata.tag_count(); ++i) {
+        tags.emplace_back(metadata.tag(i));
+    }
+    
+    FileAnnounceMessage announce_msg{
+        std::string(metadata.file_id()),
+        std::string(metadata.filename()),
+        metadata.file_size(),
+        std::string(metadata.file_hash()),
+        std::move(tags)
+    };
+    
+    connection_manager_->broadcast_message(MessageType::FILE_ANNOUNCE, announce_msg);
+    
+    LOG_DEBUG("Announced file: {} ({})", metadata.filename(), metadata.file_id());
+}
+
 std::vector<RemoteFileInfo> FileAnnouncer::get_remote_files() const {
     std::lock_guard<std::mutex> lock(files_mutex_);
     std::vector<RemoteFileInfo> files;
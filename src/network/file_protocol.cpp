@@ -157,8 +157,8 @@ std::vector<uint8_t> FileResponseMessage::serialize() const {
     write_string(oss, error_message);
     
     if (accepted) {
-        // Serialize metadata
-        auto metadata_serialized = metadata.serialize();
+        // Chunk tree files announce only the root, chunks carry their own proofs
+        auto metadata_serialized = metadata.serialize_manifest();
         write_vector_bytes(oss, metadata_serialized);
     } else {
         // Write empty metadata
@@ -230,6 +230,10 @@ std::vector<uint8_t> ChunkDataMessage::serialize() const {
     write_value(oss, chunk_index);
     write_vector_bytes(oss, data);
     write_string(oss, chunk_hash);
+    write_value<uint32_t>(oss, static_cast<uint32_t>(proof.size()));
+    for (const auto& sibling : proof) {
+        oss.write(reinterpret_cast<const char*>(sibling.data()), sibling.size());
+    }
     
     std::string str = oss.str();
     return file_protocol_utils::add_message_header(
@@ -250,6 +254,16 @@ ChunkDataMessage ChunkDataMessage::deserialize(const std::vector<uint8_t>& data)
     msg.data = read_vector_bytes(ptr, remaining);
     msg.chunk_hash = read_string(ptr, remaining);
     
+    uint32_t proof_size = read_value<uint32_t>(ptr, remaining);
+    if (proof_size <= remaining / hypershare::crypto::BLAKE3_HASH_SIZE) {
+        msg.proof.resize(proof_size);
+        for (auto& sibling : msg.proof) {
+            std::memcpy(sibling.data(), ptr, sibling.size());
+            ptr += sibling.size();
+            remaining -= sibling.size();
+        }
+    }
+    
     return msg;
 }
 
@@ -1,4 +1,5 @@
 #include "hypershare/network/message_handler.hpp"
+#include "hypershare/storage/compression.hpp"
 #include "hypershare/core/logger.hpp"
 #include <queue>
 #include <mutex>
@@ -6,6 +7,20 @@
 namespace hypershare::network {
 
 void MessageHandler::handle_message(std::shared_ptr<Connection> connection, const MessageHeader& header, std::vector<std::uint8_t> payload) {
+    // Handlers always see the plain payload; the checksum covered the compressed bytes
+    if (has_flag(header.flags, MessageFlags::COMPRESSED)) {
+        std::vector<std::uint8_t> decompressed;
+        auto result = hypershare::storage::compression::decompress(payload, decompressed);
+        if (!result) {
+            LOG_WARN("Dropping compressed message type {} from {}: {}",
+                     static_cast<int>(header.type),
+                     connection->get_remote_endpoint(),
+                     result.message);
+            return;
+        }
+        payload = std::move(decompressed);
+    }
+    
     auto it = handlers_.find(header.type);
     if (it != handlers_.end()) {
         try {
@@ -19,8 +19,7 @@ namespace {
             now.time_since_epoch()).count();
     }
     
-    std::uint32_t calculate_crc32(std::span<const std::uint8_t> data) {
-        std::uint32_t crc = 0xFFFFFFFF;
+    std::uint32_t calculate_crc32(std::span<const std::uint8_t> data, std::uint32_t crc = 0xFFFFFFFF) {
         static constexpr std::uint32_t crc_table[256] = {
             0x00000000, 0x77073096, 0xEE0E612C, 0x990951BA, 0x076DC419, 0x706AF48F,
             0xE963A535, 0x9E6495A3, 0x0EDB8832, 0x79DCB8A4, 0xE0D5E91E, 0x97D2D988,
@@ -30,7 +29,14 @@ namespace {
         for (auto byte : data) {
             crc = crc_table[(crc ^ byte) & 0xFF] ^ (crc >> 8);
         }
-        return crc ^ 0xFFFFFFFF;
+        return crc;
+    }
+    
+    void store_checksum(std::array<std::uint8_t, 4>& checksum, std::uint32_t crc) {
+        checksum[0] = (crc >> 24) & 0xFF;
+        checksum[1] = (crc >> 16) & 0xFF;
+        checksum[2] = (crc >> 8) & 0xFF;
+        checksum[3] = crc & 0xFF;
     }
     
     void write_uint32(std::vector<std::uint8_t>& buffer, std::uint32_t value) {
@@ -129,15 +135,19 @@ bool MessageHeader::is_valid() const {
 }
 
 void MessageHeader::calculate_checksum(std::span<const std::uint8_t> payload) {
-    auto crc = calculate_crc32(payload);
-    checksum[0] = (crc >> 24) & 0xFF;
-    checksum[1] = (crc >> 16) & 0xFF;
-    checksum[2] = (crc >> 8) & 0xFF;
-    checksum[3] = crc & 0xFF;
+    store_checksum(checksum, calculate_crc32(payload) ^ 0xFFFFFFFF);
+}
+
+void MessageHeader::calculate_checksum(std::initializer_list<std::span<const std::uint8_t>> payload_parts) {
+    std::uint32_t crc = 0xFFFFFFFF;
+    for (auto part : payload_parts) {
+        crc = calculate_crc32(part, crc);
+    }
+    store_checksum(checksum, crc ^ 0xFFFFFFFF);
 }
 
 bool MessageHeader::verify_checksum(std::span<const std::uint8_t> payload) const {
-    auto expected_crc = calculate_crc32(payload);
+    auto expected_crc = calculate_crc32(payload) ^ 0xFFFFFFFF;
     auto actual_crc = (static_cast<std::uint32_t>(checksum[0]) << 24) |
                      (static_cast<std::uint32_t>(checksum[1]) << 16) |
                      (static_cast<std::uint32_t>(checksum[2]) << 8) |
@@ -283,12 +293,29 @@ ChunkRequestMessage ChunkRequestMessage::deserialize(std::span<const std::uint8_
 }
 
 std::vector<std::uint8_t> ChunkDataMessage::serialize() const {
+    auto buffer = serialize_prefix(static_cast<std::uint32_t>(data.size()));
+    auto suffix = serialize_suffix();
+    buffer.reserve(buffer.size() + data.size() + suffix.size());
+    buffer.insert(buffer.end(), data.begin(), data.end());
+    buffer.insert(buffer.end(), suffix.begin(), suffix.end());
+    return buffer;
+}
+
+std::vector<std::uint8_t> ChunkDataMessage::serialize_prefix(std::uint32_t data_size) const {
     std::vector<std::uint8_t> buffer;
     write_string(buffer, file_id);
     write_uint64(buffer, chunk_index);
-    write_uint32(buffer, static_cast<std::uint32_t>(data.size()));
-    buffer.insert(buffer.end(), data.begin(), data.end());
+    write_uint32(buffer, data_size);
+    return buffer;
+}
+
+std::vector<std::uint8_t> ChunkDataMessage::serialize_suffix() const {
+    std::vector<std::uint8_t> buffer;
     write_string(buffer, chunk_hash);
+    write_uint32(buffer, static_cast<std::uint32_t>(proof.size()));
+    for (const auto& sibling : proof) {
+        buffer.insert(buffer.end(), sibling.begin(), sibling.end());
+    }
     return buffer;
 }
 
@@ -302,6 +329,19 @@ ChunkDataMessage ChunkDataMessage::deserialize(std::span<const std::uint8_t> dat
     msg.data.assign(span.begin(), span.begin() + data_size);
     span = span.subspan(data_size);
     msg.chunk_hash = read_string(span);
+    
+    // Absent from senders that predate chunk proofs
+    if (!span.empty()) {
+        auto proof_size = read_uint32(span);
+        if (span.size() / hypershare::crypto::BLAKE3_HASH_SIZE < proof_size) {
+            throw std::runtime_error("Insufficient data for chunk proof");
+        }
+        msg.proof.resize(proof_size);
+        for (auto& sibling : msg.proof) {
+            std::copy_n(span.begin(), sibling.size(), sibling.begin());
+            span = span.subspan(sibling.size());
+        }
+    }
     return msg;
 }
 
@@ -0,0 +1,464 @@
+#include "hypershare/storage/chunk_bitmap.hpp"
+#include <algorithm>
+
+namespace hypershare::storage {
+
+namespace {
+
+// Serialized form, integers little-endian:
+//   u8 version, u32 container count, then per container
+//   u64 key, u8 kind, u32 cardinality, payload by kind:
+//     ARRAY   cardinality x u16
+//     BITMAP  1024 x u64
+//     RUNS    u32 run count, then (u16 start, u16 length - 1) per run
+constexpr uint8_t FORMAT_VERSION = 1;
+
+enum ContainerKind : uint8_t {
+    ARRAY = 0,
+    BITMAP = 1,
+    RUNS = 2
+};
+
+template <typename T>
+void put_le(std::vector<uint8_t>& out, T value) {
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        out.push_back(static_cast<uint8_t>(static_cast<uint64_t>(value) >> (8 * i)));
+    }
+}
+
+// Bounds checked reader, fails once it runs past the end
+class Reader {
+public:
+    explicit Reader(std::span<const uint8_t> data) : data_(data) {}
+
+    template <typename T>
+    bool get(T& value) {
+        if (data_.size() - offset_ < sizeof(T)) {
+            return false;
+        }
+        uint64_t bits = 0;
+        for (size_t i = 0; i < sizeof(T); ++i) {
+            bits |= static_cast<uint64_t>(data_[offset_ + i]) << (8 * i);
+        }
+        value = static_cast<T>(bits);
+        offset_ += sizeof(T);
+        return true;
+    }
+
+    bool at_end() const { return offset_ == data_.size(); }
+
+private:
+    std::span<const uint8_t> data_;
+    size_t offset_ = 0;
+};
+
+} // namespace
+
+bool ChunkBitmap::Container::contains(uint16_t low) const {
+    if (!words.empty()) {
+        return (words[low / 64] >> (low % 64)) & 1;
+    }
+    return std::binary_search(array.begin(), array.end(), low);
+}
+
+bool ChunkBitmap::Container::insert(uint16_t low) {
+    if (!words.empty()) {
+        uint64_t bit = uint64_t{1} << (low % 64);
+        if (words[low / 64] & bit) {
+            return false;
+        }
+        words[low / 64] |= bit;
+        ++cardinality;
+        return true;
+    }
+
+    // Downloads mostly complete chunks in order, so try the end first
+    if (array.empty() || array.back() < low) {
+        array.push_back(low);
+    } else {
+        auto it = std::lower_bound(array.begin(), array.end(), low);
+        if (*it == low) {
+            return false;
+        }
+        array.insert(it, low);
+    }
+    ++cardinality;
+
+    if (array.size() > ARRAY_MAX) {
+        to_bitmap();
+    }
+    return true;
+}
+
+bool ChunkBitmap::Container::erase(uint16_t low) {
+    if (!words.empty()) {
+        uint64_t bit = uint64_t{1} << (low % 64);
+        if (!(words[low / 64] & bit)) {
+            return false;
+        }
+        words[low / 64] &= ~bit;
+        --cardinality;
+        if (cardinality <= ARRAY_MAX) {
+            to_array();
+        }
+        return true;
+    }
+
+    auto it = std::lower_bound(array.begin(), array.end(), low);
+    if (it == array.end() || *it != low) {
+        return false;
+    }
+    array.erase(it);
+    --cardinality;
+    return true;
+}
+
+size_t ChunkBitmap::Container::next_missing(size_t low) const {
+    if (cardinality == CONTAINER_SIZE) {
+        return CONTAINER_SIZE;
+    }
+
+    if (!words.empty()) {
+        for (size_t w = low / 64; w < BITMAP_WORDS; ++w) {
+            uint64_t unset = ~words[w];
+            if (w == low / 64) {
+                unset &= ~uint64_t{0} << (low % 64);
+            }
+            if (unset != 0) {
+                return w * 64 + std::countr_zero(unset);
+            }
+        }
+        return CONTAINER_SIZE;
+    }
+
+    auto it = std::lower_bound(array.begin(), array.end(), static_cast<uint16_t>(low));
+    while (it != array.end() && *it == low) {
+        ++it;
+        ++low;
+    }
+    return low;
+}
+
+void ChunkBitmap::Container::insert_range(size_t first, size_t last) {
+    if (words.empty() && cardinality + (last - first) <= ARRAY_MAX) {
+        for (size_t low = first; low < last; ++low) {
+            insert(static_cast<uint16_t>(low));
+        }
+        return;
+    }
+
+    if (words.empty()) {
+        to_bitmap();
+    }
+    for (size_t low = first; low < last;) {
+        size_t bits = std::min<size_t>(64 - low % 64, last - low);
+        uint64_t mask = (bits == 64 ? ~uint64_t{0} : (uint64_t{1} << bits) - 1) << (low % 64);
+        cardinality += std::popcount(mask & ~words[low / 64]);
+        words[low / 64] |= mask;
+        low += bits;
+    }
+    // The range may have mostly overlapped an array container converted above
+    if (cardinality <= ARRAY_MAX) {
+        to_array();
+    }
+}
+
+void ChunkBitmap::Container::erase_range(size_t first, size_t last) {
+    if (words.empty()) {
+        auto begin = std::lower_bound(array.begin(), array.end(), static_cast<uint16_t>(first));
+        auto end = last >= CONTAINER_SIZE ? array.end()
+                                          : std::lower_bound(begin, array.end(), static_cast<uint16_t>(last));
+        cardinality -= static_cast<uint32_t>(end - begin);
+        array.erase(begin, end);
+        return;
+    }
+
+    for (size_t low = first; low < last;) {
+        size_t bits = std::min<size_t>(64 - low % 64, last - low);
+        uint64_t mask = (bits == 64 ? ~uint64_t{0} : (uint64_t{1} << bits) - 1) << (low % 64);
+        cardinality -= std::popcount(mask & words[low / 64]);
+        words[low / 64] &= ~mask;
+        low += bits;
+    }
+    if (cardinality <= ARRAY_MAX) {
+        to_array();
+    }
+}
+
+void ChunkBitmap::Container::to_bitmap() {
+    words.assign(BITMAP_WORDS, 0);
+    for (uint16_t low : array) {
+        words[low / 64] |= uint64_t{1} << (low % 64);
+    }
+    array.clear();
+    array.shrink_to_fit();
+}
+
+void ChunkBitmap::Container::to_array() {
+    array.clear();
+    array.reserve(cardinality);
+    for (size_t w = 0; w < BITMAP_WORDS; ++w) {
+        for (uint64_t word = words[w]; word != 0; word &= word - 1) {
+            array.push_back(static_cast<uint16_t>(w * 64 + std::countr_zero(word)));
+        }
+    }
+    words.clear();
+    words.shrink_to_fit();
+}
+
+ChunkBitmap::Container* ChunkBitmap::find(uint64_t key) {
+    auto it = std::lower_bound(containers_.begin(), containers_.end(), key,
+                               [](const Container& c, uint64_t k) { return c.key < k; });
+    return it != containers_.end() && it->key == key ? &*it : nullptr;
+}
+
+const ChunkBitmap::Container* ChunkBitmap::find(uint64_t key) const {
+    return const_cast<ChunkBitmap*>(this)->find(key);
+}
+
+ChunkBitmap::Container& ChunkBitmap::find_or_insert(uint64_t key) {
+    if (!containers_.empty() && containers_.back().key == key) {
+        return containers_.back();
+    }
+
+    auto it = std::lower_bound(containers_.begin(), containers_.end(), key,
+                               [](const Container& c, uint64_t k) { return c.key < k; });
+    if (it != containers_.end() && it->key == key) {
+        return *it;
+    }
+
+    Container fresh;
+    fresh.key = key;
+    return *containers_.insert(it, std::move(fresh));
+}
+
+bool ChunkBitmap::insert(uint64_t index) {
+    if (!find_or_insert(index >> CONTAINER_BITS).insert(static_cast<uint16_t>(index))) {
+        return false;
+    }
+    ++cardinality_;
+    return true;
+}
+
+void ChunkBitmap::insert_range(uint64_t first, uint64_t last) {
+    while (first < last) {
+        uint64_t key = first >> CONTAINER_BITS;
+        uint64_t base = key << CONTAINER_BITS;
+        uint64_t end = std::min(last, base + CONTAINER_SIZE);
+
+        Container& container = find_or_insert(key);
+        uint32_t before = container.cardinality;
+        container.insert_range(first - base, end - base);
+        cardinality_ += container.cardinality - before;
+        first = end;
+    }
+}
+
+void ChunkBitmap::erase_range(uint64_t first, uint64_t last) {
+    while (first < last) {
+        uint64_t key = first >> CONTAINER_BITS;
+        uint64_t base = key << CONTAINER_BITS;
+        uint64_t end = std::min(last, base + CONTAINER_SIZE);
+
+        if (Container* container = find(key)) {
+            uint32_t before = container->cardinality;
+            container->erase_range(first - base, end - base);
+            cardinality_ -= before - container->cardinality;
+            if (container->cardinality == 0) {
+                containers_.erase(containers_.begin() + (container - containers_.data()));
+            }
+        }
+        first = end;
+    }
+}
+
+bool ChunkBitmap::erase(uint64_t index) {
+    Container* container = find(index >> CONTAINER_BITS);
+    if (!container || !container->erase(static_cast<uint16_t>(index))) {
+        return false;
+    }
+
+    --cardinality_;
+    if (container->cardinality == 0) {
+        containers_.erase(containers_.begin() + (container - containers_.data()));
+    }
+    return true;
+}
+
+bool ChunkBitmap::contains(uint64_t index) const {
+    const Container* container = find(index >> CONTAINER_BITS);
+    return container && container->contains(static_cast<uint16_t>(index));
+}
+
+void ChunkBitmap::clear() {
+    containers_.clear();
+    cardinality_ = 0;
+}
+
+uint64_t ChunkBitmap::next_missing(uint64_t from) const {
+    uint64_t index = from;
+    for (;;) {
+        const Container* container = find(index >> CONTAINER_BITS);
+        if (!container) {
+            return index;
+        }
+
+        uint64_t base = container->key << CONTAINER_BITS;
+        size_t low = container->next_missing(index - base);
+        if (low < CONTAINER_SIZE) {
+            return base + low;
+        }
+        index = base + CONTAINER_SIZE;
+    }
+}
+
+std::vector<uint64_t> ChunkBitmap::missing(uint64_t total) const {
+    std::vector<uint64_t> result;
+    for (uint64_t index = next_missing(0); index < total; index = next_missing(index + 1)) {
+        result.push_back(index);
+    }
+    return result;
+}
+
+std::vector<uint8_t> ChunkBitmap::serialize() const {
+    std::vector<uint8_t> out;
+    put_le<uint8_t>(out, FORMAT_VERSION);
+    put_le<uint32_t>(out, static_cast<uint32_t>(containers_.size()));
+
+    // (start, length - 1) of each run of consecutive values
+    std::vector<std::pair<uint16_t, uint16_t>> runs;
+    for (const auto& container : containers_) {
+        runs.clear();
+        container.for_each_low([&](uint16_t low) {
+            if (!runs.empty() && runs.back().first + runs.back().second + 1 == low) {
+                ++runs.back().second;
+            } else {
+                runs.emplace_back(low, 0);
+            }
+        });
+
+        size_t array_bytes = container.cardinality * sizeof(uint16_t);
+        size_t bitmap_bytes = BITMAP_WORDS * sizeof(uint64_t);
+        size_t run_bytes = sizeof(uint32_t) + runs.size() * 2 * sizeof(uint16_t);
+
+        put_le<uint64_t>(out, container.key);
+        if (run_bytes < array_bytes && run_bytes < bitmap_bytes) {
+            put_le<uint8_t>(out, RUNS);
+            put_le<uint32_t>(out, container.cardinality);
+            put_le<uint32_t>(out, static_cast<uint32_t>(runs.size()));
+            for (const auto& [start, length_minus_one] : runs) {
+                put_le<uint16_t>(out, start);
+                put_le<uint16_t>(out, length_minus_one);
+            }
+        } else if (container.words.empty()) {
+            put_le<uint8_t>(out, ARRAY);
+            put_le<uint32_t>(out, container.cardinality);
+            for (uint16_t low : container.array) {
+                put_le<uint16_t>(out, low);
+            }
+        } else {
+            put_le<uint8_t>(out, BITMAP);
+            put_le<uint32_t>(out, container.cardinality);
+            for (uint64_t word : container.words) {
+                put_le<uint64_t>(out, word);
+            }
+        }
+    }
+    return out;
+}
+
+std::optional<ChunkBitmap> ChunkBitmap::deserialize(std::span<const uint8_t> data) {
+    Reader reader(data);
+    uint8_t version;
+    uint32_t container_count;
+    if (!reader.get(version) || version != FORMAT_VERSION || !reader.get(container_count)) {
+        return std::nullopt;
+    }
+
+    ChunkBitmap bitmap;
+    for (uint32_t c = 0; c < container_count; ++c) {
+        Container container;
+        uint8_t kind;
+        if (!reader.get(container.key) || !reader.get(kind) || !reader.get(container.cardinality)) {
+            return std::nullopt;
+        }
+        if (!bitmap.containers_.empty() && bitmap.containers_.back().key >= container.key) {
+            return std::nullopt;
+        }
+
+        size_t values = 0;
+        if (kind == BITMAP) {
+            container.words.resize(BITMAP_WORDS);
+            for (auto& word : container.words) {
+                if (!reader.get(word)) {
+                    return std::nullopt;
+                }
+                values += std::popcount(word);
+            }
+        } else if (kind == ARRAY) {
+            if (container.cardinality > ARRAY_MAX) {
+                return std::nullopt;
+            }
+            container.array.resize(container.cardinality);
+            for (size_t i = 0; i < container.array.size(); ++i) {
+                if (!reader.get(container.array[i]) || (i > 0 && container.array[i] <= container.array[i - 1])) {
+                    return std::nullopt;
+                }
+            }
+            values = container.array.size();
+        } else if (kind == RUNS) {
+            uint32_t run_count;
+            if (!reader.get(run_count) || run_count > CONTAINER_SIZE) {
+                return std::nullopt;
+            }
+            container.words.assign(BITMAP_WORDS, 0);
+            for (uint32_t r = 0; r < run_count; ++r) {
+                uint16_t start, length_minus_one;
+                if (!reader.get(start) || !reader.get(length_minus_one) ||
+                    size_t{start} + length_minus_one >= CONTAINER_SIZE) {
+                    return std::nullopt;
+                }
+                for (size_t low = start; low <= size_t{start} + length_minus_one; ++low) {
+                    container.words[low / 64] |= uint64_t{1} << (low % 64);
+                }
+            }
+            for (uint64_t word : container.words) {
+                values += std::popcount(word);
+            }
+        } else {
+            return std::nullopt;
+        }
+
+        if (values != container.cardinality || values == 0) {
+            return std::nullopt;
+        }
+        if (!container.words.empty() && values <= ARRAY_MAX) {
+            container.to_array();
+        }
+
+        bitmap.cardinality_ += values;
+        bitmap.containers_.push_back(std::move(container));
+    }
+
+    if (!reader.at_end()) {
+        return std::nullopt;
+    }
+    return bitmap;
+}
+
+bool ChunkBitmap::operator==(const ChunkBitmap& other) const {
+    if (cardinality_ != other.cardinality_ || containers_.size() != other.containers_.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < containers_.size(); ++i) {
+        const auto& a = containers_[i];
+        const auto& b = other.containers_[i];
+        // Both sides normalize the same way, so equal sets share a representation
+        if (a.key != b.key || a.array != b.array || a.words != b.words) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace hypershare::storage
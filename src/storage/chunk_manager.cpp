@@ -1,16 +1,198 @@
 #include "hypershare/storage/chunk_manager.hpp"
+#include "hypershare/storage/parallel_hasher.hpp"
+#include "hypershare/storage/file_index.hpp"
 #include "hypershare/crypto/hash.hpp"
+#include <algorithm>
 #include <fstream>
 #include <sstream>
 #include <iomanip>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
 
 namespace hypershare::storage {
 
-ChunkManager::ChunkManager(size_t chunk_size) : chunk_size_(chunk_size) {
+namespace {
+    bool write_fully(int fd, const uint8_t* data, size_t size, uint64_t offset) {
+        while (size > 0) {
+            ssize_t written = ::pwrite(fd, data, size, static_cast<off_t>(offset));
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            data += written;
+            size -= static_cast<size_t>(written);
+            offset += static_cast<uint64_t>(written);
+        }
+        return true;
+    }
+    
+    bool read_fully(int fd, uint8_t* data, size_t size, uint64_t offset) {
+        while (size > 0) {
+            ssize_t bytes_read = ::pread(fd, data, size, static_cast<off_t>(offset));
+            if (bytes_read < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            if (bytes_read == 0) {
+                return false; // Unexpected end of file
+            }
+            data += bytes_read;
+            size -= static_cast<size_t>(bytes_read);
+            offset += static_cast<uint64_t>(bytes_read);
+        }
+        return true;
+    }
+    
+    bool preallocate(int fd, uint64_t size) {
+        if (size == 0) {
+            return true;
+        }
+#ifdef __linux__
+        if (::fallocate(fd, 0, 0, static_cast<off_t>(size)) == 0) {
+            return true;
+        }
+        if (errno != EOPNOTSUPP && errno != ENOSYS) {
+            return false;
+        }
+#endif
+        // Filesystem cannot reserve blocks up front, fall back to a sparse file
+        return ::ftruncate(fd, static_cast<off_t>(size)) == 0;
+    }
+    
+    void sync_directory(const std::filesystem::path& dir) {
+        int dir_fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dir_fd >= 0) {
+            ::fsync(dir_fd);
+            ::close(dir_fd);
+        }
+    }
+    
+    // Copies whole files into one output without pulling the data through user
+    // space where the kernel allows it. Reflinks share extents on btrfs and xfs
+    // and need block-aligned offsets; copy_file_range copies inside the kernel.
+    // A method that fails is not tried again for the rest of the output.
+    class RangeCopier {
+    public:
+        static constexpr size_t BUFFER_SIZE = 1024 * 1024;
+        
+        bool copy(int in_fd, int out_fd, uint64_t out_offset, uint64_t length) {
+            uint64_t copied = 0;
+#if defined(__linux__) && defined(FICLONERANGE)
+            if (try_clone_) {
+                file_clone_range range{};
+                range.src_fd = in_fd;
+                range.src_length = length;
+                range.dest_offset = out_offset;
+                if (::ioctl(out_fd, FICLONERANGE, &range) == 0) {
+                    return true;
+                }
+                try_clone_ = false;
+            }
+            
+            while (try_copy_range_ && copied < length) {
+                loff_t in_position = static_cast<loff_t>(copied);
+                loff_t out_position = static_cast<loff_t>(out_offset + copied);
+                ssize_t result = ::copy_file_range(in_fd, &in_position, out_fd, &out_position,
+                                                   static_cast<size_t>(length - copied), 0);
+                if (result < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (result <= 0) {
+                    // Unsupported here; whatever is left goes through the buffer
+                    try_copy_range_ = false;
+                    break;
+                }
+                copied += static_cast<uint64_t>(result);
+            }
+#endif
+            if (copied < length && buffer_.empty()) {
+                buffer_.resize(BUFFER_SIZE);
+            }
+            while (copied < length) {
+                size_t size = static_cast<size_t>(std::min<uint64_t>(buffer_.size(), length - copied));
+                if (!read_fully(in_fd, buffer_.data(), size, copied) ||
+                    !write_fully(out_fd, buffer_.data(), size, out_offset + copied)) {
+                    return false;
+                }
+                copied += size;
+            }
+            return true;
+        }
+        
+    private:
+        bool try_clone_ = true;
+        bool try_copy_range_ = true;
+        std::vector<uint8_t> buffer_;
+    };
+    
+    void copy_chunk_layout(const FileMetadata& source, FileMetadata& metadata) {
+        metadata.file_size = source.file_size;
+        metadata.chunk_count = source.chunk_count;
+        metadata.chunk_hashes = source.chunk_hashes;
+        metadata.file_hash = source.file_hash;
+        metadata.file_hash_scheme = source.file_hash_scheme;
+        metadata.chunking_mode = source.chunking_mode;
+        metadata.chunk_size = source.chunk_size;
+        metadata.cdc_min_size = source.cdc_min_size;
+        metadata.cdc_avg_size = source.cdc_avg_size;
+        metadata.chunk_offsets = source.chunk_offsets;
+    }
+}
+
+ChunkManager::ChunkManager(size_t chunk_size)
+    : chunk_size_(chunk_size)
+    , mapped_files_(std::make_shared<MappedFileCache>()) {
 }
 
 ChunkManager::ChunkManager(const StorageConfig& config) 
-    : chunk_size_(config.default_chunk_size), config_(config) {
+    : chunk_size_(config.default_chunk_size)
+    , config_(config)
+    , mapped_files_(std::make_shared<MappedFileCache>()) {
+    if (config.direct_io) {
+        // One buffer holds the requested chunk plus the read-ahead
+        direct_buffers_ = std::make_unique<AlignedBufferPool>(
+            AlignedBufferPool::align_up(config.default_chunk_size) * (config.read_ahead_chunks + 1));
+    }
+}
+
+ChunkManager::~ChunkManager() {
+    if (accountant_) {
+        accountant_->set_evictor(StorageArea::INCOMPLETE, nullptr);
+    }
+    
+    std::lock_guard<std::mutex> lock(partial_files_mutex_);
+    write_back_.clear();
+    for (const auto& [file_hash, fd] : direct_partial_files_) {
+        ::close(fd);
+    }
+    direct_partial_files_.clear();
+    for (const auto& [file_hash, fd] : partial_files_) {
+        ::close(fd);
+    }
+    partial_files_.clear();
+}
+
+void ChunkManager::set_storage_accountant(std::shared_ptr<StorageAccountant> accountant) {
+    if (accountant_) {
+        accountant_->set_evictor(StorageArea::INCOMPLETE, nullptr);
+    }
+    accountant_ = std::move(accountant);
+    if (accountant_) {
+        accountant_->set_evictor(StorageArea::INCOMPLETE, [this](const std::string& file_hash) {
+            discard_download(file_hash);
+            if (eviction_handler_) {
+                eviction_handler_(file_hash);
+            }
+            return true;
+        });
+    }
 }
 
 std::vector<std::vector<uint8_t>> ChunkManager::split_file(const std::filesystem::path& file_path) {
@@ -35,15 +217,14 @@ std::vector<std::vector<uint8_t>> ChunkManager::split_file(const std::filesystem
     return chunks;
 }
 
-std::vector<std::string> ChunkManager::get_chunk_hashes(const std::filesystem::path& file_path) {
-    std::vector<std::string> hashes;
-    auto chunks = split_file(file_path);
+std::vector<hypershare::crypto::Blake3Hash> ChunkManager::get_chunk_hashes(const std::filesystem::path& file_path) {
+    ParallelHasher::Result result;
     
-    for (const auto& chunk : chunks) {
-        hashes.push_back(compute_chunk_hash(chunk));
+    if (!hash_file_chunks(file_path, result)) {
+        return {};
     }
     
-    return hashes;
+    return std::move(result.chunk_hashes);
 }
 
 hypershare::crypto::CryptoResult ChunkManager::chunk_file(const std::string& file_path, FileMetadata& metadata) {
@@ -58,33 +239,58 @@ hypershare::crypto::CryptoResult ChunkManager::chunk_file(const std::string& fil
     }
     
     try {
-        // Get file size
-        auto file_size = std::filesystem::file_size(path);
-        
-        // Get chunk hashes
-        auto chunk_hashes = get_chunk_hashes(path);
+        // A file unchanged since it was last hashed is not read again
+        auto stamp = hash_cache_ ? FileStamp::of(path) : std::nullopt;
+        if (stamp) {
+            auto cached = hash_cache_->lookup(*stamp);
+            if (cached && matches_chunking(*cached)) {
+                copy_chunk_layout(*cached, metadata);
+                metadata.file_path = file_path;
+                metadata.filename = path.filename().string();
+                metadata.created_at = std::chrono::system_clock::now();
+                metadata.modified_at = std::chrono::system_clock::now();
+                return hypershare::crypto::CryptoResult(hypershare::crypto::CryptoError::SUCCESS);
+            }
+        }
+        auto hashed_at = std::chrono::system_clock::now();
         
-        // Calculate file hash
-        hypershare::crypto::Blake3Hash file_hash_raw;
-        auto hash_result = hypershare::crypto::Blake3Hasher::hash_file(path, file_hash_raw);
+        // Chunk hashes and the file hash come from a single, pipelined pass over the file
+        ParallelHasher::Result hashed;
+        auto hash_result = hash_file_chunks(path, hashed);
         if (!hash_result) {
-            return hypershare::crypto::CryptoResult(
-                hypershare::crypto::CryptoError::FILE_READ_ERROR,
-                "Failed to hash file: " + file_path
-            );
+            return hash_result;
         }
         
         // Fill metadata
         metadata.file_path = file_path;
         metadata.filename = path.filename().string();
-        metadata.file_size = file_size;
-        metadata.chunk_size = chunk_size_;
-        metadata.chunk_count = static_cast<uint32_t>(chunk_hashes.size());
-        metadata.chunk_hashes = std::move(chunk_hashes);
-        metadata.file_hash = hypershare::crypto::hash_utils::hash_to_hex(file_hash_raw);
+        metadata.file_size = hashed.bytes_hashed;
+        metadata.chunk_count = static_cast<uint32_t>(hashed.chunk_hashes.size());
+        metadata.chunk_hashes = std::move(hashed.chunk_hashes);
+        metadata.file_hash = hypershare::crypto::hash_utils::hash_to_hex(hashed.root);
+        metadata.file_hash_scheme = FileHashScheme::CHUNK_TREE;
+        
+        if (auto chunker = content_chunker()) {
+            metadata.chunking_mode = ChunkingMode::CONTENT_DEFINED;
+            metadata.chunk_size = chunker->max_size();
+            metadata.cdc_min_size = chunker->min_size();
+            metadata.cdc_avg_size = chunker->avg_size();
+            metadata.chunk_offsets = std::move(hashed.chunk_offsets);
+        } else {
+            metadata.chunking_mode = ChunkingMode::FIXED;
+            metadata.chunk_size = chunk_size_;
+            metadata.cdc_min_size = 0;
+            metadata.cdc_avg_size = 0;
+            metadata.chunk_offsets.clear();
+        }
         metadata.created_at = std::chrono::system_clock::now();
         metadata.modified_at = std::chrono::system_clock::now();
         
+        // Only cache hashes of a file that did not change while it was read
+        if (stamp && FileStamp::of(path) == stamp) {
+            hash_cache_->store(*stamp, metadata, hashed_at);
+        }
+        
         return hypershare::crypto::CryptoResult(hypershare::crypto::CryptoError::SUCCESS);
         
     } catch (const std::exception& e) {
@@ -105,6 +311,43 @@ hypershare::crypto::CryptoResult ChunkManager::write_chunk(const FileMetadata& m
         );
     }
     
+    if (accountant_) {
+        accountant_->touch(metadata.file_hash);
+    }
+    
+    if (config_->preallocate_downloads) {
+        if (chunk_index >= metadata.chunk_count) {
+            return hypershare::crypto::CryptoResult(
+                hypershare::crypto::CryptoError::INVALID_STATE,
+                "Chunk index out of range"
+            );
+        }
+        
+        // Any other size would spill into the next chunk or past the end of the target
+        if (chunk_data.size() != metadata.get_chunk_size(chunk_index)) {
+            return hypershare::crypto::CryptoResult(
+                hypershare::crypto::CryptoError::INVALID_STATE,
+                "Chunk " + std::to_string(chunk_index) + " has the wrong size"
+            );
+        }
+        
+        int fd = get_partial_fd(metadata, true);
+        if (fd < 0) {
+            return hypershare::crypto::CryptoResult(
+                hypershare::crypto::CryptoError::FILE_WRITE_ERROR,
+                "Failed to open download target: " + std::string(std::strerror(errno))
+            );
+        }
+        
+        return write_to_target(metadata.file_hash, *get_write_back(metadata, fd), chunk_index,
+                               get_chunk_offset(metadata, chunk_index), chunk_data);
+    }
+    
+    if (uses_chunk_store() && chunk_index < metadata.chunk_hashes.size()) {
+        return chunk_store_->put(metadata.chunk_hash_hex(chunk_index), chunk_data,
+                                 metadata.file_hash, chunk_index);
+    }
+    
     // Use incomplete directory for storing chunks
     auto base_path = config_->get_incomplete_path(metadata.file_hash);
     
@@ -129,6 +372,78 @@ hypershare::crypto::CryptoResult ChunkManager::read_chunk(const FileMetadata& me
         );
     }
     
+    if (chunk_index >= metadata.chunk_count) {
+        return hypershare::crypto::CryptoResult(
+            hypershare::crypto::CryptoError::INVALID_STATE,
+            "Chunk index out of range"
+        );
+    }
+    
+    if (config_->preallocate_downloads) {
+        // A shared file is read where it is shared, even while a download of
+        // the same hash is in progress
+        if (!metadata.file_path.empty() && uses_direct_io(metadata)) {
+            if (auto reader = get_direct_reader(metadata)) {
+                chunk_data.resize(metadata.get_chunk_size(chunk_index));
+                if (reader->read(get_chunk_offset(metadata, chunk_index), chunk_data)) {
+                    return hypershare::crypto::CryptoResult(hypershare::crypto::CryptoError::SUCCESS);
+                }
+                chunk_data.clear();
+                return hypershare::crypto::CryptoResult(
+                    hypershare::crypto::CryptoError::FILE_READ_ERROR,
+                    "Failed to read chunk " + std::to_string(chunk_index) + ": " + std::strerror(errno)
+                );
+            }
+        }
+        
+        int source_fd = -1;
+        if (!metadata.file_path.empty()) {
+            source_fd = ::open(metadata.file_path.c_str(), O_RDONLY | O_CLOEXEC);
+        }
+        
+        // Otherwise the download target, which holds zeros wherever no chunk
+        // has been written yet
+        int fd = source_fd;
+        if (fd < 0) {
+            fd = get_partial_fd(metadata, false);
+            if (fd >= 0 && !has_written_chunk(metadata.file_hash, chunk_index)) {
+                return hypershare::crypto::CryptoResult(
+                    hypershare::crypto::CryptoError::FILE_NOT_FOUND,
+                    "Chunk " + std::to_string(chunk_index) + " has not been downloaded"
+                );
+            }
+            if (fd >= 0 && !flush_write_back(metadata.file_hash)) {
+                return hypershare::crypto::CryptoResult(
+                    hypershare::crypto::CryptoError::FILE_WRITE_ERROR,
+                    "Failed to write buffered chunks: " + std::string(std::strerror(errno))
+                );
+            }
+        }
+        
+        if (fd >= 0) {
+            chunk_data.resize(metadata.get_chunk_size(chunk_index));
+            bool success = read_fully(fd, chunk_data.data(), chunk_data.size(),
+                                      get_chunk_offset(metadata, chunk_index));
+            if (source_fd >= 0) {
+                ::close(source_fd);
+            }
+            
+            if (success) {
+                return hypershare::crypto::CryptoResult(hypershare::crypto::CryptoError::SUCCESS);
+            }
+            chunk_data.clear();
+            return hypershare::crypto::CryptoResult(
+                hypershare::crypto::CryptoError::FILE_READ_ERROR,
+                "Failed to read chunk " + std::to_string(chunk_index)
+            );
+        }
+    }
+    
+    if (uses_chunk_store() && chunk_index < metadata.chunk_hashes.size() &&
+        chunk_store_->get(metadata.chunk_hash_hex(chunk_index), chunk_data)) {
+        return hypershare::crypto::CryptoResult(hypershare::crypto::CryptoError::SUCCESS);
+    }
+    
     // Try incomplete directory first
     auto incomplete_path = config_->get_incomplete_path(metadata.file_hash);
     chunk_data = read_chunk(incomplete_path.parent_path(), metadata.file_hash, chunk_index);
@@ -143,6 +458,455 @@ hypershare::crypto::CryptoResult ChunkManager::read_chunk(const FileMetadata& me
     }
 }
 
+void ChunkManager::set_immutable_roots(std::vector<std::filesystem::path> roots) {
+    immutable_roots_.clear();
+    for (const auto& root : roots) {
+        immutable_roots_.push_back(std::filesystem::absolute(root).lexically_normal());
+    }
+}
+
+std::optional<ChunkView> ChunkManager::read_chunk_view(const FileMetadata& metadata, size_t chunk_index) {
+    if (chunk_index >= metadata.chunk_count || metadata.file_path.empty()) {
+        return std::nullopt;
+    }
+    
+    uint64_t offset = get_chunk_offset(metadata, chunk_index);
+    uint64_t length = metadata.get_chunk_size(chunk_index);
+    
+    if (!is_below_immutable_root(metadata.file_path)) {
+        int fd = ::open(metadata.file_path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return std::nullopt;
+        }
+        auto copy = std::make_shared<std::vector<uint8_t>>(length);
+        bool success = read_fully(fd, copy->data(), copy->size(), offset);
+        ::close(fd);
+        if (!success) {
+            return std::nullopt; // File shrank since it was shared
+        }
+        std::span<const uint8_t> data(copy->data(), copy->size());
+        return ChunkView{data, std::move(copy)};
+    }
+    
+    if (!mapped_files_) {
+        return std::nullopt;
+    }
+    
+    auto mapping = mapped_files_->acquire(metadata.file_path);
+    if (!mapping) {
+        return std::nullopt;
+    }
+    
+    if (offset + length > mapping->size()) {
+        return std::nullopt; // File shrank since it was shared
+    }
+    
+    return ChunkView{mapping->data().subspan(offset, length), std::move(mapping)};
+}
+
+std::vector<hypershare::crypto::Blake3Hash> ChunkManager::get_chunk_proof(const FileMetadata& metadata,
+                                                                          size_t chunk_index) {
+    if (metadata.file_hash_scheme != FileHashScheme::CHUNK_TREE ||
+        chunk_index >= metadata.chunk_hashes.size()) {
+        return {};
+    }
+    
+    std::shared_ptr<const hash_tree::Tree> tree;
+    {
+        std::lock_guard<std::mutex> lock(hash_trees_mutex_);
+        auto it = hash_trees_.find(metadata.file_hash);
+        if (it != hash_trees_.end()) {
+            hash_tree_lru_.splice(hash_tree_lru_.begin(), hash_tree_lru_, it->second.lru_position);
+            tree = it->second.tree;
+        }
+    }
+    
+    if (!tree) {
+        tree = std::make_shared<const hash_tree::Tree>(metadata.chunk_hashes, metadata.file_size);
+        
+        std::lock_guard<std::mutex> lock(hash_trees_mutex_);
+        // Another thread may have built it meanwhile
+        if (hash_trees_.find(metadata.file_hash) == hash_trees_.end()) {
+            if (hash_trees_.size() >= MAX_CACHED_TREES) {
+                hash_trees_.erase(hash_tree_lru_.back());
+                hash_tree_lru_.pop_back();
+            }
+            hash_tree_lru_.push_front(metadata.file_hash);
+            hash_trees_[metadata.file_hash] = CachedTree{tree, hash_tree_lru_.begin()};
+        }
+    }
+    
+    return tree->proof(chunk_index);
+}
+
+void ChunkManager::async_read_chunk(const FileMetadata& metadata, size_t chunk_index, ReadHandler handler) {
+    bool use_engine = disk_engine_ && config_ && config_->preallocate_downloads &&
+                      chunk_index < metadata.chunk_count;
+    
+    // Same order as read_chunk: the shared file, then written chunks of the
+    // download target. Anything else, including O_DIRECT reads that need
+    // aligned buffers the engine does not use, goes through read_chunk.
+    int fd = -1;
+    std::shared_ptr<void> source_guard;
+    if (use_engine && !metadata.file_path.empty()) {
+        if (uses_direct_io(metadata)) {
+            use_engine = false;
+        } else if ((fd = ::open(metadata.file_path.c_str(), O_RDONLY | O_CLOEXEC)) >= 0) {
+            // Keep the shared file open until the read completes
+            source_guard = std::shared_ptr<void>(nullptr, [fd](void*) { ::close(fd); });
+        }
+    }
+    if (use_engine && fd < 0) {
+        fd = get_partial_fd(metadata, false);
+        if (fd < 0 || !has_written_chunk(metadata.file_hash, chunk_index)) {
+            use_engine = false;
+        } else if (!flush_write_back(metadata.file_hash)) {
+            handler(hypershare::crypto::CryptoResult(
+                hypershare::crypto::CryptoError::FILE_WRITE_ERROR,
+                "Failed to write buffered chunks: " + std::string(std::strerror(errno))
+            ), {});
+            return;
+        }
+    }
+    
+    if (!use_engine) {
+        std::vector<uint8_t> chunk_data;
+        auto result = read_chunk(metadata, chunk_index, chunk_data);
+        handler(result, std::move(chunk_data));
+        return;
+    }
+    
+    auto buffer = std::make_shared<std::vector<uint8_t>>(metadata.get_chunk_size(chunk_index));
+    disk_engine_->async_read(fd, get_chunk_offset(metadata, chunk_index), *buffer,
+        [buffer, source_guard, chunk_index, handler = std::move(handler)](const std::error_code& error, size_t bytes) {
+            if (error || bytes != buffer->size()) {
+                handler(hypershare::crypto::CryptoResult(
+                    hypershare::crypto::CryptoError::FILE_READ_ERROR,
+                    "Failed to read chunk " + std::to_string(chunk_index) +
+                    (error ? ": " + error.message() : std::string(": unexpected end of file"))
+                ), {});
+                return;
+            }
+            handler(hypershare::crypto::CryptoResult(hypershare::crypto::CryptoError::SUCCESS),
+                    std::move(*buffer));
+        });
+}
+
+void ChunkManager::async_write_chunk(const FileMetadata& metadata, size_t chunk_index,
+                                     std::vector<uint8_t> chunk_data, WriteHandler handler) {
+    if (!disk_engine_ || !config_ || !config_->preallocate_downloads ||
+        chunk_index >= metadata.chunk_count || chunk_data.size() != metadata.get_chunk_size(chunk_index)) {
+        // write_chunk reports the bad index or size
+        handler(write_chunk(metadata, chunk_index, chunk_data));
+        return;
+    }
+    
+    if (accountant_) {
+        accountant_->touch(metadata.file_hash);
+    }
+    
+    int fd = get_partial_fd(metadata, true);
+    if (fd < 0) {
+        handler(hypershare::crypto::CryptoResult(
+            hypershare::crypto::CryptoError::FILE_WRITE_ERROR,
+            "Failed to open download target: " + std::string(std::strerror(errno))
+        ));
+        return;
+    }
+    
+    auto write_back = get_write_back(metadata, fd);
+    auto buffer = std::make_shared<std::vector<uint8_t>>(std::move(chunk_data));
+    
+    // Buffering may flush and sync, so the write runs on the engine rather
+    // than blocking the io_context
+    if (!writes_through_engine(metadata)) {
+        auto result = std::make_shared<hypershare::crypto::CryptoResult>();
+        disk_engine_->async_run(
+            [this, write_back, buffer, result, chunk_index, file_hash = metadata.file_hash,
+             offset = get_chunk_offset(metadata, chunk_index)]() {
+                *result = write_to_target(file_hash, *write_back, chunk_index, offset, *buffer);
+                return 0;
+            },
+            [result, handler = std::move(handler)](const std::error_code&, size_t) {
+                handler(std::move(*result));
+            });
+        return;
+    }
+    
+    disk_engine_->async_write(fd, get_chunk_offset(metadata, chunk_index), *buffer,
+        [buffer, write_back, chunk_index, handler = std::move(handler)](const std::error_code& error, size_t bytes) {
+            if (error || bytes != buffer->size()) {
+                handler(hypershare::crypto::CryptoResult(
+                    hypershare::crypto::CryptoError::FILE_WRITE_ERROR,
+                    "Failed to write chunk " + std::to_string(chunk_index) +
+                    (error ? ": " + error.message() : std::string())
+                ));
+                return;
+            }
+            write_back->add_written(chunk_index, bytes);
+            handler(hypershare::crypto::CryptoResult(hypershare::crypto::CryptoError::SUCCESS));
+        });
+}
+
+hypershare::crypto::CryptoResult ChunkManager::prepare_download(const FileMetadata& metadata) {
+    if (!config_) {
+        return hypershare::crypto::CryptoResult(
+            hypershare::crypto::CryptoError::INVALID_STATE,
+            "ChunkManager not initialized with StorageConfig"
+        );
+    }
+    
+    // Offsets and sizes of every chunk are derived from it
+    if (metadata.chunk_size == 0) {
+        return hypershare::crypto::CryptoResult(
+            hypershare::crypto::CryptoError::INVALID_STATE,
+            "Download " + metadata.file_hash + " has no chunk size"
+        );
+    }
+    
+    // Refused up front rather than failing on a write halfway through
+    if (accountant_ && !accountant_->reserve(metadata.file_hash, metadata.file_size)) {
+        return hypershare::crypto::CryptoResult(
+            hypershare::crypto::CryptoError::FILE_WRITE_ERROR,
+            "Not enough storage for download " + metadata.file_hash
+        );
+    }
+    
+    if (get_partial_fd(metadata, true) < 0) {
+        int saved_errno = errno;
+        if (accountant_) {
+            accountant_->remove(StorageArea::INCOMPLETE, metadata.file_hash);
+            accountant_->unpin(metadata.file_hash);
+        }
+        return hypershare::crypto::CryptoResult(
+            hypershare::crypto::CryptoError::FILE_WRITE_ERROR,
+            "Failed to preallocate download target: " + std::string(std::strerror(saved_errno))
+        );
+    }
+    
+    return hypershare::crypto::CryptoResult(hypershare::crypto::CryptoError::SUCCESS);
+}
+
+hypershare::crypto::CryptoResult ChunkManager::finalize_download(const FileMetadata& metadata,
+                                                                  const std::filesystem::path& output_path) {
+    if (!config_) {
+        return hypershare::crypto::CryptoResult(
+            hypershare::crypto::CryptoError::INVALID_STATE,
+            "ChunkManager not initialized with StorageConfig"
+        );
+    }
+    
+    if (uses_chunk_store()) {
+        auto assembled = assemble_from_chunk_store(metadata);
+        if (!assembled) {
+            return assembled;
+        }
+    }
+    
+    auto partial_path = config_->get_partial_path(metadata.file_hash);
+    
+    int fd = get_partial_fd(metadata, false);
+    if (fd < 0) {
+        return hypershare::crypto::CryptoResult(
+            hypershare::crypto::CryptoError::FILE_NOT_FOUND,
+            "No download in progress for " + metadata.file_hash
+        );
+    }
+    
+    // Data must be durable before the rename makes the file visible
+    std::vector<size_t> durable;
+    bool synced = get_write_back(metadata, fd)->sync(durable) && ::fsync(fd) == 0;
+    int saved_errno = errno;
+    close_partial_fd(metadata.file_hash);
+    if (!synced) {
+        return hypershare::crypto::CryptoResult(
+            hypershare::crypto::CryptoError::FILE_WRITE_ERROR,
+            "Failed to sync download target: " + std::string(std::strerror(saved_errno))
+        );
+    }
+    report_durable(metadata.file_hash, durable);
+    
+    try {
+        if (output_path.has_parent_path()) {
+            std::filesystem::create_directories(output_path.parent_path());
+        }
+        
+        std::error_code ec;
+        std::filesystem::rename(partial_path, output_path, ec);
+        if (ec == std::errc::cross_device_link) {
+            // Different filesystems, rename cannot be atomic so copy then drop the target
+            std::filesystem::copy_file(partial_path, output_path,
+                                       std::filesystem::copy_options::overwrite_existing);
+            std::filesystem::remove(partial_path);
+        } else if (ec) {
+            return hypershare::crypto::CryptoResult(
+                hypershare::crypto::CryptoError::FILE_WRITE_ERROR,
+                "Failed to move completed download: " + ec.message()
+            );
+        }
+        
+        sync_directory(output_path.has_parent_path() ? output_path.parent_path()
+                                                     : std::filesystem::current_path());
+    } catch (const std::filesystem::filesystem_error& e) {
+        return hypershare::crypto::CryptoResult(
+            hypershare::crypto::CryptoError::FILE_WRITE_ERROR,
+            "Failed to move completed download: " + std::string(e.what())
+        );
+    }
+    
+    // The completed file is indexed from here on, so later downloads find its
+    // chunks through FileIndex and the store no longer needs to hold them
+    if (uses_chunk_store()) {
+        chunk_store_->release_file(metadata.file_hash);
+    }
+    
+    if (accountant_) {
+        accountant_->remove(StorageArea::INCOMPLETE, metadata.file_hash);
+        auto relative = output_path.lexically_relative(config_->download_directory);
+        if (!relative.empty() && *relative.begin() != "..") {
+            accountant_->charge(StorageArea::DOWNLOADS, metadata.file_size);
+        }
+        accountant_->unpin(metadata.file_hash);
+    }
+    
+    return hypershare::crypto::CryptoResult(hypershare::crypto::CryptoError::SUCCESS);
+}
+
+void ChunkManager::abort_download(const FileMetadata& metadata) {
+    discard_download(metadata.file_hash);
+    
+    if (accountant_) {
+        accountant_->unpin(metadata.file_hash);
+    }
+}
+
+void ChunkManager::discard_download(const std::string& file_hash) {
+    close_partial_fd(file_hash);
+    
+    if (config_) {
+        std::error_code ec;
+        std::filesystem::remove(config_->get_partial_path(file_hash), ec);
+        
+        // Per-chunk files of downloads without a preallocated target
+        auto chunk_directory = get_chunk_path(config_->get_incomplete_path(file_hash).parent_path(),
+                                              file_hash, 0).parent_path();
+        std::string prefix = file_hash + ".chunk.";
+        for (auto it = std::filesystem::directory_iterator(chunk_directory, ec);
+             !ec && it != std::filesystem::directory_iterator(); it.increment(ec)) {
+            if (it->path().filename().string().rfind(prefix, 0) == 0) {
+                std::error_code remove_ec;
+                std::filesystem::remove(it->path(), remove_ec);
+            }
+        }
+    }
+    
+    if (uses_chunk_store()) {
+        chunk_store_->release_file(file_hash);
+    }
+    
+    if (accountant_) {
+        accountant_->remove(StorageArea::INCOMPLETE, file_hash);
+    }
+}
+
+hypershare::crypto::CryptoResult ChunkManager::resume_download(const FileMetadata& metadata,
+                                                                const std::vector<size_t>& durable,
+                                                                std::vector<size_t>& restored) {
+    if (!config_ || !config_->preallocate_downloads) {
+        return hypershare::crypto::CryptoResult(
+            hypershare::crypto::CryptoError::INVALID_STATE,
+            "Only preallocated downloads are resumed from their target"
+        );
+    }
+    
+    int fd = get_partial_fd(metadata, false);
+    if (fd < 0) {
+        return hypershare::crypto::CryptoResult(
+            hypershare::crypto::CryptoError::FILE_NOT_FOUND,
+            "No download in progress for " + metadata.file_hash
+        );
+    }
+    
+    auto write_back = get_write_back(metadata, fd);
+    std::vector<uint8_t> chunk_data;
+    for (size_t chunk_index : durable) {
+        if (chunk_index >= metadata.chunk_count) {
+            continue;
+        }
+        
+        // The target may have been replaced or recreated since the state was saved
+        if (chunk_index < metadata.chunk_hashes.size()) {
+            chunk_data.resize(metadata.get_chunk_size(chunk_index));
+            if (!read_fully(fd, chunk_data.data(), chunk_data.size(), get_chunk_offset(metadata, chunk_index)) ||
+                !verify_chunk_hash(chunk_data, metadata.chunk_hashes[chunk_index])) {
+                continue;
+            }
+        }
+        
+        write_back->add_durable(chunk_index);
+        restored.push_back(chunk_index);
+    }
+    
+    return hypershare::crypto::CryptoResult(hypershare::crypto::CryptoError::SUCCESS);
+}
+
+hypershare::crypto::CryptoResult ChunkManager::import_local_chunks(const FileMetadata& metadata,
+                                                                    FileIndex& index,
+                                                                    std::vector<size_t>& imported) {
+    if (!config_) {
+        return hypershare::crypto::CryptoResult(
+            hypershare::crypto::CryptoError::INVALID_STATE,
+            "ChunkManager not initialized with StorageConfig"
+        );
+    }
+    
+    std::vector<uint8_t> chunk_data;
+    size_t chunk_total = std::min<size_t>(metadata.chunk_count, metadata.chunk_hashes.size());
+    
+    for (size_t i = 0; i < chunk_total; ++i) {
+        const auto& chunk_hash = metadata.chunk_hashes[i];
+        
+        if (config_->preallocate_downloads && has_written_chunk(metadata.file_hash, i)) {
+            continue;
+        }
+        
+        // Already stored for another file, a new reference is all it takes
+        if (uses_chunk_store() && chunk_store_->add_ref(metadata.chunk_hash_hex(i), metadata.file_hash, i)) {
+            imported.push_back(i);
+            continue;
+        }
+        
+        for (const auto& location : index.find_chunk_locations(chunk_hash)) {
+            if (location.file_hash == metadata.file_hash) {
+                continue;
+            }
+            
+            auto source = index.get_file_shared(location.file_hash);
+            if (!source) {
+                continue;
+            }
+            
+            auto view = read_chunk_view(*source, location.chunk_index);
+            if (!view) {
+                continue;
+            }
+            
+            // The source may have been modified since it was indexed
+            chunk_data.assign(view->data.begin(), view->data.end());
+            if (!verify_chunk_hash(chunk_data, chunk_hash)) {
+                continue;
+            }
+            
+            if (write_chunk(metadata, i, chunk_data)) {
+                imported.push_back(i);
+                break;
+            }
+        }
+    }
+    
+    return hypershare::crypto::CryptoResult(hypershare::crypto::CryptoError::SUCCESS);
+}
+
 bool ChunkManager::write_chunk(const std::filesystem::path& base_path,
                                const std::string& file_hash,
                                size_t chunk_index,
@@ -186,24 +950,34 @@ bool ChunkManager::merge_chunks(const std::filesystem::path& base_path,
                                 const std::string& file_hash,
                                 const std::filesystem::path& output_path,
                                 size_t total_chunks) {
-    std::ofstream output_file(output_path, std::ios::binary);
-    if (!output_file.is_open()) {
+    int output_fd = ::open(output_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (output_fd < 0) {
         return false;
     }
     
-    for (size_t i = 0; i < total_chunks; ++i) {
-        auto chunk_data = read_chunk(base_path, file_hash, i);
-        if (chunk_data.empty()) {
-            return false;
+    RangeCopier copier;
+    uint64_t output_offset = 0;
+    bool merged = true;
+    for (size_t i = 0; i < total_chunks && merged; ++i) {
+        int chunk_fd = ::open(get_chunk_path(base_path, file_hash, i).c_str(), O_RDONLY | O_CLOEXEC);
+        if (chunk_fd < 0) {
+            merged = false;
+            break;
         }
         
-        output_file.write(reinterpret_cast<const char*>(chunk_data.data()), chunk_data.size());
-        if (!output_file.good()) {
-            return false;
+        struct stat st;
+        merged = ::fstat(chunk_fd, &st) == 0 && st.st_size > 0 &&
+                 copier.copy(chunk_fd, output_fd, output_offset, static_cast<uint64_t>(st.st_size));
+        if (merged) {
+            output_offset += static_cast<uint64_t>(st.st_size);
         }
+        ::close(chunk_fd);
     }
     
-    return true;
+    if (::close(output_fd) != 0) {
+        merged = false;
+    }
+    return merged;
 }
 
 bool ChunkManager::verify_chunk(const std::vector<uint8_t>& chunk_data,
@@ -216,6 +990,11 @@ bool ChunkManager::verify_chunk_hash(const std::vector<uint8_t>& chunk_data,
     return verify_chunk(chunk_data, expected_hash);
 }
 
+bool ChunkManager::verify_chunk_hash(const std::vector<uint8_t>& chunk_data,
+                                     const hypershare::crypto::Blake3Hash& expected_hash) {
+    return hypershare::crypto::Blake3Hasher::hash(chunk_data) == expected_hash;
+}
+
 std::filesystem::path ChunkManager::get_chunk_path(const std::filesystem::path& base_path,
                                                    const std::string& file_hash,
                                                    size_t chunk_index) {
@@ -228,6 +1007,257 @@ std::filesystem::path ChunkManager::get_chunk_path(const std::filesystem::path&
     return base_path / subdir / filename.str();
 }
 
+int ChunkManager::get_partial_fd(const FileMetadata& metadata, bool create) {
+    std::lock_guard<std::mutex> lock(partial_files_mutex_);
+    
+    auto it = partial_files_.find(metadata.file_hash);
+    if (it != partial_files_.end()) {
+        return it->second;
+    }
+    
+    auto partial_path = config_->get_partial_path(metadata.file_hash);
+    if (!create && !std::filesystem::exists(partial_path)) {
+        errno = ENOENT;
+        return -1;
+    }
+    
+    std::error_code ec;
+    std::filesystem::create_directories(partial_path.parent_path(), ec);
+    
+    int flags = O_RDWR | O_CLOEXEC | (create ? O_CREAT : 0);
+    int fd = ::open(partial_path.c_str(), flags, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    
+    // Reserve the full size once so chunk writes never extend the file
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && static_cast<uint64_t>(st.st_size) < metadata.file_size) {
+        if (!preallocate(fd, metadata.file_size)) {
+            int saved_errno = errno;
+            ::close(fd);
+            errno = saved_errno;
+            return -1;
+        }
+    }
+    
+    partial_files_[metadata.file_hash] = fd;
+    return fd;
+}
+
+void ChunkManager::close_partial_fd(const std::string& file_hash) {
+    std::lock_guard<std::mutex> lock(partial_files_mutex_);
+    
+    write_back_.erase(file_hash);
+    auto direct = direct_partial_files_.find(file_hash);
+    if (direct != direct_partial_files_.end()) {
+        ::close(direct->second);
+        direct_partial_files_.erase(direct);
+    }
+    auto it = partial_files_.find(file_hash);
+    if (it != partial_files_.end()) {
+        ::close(it->second);
+        partial_files_.erase(it);
+    }
+}
+
+std::shared_ptr<WriteBackBuffer> ChunkManager::get_write_back(const FileMetadata& metadata, int fd) {
+    std::lock_guard<std::mutex> lock(partial_files_mutex_);
+    
+    auto& write_back = write_back_[metadata.file_hash];
+    if (!write_back) {
+        write_back = std::make_shared<WriteBackBuffer>(fd, config_->durability, config_->write_back_bytes,
+                                                       config_->sync_interval_bytes);
+        
+        // Filesystems without O_DIRECT support keep using the page cache
+        int direct_fd = uses_direct_io(metadata)
+                        ? open_direct_for_write(config_->get_partial_path(metadata.file_hash)) : -1;
+        if (direct_fd >= 0) {
+            direct_partial_files_[metadata.file_hash] = direct_fd;
+            write_back->set_direct(direct_fd, direct_buffers_.get());
+        }
+    }
+    return write_back;
+}
+
+bool ChunkManager::has_written_chunk(const std::string& file_hash, size_t chunk_index) {
+    std::lock_guard<std::mutex> lock(partial_files_mutex_);
+    auto it = write_back_.find(file_hash);
+    return it != write_back_.end() && it->second->contains(chunk_index);
+}
+
+bool ChunkManager::flush_write_back(const std::string& file_hash) {
+    std::shared_ptr<WriteBackBuffer> write_back;
+    {
+        std::lock_guard<std::mutex> lock(partial_files_mutex_);
+        auto it = write_back_.find(file_hash);
+        if (it == write_back_.end()) {
+            return true;
+        }
+        write_back = it->second;
+    }
+    
+    std::vector<size_t> durable;
+    bool flushed = write_back->flush(durable);
+    int saved_errno = errno;
+    report_durable(file_hash, durable);
+    errno = saved_errno;
+    return flushed;
+}
+
+hypershare::crypto::CryptoResult ChunkManager::write_to_target(const std::string& file_hash,
+                                                                WriteBackBuffer& write_back,
+                                                                size_t chunk_index, uint64_t offset,
+                                                                const std::vector<uint8_t>& chunk_data) {
+    std::vector<size_t> durable;
+    bool written = write_back.write(chunk_index, offset, chunk_data, durable);
+    int saved_errno = errno;
+    report_durable(file_hash, durable);
+    if (!written) {
+        return hypershare::crypto::CryptoResult(
+            hypershare::crypto::CryptoError::FILE_WRITE_ERROR,
+            "Failed to write chunk " + std::to_string(chunk_index) + ": " + std::strerror(saved_errno)
+        );
+    }
+    
+    return hypershare::crypto::CryptoResult(hypershare::crypto::CryptoError::SUCCESS);
+}
+
+void ChunkManager::report_durable(const std::string& file_hash, const std::vector<size_t>& chunks) {
+    if (durable_handler_ && !chunks.empty()) {
+        durable_handler_(file_hash, chunks);
+    }
+}
+
+bool ChunkManager::writes_through_engine(const FileMetadata& metadata) const {
+    return config_->write_back_bytes == 0 && config_->durability == DurabilityPolicy::ON_COMPLETION &&
+           !uses_direct_io(metadata);
+}
+
+bool ChunkManager::uses_direct_io(const FileMetadata& metadata) const {
+    return direct_buffers_ && metadata.file_size >= config_->direct_io_threshold;
+}
+
+std::shared_ptr<DirectFileReader> ChunkManager::get_direct_reader(const FileMetadata& metadata) {
+    std::lock_guard<std::mutex> lock(direct_readers_mutex_);
+    
+    auto it = direct_readers_.find(metadata.file_path);
+    if (it != direct_readers_.end()) {
+        // A file replaced or resized since the reader was opened is opened again
+        if (it->second.reader->file_size() == metadata.file_size) {
+            direct_reader_lru_.splice(direct_reader_lru_.begin(), direct_reader_lru_, it->second.lru_position);
+            return it->second.reader;
+        }
+        direct_reader_lru_.erase(it->second.lru_position);
+        direct_readers_.erase(it);
+    }
+    
+    std::shared_ptr<DirectFileReader> reader = DirectFileReader::open(metadata.file_path, *direct_buffers_);
+    if (!reader) {
+        return nullptr;
+    }
+    
+    if (direct_readers_.size() >= MAX_DIRECT_READERS) {
+        direct_readers_.erase(direct_reader_lru_.back());
+        direct_reader_lru_.pop_back();
+    }
+    direct_reader_lru_.push_front(metadata.file_path);
+    direct_readers_[metadata.file_path] = CachedReader{reader, direct_reader_lru_.begin()};
+    return reader;
+}
+
+bool ChunkManager::uses_chunk_store() const {
+    return chunk_store_ && config_ && config_->enable_deduplication && !config_->preallocate_downloads;
+}
+
+hypershare::crypto::CryptoResult ChunkManager::assemble_from_chunk_store(const FileMetadata& metadata) {
+    if (metadata.chunk_hashes.size() < metadata.chunk_count) {
+        return hypershare::crypto::CryptoResult(
+            hypershare::crypto::CryptoError::INVALID_STATE,
+            "Metadata is missing chunk hashes"
+        );
+    }
+    
+    int fd = get_partial_fd(metadata, true);
+    if (fd < 0) {
+        return hypershare::crypto::CryptoResult(
+            hypershare::crypto::CryptoError::FILE_WRITE_ERROR,
+            "Failed to open download target: " + std::string(std::strerror(errno))
+        );
+    }
+    
+    std::vector<uint8_t> chunk_data;
+    for (size_t i = 0; i < metadata.chunk_count; ++i) {
+        auto result = chunk_store_->get(metadata.chunk_hash_hex(i), chunk_data);
+        if (!result) {
+            return result;
+        }
+        
+        if (chunk_data.size() != metadata.get_chunk_size(i) ||
+            !write_fully(fd, chunk_data.data(), chunk_data.size(), get_chunk_offset(metadata, i))) {
+            return hypershare::crypto::CryptoResult(
+                hypershare::crypto::CryptoError::FILE_WRITE_ERROR,
+                "Failed to assemble chunk " + std::to_string(i)
+            );
+        }
+    }
+    
+    return hypershare::crypto::CryptoResult(hypershare::crypto::CryptoError::SUCCESS);
+}
+
+uint64_t ChunkManager::get_chunk_offset(const FileMetadata& metadata, size_t chunk_index) const {
+    return metadata.get_chunk_offset(chunk_index);
+}
+
+bool ChunkManager::is_below_immutable_root(const std::filesystem::path& path) const {
+    if (immutable_roots_.empty()) {
+        return false;
+    }
+    
+    auto normalized = std::filesystem::absolute(path).lexically_normal();
+    for (const auto& root : immutable_roots_) {
+        auto relative = normalized.lexically_relative(root);
+        if (!relative.empty() && *relative.begin() != "..") {
+            return true;
+        }
+    }
+    return false;
+}
+
+hypershare::crypto::CryptoResult ChunkManager::hash_file_chunks(const std::filesystem::path& file_path,
+                                                                 ParallelHasher::Result& result) {
+    size_t threads = 0;
+    if (config_) {
+        threads = config_->parallel_hashing ? config_->hash_threads : 1;
+    }
+    
+    if (auto chunker = content_chunker()) {
+        return ParallelHasher(*chunker, threads).hash_file(file_path, result);
+    }
+    return ParallelHasher(chunk_size_, threads).hash_file(file_path, result);
+}
+
+std::optional<ContentChunker> ChunkManager::content_chunker() const {
+    if (!config_ || config_->chunking_mode != ChunkingMode::CONTENT_DEFINED) {
+        return std::nullopt;
+    }
+    return ContentChunker(config_->cdc_min_chunk_size, config_->cdc_avg_chunk_size, config_->cdc_max_chunk_size);
+}
+
+bool ChunkManager::matches_chunking(const FileMetadata& metadata) const {
+    if (metadata.file_hash_scheme != FileHashScheme::CHUNK_TREE) {
+        return false;
+    }
+    
+    if (auto chunker = content_chunker()) {
+        return metadata.is_content_defined() &&
+               metadata.chunk_size == chunker->max_size() &&
+               metadata.cdc_min_size == chunker->min_size() &&
+               metadata.cdc_avg_size == chunker->avg_size();
+    }
+    return !metadata.is_content_defined() && metadata.chunk_size == chunk_size_;
+}
+
 std::string ChunkManager::compute_chunk_hash(const std::vector<uint8_t>& chunk_data) {
     std::span<const uint8_t> data_span(chunk_data.data(), chunk_data.size());
     auto hash = hypershare::crypto::Blake3Hasher::hash(data_span);
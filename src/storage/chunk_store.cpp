@@ -0,0 +1,511 @@
+#include "hypershare/storage/chunk_store.hpp"
+#include "hypershare/storage/compression.hpp"
+#include "hypershare/crypto/hash.hpp"
+#include <sqlite3.h>
+#include <chrono>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace hypershare::storage {
+
+namespace {
+    bool exec(sqlite3* db, const char* sql) {
+        char* error_msg = nullptr;
+        int result = sqlite3_exec(db, sql, nullptr, nullptr, &error_msg);
+        if (result != SQLITE_OK) {
+            sqlite3_free(error_msg);
+            return false;
+        }
+        return true;
+    }
+
+    bool read_file(const std::filesystem::path& path, std::vector<uint8_t>& data) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+
+        std::error_code ec;
+        auto size = std::filesystem::file_size(path, ec);
+        data.resize(ec ? 0 : static_cast<size_t>(size));
+
+        size_t total = 0;
+        while (total < data.size()) {
+            ssize_t bytes_read = ::read(fd, data.data() + total, data.size() - total);
+            if (bytes_read < 0 && errno == EINTR) {
+                continue;
+            }
+            if (bytes_read <= 0) {
+                break;
+            }
+            total += static_cast<size_t>(bytes_read);
+        }
+        ::close(fd);
+
+        return !ec && total == data.size();
+    }
+}
+
+ChunkStore::ChunkStore(const std::filesystem::path& store_directory, const std::filesystem::path& db_path,
+                       bool compress_chunks)
+    : store_directory_(store_directory)
+    , db_path_(db_path)
+    , db_(nullptr)
+    , compress_chunks_(compress_chunks) {
+}
+
+ChunkStore::~ChunkStore() {
+    if (accountant_) {
+        accountant_->set_evictor(StorageArea::CHUNK_STORE, nullptr);
+    }
+    if (db_) {
+        sqlite3_close(db_);
+    }
+}
+
+bool ChunkStore::initialize() {
+    std::error_code ec;
+    std::filesystem::create_directories(store_directory_, ec);
+    if (ec) {
+        return false;
+    }
+
+    int result = sqlite3_open(db_path_.string().c_str(), &db_);
+    if (result != SQLITE_OK) {
+        return false;
+    }
+
+    // Shares the database with FileIndex
+    sqlite3_busy_timeout(db_, 5000);
+
+    return create_tables();
+}
+
+void ChunkStore::set_storage_accountant(std::shared_ptr<StorageAccountant> accountant) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    accountant_ = std::move(accountant);
+    if (!accountant_) {
+        return;
+    }
+
+    // Chunks already stored become evictable per download holding them
+    const char* held_sql = R"(
+        SELECT r.file_hash, SUM(s.size), MAX(s.stored_at)
+        FROM chunk_refs r JOIN chunk_store s ON s.chunk_hash = r.chunk_hash
+        GROUP BY r.file_hash;
+    )";
+
+    sqlite3_stmt* stmt;
+    if (db_ && sqlite3_prepare_v2(db_, held_sql, -1, &stmt, nullptr) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            std::string file_hash(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)));
+            auto stored_at = std::chrono::system_clock::time_point(
+                std::chrono::system_clock::duration(sqlite3_column_int64(stmt, 2)));
+            accountant_->track_entry(StorageArea::CHUNK_STORE, file_hash,
+                                     static_cast<uint64_t>(sqlite3_column_int64(stmt, 1)), stored_at);
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    accountant_->set_evictor(StorageArea::CHUNK_STORE, [this](const std::string& file_hash) {
+        return release_file(file_hash) > 0;
+    });
+}
+
+bool ChunkStore::create_tables() {
+    const char* create_store_table = R"(
+        CREATE TABLE IF NOT EXISTS chunk_store (
+            chunk_hash TEXT PRIMARY KEY,
+            size INTEGER NOT NULL,
+            ref_count INTEGER NOT NULL DEFAULT 0,
+            stored_at INTEGER NOT NULL
+        );
+    )";
+
+    const char* create_refs_table = R"(
+        CREATE TABLE IF NOT EXISTS chunk_refs (
+            file_hash TEXT NOT NULL,
+            chunk_index INTEGER NOT NULL,
+            chunk_hash TEXT NOT NULL,
+            PRIMARY KEY (file_hash, chunk_index)
+        );
+    )";
+
+    const char* create_indexes = R"(
+        CREATE INDEX IF NOT EXISTS idx_chunk_refs_hash ON chunk_refs(chunk_hash);
+    )";
+
+    return exec(db_, create_store_table) && exec(db_, create_refs_table) && exec(db_, create_indexes);
+}
+
+hypershare::crypto::CryptoResult ChunkStore::put(const std::string& chunk_hash,
+                                                 std::span<const uint8_t> data,
+                                                 const std::string& file_hash,
+                                                 size_t chunk_index) {
+    // Content addressing only works if the key really is the content hash
+    auto actual_hash = hypershare::crypto::hash_utils::hash_to_hex(hypershare::crypto::Blake3Hasher::hash(data));
+    if (actual_hash != chunk_hash) {
+        return hypershare::crypto::CryptoResult(
+            hypershare::crypto::CryptoError::VERIFICATION_FAILED,
+            "Chunk data does not match hash " + chunk_hash
+        );
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (!exec(db_, "BEGIN IMMEDIATE;")) {
+        return hypershare::crypto::CryptoResult(
+            hypershare::crypto::CryptoError::FILE_WRITE_ERROR,
+            "Failed to begin chunk store transaction"
+        );
+    }
+
+    bool stored = chunk_row_exists(chunk_hash) && chunk_file_exists(chunk_hash);
+    uint64_t written_bytes = 0;
+    if (!stored) {
+        // Small savings are not worth a decompression on every read
+        std::optional<std::vector<uint8_t>> frame;
+        if (compress_chunks_) {
+            frame = compression::compress(data);
+        }
+
+        bool written = frame ? write_chunk_file(compressed_chunk_path(chunk_hash), *frame)
+                             : write_chunk_file(chunk_path(chunk_hash), data);
+        if (!written) {
+            exec(db_, "ROLLBACK;");
+            return hypershare::crypto::CryptoResult(
+                hypershare::crypto::CryptoError::FILE_WRITE_ERROR,
+                "Failed to write chunk " + chunk_hash
+            );
+        }
+        written_bytes = frame ? frame->size() : data.size();
+
+        const char* insert_sql = R"(
+            INSERT OR IGNORE INTO chunk_store (chunk_hash, size, ref_count, stored_at)
+            VALUES (?, ?, 0, ?);
+        )";
+
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db_, insert_sql, -1, &stmt, nullptr) != SQLITE_OK) {
+            exec(db_, "ROLLBACK;");
+            return hypershare::crypto::CryptoResult(
+                hypershare::crypto::CryptoError::FILE_WRITE_ERROR,
+                "Failed to prepare chunk insert"
+            );
+        }
+
+        sqlite3_bind_text(stmt, 1, chunk_hash.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 2, static_cast<sqlite3_int64>(data.size()));
+        sqlite3_bind_int64(stmt, 3, std::chrono::system_clock::now().time_since_epoch().count());
+        int result = sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+
+        if (result != SQLITE_DONE) {
+            exec(db_, "ROLLBACK;");
+            return hypershare::crypto::CryptoResult(
+                hypershare::crypto::CryptoError::FILE_WRITE_ERROR,
+                "Failed to record chunk " + chunk_hash
+            );
+        }
+    }
+
+    if (!insert_ref(chunk_hash, file_hash, chunk_index) || !exec(db_, "COMMIT;")) {
+        exec(db_, "ROLLBACK;");
+        return hypershare::crypto::CryptoResult(
+            hypershare::crypto::CryptoError::FILE_WRITE_ERROR,
+            "Failed to reference chunk " + chunk_hash
+        );
+    }
+
+    if (accountant_ && written_bytes > 0) {
+        accountant_->charge_entry(StorageArea::CHUNK_STORE, file_hash, written_bytes);
+    }
+
+    return hypershare::crypto::CryptoResult(hypershare::crypto::CryptoError::SUCCESS);
+}
+
+bool ChunkStore::add_ref(const std::string& chunk_hash, const std::string& file_hash, size_t chunk_index) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (!exec(db_, "BEGIN IMMEDIATE;")) {
+        return false;
+    }
+
+    if (!chunk_row_exists(chunk_hash) || !insert_ref(chunk_hash, file_hash, chunk_index)) {
+        exec(db_, "ROLLBACK;");
+        return false;
+    }
+
+    return exec(db_, "COMMIT;");
+}
+
+hypershare::crypto::CryptoResult ChunkStore::get(const std::string& chunk_hash, std::vector<uint8_t>& data) {
+    if (read_file(chunk_path(chunk_hash), data)) {
+        return hypershare::crypto::CryptoResult(hypershare::crypto::CryptoError::SUCCESS);
+    }
+
+    auto compressed_path = compressed_chunk_path(chunk_hash);
+    if (!std::filesystem::exists(compressed_path)) {
+        data.clear();
+        return hypershare::crypto::CryptoResult(
+            hypershare::crypto::CryptoError::FILE_NOT_FOUND,
+            "Chunk not in store: " + chunk_hash
+        );
+    }
+
+    std::vector<uint8_t> frame;
+    if (!read_file(compressed_path, frame)) {
+        data.clear();
+        return hypershare::crypto::CryptoResult(
+            hypershare::crypto::CryptoError::FILE_READ_ERROR,
+            "Failed to read chunk " + chunk_hash
+        );
+    }
+
+    return compression::decompress(frame, data);
+}
+
+bool ChunkStore::contains(const std::string& chunk_hash) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return chunk_row_exists(chunk_hash);
+}
+
+uint32_t ChunkStore::ref_count(const std::string& chunk_hash) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    const char* select_sql = "SELECT ref_count FROM chunk_store WHERE chunk_hash = ?;";
+
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db_, select_sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        return 0;
+    }
+
+    sqlite3_bind_text(stmt, 1, chunk_hash.c_str(), -1, SQLITE_STATIC);
+    uint32_t count = (sqlite3_step(stmt) == SQLITE_ROW) ? static_cast<uint32_t>(sqlite3_column_int64(stmt, 0)) : 0;
+    sqlite3_finalize(stmt);
+
+    return count;
+}
+
+size_t ChunkStore::release_file(const std::string& file_hash) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (!exec(db_, "BEGIN IMMEDIATE;")) {
+        return 0;
+    }
+
+    // Only chunks this file referenced can lose their last reference here;
+    // orphans left by other files are not swept up and counted as its own
+    std::vector<std::string> referenced;
+    bool ok = false;
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db_, "SELECT DISTINCT chunk_hash FROM chunk_refs WHERE file_hash = ?;",
+                           -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, file_hash.c_str(), -1, SQLITE_STATIC);
+        int result;
+        while ((result = sqlite3_step(stmt)) == SQLITE_ROW) {
+            referenced.emplace_back(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)));
+        }
+        sqlite3_finalize(stmt);
+        ok = result == SQLITE_DONE;
+    }
+
+    const char* decrement_sql = R"(
+        UPDATE chunk_store SET ref_count = ref_count - (
+            SELECT COUNT(*) FROM chunk_refs r
+            WHERE r.chunk_hash = chunk_store.chunk_hash AND r.file_hash = ?1
+        )
+        WHERE chunk_hash IN (SELECT chunk_hash FROM chunk_refs WHERE file_hash = ?1);
+    )";
+
+    const char* delete_refs_sql = "DELETE FROM chunk_refs WHERE file_hash = ?;";
+
+    for (const char* sql : {decrement_sql, delete_refs_sql}) {
+        if (!ok) {
+            break;
+        }
+        if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+            ok = false;
+            break;
+        }
+        sqlite3_bind_text(stmt, 1, file_hash.c_str(), -1, SQLITE_STATIC);
+        ok = sqlite3_step(stmt) == SQLITE_DONE;
+        sqlite3_finalize(stmt);
+    }
+
+    // Of those, delete the ones nobody references any more
+    std::vector<std::string> unreferenced;
+    if (ok && sqlite3_prepare_v2(db_, "DELETE FROM chunk_store WHERE chunk_hash = ? AND ref_count <= 0;",
+                                 -1, &stmt, nullptr) == SQLITE_OK) {
+        for (const auto& chunk_hash : referenced) {
+            sqlite3_bind_text(stmt, 1, chunk_hash.c_str(), -1, SQLITE_STATIC);
+            if (sqlite3_step(stmt) != SQLITE_DONE) {
+                ok = false;
+                break;
+            }
+            if (sqlite3_changes(db_) > 0) {
+                unreferenced.push_back(chunk_hash);
+            }
+            sqlite3_reset(stmt);
+        }
+        sqlite3_finalize(stmt);
+    } else {
+        ok = false;
+    }
+
+    if (!ok || !exec(db_, "COMMIT;")) {
+        exec(db_, "ROLLBACK;");
+        return 0;
+    }
+
+    // Files go only after the rows are gone; a crash in between leaves orphans
+    // that the next put() of the same chunk simply overwrites
+    uint64_t freed_bytes = 0;
+    for (const auto& chunk_hash : unreferenced) {
+        for (const auto& path : {chunk_path(chunk_hash), compressed_chunk_path(chunk_hash)}) {
+            std::error_code ec;
+            auto size = std::filesystem::file_size(path, ec);
+            if (std::filesystem::remove(path, ec)) {
+                freed_bytes += size;
+            }
+        }
+    }
+
+    if (accountant_) {
+        accountant_->release(StorageArea::CHUNK_STORE, freed_bytes);
+        accountant_->forget(StorageArea::CHUNK_STORE, file_hash);
+    }
+
+    return unreferenced.size();
+}
+
+size_t ChunkStore::chunk_count() {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db_, "SELECT COUNT(*) FROM chunk_store;", -1, &stmt, nullptr) != SQLITE_OK) {
+        return 0;
+    }
+
+    size_t count = (sqlite3_step(stmt) == SQLITE_ROW) ? static_cast<size_t>(sqlite3_column_int64(stmt, 0)) : 0;
+    sqlite3_finalize(stmt);
+
+    return count;
+}
+
+uint64_t ChunkStore::stored_bytes() {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db_, "SELECT SUM(size) FROM chunk_store;", -1, &stmt, nullptr) != SQLITE_OK) {
+        return 0;
+    }
+
+    uint64_t total = (sqlite3_step(stmt) == SQLITE_ROW) ? static_cast<uint64_t>(sqlite3_column_int64(stmt, 0)) : 0;
+    sqlite3_finalize(stmt);
+
+    return total;
+}
+
+std::filesystem::path ChunkStore::chunk_path(const std::string& chunk_hash) const {
+    // Same two-character fan-out as StorageConfig::get_file_path
+    return store_directory_ / chunk_hash.substr(0, 2) / chunk_hash;
+}
+
+std::filesystem::path ChunkStore::compressed_chunk_path(const std::string& chunk_hash) const {
+    return store_directory_ / chunk_hash.substr(0, 2) / (chunk_hash + ".zst");
+}
+
+bool ChunkStore::chunk_file_exists(const std::string& chunk_hash) const {
+    return std::filesystem::exists(chunk_path(chunk_hash)) ||
+           std::filesystem::exists(compressed_chunk_path(chunk_hash));
+}
+
+bool ChunkStore::insert_ref(const std::string& chunk_hash, const std::string& file_hash, size_t chunk_index) {
+    const char* insert_sql = R"(
+        INSERT OR IGNORE INTO chunk_refs (file_hash, chunk_index, chunk_hash)
+        VALUES (?, ?, ?);
+    )";
+
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db_, insert_sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        return false;
+    }
+
+    sqlite3_bind_text(stmt, 1, file_hash.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, static_cast<sqlite3_int64>(chunk_index));
+    sqlite3_bind_text(stmt, 3, chunk_hash.c_str(), -1, SQLITE_STATIC);
+    int result = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+
+    if (result != SQLITE_DONE) {
+        return false;
+    }
+
+    // Re-adding an existing reference is a no-op
+    if (sqlite3_changes(db_) == 0) {
+        return true;
+    }
+
+    const char* increment_sql = "UPDATE chunk_store SET ref_count = ref_count + 1 WHERE chunk_hash = ?;";
+    if (sqlite3_prepare_v2(db_, increment_sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        return false;
+    }
+
+    sqlite3_bind_text(stmt, 1, chunk_hash.c_str(), -1, SQLITE_STATIC);
+    result = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+
+    return result == SQLITE_DONE;
+}
+
+bool ChunkStore::chunk_row_exists(const std::string& chunk_hash) {
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db_, "SELECT 1 FROM chunk_store WHERE chunk_hash = ? LIMIT 1;",
+                           -1, &stmt, nullptr) != SQLITE_OK) {
+        return false;
+    }
+
+    sqlite3_bind_text(stmt, 1, chunk_hash.c_str(), -1, SQLITE_STATIC);
+    bool exists = sqlite3_step(stmt) == SQLITE_ROW;
+    sqlite3_finalize(stmt);
+
+    return exists;
+}
+
+bool ChunkStore::write_chunk_file(const std::filesystem::path& path, std::span<const uint8_t> data) {
+    auto temp_path = path;
+    temp_path += ".tmp";
+
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+
+    int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    size_t total = 0;
+    while (total < data.size()) {
+        ssize_t written = ::write(fd, data.data() + total, data.size() - total);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        total += static_cast<size_t>(written);
+    }
+
+    bool ok = total == data.size() && ::fsync(fd) == 0;
+    ::close(fd);
+
+    // Publish under the final name only once complete, readers never see a torn chunk
+    if (!ok || ::rename(temp_path.c_str(), path.c_str()) != 0) {
+        std::filesystem::remove(temp_path, ec);
+        return false;
+    }
+
+    return true;
+}
+
+} // namespace hypershare::storage
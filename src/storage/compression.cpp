@@ -0,0 +1,152 @@
+#include "hypershare/storage/compression.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <memory>
+#include <string>
+
+#ifdef HYPERSHARE_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace hypershare::storage::compression {
+
+namespace {
+    constexpr size_t SAMPLE_WINDOWS = 8;
+    constexpr size_t SAMPLE_WINDOW_SIZE = 512;
+
+#ifdef HYPERSHARE_HAVE_ZSTD
+    // Contexts are reused per thread, allocating one per chunk costs more than small chunks take to compress
+    ZSTD_CCtx* compress_context() {
+        thread_local std::unique_ptr<ZSTD_CCtx, decltype(&ZSTD_freeCCtx)> context(ZSTD_createCCtx(), &ZSTD_freeCCtx);
+        return context.get();
+    }
+
+    ZSTD_DCtx* decompress_context() {
+        thread_local std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)> context(ZSTD_createDCtx(), &ZSTD_freeDCtx);
+        return context.get();
+    }
+#endif
+}
+
+bool available() {
+#ifdef HYPERSHARE_HAVE_ZSTD
+    return true;
+#else
+    return false;
+#endif
+}
+
+double sample_entropy(std::span<const uint8_t> data) {
+    if (data.empty()) {
+        return 0.0;
+    }
+
+    std::array<uint32_t, 256> counts{};
+    size_t sampled = 0;
+
+    auto count_window = [&](size_t offset, size_t length) {
+        for (size_t i = offset; i < offset + length; ++i) {
+            ++counts[data[i]];
+        }
+        sampled += length;
+    };
+
+    if (data.size() <= SAMPLE_WINDOWS * SAMPLE_WINDOW_SIZE) {
+        count_window(0, data.size());
+    } else {
+        size_t stride = (data.size() - SAMPLE_WINDOW_SIZE) / (SAMPLE_WINDOWS - 1);
+        for (size_t w = 0; w < SAMPLE_WINDOWS; ++w) {
+            count_window(w * stride, SAMPLE_WINDOW_SIZE);
+        }
+    }
+
+    double entropy = 0.0;
+    for (uint32_t count : counts) {
+        if (count > 0) {
+            double p = static_cast<double>(count) / static_cast<double>(sampled);
+            entropy -= p * std::log2(p);
+        }
+    }
+    return entropy;
+}
+
+bool worth_compressing(std::span<const uint8_t> data) {
+    return available() && data.size() >= MIN_COMPRESS_SIZE &&
+           sample_entropy(data) <= MAX_COMPRESSIBLE_ENTROPY;
+}
+
+std::optional<std::vector<uint8_t>> compress(std::span<const uint8_t> data, int level) {
+    if (!worth_compressing(data)) {
+        return std::nullopt;
+    }
+
+#ifdef HYPERSHARE_HAVE_ZSTD
+    ZSTD_CCtx* context = compress_context();
+    if (!context) {
+        return std::nullopt;
+    }
+
+    std::vector<uint8_t> frame(ZSTD_compressBound(data.size()));
+    size_t size = ZSTD_compressCCtx(context, frame.data(), frame.size(), data.data(), data.size(), level);
+    if (ZSTD_isError(size) || size > data.size() - data.size() / 16) {
+        return std::nullopt;
+    }
+
+    frame.resize(size);
+    return frame;
+#else
+    (void)level;
+    return std::nullopt;
+#endif
+}
+
+hypershare::crypto::CryptoResult decompress(std::span<const uint8_t> frame,
+                                            std::vector<uint8_t>& output,
+                                            size_t max_size) {
+#ifdef HYPERSHARE_HAVE_ZSTD
+    unsigned long long content_size = ZSTD_getFrameContentSize(frame.data(), frame.size());
+    if (content_size == ZSTD_CONTENTSIZE_ERROR || content_size == ZSTD_CONTENTSIZE_UNKNOWN) {
+        return hypershare::crypto::CryptoResult(
+            hypershare::crypto::CryptoError::DECRYPTION_FAILED,
+            "Not a zstd frame with a known content size"
+        );
+    }
+    if (content_size > max_size) {
+        return hypershare::crypto::CryptoResult(
+            hypershare::crypto::CryptoError::BUFFER_TOO_SMALL,
+            "Decompressed size " + std::to_string(content_size) + " exceeds limit"
+        );
+    }
+
+    ZSTD_DCtx* context = decompress_context();
+    if (!context) {
+        return hypershare::crypto::CryptoResult(
+            hypershare::crypto::CryptoError::INVALID_STATE,
+            "Failed to create zstd context"
+        );
+    }
+
+    output.resize(static_cast<size_t>(content_size));
+    size_t size = ZSTD_decompressDCtx(context, output.data(), output.size(), frame.data(), frame.size());
+    if (ZSTD_isError(size) || size != output.size()) {
+        output.clear();
+        return hypershare::crypto::CryptoResult(
+            hypershare::crypto::CryptoError::DECRYPTION_FAILED,
+            "Corrupt zstd frame"
+        );
+    }
+
+    return hypershare::crypto::CryptoResult(hypershare::crypto::CryptoError::SUCCESS);
+#else
+    (void)frame;
+    (void)max_size;
+    output.clear();
+    return hypershare::crypto::CryptoResult(
+        hypershare::crypto::CryptoError::INVALID_STATE,
+        "Built without zstd support"
+    );
+#endif
+}
+
+} // namespace hypershare::storage::compression
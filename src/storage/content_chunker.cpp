@@ -0,0 +1,80 @@
+#include "hypershare/storage/content_chunker.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+
+namespace hypershare::storage {
+
+namespace {
+    // Gear values from a fixed splitmix64 sequence; part of the chunk format
+    constexpr std::array<uint64_t, 256> make_gear_table() {
+        std::array<uint64_t, 256> table{};
+        uint64_t state = 0x48797065725368ULL; // "HyperSh"
+        for (auto& value : table) {
+            state += 0x9E3779B97F4A7C15ULL;
+            uint64_t z = state;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            value = z ^ (z >> 31);
+        }
+        return table;
+    }
+
+    constexpr std::array<uint64_t, 256> GEAR = make_gear_table();
+
+    // Mask over the top bits of the fingerprint, which depend on the last 64 bytes
+    constexpr uint64_t top_bits_mask(unsigned bits) {
+        bits = std::clamp(bits, 1u, 63u);
+        return ((uint64_t{1} << bits) - 1) << (64 - bits);
+    }
+
+    constexpr unsigned NORMALIZATION_LEVEL = 2;
+}
+
+ContentChunker::ContentChunker(uint32_t min_size, uint32_t avg_size, uint32_t max_size)
+    : min_size_(min_size)
+    , avg_size_(avg_size)
+    , max_size_(max_size) {
+    if (!valid_sizes(min_size_, avg_size_, max_size_)) {
+        min_size_ = DEFAULT_MIN_SIZE;
+        avg_size_ = DEFAULT_AVG_SIZE;
+        max_size_ = DEFAULT_MAX_SIZE;
+    }
+
+    unsigned avg_bits = static_cast<unsigned>(std::bit_width(avg_size_) - 1);
+    mask_small_ = top_bits_mask(avg_bits + NORMALIZATION_LEVEL);
+    mask_large_ = top_bits_mask(avg_bits - NORMALIZATION_LEVEL);
+}
+
+bool ContentChunker::valid_sizes(uint32_t min_size, uint32_t avg_size, uint32_t max_size) {
+    return min_size >= 64 && min_size < avg_size && avg_size < max_size;
+}
+
+size_t ContentChunker::next_boundary(std::span<const uint8_t> data) const {
+    size_t length = std::min<size_t>(data.size(), max_size_);
+    if (length <= min_size_) {
+        return length;
+    }
+
+    size_t normal = std::min<size_t>(length, avg_size_);
+    uint64_t fingerprint = 0;
+    size_t i = min_size_;
+
+    for (; i < normal; ++i) {
+        fingerprint = (fingerprint << 1) + GEAR[data[i]];
+        if ((fingerprint & mask_small_) == 0) {
+            return i + 1;
+        }
+    }
+
+    for (; i < length; ++i) {
+        fingerprint = (fingerprint << 1) + GEAR[data[i]];
+        if ((fingerprint & mask_large_) == 0) {
+            return i + 1;
+        }
+    }
+
+    return length;
+}
+
+} // namespace hypershare::storage
@@ -0,0 +1,168 @@
+#include "hypershare/storage/direct_io.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace hypershare::storage {
+
+AlignedBufferPool::Buffer::Buffer(AlignedBufferPool* pool, uint8_t* data, size_t size)
+    : pool_(pool)
+    , data_(data)
+    , size_(size) {
+}
+
+AlignedBufferPool::Buffer::Buffer(Buffer&& other) noexcept
+    : pool_(other.pool_)
+    , data_(other.data_)
+    , size_(other.size_) {
+    other.data_ = nullptr;
+    other.size_ = 0;
+}
+
+AlignedBufferPool::Buffer& AlignedBufferPool::Buffer::operator=(Buffer&& other) noexcept {
+    if (this != &other) {
+        if (data_) {
+            pool_->release(data_);
+        }
+        pool_ = other.pool_;
+        data_ = other.data_;
+        size_ = other.size_;
+        other.data_ = nullptr;
+        other.size_ = 0;
+    }
+    return *this;
+}
+
+AlignedBufferPool::Buffer::~Buffer() {
+    if (data_) {
+        pool_->release(data_);
+    }
+}
+
+AlignedBufferPool::AlignedBufferPool(size_t buffer_size, size_t max_pooled)
+    : buffer_size_(align_up(std::max<size_t>(buffer_size, 1)))
+    , max_pooled_(max_pooled) {
+}
+
+AlignedBufferPool::~AlignedBufferPool() {
+    for (uint8_t* data : free_) {
+        std::free(data);
+    }
+}
+
+AlignedBufferPool::Buffer AlignedBufferPool::acquire() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!free_.empty()) {
+            uint8_t* data = free_.back();
+            free_.pop_back();
+            return Buffer(this, data, buffer_size_);
+        }
+    }
+
+    auto* data = static_cast<uint8_t*>(std::aligned_alloc(ALIGNMENT, buffer_size_));
+    return data ? Buffer(this, data, buffer_size_) : Buffer();
+}
+
+void AlignedBufferPool::release(uint8_t* data) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_.size() < max_pooled_) {
+        free_.push_back(data);
+    } else {
+        std::free(data);
+    }
+}
+
+std::unique_ptr<DirectFileReader> DirectFileReader::open(const std::filesystem::path& path,
+                                                         AlignedBufferPool& pool) {
+#ifdef O_DIRECT
+    int fd = ::open(path.c_str(), O_RDONLY | O_DIRECT | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        return nullptr;
+    }
+
+    return std::unique_ptr<DirectFileReader>(new DirectFileReader(fd, static_cast<uint64_t>(st.st_size), pool));
+#else
+    (void)path;
+    (void)pool;
+    return nullptr;
+#endif
+}
+
+DirectFileReader::DirectFileReader(int fd, uint64_t file_size, AlignedBufferPool& pool)
+    : fd_(fd)
+    , file_size_(file_size)
+    , pool_(pool) {
+}
+
+DirectFileReader::~DirectFileReader() {
+    delete parked_.exchange(nullptr);
+    ::close(fd_);
+}
+
+bool DirectFileReader::read(uint64_t offset, std::span<uint8_t> out) {
+    std::unique_ptr<Window> window(parked_.exchange(nullptr));
+    if (!window) {
+        auto buffer = pool_.acquire();
+        if (!buffer) {
+            errno = ENOMEM;
+            return false;
+        }
+        window = std::make_unique<Window>(Window{std::move(buffer)});
+    }
+
+    size_t copied = 0;
+    while (copied < out.size()) {
+        uint64_t position = offset + copied;
+        if (position < window->offset || position >= window->offset + window->length) {
+            // Refill from the aligned block holding position; the end of the
+            // file comes back as a short read
+            uint64_t aligned = AlignedBufferPool::align_down(position);
+            ssize_t bytes_read;
+            do {
+                bytes_read = ::pread(fd_, window->buffer.data(), window->buffer.size(), static_cast<off_t>(aligned));
+            } while (bytes_read < 0 && errno == EINTR);
+
+            if (bytes_read <= 0 || aligned + static_cast<uint64_t>(bytes_read) <= position) {
+                if (bytes_read >= 0) {
+                    errno = EIO; // Unexpected end of file
+                }
+                return false;
+            }
+            window->offset = aligned;
+            window->length = static_cast<size_t>(bytes_read);
+        }
+
+        size_t start = static_cast<size_t>(position - window->offset);
+        size_t length = std::min(out.size() - copied, window->length - start);
+        std::memcpy(out.data() + copied, window->buffer.data() + start, length);
+        copied += length;
+    }
+
+    // Park the window for the next read; one parked meanwhile by a
+    // concurrent read goes back to the pool
+    delete parked_.exchange(window.release());
+    return true;
+}
+
+int open_direct_for_write(const std::filesystem::path& path) {
+#ifdef O_DIRECT
+    return ::open(path.c_str(), O_WRONLY | O_DIRECT | O_CLOEXEC);
+#else
+    (void)path;
+    errno = EINVAL;
+    return -1;
+#endif
+}
+
+} // namespace hypershare::storage
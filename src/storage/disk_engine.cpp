@@ -0,0 +1,370 @@
+#include "hypershare/storage/disk_engine.hpp"
+#include "hypershare/core/logger.hpp"
+#include <boost/asio.hpp>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+#ifdef HYPERSHARE_HAVE_LIBURING
+#include <liburing.h>
+#include <sys/eventfd.h>
+#endif
+
+namespace hypershare::storage {
+
+namespace {
+
+std::error_code make_error(int error) {
+    return error == 0 ? std::error_code() : std::error_code(error, std::generic_category());
+}
+
+} // namespace
+
+ThreadPoolDiskEngine::ThreadPoolDiskEngine(boost::asio::io_context& io_context, size_t thread_count)
+    : io_context_(io_context)
+    , stopping_(false) {
+    if (thread_count == 0) {
+        thread_count = 1;
+    }
+
+    workers_.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i) {
+        workers_.emplace_back([this] { worker_loop(); });
+    }
+}
+
+ThreadPoolDiskEngine::~ThreadPoolDiskEngine() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+
+    for (auto& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+void ThreadPoolDiskEngine::async_read(int fd, uint64_t offset, std::span<uint8_t> buffer,
+                                      DiskCompletion handler) {
+    submit([this, fd, offset, buffer, handler = std::move(handler)]() mutable {
+        size_t total = 0;
+        int error = 0;
+        while (total < buffer.size()) {
+            ssize_t n = ::pread(fd, buffer.data() + total, buffer.size() - total,
+                                static_cast<off_t>(offset + total));
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                error = errno;
+                break;
+            }
+            if (n == 0) {
+                break;
+            }
+            total += static_cast<size_t>(n);
+        }
+        complete(std::move(handler), error, total);
+    });
+}
+
+void ThreadPoolDiskEngine::async_write(int fd, uint64_t offset, std::span<const uint8_t> buffer,
+                                       DiskCompletion handler) {
+    submit([this, fd, offset, buffer, handler = std::move(handler)]() mutable {
+        size_t total = 0;
+        int error = 0;
+        while (total < buffer.size()) {
+            ssize_t n = ::pwrite(fd, buffer.data() + total, buffer.size() - total,
+                                 static_cast<off_t>(offset + total));
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                error = errno;
+                break;
+            }
+            total += static_cast<size_t>(n);
+        }
+        complete(std::move(handler), error, total);
+    });
+}
+
+void ThreadPoolDiskEngine::async_fsync(int fd, DiskCompletion handler) {
+    submit([this, fd, handler = std::move(handler)]() mutable {
+        int error = ::fsync(fd) == 0 ? 0 : errno;
+        complete(std::move(handler), error, 0);
+    });
+}
+
+void ThreadPoolDiskEngine::async_run(std::function<int()> work, DiskCompletion handler) {
+    submit([this, work = std::move(work), handler = std::move(handler)]() mutable {
+        int error = work();
+        complete(std::move(handler), error, 0);
+    });
+}
+
+void ThreadPoolDiskEngine::submit(std::function<void()> task) {
+    // Keep io_context::run() from returning while the operation is still on a worker
+    auto work = std::make_shared<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>>(
+        io_context_.get_executor());
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.push([work, task = std::move(task)]() { task(); });
+    }
+    cv_.notify_one();
+}
+
+void ThreadPoolDiskEngine::worker_loop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+            // Drain queued work before exiting so no completion is silently dropped
+            if (tasks_.empty()) {
+                return;
+            }
+            task = std::move(tasks_.front());
+            tasks_.pop();
+        }
+        task();
+    }
+}
+
+void ThreadPoolDiskEngine::complete(DiskCompletion handler, int error, size_t bytes) {
+    boost::asio::post(io_context_, [handler = std::move(handler), error, bytes]() {
+        handler(make_error(error), bytes);
+    });
+}
+
+#ifdef HYPERSHARE_HAVE_LIBURING
+
+struct IoUringDiskEngine::Impl {
+    enum class OpType { READ, WRITE, FSYNC };
+
+    struct Operation {
+        OpType type;
+        int fd;
+        uint64_t offset;
+        uint8_t* data;
+        size_t length;
+        size_t transferred;
+        DiskCompletion handler;
+    };
+
+    boost::asio::io_context& io_context;
+    struct io_uring ring;
+    bool ring_ready;
+    int event_fd;
+    boost::asio::posix::stream_descriptor event_stream;
+    uint64_t event_counter;
+    bool armed;
+    std::atomic<size_t> in_flight;
+    std::mutex submit_mutex;
+    ThreadPoolDiskEngine blocking;
+
+    Impl(boost::asio::io_context& context, int efd)
+        : io_context(context)
+        , ring{}
+        , ring_ready(false)
+        , event_fd(efd)
+        , event_stream(context, efd)
+        , event_counter(0)
+        , armed(false)
+        , in_flight(0)
+        , blocking(context, 1) {
+    }
+
+    ~Impl() {
+        boost::system::error_code ignored;
+        event_stream.cancel(ignored);
+        event_stream.close(ignored);  // also closes event_fd
+
+        if (!ring_ready) {
+            return;
+        }
+
+        // Drop whatever is still in flight; handlers are destroyed without being called
+        struct io_uring_cqe* cqe = nullptr;
+        while (io_uring_peek_cqe(&ring, &cqe) == 0) {
+            delete static_cast<Operation*>(io_uring_cqe_get_data(cqe));
+            io_uring_cqe_seen(&ring, cqe);
+        }
+        io_uring_queue_exit(&ring);
+    }
+
+    void submit(Operation* op) {
+        std::lock_guard<std::mutex> lock(submit_mutex);
+
+        struct io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+        while (!sqe) {
+            // Submission queue full, hand what we have to the kernel and retry
+            io_uring_submit(&ring);
+            sqe = io_uring_get_sqe(&ring);
+        }
+
+        switch (op->type) {
+            case OpType::READ:
+                io_uring_prep_read(sqe, op->fd, op->data + op->transferred,
+                                   static_cast<unsigned>(op->length - op->transferred),
+                                   op->offset + op->transferred);
+                break;
+            case OpType::WRITE:
+                io_uring_prep_write(sqe, op->fd, op->data + op->transferred,
+                                    static_cast<unsigned>(op->length - op->transferred),
+                                    op->offset + op->transferred);
+                break;
+            case OpType::FSYNC:
+                io_uring_prep_fsync(sqe, op->fd, 0);
+                break;
+        }
+        io_uring_sqe_set_data(sqe, op);
+        io_uring_submit(&ring);
+    }
+
+    void start(Operation* op) {
+        in_flight.fetch_add(1);
+        submit(op);
+        boost::asio::post(io_context, [this]() { arm(); });
+    }
+
+    // The eventfd is only watched while operations are outstanding, so an idle
+    // engine does not keep io_context::run() from returning
+    void arm() {
+        if (armed || in_flight.load() == 0) {
+            return;
+        }
+        armed = true;
+        event_stream.async_read_some(
+            boost::asio::buffer(&event_counter, sizeof(event_counter)),
+            [this](const boost::system::error_code& error, size_t) {
+                if (error == boost::asio::error::operation_aborted) {
+                    return;
+                }
+                armed = false;
+                drain_completions();
+                arm();
+            });
+    }
+
+    void drain_completions() {
+        struct io_uring_cqe* cqe = nullptr;
+        while (io_uring_peek_cqe(&ring, &cqe) == 0) {
+            auto* op = static_cast<Operation*>(io_uring_cqe_get_data(cqe));
+            int result = cqe->res;
+            io_uring_cqe_seen(&ring, cqe);
+            handle_completion(op, result);
+        }
+    }
+
+    void handle_completion(Operation* op, int result) {
+        if (result == -EINTR || result == -EAGAIN) {
+            submit(op);
+            return;
+        }
+
+        if (result < 0) {
+            finish(op, -result);
+            return;
+        }
+
+        op->transferred += static_cast<size_t>(result);
+
+        // Short transfer: resubmit the remainder, except a read that reached end of file
+        bool more = op->type != OpType::FSYNC && op->transferred < op->length &&
+                    !(op->type == OpType::READ && result == 0);
+        if (more) {
+            submit(op);
+            return;
+        }
+
+        finish(op, 0);
+    }
+
+    void finish(Operation* op, int error) {
+        std::unique_ptr<Operation> owned(op);
+        in_flight.fetch_sub(1);
+        owned->handler(make_error(error), owned->transferred);
+    }
+};
+
+std::unique_ptr<IoUringDiskEngine> IoUringDiskEngine::create(boost::asio::io_context& io_context,
+                                                             unsigned queue_depth) {
+    int efd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (efd < 0) {
+        return nullptr;
+    }
+
+    auto impl = std::make_unique<Impl>(io_context, efd);
+
+    int rc = io_uring_queue_init(queue_depth, &impl->ring, 0);
+    if (rc < 0) {
+        LOG_DEBUG("io_uring_queue_init failed: {}", std::strerror(-rc));
+        return nullptr;
+    }
+    impl->ring_ready = true;
+
+    rc = io_uring_register_eventfd(&impl->ring, efd);
+    if (rc < 0) {
+        LOG_DEBUG("io_uring_register_eventfd failed: {}", std::strerror(-rc));
+        return nullptr;
+    }
+
+    return std::unique_ptr<IoUringDiskEngine>(new IoUringDiskEngine(std::move(impl)));
+}
+
+IoUringDiskEngine::IoUringDiskEngine(std::unique_ptr<Impl> impl)
+    : impl_(std::move(impl)) {
+}
+
+IoUringDiskEngine::~IoUringDiskEngine() = default;
+
+void IoUringDiskEngine::async_read(int fd, uint64_t offset, std::span<uint8_t> buffer,
+                                   DiskCompletion handler) {
+    impl_->start(new Impl::Operation{Impl::OpType::READ, fd, offset, buffer.data(),
+                                      buffer.size(), 0, std::move(handler)});
+}
+
+void IoUringDiskEngine::async_write(int fd, uint64_t offset, std::span<const uint8_t> buffer,
+                                    DiskCompletion handler) {
+    // The kernel never writes through this pointer for a write op
+    impl_->start(new Impl::Operation{Impl::OpType::WRITE, fd, offset,
+                                      const_cast<uint8_t*>(buffer.data()),
+                                      buffer.size(), 0, std::move(handler)});
+}
+
+void IoUringDiskEngine::async_fsync(int fd, DiskCompletion handler) {
+    impl_->start(new Impl::Operation{Impl::OpType::FSYNC, fd, 0, nullptr, 0, 0,
+                                      std::move(handler)});
+}
+
+void IoUringDiskEngine::async_run(std::function<int()> work, DiskCompletion handler) {
+    impl_->blocking.async_run(std::move(work), std::move(handler));
+}
+
+#endif // HYPERSHARE_HAVE_LIBURING
+
+std::shared_ptr<DiskEngine> make_disk_engine(boost::asio::io_context& io_context,
+                                             bool prefer_io_uring,
+                                             size_t thread_count) {
+#ifdef HYPERSHARE_HAVE_LIBURING
+    if (prefer_io_uring) {
+        if (auto engine = IoUringDiskEngine::create(io_context)) {
+            LOG_INFO("Disk I/O engine: io_uring");
+            return engine;
+        }
+        LOG_WARN("io_uring unavailable, falling back to thread pool disk I/O");
+    }
+#else
+    (void)prefer_io_uring;
+#endif
+
+    LOG_INFO("Disk I/O engine: thread pool ({} threads)", thread_count);
+    return std::make_shared<ThreadPoolDiskEngine>(io_context, thread_count);
+}
+
+} // namespace hypershare::storage
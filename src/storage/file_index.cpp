@@ -1,16 +1,141 @@
 #include "hypershare/storage/file_index.hpp"
+#include "hypershare/crypto/hash.hpp"
 #include <sqlite3.h>
 #include <sstream>
 #include <stdexcept>
+#include <algorithm>
 
 namespace hypershare::storage {
 
-FileIndex::FileIndex(const std::filesystem::path& db_path) 
-    : db_path_(db_path), db_(nullptr) {
+namespace {
+
+bool exec(sqlite3* db, const char* sql) {
+    char* error_msg = nullptr;
+    int result = sqlite3_exec(db, sql, nullptr, nullptr, &error_msg);
+    if (error_msg) {
+        sqlite3_free(error_msg);
+    }
+    return result == SQLITE_OK;
+}
+
+// Resets a cached statement on scope exit, so it never keeps a read
+// transaction open between calls and starts out unbound for the next one
+class ScopedStatement {
+public:
+    explicit ScopedStatement(sqlite3_stmt* stmt) : stmt_(stmt) {}
+    
+    ~ScopedStatement() {
+        if (stmt_) {
+            sqlite3_reset(stmt_);
+            sqlite3_clear_bindings(stmt_);
+        }
+    }
+    
+    ScopedStatement(const ScopedStatement&) = delete;
+    ScopedStatement& operator=(const ScopedStatement&) = delete;
+    
+    sqlite3_stmt* get() const { return stmt_; }
+    explicit operator bool() const { return stmt_ != nullptr; }
+    
+private:
+    sqlite3_stmt* stmt_;
+};
+
+// Valid until the statement steps or resets
+std::span<const uint8_t> column_blob(sqlite3_stmt* stmt, int column) {
+    const void* blob_data = sqlite3_column_blob(stmt, column);
+    int blob_size = sqlite3_column_bytes(stmt, column);
+    
+    return std::span<const uint8_t>(static_cast<const uint8_t*>(blob_data), static_cast<size_t>(blob_size));
+}
+
+// Tags are indexed as one space separated column
+std::string join_tags(const std::vector<std::string>& tags) {
+    std::string joined;
+    for (const auto& tag : tags) {
+        if (!joined.empty()) {
+            joined += ' ';
+        }
+        joined += tag;
+    }
+    return joined;
+}
+
+std::string join_tags(const FileMetadataView& metadata) {
+    std::string joined;
+    for (size_t i = 0; i < metadata.tag_count(); ++i) {
+        if (!joined.empty()) {
+            joined += ' ';
+        }
+        joined += metadata.tag(i);
+    }
+    return joined;
+}
+
+void bind_text(sqlite3_stmt* stmt, int index, std::string_view text) {
+    sqlite3_bind_text(stmt, index, text.data(), static_cast<int>(text.size()), SQLITE_STATIC);
+}
+
+// Each whitespace separated term becomes a quoted prefix query, so user input
+// never reaches FTS5 query syntax. Empty when the query has no terms.
+std::string to_fts_query(const std::string& query) {
+    std::istringstream terms(query);
+    std::string term;
+    std::string match;
+    while (terms >> term) {
+        if (!match.empty()) {
+            match += ' ';
+        }
+        match += '"';
+        for (char c : term) {
+            if (c == '"') {
+                match += '"';
+            }
+            match += c;
+        }
+        match += "\"*";
+    }
+    return match;
+}
+
+constexpr int BUSY_TIMEOUT_MS = 5000;
+constexpr int64_t MMAP_SIZE = 256LL * 1024 * 1024;
+
+} // namespace
+
+class FileIndex::ReadLease {
+public:
+    ReadLease(FileIndex* index, std::unique_ptr<ReadConnection> reader)
+        : index_(index), reader_(std::move(reader)) {}
+    
+    ~ReadLease() {
+        if (reader_) {
+            index_->release_reader(std::move(reader_));
+        }
+    }
+    
+    ReadLease(ReadLease&&) = default;
+    ReadLease(const ReadLease&) = delete;
+    ReadLease& operator=(const ReadLease&) = delete;
+    
+    explicit operator bool() const { return reader_ != nullptr; }
+    ReadConnection& operator*() const { return *reader_; }
+    sqlite3_stmt* statement(Statement id) const { return reader_->statements[id]; }
+    
+private:
+    FileIndex* index_;
+    std::unique_ptr<ReadConnection> reader_;
+};
+
+FileIndex::FileIndex(const std::filesystem::path& db_path, size_t read_connections) 
+    : db_path_(db_path), db_(nullptr), max_readers_(std::max<size_t>(read_connections, 1)) {
 }
 
 FileIndex::~FileIndex() {
-    cleanup_statements();
+    for (auto& reader : idle_readers_) {
+        close_reader(*reader);
+    }
+    cleanup_statements(statements_);
     if (db_) {
         sqlite3_close(db_);
     }
@@ -22,7 +147,26 @@ bool FileIndex::initialize() {
         return false;
     }
     
-    return create_tables() && prepare_statements();
+    return configure_connection(db_, true) && create_tables() &&
+           prepare_statements(db_, statements_, 0, FIRST_READ_STATEMENT);
+}
+
+bool FileIndex::configure_connection(sqlite3* db, bool writer) {
+    // Shares the database with ChunkStore and the other connections
+    sqlite3_busy_timeout(db, BUSY_TIMEOUT_MS);
+    
+    std::string mmap_pragma = "PRAGMA mmap_size = " + std::to_string(MMAP_SIZE) + ";";
+    if (!exec(db, mmap_pragma.c_str())) {
+        return false;
+    }
+    
+    if (!writer) {
+        return true;
+    }
+    
+    // WAL lets readers run alongside the writer; NORMAL only syncs at
+    // checkpoints, a crash can lose the last commits but not corrupt the index
+    return exec(db, "PRAGMA journal_mode = WAL;") && exec(db, "PRAGMA synchronous = NORMAL;");
 }
 
 bool FileIndex::create_tables() {
@@ -36,7 +180,8 @@ bool FileIndex::create_tables() {
             chunk_size INTEGER NOT NULL,
             file_type TEXT,
             description TEXT,
-            metadata_blob BLOB
+            metadata_blob BLOB,
+            available_chunks BLOB
         );
     )";
     
@@ -44,7 +189,7 @@ bool FileIndex::create_tables() {
         CREATE TABLE IF NOT EXISTS chunks (
             file_hash TEXT NOT NULL,
             chunk_index INTEGER NOT NULL,
-            chunk_hash TEXT NOT NULL,
+            chunk_hash BLOB NOT NULL,
             is_available INTEGER DEFAULT 0,
             PRIMARY KEY (file_hash, chunk_index),
             FOREIGN KEY (file_hash) REFERENCES files(file_hash) ON DELETE CASCADE
@@ -58,49 +203,408 @@ bool FileIndex::create_tables() {
         CREATE INDEX IF NOT EXISTS idx_chunks_available ON chunks(is_available);
     )";
     
-    char* error_msg = nullptr;
+    if (!exec(db_, create_files_table) || !exec(db_, create_chunks_table) || !exec(db_, create_indexes)) {
+        return false;
+    }
+    
+    return migrate_chunk_hashes() && migrate_metadata_blobs() && migrate_chunk_availability() &&
+           create_search_index();
+}
+
+bool FileIndex::create_search_index() {
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db_, "SELECT 1 FROM sqlite_master WHERE name = 'files_fts';", -1, &stmt, nullptr) != SQLITE_OK) {
+        return false;
+    }
+    bool exists = sqlite3_step(stmt) == SQLITE_ROW;
+    sqlite3_finalize(stmt);
+    
+    if (exists) {
+        fts_available_ = true;
+        return true;
+    }
+    
+    // Each entry shares the rowid of its files row
+    const char* create_fts_table = R"(
+        CREATE VIRTUAL TABLE files_fts USING fts5(
+            filename, file_type, description, tags,
+            tokenize = 'unicode61 remove_diacritics 2',
+            prefix = '2 3'
+        );
+    )";
+    
+    if (!exec(db_, create_fts_table)) {
+        // SQLite built without FTS5, search_files scans with LIKE instead
+        return true;
+    }
+    
+    fts_available_ = true;
+    return rebuild_search_index();
+}
+
+bool FileIndex::rebuild_search_index() {
+    // Files indexed before the search table existed. Blobs migrated from the
+    // stream layout carry no tags, those entries match on name, type and
+    // description only.
+    sqlite3_stmt* select_stmt;
+    if (sqlite3_prepare_v2(db_, "SELECT rowid, metadata_blob FROM files;", -1, &select_stmt, nullptr) != SQLITE_OK) {
+        return false;
+    }
+    
+    const char* insert_sql = R"(
+        INSERT INTO files_fts (rowid, filename, file_type, description, tags)
+        VALUES (?, ?, ?, ?, ?);
+    )";
+    
+    sqlite3_stmt* insert_stmt;
+    if (sqlite3_prepare_v2(db_, insert_sql, -1, &insert_stmt, nullptr) != SQLITE_OK) {
+        sqlite3_finalize(select_stmt);
+        return false;
+    }
+    
+    exec(db_, "BEGIN;");
+    while (sqlite3_step(select_stmt) == SQLITE_ROW) {
+        auto metadata = FileMetadataView::parse(column_blob(select_stmt, 1));
+        if (!metadata) {
+            continue;
+        }
+        auto tags = join_tags(*metadata);
+        
+        sqlite3_bind_int64(insert_stmt, 1, sqlite3_column_int64(select_stmt, 0));
+        bind_text(insert_stmt, 2, metadata->filename());
+        bind_text(insert_stmt, 3, metadata->file_type());
+        bind_text(insert_stmt, 4, metadata->description());
+        bind_text(insert_stmt, 5, tags);
+        sqlite3_step(insert_stmt);
+        sqlite3_reset(insert_stmt);
+    }
+    sqlite3_finalize(insert_stmt);
+    sqlite3_finalize(select_stmt);
+    
+    return exec(db_, "COMMIT;");
+}
+
+bool FileIndex::migrate_chunk_hashes() {
+    // Indexes written before chunk hashes were stored raw hold them as hex text
+    const char* select_sql = "SELECT rowid, chunk_hash FROM chunks WHERE typeof(chunk_hash) = 'text';";
     
-    int result = sqlite3_exec(db_, create_files_table, nullptr, nullptr, &error_msg);
+    sqlite3_stmt* stmt;
+    int result = sqlite3_prepare_v2(db_, select_sql, -1, &stmt, nullptr);
     if (result != SQLITE_OK) {
-        sqlite3_free(error_msg);
         return false;
     }
     
-    result = sqlite3_exec(db_, create_chunks_table, nullptr, nullptr, &error_msg);
+    std::vector<std::pair<sqlite3_int64, hypershare::crypto::Blake3Hash>> converted;
+    while ((result = sqlite3_step(stmt)) == SQLITE_ROW) {
+        std::string hex(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)));
+        if (auto hash = hypershare::crypto::hash_utils::hash_from_hex(hex)) {
+            converted.emplace_back(sqlite3_column_int64(stmt, 0), *hash);
+        }
+    }
+    sqlite3_finalize(stmt);
+    
+    if (converted.empty()) {
+        return true;
+    }
+    
+    const char* update_sql = "UPDATE chunks SET chunk_hash = ? WHERE rowid = ?;";
+    result = sqlite3_prepare_v2(db_, update_sql, -1, &stmt, nullptr);
     if (result != SQLITE_OK) {
-        sqlite3_free(error_msg);
         return false;
     }
     
-    result = sqlite3_exec(db_, create_indexes, nullptr, nullptr, &error_msg);
+    exec(db_, "BEGIN;");
+    for (const auto& [rowid, hash] : converted) {
+        sqlite3_bind_blob(stmt, 1, hash.data(), static_cast<int>(hash.size()), SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 2, rowid);
+        sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+    
+    return exec(db_, "COMMIT;");
+}
+
+bool FileIndex::migrate_metadata_blobs() {
+    // Rewrites blobs from the stream layout, so every row reads in place
+    sqlite3_stmt* stmt;
+    int result = sqlite3_prepare_v2(db_, "SELECT rowid, metadata_blob FROM files;", -1, &stmt, nullptr);
     if (result != SQLITE_OK) {
-        sqlite3_free(error_msg);
         return false;
     }
     
-    return true;
+    std::vector<std::pair<sqlite3_int64, std::vector<uint8_t>>> converted;
+    while ((result = sqlite3_step(stmt)) == SQLITE_ROW) {
+        auto blob = column_blob(stmt, 1);
+        if (FileMetadataView::parse(blob)) {
+            continue;
+        }
+        try {
+            converted.emplace_back(sqlite3_column_int64(stmt, 0), deserialize_metadata(blob).serialize());
+        } catch (const std::exception&) {
+            // Left as is, readers skip it
+        }
+    }
+    sqlite3_finalize(stmt);
+    
+    if (converted.empty()) {
+        return true;
+    }
+    
+    result = sqlite3_prepare_v2(db_, "UPDATE files SET metadata_blob = ? WHERE rowid = ?;", -1, &stmt, nullptr);
+    if (result != SQLITE_OK) {
+        return false;
+    }
+    
+    exec(db_, "BEGIN;");
+    for (const auto& [rowid, blob] : converted) {
+        sqlite3_bind_blob(stmt, 1, blob.data(), static_cast<int>(blob.size()), SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 2, rowid);
+        sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+    
+    return exec(db_, "COMMIT;");
 }
 
-bool FileIndex::prepare_statements() {
-    // For now, we'll use sqlite3_exec directly
-    // In a production implementation, we'd prepare statements for better performance
+bool FileIndex::migrate_chunk_availability() {
+    // Indexes from before the bitmap column track availability in chunk rows only
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db_, "SELECT available_chunks FROM files LIMIT 0;", -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_finalize(stmt);
+        return true;
+    }
+    
+    if (!exec(db_, "ALTER TABLE files ADD COLUMN available_chunks BLOB;")) {
+        return false;
+    }
+    
+    const char* select_sql = "SELECT file_hash, chunk_index FROM chunks WHERE is_available = 1 ORDER BY file_hash;";
+    if (sqlite3_prepare_v2(db_, select_sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        return false;
+    }
+    
+    std::vector<std::pair<std::string, ChunkBitmap>> converted;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        std::string file_hash(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)));
+        if (converted.empty() || converted.back().first != file_hash) {
+            converted.emplace_back(std::move(file_hash), ChunkBitmap());
+        }
+        converted.back().second.insert(static_cast<uint64_t>(sqlite3_column_int64(stmt, 1)));
+    }
+    sqlite3_finalize(stmt);
+    
+    if (sqlite3_prepare_v2(db_, "UPDATE files SET available_chunks = ? WHERE file_hash = ?;", -1, &stmt, nullptr) != SQLITE_OK) {
+        return false;
+    }
+    
+    exec(db_, "BEGIN;");
+    for (const auto& [file_hash, available] : converted) {
+        auto blob = available.serialize();
+        sqlite3_bind_blob(stmt, 1, blob.data(), static_cast<int>(blob.size()), SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, file_hash.c_str(), -1, SQLITE_STATIC);
+        sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+    
+    return exec(db_, "COMMIT;");
+}
+
+bool FileIndex::prepare_statements(sqlite3* db, Statements& statements, size_t first, size_t last) {
+    std::array<const char*, STATEMENT_COUNT> sql{};
+    
+    sql[INSERT_FILE] = R"(
+        INSERT OR REPLACE INTO files
+        (file_hash, filename, file_size, created_at, modified_at, chunk_size, file_type, description,
+         metadata_blob, available_chunks)
+        VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?);
+    )";
+    
+    sql[INSERT_CHUNK] = R"(
+        INSERT OR REPLACE INTO chunks (file_hash, chunk_index, chunk_hash, is_available)
+        VALUES (?, ?, ?, 1);
+    )";
+    
+    sql[DELETE_FILE] = "DELETE FROM files WHERE file_hash = ?;";
+    
+    sql[DELETE_CHUNKS] = "DELETE FROM chunks WHERE file_hash = ?;";
+    
+    sql[LOAD_AVAILABILITY] = "SELECT available_chunks FROM files WHERE file_hash = ?;";
+    
+    sql[STORE_AVAILABILITY] = "UPDATE files SET available_chunks = ? WHERE file_hash = ?;";
+    
+    sql[SET_CHUNK_ROWS_AVAILABLE] = R"(
+        UPDATE chunks SET is_available = ?
+        WHERE file_hash = ? AND chunk_index >= ? AND chunk_index < ?;
+    )";
+    
+    sql[CLEANUP_CANDIDATES] = R"(
+        SELECT file_hash, metadata_blob, available_chunks FROM files WHERE created_at < ?;
+    )";
+    
+    sql[SELECT_FILE] = "SELECT metadata_blob FROM files WHERE file_hash = ?;";
+    
+    sql[LIST_FILES] = "SELECT metadata_blob FROM files ORDER BY created_at DESC;";
+    
+    sql[SEARCH_FILES] = R"(
+        SELECT metadata_blob FROM files
+        WHERE filename LIKE ? OR file_type LIKE ? OR description LIKE ?
+        ORDER BY created_at DESC
+        LIMIT ?;
+    )";
+    
+    if (fts_available_) {
+        sql[DELETE_SEARCH_ENTRY] = R"(
+            DELETE FROM files_fts WHERE rowid = (SELECT rowid FROM files WHERE file_hash = ?);
+        )";
+        
+        sql[INSERT_SEARCH_ENTRY] = R"(
+            INSERT INTO files_fts (rowid, filename, file_type, description, tags)
+            SELECT rowid, ?, ?, ?, ? FROM files WHERE file_hash = ?;
+        )";
+        
+        // Column weights favour filename, then tags
+        sql[SEARCH_FILES_FTS] = R"(
+            SELECT f.metadata_blob FROM files_fts
+            JOIN files f ON f.rowid = files_fts.rowid
+            WHERE files_fts MATCH ?
+            ORDER BY bm25(files_fts, 10.0, 2.0, 1.0, 5.0)
+            LIMIT ?;
+        )";
+    }
+    
+    sql[FILE_EXISTS] = "SELECT 1 FROM files WHERE file_hash = ? LIMIT 1;";
+    
+    sql[FILE_COUNT] = "SELECT COUNT(*) FROM files;";
+    
+    sql[TOTAL_SIZE] = "SELECT SUM(file_size) FROM files;";
+    
+    sql[SELECT_AVAILABILITY] = "SELECT metadata_blob, available_chunks FROM files WHERE file_hash = ?;";
+    
+    sql[FIND_CHUNK_LOCATIONS] = R"(
+        SELECT file_hash, chunk_index FROM chunks
+        WHERE chunk_hash = ? AND is_available = 1
+        LIMIT ?;
+    )";
+    
+    for (size_t i = first; i < last; ++i) {
+        if (!sql[i]) {
+            continue;
+        }
+        if (sqlite3_prepare_v3(db, sql[i], -1, SQLITE_PREPARE_PERSISTENT, &statements[i], nullptr) != SQLITE_OK) {
+            cleanup_statements(statements);
+            return false;
+        }
+    }
+    
     return true;
 }
 
-void FileIndex::cleanup_statements() {
-    // Clean up prepared statements if any
+void FileIndex::cleanup_statements(Statements& statements) {
+    for (auto& stmt : statements) {
+        sqlite3_finalize(stmt);
+        stmt = nullptr;
+    }
+}
+
+FileIndex::ReadLease FileIndex::acquire_reader() {
+    std::unique_lock<std::mutex> lock(readers_mutex_);
+    if (!db_) {
+        return ReadLease(this, nullptr);
+    }
+    
+    readers_cv_.wait(lock, [this] { return !idle_readers_.empty() || open_readers_ < max_readers_; });
+    
+    if (!idle_readers_.empty()) {
+        auto reader = std::move(idle_readers_.back());
+        idle_readers_.pop_back();
+        return ReadLease(this, std::move(reader));
+    }
+    
+    ++open_readers_;
+    lock.unlock();
+    
+    auto reader = std::make_unique<ReadConnection>();
+    int result = sqlite3_open_v2(db_path_.string().c_str(), &reader->db,
+                                 SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, nullptr);
+    if (result != SQLITE_OK || !configure_connection(reader->db, false) ||
+        !prepare_statements(reader->db, reader->statements, FIRST_READ_STATEMENT, STATEMENT_COUNT)) {
+        close_reader(*reader);
+        
+        lock.lock();
+        --open_readers_;
+        readers_cv_.notify_one();
+        return ReadLease(this, nullptr);
+    }
+    
+    return ReadLease(this, std::move(reader));
+}
+
+void FileIndex::release_reader(std::unique_ptr<ReadConnection> reader) {
+    {
+        std::lock_guard<std::mutex> lock(readers_mutex_);
+        idle_readers_.push_back(std::move(reader));
+    }
+    readers_cv_.notify_one();
+}
+
+void FileIndex::close_reader(ReadConnection& reader) {
+    cleanup_statements(reader.statements);
+    if (reader.db) {
+        sqlite3_close(reader.db);
+        reader.db = nullptr;
+    }
 }
 
 bool FileIndex::add_file(const FileMetadata& metadata) {
-    const char* insert_file_sql = R"(
-        INSERT OR REPLACE INTO files 
-        (file_hash, filename, file_size, created_at, modified_at, chunk_size, file_type, description, metadata_blob)
-        VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?);
-    )";
+    std::lock_guard<std::mutex> lock(mutex_);
     
-    sqlite3_stmt* stmt;
-    int result = sqlite3_prepare_v2(db_, insert_file_sql, -1, &stmt, nullptr);
-    if (result != SQLITE_OK) {
+    // The file row and all of its chunk rows commit together, one sync per file
+    if (!exec(db_, "BEGIN IMMEDIATE;")) {
+        return false;
+    }
+    
+    if (!insert_file(metadata)) {
+        exec(db_, "ROLLBACK;");
+        return false;
+    }
+    
+    bool committed = exec(db_, "COMMIT;");
+    metadata_cache_.invalidate(metadata.file_hash);
+    return committed;
+}
+
+bool FileIndex::add_files(const std::vector<FileMetadata>& files) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    if (!exec(db_, "BEGIN IMMEDIATE;")) {
+        return false;
+    }
+    
+    for (const auto& metadata : files) {
+        if (!insert_file(metadata)) {
+            exec(db_, "ROLLBACK;");
+            return false;
+        }
+    }
+    
+    bool committed = exec(db_, "COMMIT;");
+    for (const auto& metadata : files) {
+        metadata_cache_.invalidate(metadata.file_hash);
+    }
+    return committed;
+}
+
+bool FileIndex::insert_file(const FileMetadata& metadata) {
+    ScopedStatement stmt(statements_[INSERT_FILE]);
+    if (!stmt) {
+        return false;
+    }
+    
+    // REPLACE gives the files row a new rowid, drop the entry keyed by the old one
+    if (!delete_search_entry(metadata.file_hash)) {
         return false;
     }
     
@@ -108,68 +612,145 @@ bool FileIndex::add_file(const FileMetadata& metadata) {
     auto modified_time = metadata.modified_at.time_since_epoch().count();
     auto serialized = serialize_metadata(metadata);
     
-    sqlite3_bind_text(stmt, 1, metadata.file_hash.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 2, metadata.filename.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_int64(stmt, 3, metadata.file_size);
-    sqlite3_bind_int64(stmt, 4, created_time);
-    sqlite3_bind_int64(stmt, 5, modified_time);
-    sqlite3_bind_int(stmt, 6, metadata.chunk_size);
-    sqlite3_bind_text(stmt, 7, metadata.file_type.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 8, metadata.description.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_blob(stmt, 9, serialized.data(), serialized.size(), SQLITE_STATIC);
-    
-    result = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    // Chunks with a known hash are on disk. Re-adding a partial file keeps
+    // what was downloaded since.
+    ChunkBitmap available;
+    if (metadata.chunk_hashes.size() < metadata.total_chunks()) {
+        available = load_availability(metadata.file_hash).value_or(ChunkBitmap());
+    }
+    available.insert_range(0, metadata.chunk_hashes.size());
+    auto available_blob = available.serialize();
     
-    if (result != SQLITE_DONE) {
+    sqlite3_bind_text(stmt.get(), 1, metadata.file_hash.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt.get(), 2, metadata.filename.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt.get(), 3, metadata.file_size);
+    sqlite3_bind_int64(stmt.get(), 4, created_time);
+    sqlite3_bind_int64(stmt.get(), 5, modified_time);
+    sqlite3_bind_int(stmt.get(), 6, metadata.chunk_size);
+    sqlite3_bind_text(stmt.get(), 7, metadata.file_type.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt.get(), 8, metadata.description.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_blob(stmt.get(), 9, serialized.data(), serialized.size(), SQLITE_STATIC);
+    sqlite3_bind_blob(stmt.get(), 10, available_blob.data(), static_cast<int>(available_blob.size()), SQLITE_STATIC);
+    
+    if (sqlite3_step(stmt.get()) != SQLITE_DONE || !insert_search_entry(metadata)) {
         return false;
     }
     
+    if (!index_chunk_hashes_) {
+        return true;
+    }
+    
     // Insert chunk information
     for (size_t i = 0; i < metadata.chunk_hashes.size(); ++i) {
-        const char* insert_chunk_sql = R"(
-            INSERT OR REPLACE INTO chunks (file_hash, chunk_index, chunk_hash, is_available)
-            VALUES (?, ?, ?, 1);
-        )";
-        
-        sqlite3_stmt* chunk_stmt;
-        result = sqlite3_prepare_v2(db_, insert_chunk_sql, -1, &chunk_stmt, nullptr);
-        if (result != SQLITE_OK) {
-            continue;
+        const auto& chunk_hash = metadata.chunk_hashes[i];
+        if (!insert_chunk(metadata.file_hash, i, chunk_hash.data(), chunk_hash.size())) {
+            return false;
         }
-        
-        sqlite3_bind_text(chunk_stmt, 1, metadata.file_hash.c_str(), -1, SQLITE_STATIC);
-        sqlite3_bind_int64(chunk_stmt, 2, i);
-        sqlite3_bind_text(chunk_stmt, 3, metadata.chunk_hashes[i].c_str(), -1, SQLITE_STATIC);
-        
-        sqlite3_step(chunk_stmt);
-        sqlite3_finalize(chunk_stmt);
     }
     
     return true;
 }
 
+bool FileIndex::insert_chunk(const std::string& file_hash, size_t chunk_index,
+                             const void* chunk_hash, size_t hash_size) {
+    ScopedStatement stmt(statements_[INSERT_CHUNK]);
+    if (!stmt) {
+        return false;
+    }
+    
+    sqlite3_bind_text(stmt.get(), 1, file_hash.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt.get(), 2, chunk_index);
+    sqlite3_bind_blob(stmt.get(), 3, chunk_hash, static_cast<int>(hash_size), SQLITE_STATIC);
+    
+    return sqlite3_step(stmt.get()) == SQLITE_DONE;
+}
+
+bool FileIndex::delete_file_rows(const std::string& file_hash) {
+    ScopedStatement delete_file(statements_[DELETE_FILE]);
+    ScopedStatement delete_chunks(statements_[DELETE_CHUNKS]);
+    if (!delete_file || !delete_chunks || !delete_search_entry(file_hash)) {
+        return false;
+    }
+    
+    sqlite3_bind_text(delete_file.get(), 1, file_hash.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(delete_chunks.get(), 1, file_hash.c_str(), -1, SQLITE_STATIC);
+    return sqlite3_step(delete_file.get()) == SQLITE_DONE && sqlite3_step(delete_chunks.get()) == SQLITE_DONE;
+}
+
+std::optional<ChunkBitmap> FileIndex::load_availability(const std::string& file_hash) {
+    ScopedStatement stmt(statements_[LOAD_AVAILABILITY]);
+    if (!stmt) {
+        return std::nullopt;
+    }
+    
+    sqlite3_bind_text(stmt.get(), 1, file_hash.c_str(), -1, SQLITE_STATIC);
+    if (sqlite3_step(stmt.get()) != SQLITE_ROW) {
+        return std::nullopt;
+    }
+    
+    return ChunkBitmap::deserialize(column_blob(stmt.get(), 0)).value_or(ChunkBitmap());
+}
+
+bool FileIndex::store_availability(const std::string& file_hash, const ChunkBitmap& available) {
+    ScopedStatement stmt(statements_[STORE_AVAILABILITY]);
+    if (!stmt) {
+        return false;
+    }
+    
+    auto blob = available.serialize();
+    sqlite3_bind_blob(stmt.get(), 1, blob.data(), static_cast<int>(blob.size()), SQLITE_STATIC);
+    sqlite3_bind_text(stmt.get(), 2, file_hash.c_str(), -1, SQLITE_STATIC);
+    return sqlite3_step(stmt.get()) == SQLITE_DONE;
+}
+
+bool FileIndex::delete_search_entry(const std::string& file_hash) {
+    if (!fts_available_) {
+        return true;
+    }
+    
+    ScopedStatement stmt(statements_[DELETE_SEARCH_ENTRY]);
+    if (!stmt) {
+        return false;
+    }
+    
+    sqlite3_bind_text(stmt.get(), 1, file_hash.c_str(), -1, SQLITE_STATIC);
+    return sqlite3_step(stmt.get()) == SQLITE_DONE;
+}
+
+bool FileIndex::insert_search_entry(const FileMetadata& metadata) {
+    if (!fts_available_) {
+        return true;
+    }
+    
+    ScopedStatement stmt(statements_[INSERT_SEARCH_ENTRY]);
+    if (!stmt) {
+        return false;
+    }
+    
+    auto tags = join_tags(metadata.tags);
+    sqlite3_bind_text(stmt.get(), 1, metadata.filename.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt.get(), 2, metadata.file_type.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt.get(), 3, metadata.description.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt.get(), 4, tags.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt.get(), 5, metadata.file_hash.c_str(), -1, SQLITE_STATIC);
+    return sqlite3_step(stmt.get()) == SQLITE_DONE;
+}
+
 bool FileIndex::update_file(const FileMetadata& metadata) {
     return add_file(metadata); // Same as add with REPLACE
 }
 
 hypershare::crypto::CryptoResult FileIndex::remove_file(const std::string& file_hash) {
-    const char* delete_sql = "DELETE FROM files WHERE file_hash = ?;";
+    std::lock_guard<std::mutex> lock(mutex_);
     
-    sqlite3_stmt* stmt;
-    int result = sqlite3_prepare_v2(db_, delete_sql, -1, &stmt, nullptr);
-    if (result != SQLITE_OK) {
-        return hypershare::crypto::CryptoResult(
-            hypershare::crypto::CryptoError::FILE_WRITE_ERROR,
-            "Failed to prepare delete statement"
-        );
+    bool removed = exec(db_, "BEGIN IMMEDIATE;");
+    if (removed) {
+        removed = delete_file_rows(file_hash);
+        exec(db_, removed ? "COMMIT;" : "ROLLBACK;");
+        metadata_cache_.invalidate(file_hash);
     }
     
-    sqlite3_bind_text(stmt, 1, file_hash.c_str(), -1, SQLITE_STATIC);
-    result = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-    
-    if (result == SQLITE_DONE) {
+    if (removed) {
         return hypershare::crypto::CryptoResult(hypershare::crypto::CryptoError::SUCCESS);
     } else {
         return hypershare::crypto::CryptoResult(
@@ -180,33 +761,52 @@ hypershare::crypto::CryptoResult FileIndex::remove_file(const std::string& file_
 }
 
 std::optional<FileMetadata> FileIndex::get_file(const std::string& file_hash) {
-    const char* select_sql = "SELECT metadata_blob FROM files WHERE file_hash = ?;";
-    
-    sqlite3_stmt* stmt;
-    int result = sqlite3_prepare_v2(db_, select_sql, -1, &stmt, nullptr);
-    if (result != SQLITE_OK) {
+    auto metadata = get_file_shared(file_hash);
+    if (!metadata) {
         return std::nullopt;
     }
     
-    sqlite3_bind_text(stmt, 1, file_hash.c_str(), -1, SQLITE_STATIC);
-    result = sqlite3_step(stmt);
+    return *metadata;
+}
+
+std::shared_ptr<const FileMetadata> FileIndex::get_file_shared(const std::string& file_hash) {
+    if (auto cached = metadata_cache_.get(file_hash)) {
+        return cached;
+    }
     
-    if (result != SQLITE_ROW) {
-        sqlite3_finalize(stmt);
-        return std::nullopt;
+    // Read before the query, see MetadataCache::put
+    uint64_t generation = metadata_cache_.generation();
+    
+    std::optional<FileMetadata> loaded;
+    {
+        auto reader = acquire_reader();
+        if (!reader) {
+            return nullptr;
+        }
+        loaded = load_file(*reader, file_hash);
     }
     
-    const void* blob_data = sqlite3_column_blob(stmt, 0);
-    int blob_size = sqlite3_column_bytes(stmt, 0);
+    if (!loaded) {
+        return nullptr;
+    }
     
-    std::vector<uint8_t> serialized_data(
-        static_cast<const uint8_t*>(blob_data),
-        static_cast<const uint8_t*>(blob_data) + blob_size
-    );
+    auto metadata = std::make_shared<const FileMetadata>(std::move(*loaded));
+    metadata_cache_.put(metadata, generation);
+    return metadata;
+}
+
+std::optional<FileMetadata> FileIndex::load_file(ReadConnection& reader, const std::string& file_hash) {
+    ScopedStatement stmt(reader.statements[SELECT_FILE]);
+    if (!stmt) {
+        return std::nullopt;
+    }
     
-    sqlite3_finalize(stmt);
+    sqlite3_bind_text(stmt.get(), 1, file_hash.c_str(), -1, SQLITE_STATIC);
+    if (sqlite3_step(stmt.get()) != SQLITE_ROW) {
+        return std::nullopt;
+    }
     
-    return deserialize_metadata(serialized_data);
+    return deserialize_metadata(column_blob(stmt.get(), 0));
 }
 
 hypershare::crypto::CryptoResult FileIndex::get_file(const std::string& file_id, FileMetadata& metadata) {
@@ -225,225 +825,291 @@ hypershare::crypto::CryptoResult FileIndex::get_file(const std::string& file_id,
 }
 
 std::vector<FileMetadata> FileIndex::list_files() {
-    std::vector<FileMetadata> files;
-    const char* select_sql = "SELECT metadata_blob FROM files ORDER BY created_at DESC;";
-    
-    sqlite3_stmt* stmt;
-    int result = sqlite3_prepare_v2(db_, select_sql, -1, &stmt, nullptr);
-    if (result != SQLITE_OK) {
-        return files;
+    auto reader = acquire_reader();
+    ScopedStatement stmt(reader ? reader.statement(LIST_FILES) : nullptr);
+    if (!stmt) {
+        return {};
     }
     
-    while ((result = sqlite3_step(stmt)) == SQLITE_ROW) {
-        const void* blob_data = sqlite3_column_blob(stmt, 0);
-        int blob_size = sqlite3_column_bytes(stmt, 0);
-        
-        std::vector<uint8_t> serialized_data(
-            static_cast<const uint8_t*>(blob_data),
-            static_cast<const uint8_t*>(blob_data) + blob_size
-        );
-        
-        files.push_back(deserialize_metadata(serialized_data));
+    return collect_files(stmt.get());
+}
+
+void FileIndex::for_each_file(const std::function<void(const FileMetadataView&)>& visitor) {
+    auto reader = acquire_reader();
+    ScopedStatement stmt(reader ? reader.statement(LIST_FILES) : nullptr);
+    if (!stmt) {
+        return;
     }
     
-    sqlite3_finalize(stmt);
-    return files;
+    while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+        if (auto metadata = FileMetadataView::parse(column_blob(stmt.get(), 0))) {
+            visitor(*metadata);
+        }
+    }
 }
 
-std::vector<FileMetadata> FileIndex::search_files(const std::string& query) {
-    std::vector<FileMetadata> files;
-    const char* search_sql = R"(
-        SELECT metadata_blob FROM files 
-        WHERE filename LIKE ? OR file_type LIKE ? OR description LIKE ?
-        ORDER BY created_at DESC;
-    )";
+std::vector<FileMetadata> FileIndex::search_files(const std::string& query, size_t limit) {
+    auto reader = acquire_reader();
+    if (!reader) {
+        return {};
+    }
     
-    sqlite3_stmt* stmt;
-    int result = sqlite3_prepare_v2(db_, search_sql, -1, &stmt, nullptr);
-    if (result != SQLITE_OK) {
-        return files;
+    sqlite3_int64 row_limit = limit == 0 ? -1 : static_cast<sqlite3_int64>(limit);
+    
+    auto match = fts_available_ ? to_fts_query(query) : std::string();
+    if (!match.empty()) {
+        ScopedStatement stmt(reader.statement(SEARCH_FILES_FTS));
+        sqlite3_bind_text(stmt.get(), 1, match.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt.get(), 2, row_limit);
+        return collect_files(stmt.get());
     }
     
+    ScopedStatement stmt(reader.statement(SEARCH_FILES));
+    
     std::string search_pattern = "%" + query + "%";
-    sqlite3_bind_text(stmt, 1, search_pattern.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 2, search_pattern.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 3, search_pattern.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt.get(), 1, search_pattern.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt.get(), 2, search_pattern.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt.get(), 3, search_pattern.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt.get(), 4, row_limit);
     
-    while ((result = sqlite3_step(stmt)) == SQLITE_ROW) {
-        const void* blob_data = sqlite3_column_blob(stmt, 0);
-        int blob_size = sqlite3_column_bytes(stmt, 0);
-        
-        std::vector<uint8_t> serialized_data(
-            static_cast<const uint8_t*>(blob_data),
-            static_cast<const uint8_t*>(blob_data) + blob_size
-        );
-        
-        files.push_back(deserialize_metadata(serialized_data));
+    return collect_files(stmt.get());
+}
+
+std::vector<FileMetadata> FileIndex::collect_files(sqlite3_stmt* stmt) {
+    std::vector<FileMetadata> files;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        files.push_back(deserialize_metadata(column_blob(stmt, 0)));
     }
-    
-    sqlite3_finalize(stmt);
     return files;
 }
 
 bool FileIndex::file_exists(const std::string& file_hash) {
-    const char* exists_sql = "SELECT 1 FROM files WHERE file_hash = ? LIMIT 1;";
-    
-    sqlite3_stmt* stmt;
-    int result = sqlite3_prepare_v2(db_, exists_sql, -1, &stmt, nullptr);
-    if (result != SQLITE_OK) {
+    auto reader = acquire_reader();
+    ScopedStatement stmt(reader ? reader.statement(FILE_EXISTS) : nullptr);
+    if (!stmt) {
         return false;
     }
     
-    sqlite3_bind_text(stmt, 1, file_hash.c_str(), -1, SQLITE_STATIC);
-    result = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-    
-    return result == SQLITE_ROW;
+    sqlite3_bind_text(stmt.get(), 1, file_hash.c_str(), -1, SQLITE_STATIC);
+    return sqlite3_step(stmt.get()) == SQLITE_ROW;
 }
 
 size_t FileIndex::get_file_count() {
-    const char* count_sql = "SELECT COUNT(*) FROM files;";
-    
-    sqlite3_stmt* stmt;
-    int result = sqlite3_prepare_v2(db_, count_sql, -1, &stmt, nullptr);
-    if (result != SQLITE_OK) {
+    auto reader = acquire_reader();
+    ScopedStatement stmt(reader ? reader.statement(FILE_COUNT) : nullptr);
+    if (!stmt) {
         return 0;
     }
     
-    result = sqlite3_step(stmt);
-    size_t count = (result == SQLITE_ROW) ? sqlite3_column_int64(stmt, 0) : 0;
-    sqlite3_finalize(stmt);
-    
-    return count;
+    return sqlite3_step(stmt.get()) == SQLITE_ROW ? sqlite3_column_int64(stmt.get(), 0) : 0;
 }
 
 uint64_t FileIndex::get_total_size() {
-    const char* size_sql = "SELECT SUM(file_size) FROM files;";
-    
-    sqlite3_stmt* stmt;
-    int result = sqlite3_prepare_v2(db_, size_sql, -1, &stmt, nullptr);
-    if (result != SQLITE_OK) {
+    auto reader = acquire_reader();
+    ScopedStatement stmt(reader ? reader.statement(TOTAL_SIZE) : nullptr);
+    if (!stmt) {
         return 0;
     }
     
-    result = sqlite3_step(stmt);
-    uint64_t total_size = (result == SQLITE_ROW) ? sqlite3_column_int64(stmt, 0) : 0;
-    sqlite3_finalize(stmt);
-    
-    return total_size;
+    return sqlite3_step(stmt.get()) == SQLITE_ROW ? sqlite3_column_int64(stmt.get(), 0) : 0;
+}
+
+bool FileIndex::update_chunk_progress(const std::string& file_hash,
+                                      size_t chunk_index,
+                                      const hypershare::crypto::Blake3Hash& chunk_hash) {
+    return record_chunk(file_hash, chunk_index, chunk_hash.data(), chunk_hash.size());
 }
 
 bool FileIndex::update_chunk_progress(const std::string& file_hash,
                                       size_t chunk_index,
                                       const std::string& chunk_hash) {
-    const char* update_sql = R"(
-        INSERT OR REPLACE INTO chunks (file_hash, chunk_index, chunk_hash, is_available)
-        VALUES (?, ?, ?, 1);
-    )";
+    if (auto hash = hypershare::crypto::hash_utils::hash_from_hex(chunk_hash)) {
+        return update_chunk_progress(file_hash, chunk_index, *hash);
+    }
     
-    sqlite3_stmt* stmt;
-    int result = sqlite3_prepare_v2(db_, update_sql, -1, &stmt, nullptr);
-    if (result != SQLITE_OK) {
+    return record_chunk(file_hash, chunk_index, chunk_hash.data(), chunk_hash.size());
+}
+
+bool FileIndex::record_chunk(const std::string& file_hash, size_t chunk_index,
+                             const void* chunk_hash, size_t hash_size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!exec(db_, "BEGIN IMMEDIATE;")) {
         return false;
     }
     
-    sqlite3_bind_text(stmt, 1, file_hash.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_int64(stmt, 2, chunk_index);
-    sqlite3_bind_text(stmt, 3, chunk_hash.c_str(), -1, SQLITE_STATIC);
-    
-    result = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    auto available = load_availability(file_hash);
+    bool recorded = available.has_value();
+    if (recorded && index_chunk_hashes_) {
+        recorded = insert_chunk(file_hash, chunk_index, chunk_hash, hash_size);
+    }
+    // The bitmap is only rewritten when the chunk is new
+    if (recorded && available->insert(chunk_index)) {
+        recorded = store_availability(file_hash, *available);
+    }
     
-    return result == SQLITE_DONE;
+    exec(db_, recorded ? "COMMIT;" : "ROLLBACK;");
+    return recorded;
 }
 
-std::vector<size_t> FileIndex::get_missing_chunks(const std::string& file_hash) {
-    std::vector<size_t> missing_chunks;
+bool FileIndex::mark_chunks_available(const std::string& file_hash, size_t first, size_t count) {
+    return set_chunk_range(file_hash, first, count, true);
+}
+
+bool FileIndex::mark_chunks_missing(const std::string& file_hash, size_t first, size_t count) {
+    return set_chunk_range(file_hash, first, count, false);
+}
+
+bool FileIndex::set_chunk_range(const std::string& file_hash, size_t first, size_t count, bool available) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!exec(db_, "BEGIN IMMEDIATE;")) {
+        return false;
+    }
     
-    // First get total expected chunks
-    auto metadata_opt = get_file(file_hash);
-    if (!metadata_opt) {
-        return missing_chunks;
+    auto bitmap = load_availability(file_hash);
+    bool updated = bitmap.has_value();
+    if (updated) {
+        if (available) {
+            bitmap->insert_range(first, first + count);
+        } else {
+            bitmap->erase_range(first, first + count);
+        }
+        updated = store_availability(file_hash, *bitmap);
     }
     
-    auto metadata = *metadata_opt;
-    size_t total_chunks = metadata.total_chunks();
+    // Keeps find_chunk_locations from offering chunks that are gone
+    if (updated && index_chunk_hashes_) {
+        ScopedStatement stmt(statements_[SET_CHUNK_ROWS_AVAILABLE]);
+        sqlite3_bind_int(stmt.get(), 1, available ? 1 : 0);
+        sqlite3_bind_text(stmt.get(), 2, file_hash.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt.get(), 3, static_cast<sqlite3_int64>(first));
+        sqlite3_bind_int64(stmt.get(), 4, static_cast<sqlite3_int64>(first + count));
+        updated = sqlite3_step(stmt.get()) == SQLITE_DONE;
+    }
     
-    // Get available chunks
-    const char* available_sql = R"(
-        SELECT chunk_index FROM chunks 
-        WHERE file_hash = ? AND is_available = 1
-        ORDER BY chunk_index;
-    )";
+    exec(db_, updated ? "COMMIT;" : "ROLLBACK;");
+    return updated;
+}
+
+std::optional<FileIndex::ChunkProgress> FileIndex::load_progress(const std::string& file_hash) {
+    auto reader = acquire_reader();
+    ScopedStatement stmt(reader ? reader.statement(SELECT_AVAILABILITY) : nullptr);
+    if (!stmt) {
+        return std::nullopt;
+    }
     
-    sqlite3_stmt* stmt;
-    int result = sqlite3_prepare_v2(db_, available_sql, -1, &stmt, nullptr);
-    if (result != SQLITE_OK) {
-        return missing_chunks;
+    sqlite3_bind_text(stmt.get(), 1, file_hash.c_str(), -1, SQLITE_STATIC);
+    if (sqlite3_step(stmt.get()) != SQLITE_ROW) {
+        return std::nullopt;
     }
     
-    sqlite3_bind_text(stmt, 1, file_hash.c_str(), -1, SQLITE_STATIC);
+    auto metadata = FileMetadataView::parse(column_blob(stmt.get(), 0));
+    if (!metadata) {
+        return std::nullopt;
+    }
     
-    std::vector<bool> available(total_chunks, false);
-    while ((result = sqlite3_step(stmt)) == SQLITE_ROW) {
-        size_t chunk_index = sqlite3_column_int64(stmt, 0);
-        if (chunk_index < total_chunks) {
-            available[chunk_index] = true;
-        }
+    ChunkProgress progress;
+    progress.total_chunks = metadata->total_chunks();
+    progress.available = ChunkBitmap::deserialize(column_blob(stmt.get(), 1)).value_or(ChunkBitmap());
+    return progress;
+}
+
+ChunkBitmap FileIndex::get_available_chunks(const std::string& file_hash) {
+    auto progress = load_progress(file_hash);
+    return progress ? std::move(progress->available) : ChunkBitmap();
+}
+
+std::vector<size_t> FileIndex::get_missing_chunks(const std::string& file_hash) {
+    auto progress = load_progress(file_hash);
+    if (!progress) {
+        return {};
     }
-    sqlite3_finalize(stmt);
     
-    // Find missing chunks
-    for (size_t i = 0; i < total_chunks; ++i) {
-        if (!available[i]) {
-            missing_chunks.push_back(i);
-        }
+    auto missing = progress->available.missing(progress->total_chunks);
+    return std::vector<size_t>(missing.begin(), missing.end());
+}
+
+std::optional<size_t> FileIndex::next_missing_chunk(const std::string& file_hash, size_t from) {
+    auto progress = load_progress(file_hash);
+    if (!progress) {
+        return std::nullopt;
+    }
+    
+    uint64_t next = progress->available.next_missing(from);
+    if (next >= progress->total_chunks) {
+        return std::nullopt;
     }
+    return static_cast<size_t>(next);
+}
+
+std::vector<ChunkLocation> FileIndex::find_chunk_locations(const hypershare::crypto::Blake3Hash& chunk_hash,
+                                                           size_t limit) {
+    std::vector<ChunkLocation> locations;
+    auto reader = acquire_reader();
+    ScopedStatement stmt(reader ? reader.statement(FIND_CHUNK_LOCATIONS) : nullptr);
+    if (!stmt) {
+        return locations;
+    }
+    
+    sqlite3_bind_blob(stmt.get(), 1, chunk_hash.data(), static_cast<int>(chunk_hash.size()), SQLITE_STATIC);
+    sqlite3_bind_int64(stmt.get(), 2, static_cast<sqlite3_int64>(limit));
     
-    return missing_chunks;
+    while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+        ChunkLocation location;
+        location.file_hash = reinterpret_cast<const char*>(sqlite3_column_text(stmt.get(), 0));
+        location.chunk_index = static_cast<size_t>(sqlite3_column_int64(stmt.get(), 1));
+        locations.push_back(std::move(location));
+    }
+    
+    return locations;
 }
 
 void FileIndex::cleanup_incomplete_files(const std::chrono::system_clock::time_point& cutoff_time) {
+    std::lock_guard<std::mutex> lock(mutex_);
     auto cutoff_timestamp = cutoff_time.time_since_epoch().count();
     
-    const char* cleanup_sql = R"(
-        DELETE FROM files 
-        WHERE created_at < ? AND file_hash IN (
-            SELECT f.file_hash FROM files f
-            LEFT JOIN chunks c ON f.file_hash = c.file_hash AND c.is_available = 1
-            GROUP BY f.file_hash
-            HAVING COUNT(c.chunk_index) < (f.file_size + f.chunk_size - 1) / f.chunk_size
-        );
-    )";
+    // The chunk total comes from the metadata: content-defined chunks have no
+    // fixed size to divide the file size by
+    std::vector<std::string> incomplete;
+    {
+        ScopedStatement stmt(statements_[CLEANUP_CANDIDATES]);
+        if (!stmt) {
+            return;
+        }
+        
+        sqlite3_bind_int64(stmt.get(), 1, cutoff_timestamp);
+        while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+            auto metadata = FileMetadataView::parse(column_blob(stmt.get(), 1));
+            auto available = ChunkBitmap::deserialize(column_blob(stmt.get(), 2)).value_or(ChunkBitmap());
+            if (metadata && available.next_missing(0) < metadata->total_chunks()) {
+                incomplete.emplace_back(reinterpret_cast<const char*>(sqlite3_column_text(stmt.get(), 0)));
+            }
+        }
+    }
     
-    sqlite3_stmt* stmt;
-    int result = sqlite3_prepare_v2(db_, cleanup_sql, -1, &stmt, nullptr);
-    if (result != SQLITE_OK) {
+    if (incomplete.empty() || !exec(db_, "BEGIN IMMEDIATE;")) {
         return;
     }
     
-    sqlite3_bind_int64(stmt, 1, cutoff_timestamp);
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    bool removed = true;
+    for (const auto& file_hash : incomplete) {
+        removed = removed && delete_file_rows(file_hash);
+    }
+    exec(db_, removed ? "COMMIT;" : "ROLLBACK;");
+    
+    metadata_cache_.clear();
 }
 
 bool FileIndex::vacuum_database() {
-    char* error_msg = nullptr;
-    int result = sqlite3_exec(db_, "VACUUM;", nullptr, nullptr, &error_msg);
-    
-    if (error_msg) {
-        sqlite3_free(error_msg);
-    }
-    
-    return result == SQLITE_OK;
+    std::lock_guard<std::mutex> lock(mutex_);
+    return exec(db_, "VACUUM;");
 }
 
 std::vector<uint8_t> FileIndex::serialize_metadata(const FileMetadata& metadata) {
     return metadata.serialize();
 }
 
-FileMetadata FileIndex::deserialize_metadata(const std::vector<uint8_t>& data) {
+FileMetadata FileIndex::deserialize_metadata(std::span<const uint8_t> data) {
     return FileMetadata::deserialize(data);
 }
 
-} // namespace hypershare::storage
\ No newline at end of file
+} // namespace hypershare::storage
@@ -1,9 +1,89 @@
 #include "hypershare/storage/file_metadata.hpp"
-#include <sstream>
-#include <iomanip>
+#include "hypershare/crypto/hash.hpp"
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
 
 namespace hypershare::storage {
 
+namespace {
+
+// Set in the serialized chunk hash count when the hashes follow as raw 32-byte
+// arrays. Blobs written before that carry length-prefixed hex strings instead.
+constexpr uint32_t RAW_CHUNK_HASHES = 0x80000000u;
+
+// Flat layout, all integers little-endian and offsets relative to the blob:
+//
+//   header   fixed fields, then (offset, length) of each string and
+//            (offset, count) of each array, see the *_REF constants
+//   data     chunk offsets (u64), chunk hashes (32 bytes each), the tag table
+//            of (offset, length) pairs, then string bytes
+//
+// New header fields are only ever appended: readers skip header_size bytes and
+// ignore what they do not know. Incompatible changes bump FORMAT_VERSION.
+constexpr uint32_t FORMAT_MAGIC = 0x324D5348; // "HSM2"
+constexpr uint16_t FORMAT_VERSION = 2;
+
+constexpr size_t MAGIC = 0;
+constexpr size_t VERSION = 4;
+constexpr size_t HEADER_SIZE = 6;
+constexpr size_t HASH_SCHEME = 8;
+constexpr size_t CHUNKING_MODE = 9;
+constexpr size_t CHUNK_SIZE = 12;
+constexpr size_t CHUNK_COUNT = 16;
+constexpr size_t CDC_MIN_SIZE = 20;
+constexpr size_t CDC_AVG_SIZE = 24;
+constexpr size_t FILE_SIZE = 32;
+constexpr size_t CREATED_AT = 40;
+constexpr size_t MODIFIED_AT = 48;
+constexpr size_t FILE_ID_REF = 56;
+constexpr size_t FILE_HASH_REF = 64;
+constexpr size_t FILENAME_REF = 72;
+constexpr size_t FILE_PATH_REF = 80;
+constexpr size_t FILE_TYPE_REF = 88;
+constexpr size_t DESCRIPTION_REF = 96;
+constexpr size_t TAGS_REF = 104;
+constexpr size_t CHUNK_HASHES_REF = 112;
+constexpr size_t CHUNK_OFFSETS_REF = 120;
+constexpr size_t FIXED_HEADER_SIZE = 128;
+
+constexpr size_t REF_SIZE = 2 * sizeof(uint32_t);
+constexpr size_t STRING_REFS[] = {
+    FILE_ID_REF, FILE_HASH_REF, FILENAME_REF, FILE_PATH_REF, FILE_TYPE_REF, DESCRIPTION_REF
+};
+
+template <typename T>
+void store_le(uint8_t* out, T value) {
+    auto bits = static_cast<std::make_unsigned_t<T>>(value);
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        out[i] = static_cast<uint8_t>(bits >> (8 * i));
+    }
+}
+
+template <typename T>
+T load_le(const uint8_t* in) {
+    std::make_unsigned_t<T> bits = 0;
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        bits |= static_cast<std::make_unsigned_t<T>>(in[i]) << (8 * i);
+    }
+    return static_cast<T>(bits);
+}
+
+void store_ref(uint8_t* out, size_t offset, size_t length) {
+    store_le<uint32_t>(out, static_cast<uint32_t>(offset));
+    store_le<uint32_t>(out + sizeof(uint32_t), static_cast<uint32_t>(length));
+}
+
+bool ref_in_bounds(std::span<const uint8_t> data, size_t ref_offset, size_t element_size) {
+    uint64_t offset = load_le<uint32_t>(data.data() + ref_offset);
+    uint64_t length = load_le<uint32_t>(data.data() + ref_offset + sizeof(uint32_t));
+    return offset + length * element_size <= data.size();
+}
+
+FileMetadata deserialize_stream(std::span<const uint8_t> data);
+
+} // namespace
+
 FileMetadata::FileMetadata(const std::string& hash, const std::string& name, uint64_t size)
     : file_hash(hash)
     , filename(name)
@@ -16,67 +96,97 @@ FileMetadata::FileMetadata(const std::string& hash, const std::string& name, uin
 }
 
 std::vector<uint8_t> FileMetadata::serialize() const {
-    std::ostringstream oss;
-    
-    // Write file_id
-    uint32_t id_size = static_cast<uint32_t>(file_id.size());
-    oss.write(reinterpret_cast<const char*>(&id_size), sizeof(id_size));
-    oss.write(file_id.c_str(), id_size);
+    return serialize_fields(true);
+}
+
+std::vector<uint8_t> FileMetadata::serialize_manifest() const {
+    return serialize_fields(file_hash_scheme != FileHashScheme::CHUNK_TREE);
+}
+
+std::vector<uint8_t> FileMetadata::serialize_fields(bool include_chunk_hashes) const {
+    using hypershare::crypto::Blake3Hash;
     
-    // Write file_hash
-    uint32_t hash_size = static_cast<uint32_t>(file_hash.size());
-    oss.write(reinterpret_cast<const char*>(&hash_size), sizeof(hash_size));
-    oss.write(file_hash.c_str(), hash_size);
+    const std::string* strings[] = {&file_id, &file_hash, &filename, &file_path, &file_type, &description};
+    size_t hash_count = include_chunk_hashes ? chunk_hashes.size() : 0;
+    size_t offset_count = is_content_defined() ? chunk_offsets.size() : 0;
     
-    // Write filename
-    uint32_t name_size = static_cast<uint32_t>(filename.size());
-    oss.write(reinterpret_cast<const char*>(&name_size), sizeof(name_size));
-    oss.write(filename.c_str(), name_size);
+    // Arrays first, so the u64 offsets sit 8-byte aligned behind the header
+    size_t offsets_at = FIXED_HEADER_SIZE;
+    size_t hashes_at = offsets_at + offset_count * sizeof(uint64_t);
+    size_t tags_at = hashes_at + hash_count * sizeof(Blake3Hash);
+    size_t strings_at = tags_at + tags.size() * REF_SIZE;
     
-    // Write file_path
-    uint32_t path_size = static_cast<uint32_t>(file_path.size());
-    oss.write(reinterpret_cast<const char*>(&path_size), sizeof(path_size));
-    oss.write(file_path.c_str(), path_size);
+    size_t total_size = strings_at;
+    for (const auto* str : strings) {
+        total_size += str->size();
+    }
+    for (const auto& tag : tags) {
+        total_size += tag.size();
+    }
+    if (total_size > UINT32_MAX) {
+        throw std::length_error("File metadata too large to serialize");
+    }
     
-    // Write file_size
-    oss.write(reinterpret_cast<const char*>(&file_size), sizeof(file_size));
+    std::vector<uint8_t> data(total_size);
+    uint8_t* out = data.data();
     
-    // Write timestamps
-    auto created_time = created_at.time_since_epoch().count();
-    auto modified_time = modified_at.time_since_epoch().count();
-    oss.write(reinterpret_cast<const char*>(&created_time), sizeof(created_time));
-    oss.write(reinterpret_cast<const char*>(&modified_time), sizeof(modified_time));
+    store_le<uint32_t>(out + MAGIC, FORMAT_MAGIC);
+    store_le<uint16_t>(out + VERSION, FORMAT_VERSION);
+    store_le<uint16_t>(out + HEADER_SIZE, FIXED_HEADER_SIZE);
+    out[HASH_SCHEME] = static_cast<uint8_t>(file_hash_scheme);
+    out[CHUNKING_MODE] = static_cast<uint8_t>(chunking_mode);
+    store_le<uint32_t>(out + CHUNK_SIZE, chunk_size);
+    store_le<uint32_t>(out + CHUNK_COUNT, chunk_count);
+    store_le<uint32_t>(out + CDC_MIN_SIZE, cdc_min_size);
+    store_le<uint32_t>(out + CDC_AVG_SIZE, cdc_avg_size);
+    store_le<uint64_t>(out + FILE_SIZE, file_size);
+    store_le<int64_t>(out + CREATED_AT, created_at.time_since_epoch().count());
+    store_le<int64_t>(out + MODIFIED_AT, modified_at.time_since_epoch().count());
     
-    // Write chunk_hashes
-    uint32_t chunk_count = static_cast<uint32_t>(chunk_hashes.size());
-    oss.write(reinterpret_cast<const char*>(&chunk_count), sizeof(chunk_count));
-    for (const auto& chunk_hash : chunk_hashes) {
-        uint32_t chunk_hash_size = static_cast<uint32_t>(chunk_hash.size());
-        oss.write(reinterpret_cast<const char*>(&chunk_hash_size), sizeof(chunk_hash_size));
-        oss.write(chunk_hash.c_str(), chunk_hash_size);
+    store_ref(out + CHUNK_OFFSETS_REF, offsets_at, offset_count);
+    for (size_t i = 0; i < offset_count; ++i) {
+        store_le<uint64_t>(out + offsets_at + i * sizeof(uint64_t), chunk_offsets[i]);
     }
     
-    // Write chunk_size
-    oss.write(reinterpret_cast<const char*>(&chunk_size), sizeof(chunk_size));
+    store_ref(out + CHUNK_HASHES_REF, hashes_at, hash_count);
+    if (hash_count > 0) {
+        std::memcpy(out + hashes_at, chunk_hashes.data(), hash_count * sizeof(Blake3Hash));
+    }
     
-    // Write chunk_count
-    oss.write(reinterpret_cast<const char*>(&chunk_count), sizeof(chunk_count));
+    size_t string_offset = strings_at;
+    for (size_t i = 0; i < std::size(strings); ++i) {
+        store_ref(out + STRING_REFS[i], string_offset, strings[i]->size());
+        std::memcpy(out + string_offset, strings[i]->data(), strings[i]->size());
+        string_offset += strings[i]->size();
+    }
     
-    // Write file_type
-    uint32_t type_size = static_cast<uint32_t>(file_type.size());
-    oss.write(reinterpret_cast<const char*>(&type_size), sizeof(type_size));
-    oss.write(file_type.c_str(), type_size);
+    store_ref(out + TAGS_REF, tags_at, tags.size());
+    for (size_t i = 0; i < tags.size(); ++i) {
+        store_ref(out + tags_at + i * REF_SIZE, string_offset, tags[i].size());
+        std::memcpy(out + string_offset, tags[i].data(), tags[i].size());
+        string_offset += tags[i].size();
+    }
     
-    // Write description
-    uint32_t desc_size = static_cast<uint32_t>(description.size());
-    oss.write(reinterpret_cast<const char*>(&desc_size), sizeof(desc_size));
-    oss.write(description.c_str(), desc_size);
+    return data;
+}
+
+FileMetadata FileMetadata::deserialize(std::span<const uint8_t> data) {
+    if (data.size() >= sizeof(uint32_t) && load_le<uint32_t>(data.data()) == FORMAT_MAGIC) {
+        auto view = FileMetadataView::parse(data);
+        if (!view) {
+            throw std::runtime_error("Malformed file metadata");
+        }
+        return view->to_metadata();
+    }
     
-    std::string str = oss.str();
-    return std::vector<uint8_t>(str.begin(), str.end());
+    // A stream blob starts with the file_id length, never anywhere near the magic
+    return deserialize_stream(data);
 }
 
-FileMetadata FileMetadata::deserialize(const std::vector<uint8_t>& data) {
+namespace {
+
+// Sequential host-endian layout used before the flat one
+FileMetadata deserialize_stream(std::span<const uint8_t> data) {
     FileMetadata metadata;
     size_t offset = 0;
     
@@ -125,19 +235,31 @@ FileMetadata FileMetadata::deserialize(const std::vector<uint8_t>& data) {
         std::chrono::system_clock::duration(modified_time));
     
     // Read chunk_hashes
-    uint32_t chunk_count;
-    std::memcpy(&chunk_count, data.data() + offset, sizeof(chunk_count));
-    offset += sizeof(chunk_count);
-    
-    metadata.chunk_hashes.reserve(chunk_count);
-    for (uint32_t i = 0; i < chunk_count; ++i) {
-        uint32_t chunk_hash_size;
-        std::memcpy(&chunk_hash_size, data.data() + offset, sizeof(chunk_hash_size));
-        offset += sizeof(chunk_hash_size);
-        
-        std::string chunk_hash(reinterpret_cast<const char*>(data.data() + offset), chunk_hash_size);
-        metadata.chunk_hashes.push_back(chunk_hash);
-        offset += chunk_hash_size;
+    uint32_t hash_count;
+    std::memcpy(&hash_count, data.data() + offset, sizeof(hash_count));
+    offset += sizeof(hash_count);
+    
+    if (hash_count & RAW_CHUNK_HASHES) {
+        hash_count &= ~RAW_CHUNK_HASHES;
+        if (offset + static_cast<size_t>(hash_count) * sizeof(hypershare::crypto::Blake3Hash) > data.size()) {
+            throw std::runtime_error("Truncated chunk hash list");
+        }
+        metadata.chunk_hashes.resize(hash_count);
+        std::memcpy(metadata.chunk_hashes.data(), data.data() + offset,
+                    hash_count * sizeof(hypershare::crypto::Blake3Hash));
+        offset += hash_count * sizeof(hypershare::crypto::Blake3Hash);
+    } else {
+        metadata.chunk_hashes.reserve(hash_count);
+        for (uint32_t i = 0; i < hash_count; ++i) {
+            uint32_t chunk_hash_size;
+            std::memcpy(&chunk_hash_size, data.data() + offset, sizeof(chunk_hash_size));
+            offset += sizeof(chunk_hash_size);
+            
+            std::string chunk_hash(reinterpret_cast<const char*>(data.data() + offset), chunk_hash_size);
+            auto parsed = hypershare::crypto::hash_utils::hash_from_hex(chunk_hash);
+            metadata.chunk_hashes.push_back(parsed.value_or(hypershare::crypto::Blake3Hash{}));
+            offset += chunk_hash_size;
+        }
     }
     
     // Read chunk_size
@@ -160,32 +282,80 @@ FileMetadata FileMetadata::deserialize(const std::vector<uint8_t>& data) {
     std::memcpy(&desc_size, data.data() + offset, sizeof(desc_size));
     offset += sizeof(desc_size);
     metadata.description = std::string(reinterpret_cast<const char*>(data.data() + offset), desc_size);
+    offset += desc_size;
+    
+    // Read file_hash_scheme, absent in blobs written before it existed
+    if (offset + sizeof(uint8_t) <= data.size()) {
+        metadata.file_hash_scheme = static_cast<FileHashScheme>(data[offset]);
+        offset += sizeof(uint8_t);
+    }
+    
+    // Read chunking mode
+    if (offset + sizeof(uint8_t) <= data.size()) {
+        metadata.chunking_mode = static_cast<ChunkingMode>(data[offset]);
+        offset += sizeof(uint8_t);
+    }
+    
+    if (metadata.is_content_defined() && offset + 3 * sizeof(uint32_t) <= data.size()) {
+        std::memcpy(&metadata.cdc_min_size, data.data() + offset, sizeof(metadata.cdc_min_size));
+        offset += sizeof(metadata.cdc_min_size);
+        std::memcpy(&metadata.cdc_avg_size, data.data() + offset, sizeof(metadata.cdc_avg_size));
+        offset += sizeof(metadata.cdc_avg_size);
+        
+        uint32_t offset_count;
+        std::memcpy(&offset_count, data.data() + offset, sizeof(offset_count));
+        offset += sizeof(offset_count);
+        
+        if (offset + static_cast<size_t>(offset_count) * sizeof(uint64_t) <= data.size()) {
+            metadata.chunk_offsets.resize(offset_count);
+            std::memcpy(metadata.chunk_offsets.data(), data.data() + offset, offset_count * sizeof(uint64_t));
+            offset += offset_count * sizeof(uint64_t);
+        }
+    }
     
     return metadata;
 }
 
-void FileMetadata::add_chunk_hash(const std::string& hash) {
+} // namespace
+
+void FileMetadata::add_chunk_hash(const hypershare::crypto::Blake3Hash& hash) {
     chunk_hashes.push_back(hash);
 }
 
+void FileMetadata::add_chunk_hash(const std::string& hex_hash) {
+    if (auto hash = hypershare::crypto::hash_utils::hash_from_hex(hex_hash)) {
+        chunk_hashes.push_back(*hash);
+    }
+}
+
+std::string FileMetadata::chunk_hash_hex(size_t chunk_index) const {
+    if (chunk_index >= chunk_hashes.size()) {
+        return {};
+    }
+    return hypershare::crypto::hash_utils::hash_to_hex(chunk_hashes[chunk_index]);
+}
+
 bool FileMetadata::is_complete() const {
     if (chunk_hashes.empty()) return false;
     
-    size_t expected_chunks = (file_size + chunk_size - 1) / chunk_size;
-    return chunk_hashes.size() == expected_chunks;
+    return chunk_hashes.size() == total_chunks();
 }
 
 double FileMetadata::progress() const {
     if (file_size == 0) return 1.0;
     
-    size_t expected_chunks = (file_size + chunk_size - 1) / chunk_size;
+    size_t expected_chunks = total_chunks();
     if (expected_chunks == 0) return 1.0;
     
     return static_cast<double>(chunk_hashes.size()) / expected_chunks;
 }
 
 size_t FileMetadata::total_chunks() const {
-    return (file_size + chunk_size - 1) / chunk_size;
+    if (is_content_defined()) {
+        return chunk_offsets.size();
+    }
+    // chunk_size comes from the peer that announced the file
+    return chunk_size == 0 ? 0 : (file_size + chunk_size - 1) / chunk_size;
 }
 
 uint32_t FileMetadata::get_chunk_count() const {
@@ -193,6 +363,18 @@ uint32_t FileMetadata::get_chunk_count() const {
 }
 
 uint32_t FileMetadata::get_chunk_size(size_t chunk_index) const {
+    if (is_content_defined()) {
+        if (chunk_index >= chunk_offsets.size()) {
+            return 0; // Invalid chunk index
+        }
+        uint64_t end = chunk_index + 1 < chunk_offsets.size() ? chunk_offsets[chunk_index + 1] : file_size;
+        return static_cast<uint32_t>(end - chunk_offsets[chunk_index]);
+    }
+    
+    if (chunk_size == 0) {
+        return 0; // No valid chunk at all
+    }
+    
     // For most chunks, return the standard chunk size
     if (chunk_index < chunk_count - 1) {
         return chunk_size;
@@ -207,6 +389,13 @@ uint32_t FileMetadata::get_chunk_size(size_t chunk_index) const {
     return 0; // Invalid chunk index
 }
 
+uint64_t FileMetadata::get_chunk_offset(size_t chunk_index) const {
+    if (is_content_defined()) {
+        return chunk_index < chunk_offsets.size() ? chunk_offsets[chunk_index] : file_size;
+    }
+    return static_cast<uint64_t>(chunk_index) * chunk_size;
+}
+
 bool FileMetadata::operator==(const FileMetadata& other) const {
     return file_id == other.file_id &&
            file_hash == other.file_hash &&
@@ -217,11 +406,173 @@ bool FileMetadata::operator==(const FileMetadata& other) const {
            chunk_size == other.chunk_size &&
            chunk_count == other.chunk_count &&
            file_type == other.file_type &&
-           description == other.description;
+           description == other.description &&
+           file_hash_scheme == other.file_hash_scheme &&
+           chunking_mode == other.chunking_mode &&
+           chunk_offsets == other.chunk_offsets;
 }
 
 bool FileMetadata::operator!=(const FileMetadata& other) const {
     return !(*this == other);
 }
 
+std::optional<FileMetadataView> FileMetadataView::parse(std::span<const uint8_t> data) {
+    if (data.size() < FIXED_HEADER_SIZE ||
+        load_le<uint32_t>(data.data() + MAGIC) != FORMAT_MAGIC ||
+        load_le<uint16_t>(data.data() + VERSION) != FORMAT_VERSION) {
+        return std::nullopt;
+    }
+    
+    size_t header_size = load_le<uint16_t>(data.data() + HEADER_SIZE);
+    if (header_size < FIXED_HEADER_SIZE || header_size > data.size()) {
+        return std::nullopt;
+    }
+    
+    for (size_t ref : STRING_REFS) {
+        if (!ref_in_bounds(data, ref, 1)) {
+            return std::nullopt;
+        }
+    }
+    
+    if (!ref_in_bounds(data, CHUNK_HASHES_REF, sizeof(hypershare::crypto::Blake3Hash)) ||
+        !ref_in_bounds(data, CHUNK_OFFSETS_REF, sizeof(uint64_t)) ||
+        !ref_in_bounds(data, TAGS_REF, REF_SIZE)) {
+        return std::nullopt;
+    }
+    
+    size_t tags_at = load_le<uint32_t>(data.data() + TAGS_REF);
+    size_t tag_count = load_le<uint32_t>(data.data() + TAGS_REF + sizeof(uint32_t));
+    for (size_t i = 0; i < tag_count; ++i) {
+        if (!ref_in_bounds(data, tags_at + i * REF_SIZE, 1)) {
+            return std::nullopt;
+        }
+    }
+    
+    return FileMetadataView(data);
+}
+
+std::string_view FileMetadataView::string_at(size_t ref_offset) const {
+    uint32_t offset = load_le<uint32_t>(data_.data() + ref_offset);
+    uint32_t length = load_le<uint32_t>(data_.data() + ref_offset + sizeof(uint32_t));
+    return std::string_view(reinterpret_cast<const char*>(data_.data() + offset), length);
+}
+
+std::string_view FileMetadataView::file_id() const { return string_at(FILE_ID_REF); }
+std::string_view FileMetadataView::file_hash() const { return string_at(FILE_HASH_REF); }
+std::string_view FileMetadataView::filename() const { return string_at(FILENAME_REF); }
+std::string_view FileMetadataView::file_path() const { return string_at(FILE_PATH_REF); }
+std::string_view FileMetadataView::file_type() const { return string_at(FILE_TYPE_REF); }
+std::string_view FileMetadataView::description() const { return string_at(DESCRIPTION_REF); }
+
+uint64_t FileMetadataView::file_size() const {
+    return load_le<uint64_t>(data_.data() + FILE_SIZE);
+}
+
+std::chrono::system_clock::time_point FileMetadataView::created_at() const {
+    return std::chrono::system_clock::time_point(
+        std::chrono::system_clock::duration(load_le<int64_t>(data_.data() + CREATED_AT)));
+}
+
+std::chrono::system_clock::time_point FileMetadataView::modified_at() const {
+    return std::chrono::system_clock::time_point(
+        std::chrono::system_clock::duration(load_le<int64_t>(data_.data() + MODIFIED_AT)));
+}
+
+uint32_t FileMetadataView::chunk_size() const { return load_le<uint32_t>(data_.data() + CHUNK_SIZE); }
+uint32_t FileMetadataView::chunk_count() const { return load_le<uint32_t>(data_.data() + CHUNK_COUNT); }
+uint32_t FileMetadataView::cdc_min_size() const { return load_le<uint32_t>(data_.data() + CDC_MIN_SIZE); }
+uint32_t FileMetadataView::cdc_avg_size() const { return load_le<uint32_t>(data_.data() + CDC_AVG_SIZE); }
+
+FileHashScheme FileMetadataView::file_hash_scheme() const {
+    return static_cast<FileHashScheme>(data_[HASH_SCHEME]);
+}
+
+ChunkingMode FileMetadataView::chunking_mode() const {
+    return static_cast<ChunkingMode>(data_[CHUNKING_MODE]);
+}
+
+size_t FileMetadataView::tag_count() const {
+    return load_le<uint32_t>(data_.data() + TAGS_REF + sizeof(uint32_t));
+}
+
+std::string_view FileMetadataView::tag(size_t index) const {
+    if (index >= tag_count()) {
+        return {};
+    }
+    return string_at(load_le<uint32_t>(data_.data() + TAGS_REF) + index * REF_SIZE);
+}
+
+size_t FileMetadataView::chunk_hash_count() const {
+    return load_le<uint32_t>(data_.data() + CHUNK_HASHES_REF + sizeof(uint32_t));
+}
+
+hypershare::crypto::Blake3Hash FileMetadataView::chunk_hash(size_t index) const {
+    hypershare::crypto::Blake3Hash hash{};
+    if (index < chunk_hash_count()) {
+        size_t offset = load_le<uint32_t>(data_.data() + CHUNK_HASHES_REF) + index * hash.size();
+        std::memcpy(hash.data(), data_.data() + offset, hash.size());
+    }
+    return hash;
+}
+
+size_t FileMetadataView::chunk_offset_count() const {
+    return load_le<uint32_t>(data_.data() + CHUNK_OFFSETS_REF + sizeof(uint32_t));
+}
+
+uint64_t FileMetadataView::chunk_offset(size_t index) const {
+    if (index >= chunk_offset_count()) {
+        return 0;
+    }
+    size_t offset = load_le<uint32_t>(data_.data() + CHUNK_OFFSETS_REF) + index * sizeof(uint64_t);
+    return load_le<uint64_t>(data_.data() + offset);
+}
+
+size_t FileMetadataView::total_chunks() const {
+    if (chunking_mode() == ChunkingMode::CONTENT_DEFINED) {
+        return chunk_offset_count();
+    }
+    uint32_t size = chunk_size();
+    return size == 0 ? 0 : (file_size() + size - 1) / size;
+}
+
+FileMetadata FileMetadataView::to_metadata() const {
+    FileMetadata metadata;
+    metadata.file_id = file_id();
+    metadata.file_hash = file_hash();
+    metadata.filename = filename();
+    metadata.file_path = file_path();
+    metadata.file_type = file_type();
+    metadata.description = description();
+    metadata.file_size = file_size();
+    metadata.created_at = created_at();
+    metadata.modified_at = modified_at();
+    metadata.chunk_size = chunk_size();
+    metadata.chunk_count = chunk_count();
+    metadata.file_hash_scheme = file_hash_scheme();
+    metadata.chunking_mode = chunking_mode();
+    metadata.cdc_min_size = cdc_min_size();
+    metadata.cdc_avg_size = cdc_avg_size();
+    
+    metadata.tags.reserve(tag_count());
+    for (size_t i = 0; i < tag_count(); ++i) {
+        metadata.tags.emplace_back(tag(i));
+    }
+    
+    // Raw hashes are stored exactly as the vector holds them
+    size_t hash_count = chunk_hash_count();
+    metadata.chunk_hashes.resize(hash_count);
+    if (hash_count > 0) {
+        size_t hashes_at = load_le<uint32_t>(data_.data() + CHUNK_HASHES_REF);
+        std::memcpy(metadata.chunk_hashes.data(), data_.data() + hashes_at,
+                    hash_count * sizeof(hypershare::crypto::Blake3Hash));
+    }
+    
+    metadata.chunk_offsets.reserve(chunk_offset_count());
+    for (size_t i = 0; i < chunk_offset_count(); ++i) {
+        metadata.chunk_offsets.push_back(chunk_offset(i));
+    }
+    
+    return metadata;
+}
+
 } // namespace hypershare::storage
\ No newline at end of file
@@ -0,0 +1,154 @@
+#include "hypershare/storage/hash_cache.hpp"
+#include <sqlite3.h>
+#include <sys/stat.h>
+
+namespace hypershare::storage {
+
+namespace {
+    bool exec(sqlite3* db, const char* sql) {
+        char* error_msg = nullptr;
+        int result = sqlite3_exec(db, sql, nullptr, nullptr, &error_msg);
+        if (result != SQLITE_OK) {
+            sqlite3_free(error_msg);
+            return false;
+        }
+        return true;
+    }
+
+    int64_t to_nanoseconds(std::chrono::system_clock::time_point time) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    }
+}
+
+std::optional<FileStamp> FileStamp::of(const std::filesystem::path& path) {
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        return std::nullopt;
+    }
+
+    FileStamp stamp;
+    stamp.device = static_cast<uint64_t>(st.st_dev);
+    stamp.inode = static_cast<uint64_t>(st.st_ino);
+    stamp.file_size = static_cast<uint64_t>(st.st_size);
+    stamp.mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    return stamp;
+}
+
+HashCache::HashCache(const std::filesystem::path& db_path)
+    : db_path_(db_path)
+    , db_(nullptr)
+    , lookup_stmt_(nullptr)
+    , store_stmt_(nullptr) {
+}
+
+HashCache::~HashCache() {
+    sqlite3_finalize(lookup_stmt_);
+    sqlite3_finalize(store_stmt_);
+    if (db_) {
+        sqlite3_close(db_);
+    }
+}
+
+bool HashCache::initialize() {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (sqlite3_open(db_path_.string().c_str(), &db_) != SQLITE_OK) {
+        return false;
+    }
+
+    // Shares the database with FileIndex
+    sqlite3_busy_timeout(db_, 5000);
+
+    // One row per inode: hashing a file again replaces its entry
+    const char* create_table = R"(
+        CREATE TABLE IF NOT EXISTS hash_cache (
+            device INTEGER NOT NULL,
+            inode INTEGER NOT NULL,
+            file_size INTEGER NOT NULL,
+            mtime_ns INTEGER NOT NULL,
+            metadata_blob BLOB NOT NULL,
+            PRIMARY KEY (device, inode)
+        ) WITHOUT ROWID;
+    )";
+    if (!exec(db_, create_table)) {
+        return false;
+    }
+
+    const char* lookup_sql = R"(
+        SELECT metadata_blob FROM hash_cache
+        WHERE device = ? AND inode = ? AND file_size = ? AND mtime_ns = ?;
+    )";
+    const char* store_sql = R"(
+        INSERT OR REPLACE INTO hash_cache (device, inode, file_size, mtime_ns, metadata_blob)
+        VALUES (?, ?, ?, ?, ?);
+    )";
+    return sqlite3_prepare_v3(db_, lookup_sql, -1, SQLITE_PREPARE_PERSISTENT, &lookup_stmt_, nullptr) == SQLITE_OK &&
+           sqlite3_prepare_v3(db_, store_sql, -1, SQLITE_PREPARE_PERSISTENT, &store_stmt_, nullptr) == SQLITE_OK;
+}
+
+std::optional<FileMetadata> HashCache::lookup(const FileStamp& stamp) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!lookup_stmt_) {
+        return std::nullopt;
+    }
+
+    sqlite3_bind_int64(lookup_stmt_, 1, static_cast<sqlite3_int64>(stamp.device));
+    sqlite3_bind_int64(lookup_stmt_, 2, static_cast<sqlite3_int64>(stamp.inode));
+    sqlite3_bind_int64(lookup_stmt_, 3, static_cast<sqlite3_int64>(stamp.file_size));
+    sqlite3_bind_int64(lookup_stmt_, 4, stamp.mtime_ns);
+
+    std::optional<FileMetadata> metadata;
+    if (sqlite3_step(lookup_stmt_) == SQLITE_ROW) {
+        const auto* blob = static_cast<const uint8_t*>(sqlite3_column_blob(lookup_stmt_, 0));
+        auto size = static_cast<size_t>(sqlite3_column_bytes(lookup_stmt_, 0));
+        try {
+            metadata = FileMetadata::deserialize(std::span<const uint8_t>(blob, size));
+        } catch (const std::exception&) {
+            metadata.reset();
+        }
+    }
+    sqlite3_reset(lookup_stmt_);
+
+    return metadata;
+}
+
+bool HashCache::store(const FileStamp& stamp, const FileMetadata& metadata,
+                      std::chrono::system_clock::time_point hashed_at) {
+    if (stamp.mtime_ns > to_nanoseconds(hashed_at - TIMESTAMP_GRANULARITY)) {
+        return false;
+    }
+
+    auto blob = metadata.serialize();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!store_stmt_) {
+        return false;
+    }
+
+    sqlite3_bind_int64(store_stmt_, 1, static_cast<sqlite3_int64>(stamp.device));
+    sqlite3_bind_int64(store_stmt_, 2, static_cast<sqlite3_int64>(stamp.inode));
+    sqlite3_bind_int64(store_stmt_, 3, static_cast<sqlite3_int64>(stamp.file_size));
+    sqlite3_bind_int64(store_stmt_, 4, stamp.mtime_ns);
+    sqlite3_bind_blob(store_stmt_, 5, blob.data(), static_cast<int>(blob.size()), SQLITE_STATIC);
+    bool stored = sqlite3_step(store_stmt_) == SQLITE_DONE;
+    sqlite3_reset(store_stmt_);
+    sqlite3_clear_bindings(store_stmt_);
+
+    return stored;
+}
+
+size_t HashCache::entry_count() {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    sqlite3_stmt* stmt;
+    if (!db_ || sqlite3_prepare_v2(db_, "SELECT COUNT(*) FROM hash_cache;", -1, &stmt, nullptr) != SQLITE_OK) {
+        return 0;
+    }
+
+    size_t count = (sqlite3_step(stmt) == SQLITE_ROW) ? static_cast<size_t>(sqlite3_column_int64(stmt, 0)) : 0;
+    sqlite3_finalize(stmt);
+
+    return count;
+}
+
+} // namespace hypershare::storage
@@ -0,0 +1,141 @@
+#include "hypershare/storage/hash_tree.hpp"
+#include "hypershare/crypto/hash.hpp"
+#include <algorithm>
+#include <array>
+#include <vector>
+
+namespace hypershare::storage::hash_tree {
+
+namespace {
+    constexpr uint8_t LEAF_PREFIX = 0x00;
+    constexpr uint8_t PARENT_PREFIX = 0x01;
+    constexpr uint8_t ROOT_PREFIX = 0x02;
+
+    void put_u64_le(uint8_t* out, uint64_t value) {
+        for (size_t i = 0; i < 8; ++i) {
+            out[i] = static_cast<uint8_t>(value >> (8 * i));
+        }
+    }
+
+    // Reduces one level of nodes to its parents in place until one node is left
+    hypershare::crypto::Blake3Hash tree_root(std::vector<hypershare::crypto::Blake3Hash> level) {
+        while (level.size() > 1) {
+            size_t parents = 0;
+            for (size_t i = 0; i < level.size(); i += 2) {
+                level[parents++] = (i + 1 < level.size()) ? combine(level[i], level[i + 1]) : level[i];
+            }
+            level.resize(parents);
+        }
+        return level.front();
+    }
+
+    hypershare::crypto::Blake3Hash bind_root(const hypershare::crypto::Blake3Hash& tree_root,
+                                             uint64_t file_size, size_t leaf_count) {
+        std::array<uint8_t, 1 + 8 + 8 + hypershare::crypto::BLAKE3_HASH_SIZE> input;
+        input[0] = ROOT_PREFIX;
+        put_u64_le(input.data() + 1, file_size);
+        put_u64_le(input.data() + 9, static_cast<uint64_t>(leaf_count));
+        std::copy(tree_root.begin(), tree_root.end(), input.begin() + 17);
+        return hypershare::crypto::Blake3Hasher::hash(input);
+    }
+
+    std::vector<hypershare::crypto::Blake3Hash> leaves_of(
+        std::span<const hypershare::crypto::Blake3Hash> chunk_hashes) {
+        std::vector<hypershare::crypto::Blake3Hash> leaves;
+        leaves.reserve(chunk_hashes.size());
+        for (const auto& chunk_hash : chunk_hashes) {
+            leaves.push_back(leaf(chunk_hash));
+        }
+        return leaves;
+    }
+}
+
+hypershare::crypto::Blake3Hash leaf(const hypershare::crypto::Blake3Hash& chunk_hash) {
+    std::array<uint8_t, 1 + hypershare::crypto::BLAKE3_HASH_SIZE> input;
+    input[0] = LEAF_PREFIX;
+    std::copy(chunk_hash.begin(), chunk_hash.end(), input.begin() + 1);
+    return hypershare::crypto::Blake3Hasher::hash(input);
+}
+
+hypershare::crypto::Blake3Hash combine(const hypershare::crypto::Blake3Hash& left,
+                                       const hypershare::crypto::Blake3Hash& right) {
+    std::array<uint8_t, 1 + 2 * hypershare::crypto::BLAKE3_HASH_SIZE> input;
+    input[0] = PARENT_PREFIX;
+    std::copy(left.begin(), left.end(), input.begin() + 1);
+    std::copy(right.begin(), right.end(), input.begin() + 1 + left.size());
+    return hypershare::crypto::Blake3Hasher::hash(input);
+}
+
+hypershare::crypto::Blake3Hash root(std::span<const hypershare::crypto::Blake3Hash> chunk_hashes,
+                                    uint64_t file_size) {
+    if (chunk_hashes.empty()) {
+        return bind_root(hypershare::crypto::Blake3Hasher::hash(std::span<const uint8_t>()), file_size, 0);
+    }
+
+    return bind_root(tree_root(leaves_of(chunk_hashes)), file_size, chunk_hashes.size());
+}
+
+bool verify(const hypershare::crypto::Blake3Hash& chunk_hash,
+            size_t index,
+            size_t leaf_count,
+            uint64_t file_size,
+            std::span<const hypershare::crypto::Blake3Hash> proof,
+            const hypershare::crypto::Blake3Hash& root) {
+    if (index >= leaf_count) {
+        return false;
+    }
+
+    hypershare::crypto::Blake3Hash node = leaf(chunk_hash);
+    auto sibling = proof.begin();
+
+    for (size_t width = leaf_count; width > 1; width = (width + 1) / 2, index /= 2) {
+        bool is_right = index % 2 == 1;
+        if (!is_right && index + 1 == width) {
+            continue; // Promoted without a sibling
+        }
+        if (sibling == proof.end()) {
+            return false;
+        }
+        node = is_right ? combine(*sibling, node) : combine(node, *sibling);
+        ++sibling;
+    }
+
+    return sibling == proof.end() && bind_root(node, file_size, leaf_count) == root;
+}
+
+Tree::Tree(std::span<const hypershare::crypto::Blake3Hash> chunk_hashes, uint64_t file_size)
+    : leaf_count_(chunk_hashes.size()) {
+    if (chunk_hashes.empty()) {
+        root_ = hash_tree::root(chunk_hashes, file_size);
+        return;
+    }
+
+    levels_.push_back(leaves_of(chunk_hashes));
+    while (levels_.back().size() > 1) {
+        const auto& level = levels_.back();
+        std::vector<hypershare::crypto::Blake3Hash> parents;
+        parents.reserve((level.size() + 1) / 2);
+        for (size_t i = 0; i < level.size(); i += 2) {
+            parents.push_back((i + 1 < level.size()) ? combine(level[i], level[i + 1]) : level[i]);
+        }
+        levels_.push_back(std::move(parents));
+    }
+    root_ = bind_root(levels_.back().front(), file_size, leaf_count_);
+}
+
+std::vector<hypershare::crypto::Blake3Hash> Tree::proof(size_t index) const {
+    std::vector<hypershare::crypto::Blake3Hash> path;
+    if (index >= leaf_count_) {
+        return path;
+    }
+
+    for (size_t depth = 0; depth + 1 < levels_.size(); ++depth, index /= 2) {
+        size_t sibling = index ^ 1;
+        if (sibling < levels_[depth].size()) {
+            path.push_back(levels_[depth][sibling]);
+        }
+    }
+    return path;
+}
+
+} // namespace hypershare::storage::hash_tree
@@ -0,0 +1,194 @@
+#include "hypershare/storage/integrity_scrubber.hpp"
+#include "hypershare/storage/file_index.hpp"
+#include "hypershare/crypto/file_verification.hpp"
+#include "hypershare/core/logger.hpp"
+#include <algorithm>
+#include <optional>
+#include <sys/stat.h>
+
+namespace hypershare::storage {
+
+namespace {
+    // Converted from st_mtim the way the share watcher records modified_at,
+    // so an untouched file compares exactly
+    std::optional<std::chrono::system_clock::time_point> modification_time(const std::string& path) {
+        struct stat st;
+        if (::stat(path.c_str(), &st) != 0) {
+            return std::nullopt;
+        }
+        auto since_epoch = std::chrono::seconds(st.st_mtim.tv_sec) + std::chrono::nanoseconds(st.st_mtim.tv_nsec);
+        return std::chrono::system_clock::time_point(
+            std::chrono::duration_cast<std::chrono::system_clock::duration>(since_epoch));
+    }
+}
+
+IntegrityScrubber::IntegrityScrubber(std::shared_ptr<FileIndex> file_index, uint64_t bytes_per_second,
+                                     std::chrono::seconds pass_interval)
+    : file_index_(std::move(file_index))
+    , bytes_per_second_(std::max<uint64_t>(bytes_per_second, 1))
+    , pass_interval_(pass_interval) {
+}
+
+IntegrityScrubber::~IntegrityScrubber() {
+    stop();
+}
+
+bool IntegrityScrubber::start() {
+    if (running_) {
+        return true;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = false;
+    }
+    running_ = true;
+    scrub_thread_ = std::thread(&IntegrityScrubber::scrub_loop, this);
+    return true;
+}
+
+void IntegrityScrubber::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    stop_cv_.notify_all();
+
+    if (scrub_thread_.joinable()) {
+        scrub_thread_.join();
+    }
+    running_ = false;
+}
+
+void IntegrityScrubber::set_corruption_handler(CorruptionHandler handler) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    corruption_handler_ = std::move(handler);
+}
+
+IntegrityScrubber::Stats IntegrityScrubber::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void IntegrityScrubber::scrub_loop() {
+    while (running_) {
+        scrub_pass();
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (stop_cv_.wait_for(lock, pass_interval_, [this] { return stopping_; })) {
+            break;
+        }
+    }
+}
+
+uint64_t IntegrityScrubber::scrub_pass() {
+    // Hashes only; each file is read fresh from the index when its turn comes
+    std::vector<std::string> file_hashes;
+    file_index_->for_each_file([&](const FileMetadataView& file) {
+        if (!file.file_path().empty()) {
+            file_hashes.emplace_back(file.file_hash());
+        }
+    });
+
+    uint64_t corrupted = 0;
+    for (const auto& file_hash : file_hashes) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_) {
+                return corrupted;
+            }
+        }
+        corrupted += scrub_file(file_hash).size();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!stopping_) {
+        ++stats_.passes_completed;
+    }
+    return corrupted;
+}
+
+std::vector<uint64_t> IntegrityScrubber::scrub_file(const std::string& file_hash) {
+    auto metadata = file_index_->get_file(file_hash);
+    if (!metadata || metadata->file_path.empty() || !metadata->is_complete()) {
+        return {};
+    }
+
+    // A file written since it was hashed was edited, not corrupted; it is
+    // indexed again when it is re-shared
+    auto modified = modification_time(metadata->file_path);
+    if (modified && *modified > metadata->modified_at) {
+        return {};
+    }
+
+    auto available = file_index_->get_available_chunks(file_hash);
+    uint64_t chunks_verified = 0;
+    uint64_t bytes_read = 0;
+
+    hypershare::crypto::FileVerifier verifier;
+    auto report = verifier.check_file_integrity(metadata->file_path, *metadata,
+        [&](size_t chunk_index, uint32_t chunk_size) {
+            if (!available.contains(chunk_index) || !pace(chunk_size)) {
+                return false;
+            }
+            ++chunks_verified;
+            bytes_read += chunk_size;
+            return true;
+        });
+
+    // Chunks already missing need no marking
+    std::vector<uint64_t> corrupted;
+    for (uint64_t chunk_index : report.corrupted_chunks) {
+        if (available.contains(chunk_index)) {
+            corrupted.push_back(chunk_index);
+        }
+    }
+
+    // One update per run of adjacent bad chunks
+    for (size_t first = 0; first < corrupted.size(); ) {
+        size_t last = first;
+        while (last + 1 < corrupted.size() && corrupted[last + 1] == corrupted[last] + 1) {
+            ++last;
+        }
+        file_index_->mark_chunks_missing(file_hash, corrupted[first], last - first + 1);
+        first = last + 1;
+    }
+
+    CorruptionHandler handler;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++stats_.files_scrubbed;
+        stats_.chunks_verified += chunks_verified;
+        stats_.bytes_read += bytes_read;
+        stats_.chunks_corrupted += corrupted.size();
+        handler = corruption_handler_;
+    }
+
+    if (!corrupted.empty()) {
+        LOG_WARN("Scrub found {} corrupted chunks in {}: {}", corrupted.size(), metadata->file_path, report.details);
+        if (handler) {
+            handler(*metadata, corrupted);
+        }
+    }
+    return corrupted;
+}
+
+bool IntegrityScrubber::pace(uint64_t bytes) {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    auto now = std::chrono::steady_clock::now();
+    if (next_read_at_ > now && stop_cv_.wait_until(lock, next_read_at_, [this] { return stopping_; })) {
+        return false;
+    }
+    if (stopping_) {
+        return false;
+    }
+
+    // Idle time does not build up credit for a burst
+    auto cost = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(static_cast<double>(bytes) / static_cast<double>(bytes_per_second_)));
+    next_read_at_ = std::max(next_read_at_, now) + cost;
+    return true;
+}
+
+} // namespace hypershare::storage
@@ -0,0 +1,125 @@
+#include "hypershare/storage/mapped_file_cache.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace hypershare::storage {
+
+MappedFile::MappedFile(const std::filesystem::path& path, void* address, size_t size,
+                       uint64_t inode, struct timespec mtime)
+    : path_(path)
+    , address_(address)
+    , size_(size)
+    , inode_(inode)
+    , mtime_(mtime) {
+}
+
+MappedFile::~MappedFile() {
+    if (address_ && size_ > 0) {
+        ::munmap(address_, size_);
+    }
+}
+
+std::shared_ptr<MappedFile> MappedFile::open(const std::filesystem::path& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        return nullptr;
+    }
+
+    size_t size = static_cast<size_t>(st.st_size);
+    void* address = nullptr;
+    if (size > 0) {
+        address = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (address == MAP_FAILED) {
+            ::close(fd);
+            return nullptr;
+        }
+    }
+
+    // The mapping keeps the file contents reachable, the descriptor is not needed
+    ::close(fd);
+
+    return std::shared_ptr<MappedFile>(
+        new MappedFile(path, address, size, static_cast<uint64_t>(st.st_ino), st.st_mtim));
+}
+
+bool MappedFile::is_stale() const {
+    struct stat st;
+    if (::stat(path_.c_str(), &st) != 0) {
+        return true;
+    }
+
+    return static_cast<uint64_t>(st.st_ino) != inode_ ||
+           static_cast<size_t>(st.st_size) != size_ ||
+           st.st_mtim.tv_sec != mtime_.tv_sec ||
+           st.st_mtim.tv_nsec != mtime_.tv_nsec;
+}
+
+MappedFileCache::MappedFileCache(size_t max_mappings)
+    : max_mappings_(max_mappings == 0 ? 1 : max_mappings) {
+}
+
+std::shared_ptr<const MappedFile> MappedFileCache::acquire(const std::filesystem::path& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto key = path.string();
+    auto it = entries_.find(key);
+    if (it != entries_.end()) {
+        if (!it->second.mapping->is_stale()) {
+            lru_.splice(lru_.begin(), lru_, it->second.lru_position);
+            return it->second.mapping;
+        }
+
+        // Views already handed out keep the old mapping alive until they are released
+        lru_.erase(it->second.lru_position);
+        entries_.erase(it);
+    }
+
+    auto mapping = MappedFile::open(path);
+    if (!mapping) {
+        return nullptr;
+    }
+
+    lru_.push_front(key);
+    entries_[key] = Entry{mapping, lru_.begin()};
+    evict_if_needed();
+
+    return mapping;
+}
+
+void MappedFileCache::invalidate(const std::filesystem::path& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = entries_.find(path.string());
+    if (it != entries_.end()) {
+        lru_.erase(it->second.lru_position);
+        entries_.erase(it);
+    }
+}
+
+void MappedFileCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    lru_.clear();
+}
+
+size_t MappedFileCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
+
+void MappedFileCache::evict_if_needed() {
+    while (entries_.size() > max_mappings_ && !lru_.empty()) {
+        entries_.erase(lru_.back());
+        lru_.pop_back();
+    }
+}
+
+} // namespace hypershare::storage
@@ -0,0 +1,99 @@
+#include "hypershare/storage/metadata_cache.hpp"
+
+namespace hypershare::storage {
+
+MetadataCache::MetadataCache(size_t max_entries, size_t max_bytes)
+    : max_entries_(max_entries == 0 ? 1 : max_entries)
+    , max_bytes_(max_bytes) {
+}
+
+std::shared_ptr<const FileMetadata> MetadataCache::get(const std::string& file_hash) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = entries_.find(file_hash);
+    if (it == entries_.end()) {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    lru_.splice(lru_.begin(), lru_, it->second.lru_position);
+    return it->second.metadata;
+}
+
+void MetadataCache::put(std::shared_ptr<const FileMetadata> metadata, uint64_t generation) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Invalidations take the lock too, so this check cannot race with one
+    if (!metadata || generation != generation_.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    size_t bytes = approximate_size(*metadata);
+    auto it = entries_.find(metadata->file_hash);
+    if (it != entries_.end()) {
+        bytes_ = bytes_ - it->second.bytes + bytes;
+        it->second.metadata = std::move(metadata);
+        it->second.bytes = bytes;
+        lru_.splice(lru_.begin(), lru_, it->second.lru_position);
+    } else {
+        lru_.push_front(metadata->file_hash);
+        entries_[lru_.front()] = Entry{std::move(metadata), lru_.begin(), bytes};
+        bytes_ += bytes;
+    }
+    evict_if_needed();
+}
+
+void MetadataCache::invalidate(const std::string& file_hash) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    generation_.fetch_add(1, std::memory_order_acq_rel);
+
+    auto it = entries_.find(file_hash);
+    if (it != entries_.end()) {
+        bytes_ -= it->second.bytes;
+        lru_.erase(it->second.lru_position);
+        entries_.erase(it);
+    }
+}
+
+void MetadataCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    generation_.fetch_add(1, std::memory_order_acq_rel);
+    entries_.clear();
+    lru_.clear();
+    bytes_ = 0;
+}
+
+size_t MetadataCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
+
+size_t MetadataCache::bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_;
+}
+
+void MetadataCache::evict_if_needed() {
+    // The most recent entry stays even if it alone is over the byte bound
+    while ((entries_.size() > max_entries_ || (bytes_ > max_bytes_ && entries_.size() > 1)) && !lru_.empty()) {
+        auto it = entries_.find(lru_.back());
+        bytes_ -= it->second.bytes;
+        entries_.erase(it);
+        lru_.pop_back();
+    }
+}
+
+size_t MetadataCache::approximate_size(const FileMetadata& metadata) {
+    size_t size = sizeof(FileMetadata) + metadata.file_id.capacity() + metadata.file_hash.capacity() +
+                  metadata.filename.capacity() + metadata.file_path.capacity() +
+                  metadata.file_type.capacity() + metadata.description.capacity() +
+                  metadata.chunk_hashes.capacity() * sizeof(hypershare::crypto::Blake3Hash) +
+                  metadata.chunk_offsets.capacity() * sizeof(uint64_t);
+    for (const auto& tag : metadata.tags) {
+        size += sizeof(tag) + tag.capacity();
+    }
+    return size;
+}
+
+} // namespace hypershare::storage
@@ -0,0 +1,283 @@
+#include "hypershare/storage/parallel_hasher.hpp"
+#include "hypershare/storage/hash_tree.hpp"
+#include "hypershare/crypto/hash.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace hypershare::storage {
+
+namespace {
+    bool read_fully(int fd, uint8_t* data, size_t size, uint64_t offset) {
+        while (size > 0) {
+            ssize_t bytes_read = ::pread(fd, data, size, static_cast<off_t>(offset));
+            if (bytes_read < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            if (bytes_read == 0) {
+                errno = EIO; // File shrank while it was being hashed
+                return false;
+            }
+            data += bytes_read;
+            size -= static_cast<size_t>(bytes_read);
+            offset += static_cast<uint64_t>(bytes_read);
+        }
+        return true;
+    }
+}
+
+ParallelHasher::ParallelHasher(size_t chunk_size, size_t thread_count, size_t block_size)
+    : chunk_size_(chunk_size == 0 ? 1 : chunk_size)
+    , thread_count_(thread_count == 0 ? hardware_threads() : thread_count)
+    , block_size_(std::max(block_size, chunk_size_)) {
+}
+
+ParallelHasher::ParallelHasher(const ContentChunker& chunker, size_t thread_count, size_t block_size)
+    : chunk_size_(chunker.max_size())
+    , thread_count_(thread_count == 0 ? hardware_threads() : thread_count)
+    , block_size_(std::max(block_size, chunk_size_))
+    , chunker_(chunker) {
+}
+
+size_t ParallelHasher::hardware_threads() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+size_t ParallelHasher::next_chunk(std::span<const uint8_t> data, bool end_of_file) const {
+    if (!chunker_) {
+        if (data.size() >= chunk_size_) {
+            return chunk_size_;
+        }
+        return end_of_file ? data.size() : 0;
+    }
+    
+    size_t cut = chunker_->next_boundary(data);
+    if (cut < data.size() || data.size() >= chunk_size_ || end_of_file) {
+        return cut;
+    }
+    return 0; // No cut point yet, the chunk may continue past the buffered data
+}
+
+hypershare::crypto::CryptoResult ParallelHasher::hash_file(const std::filesystem::path& file_path,
+                                                           Result& result) {
+    int fd = ::open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return hypershare::crypto::CryptoResult(
+            hypershare::crypto::CryptoError::FILE_READ_ERROR,
+            "Failed to open " + file_path.string() + ": " + std::strerror(errno)
+        );
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        int saved_errno = errno;
+        ::close(fd);
+        return hypershare::crypto::CryptoResult(
+            hypershare::crypto::CryptoError::FILE_READ_ERROR,
+            "Failed to stat " + file_path.string() + ": " + std::strerror(saved_errno)
+        );
+    }
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    const uint64_t file_size = static_cast<uint64_t>(st.st_size);
+    const uint64_t block_estimate = file_size / block_size_ + 1;
+
+    // A partial chunk left at the end of a block is carried into the next buffer
+    const size_t buffer_capacity = block_size_ + chunk_size_;
+
+    // Two buffers per worker keeps the reader one block ahead of every hasher
+    const size_t worker_count = static_cast<size_t>(std::min<uint64_t>(thread_count_, block_estimate));
+    const size_t buffer_count = std::max<size_t>(2, worker_count * 2);
+    std::vector<std::vector<uint8_t>> buffers(buffer_count);
+
+    struct Block {
+        size_t buffer;
+        std::vector<uint32_t> chunk_lengths;
+        std::vector<hypershare::crypto::Blake3Hash>* hashes;
+        size_t first_chunk;
+        uint64_t bytes;
+    };
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::queue<size_t> free_buffers;
+    std::queue<Block> ready_blocks;
+    bool reading_done = false;
+    std::atomic<bool> stopped{false};
+
+    // Per-block results; deque growth never moves existing elements, so workers
+    // can fill one block's vector while the reader appends the next
+    std::deque<std::vector<hypershare::crypto::Blake3Hash>> block_hashes;
+    std::vector<uint64_t> chunk_offsets;
+
+    for (size_t i = 0; i < buffer_count; ++i) {
+        free_buffers.push(i);
+    }
+
+    auto worker = [&]() {
+        while (true) {
+            Block block;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&] { return reading_done || !ready_blocks.empty(); });
+                if (ready_blocks.empty()) {
+                    return;
+                }
+                block = std::move(ready_blocks.front());
+                ready_blocks.pop();
+            }
+
+            // Blocks queued before a stop are dropped unhashed
+            if (!stopped) {
+                const uint8_t* data = buffers[block.buffer].data();
+                for (size_t i = 0; i < block.chunk_lengths.size(); ++i) {
+                    (*block.hashes)[i] = hypershare::crypto::Blake3Hasher::hash(
+                        std::span<const uint8_t>(data, block.chunk_lengths[i]));
+                    data += block.chunk_lengths[i];
+                }
+
+                if (block_handler_ && !stopped && !block_handler_(block.first_chunk, *block.hashes, block.bytes)) {
+                    stopped = true;
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                free_buffers.push(block.buffer);
+            }
+            cv.notify_all();
+        }
+    };
+
+    auto acquire_buffer = [&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&] { return !free_buffers.empty(); });
+        size_t buffer = free_buffers.front();
+        free_buffers.pop();
+        return buffer;
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(worker_count);
+    for (size_t i = 0; i < worker_count; ++i) {
+        workers.emplace_back(worker);
+    }
+
+    int read_error = 0;
+    uint64_t read_offset = 0;
+    uint64_t chunk_offset = 0;
+    size_t current = acquire_buffer();
+    size_t filled = 0;
+
+    while (!stopped) {
+        buffers[current].resize(buffer_capacity);
+
+        size_t want = static_cast<size_t>(std::min<uint64_t>(buffer_capacity - filled, file_size - read_offset));
+        if (!read_fully(fd, buffers[current].data() + filled, want, read_offset)) {
+            read_error = errno;
+            break;
+        }
+        filled += want;
+        read_offset += want;
+        const bool end_of_file = read_offset == file_size;
+
+        Block block{current, {}, nullptr, chunk_offsets.size(), 0};
+        size_t consumed = 0;
+        while (consumed < filled) {
+            size_t length = next_chunk(
+                std::span<const uint8_t>(buffers[current].data() + consumed, filled - consumed), end_of_file);
+            if (length == 0) {
+                break;
+            }
+            block.chunk_lengths.push_back(static_cast<uint32_t>(length));
+            chunk_offsets.push_back(chunk_offset);
+            chunk_offset += length;
+            consumed += length;
+            block.bytes += length;
+        }
+
+        if (block.chunk_lengths.empty()) {
+            if (end_of_file) {
+                break; // Empty file
+            }
+            continue; // Not enough data for a cut point yet, keep filling
+        }
+
+        block_hashes.emplace_back(block.chunk_lengths.size());
+        block.hashes = &block_hashes.back();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ready_blocks.push(std::move(block));
+        }
+        cv.notify_all();
+
+        if (end_of_file) {
+            break;
+        }
+
+        // The block's buffer is only read by workers, so the tail stays intact
+        // until the reader itself reuses the buffer
+        size_t next = acquire_buffer();
+        size_t tail = filled - consumed;
+        if (tail > 0) {
+            buffers[next].resize(buffer_capacity);
+            std::memmove(buffers[next].data(), buffers[current].data() + consumed, tail);
+        }
+        current = next;
+        filled = tail;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        reading_done = true;
+    }
+    cv.notify_all();
+
+    for (auto& thread : workers) {
+        thread.join();
+    }
+    ::close(fd);
+
+    if (read_error != 0) {
+        result.chunk_hashes.clear();
+        result.chunk_offsets.clear();
+        return hypershare::crypto::CryptoResult(
+            hypershare::crypto::CryptoError::FILE_READ_ERROR,
+            "Failed to read " + file_path.string() + ": " + std::strerror(read_error)
+        );
+    }
+
+    if (stopped) {
+        result.chunk_hashes.clear();
+        result.chunk_offsets.clear();
+        return hypershare::crypto::CryptoResult(
+            hypershare::crypto::CryptoError::VERIFICATION_FAILED,
+            "Hashing of " + file_path.string() + " was stopped"
+        );
+    }
+
+    result.chunk_hashes.clear();
+    result.chunk_hashes.reserve(chunk_offsets.size());
+    for (const auto& hashes : block_hashes) {
+        result.chunk_hashes.insert(result.chunk_hashes.end(), hashes.begin(), hashes.end());
+    }
+    result.chunk_offsets = std::move(chunk_offsets);
+    result.bytes_hashed = file_size;
+    result.root = hash_tree::root(result.chunk_hashes, file_size);
+    return hypershare::crypto::CryptoResult(hypershare::crypto::CryptoError::SUCCESS);
+}
+
+} // namespace hypershare::storage
@@ -1,13 +1,60 @@
 #include "hypershare/storage/resume_manager.hpp"
 #include <sqlite3.h>
+#include <cstring>
 
 namespace hypershare::storage {
 
-ResumeManager::ResumeManager(const std::filesystem::path& database_path)
-    : db_path_(database_path), db_(nullptr) {
+namespace {
+
+constexpr int BUSY_TIMEOUT_MS = 5000;
+
+bool exec(sqlite3* db, const char* sql) {
+    char* error_msg = nullptr;
+    int result = sqlite3_exec(db, sql, nullptr, nullptr, &error_msg);
+    if (error_msg) {
+        sqlite3_free(error_msg);
+    }
+    return result == SQLITE_OK;
+}
+
+int64_t to_millis(std::chrono::system_clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
+}
+
+std::chrono::system_clock::time_point from_millis(int64_t millis) {
+    return std::chrono::system_clock::time_point(
+        std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::milliseconds(millis)));
+}
+
+std::span<const uint8_t> column_blob(sqlite3_stmt* stmt, int column) {
+    const void* blob_data = sqlite3_column_blob(stmt, column);
+    int blob_size = sqlite3_column_bytes(stmt, column);
+    return std::span<const uint8_t>(static_cast<const uint8_t*>(blob_data), static_cast<size_t>(blob_size));
+}
+
+std::string column_text(sqlite3_stmt* stmt, int column) {
+    const unsigned char* text = sqlite3_column_text(stmt, column);
+    return text ? std::string(reinterpret_cast<const char*>(text)) : std::string();
+}
+
+} // namespace
+
+ResumeManager::ResumeManager(const std::filesystem::path& database_path,
+                             std::chrono::milliseconds commit_interval)
+    : db_path_(database_path), db_(nullptr), commit_interval_(commit_interval) {
 }
 
 ResumeManager::~ResumeManager() {
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        stopping_ = true;
+    }
+    commit_cv_.notify_all();
+    if (commit_thread_.joinable()) {
+        commit_thread_.join();
+    }
+    
+    flush();
     cleanup_statements();
     if (db_) {
         sqlite3_close(db_);
@@ -20,115 +67,459 @@ bool ResumeManager::initialize() {
         return false;
     }
     
-    return create_tables() && prepare_statements();
+    // With WAL, NORMAL commits without an fsync; only checkpoints sync
+    sqlite3_busy_timeout(db_, BUSY_TIMEOUT_MS);
+    if (!exec(db_, "PRAGMA journal_mode = WAL;") || !exec(db_, "PRAGMA synchronous = NORMAL;")) {
+        return false;
+    }
+    
+    if (!create_tables() || !prepare_statements()) {
+        return false;
+    }
+    
+    commit_thread_ = std::thread([this]() { commit_loop(); });
+    return true;
 }
 
 bool ResumeManager::create_tables() {
-    // Implementation stub - create tables for resume state
-    return true;
+    const char* create_resume_table = R"(
+        CREATE TABLE IF NOT EXISTS resume_state (
+            file_id TEXT PRIMARY KEY,
+            session_id TEXT NOT NULL,
+            completed_chunks BLOB,
+            last_activity INTEGER NOT NULL,
+            stats BLOB
+        );
+        CREATE INDEX IF NOT EXISTS idx_resume_session ON resume_state(session_id);
+        CREATE INDEX IF NOT EXISTS idx_resume_activity ON resume_state(last_activity);
+    )";
+    
+    return exec(db_, create_resume_table);
 }
 
 bool ResumeManager::prepare_statements() {
-    // Implementation stub
+    std::array<const char*, STATEMENT_COUNT> sql{};
+    
+    sql[UPSERT_STATE] = R"(
+        INSERT OR REPLACE INTO resume_state (file_id, session_id, completed_chunks, last_activity, stats)
+        VALUES (?, ?, ?, ?, ?);
+    )";
+    
+    sql[SELECT_BY_FILE] = R"(
+        SELECT file_id, session_id, completed_chunks, last_activity, stats
+        FROM resume_state WHERE file_id = ?;
+    )";
+    
+    sql[SELECT_FILE_BY_SESSION] = "SELECT file_id FROM resume_state WHERE session_id = ?;";
+    
+    sql[SELECT_ALL] = R"(
+        SELECT file_id, session_id, completed_chunks, last_activity, stats
+        FROM resume_state ORDER BY last_activity DESC;
+    )";
+    
+    sql[DELETE_BY_FILE] = "DELETE FROM resume_state WHERE file_id = ?;";
+    
+    sql[DELETE_OLDER_THAN] = "DELETE FROM resume_state WHERE last_activity < ?;";
+    
+    sql[COUNT_STATES] = "SELECT COUNT(*) FROM resume_state;";
+    
+    for (size_t i = 0; i < STATEMENT_COUNT; ++i) {
+        if (sqlite3_prepare_v3(db_, sql[i], -1, SQLITE_PREPARE_PERSISTENT, &statements_[i], nullptr) != SQLITE_OK) {
+            return false;
+        }
+    }
     return true;
 }
 
 void ResumeManager::cleanup_statements() {
-    // Implementation stub
+    for (auto& stmt : statements_) {
+        if (stmt) {
+            sqlite3_finalize(stmt);
+            stmt = nullptr;
+        }
+    }
 }
 
 bool ResumeManager::save_resume_state(const ResumeInfo& info) {
-    // Implementation stub
+    std::lock_guard<std::mutex> db_lock(db_mutex_);
+    if (!write_state(info)) {
+        return false;
+    }
+    
+    std::lock_guard<std::mutex> state_lock(state_mutex_);
+    auto& state = states_[info.file_id];
+    if (!state.info.session_id.empty()) {
+        session_files_.erase(state.info.session_id);
+    }
+    state.info = info;
+    state.dirty = false;
+    session_files_[info.session_id] = info.file_id;
     return true;
 }
 
 std::optional<ResumeInfo> ResumeManager::load_resume_state(const std::string& file_id) {
-    // Implementation stub
-    return std::nullopt;
+    std::unique_lock<std::mutex> state_lock(state_mutex_);
+    TrackedState* state = track(state_lock, file_id);
+    if (!state) {
+        return std::nullopt;
+    }
+    return state->info;
 }
 
 std::optional<ResumeInfo> ResumeManager::load_resume_state_by_session(const std::string& session_id) {
-    // Implementation stub
-    return std::nullopt;
+    auto file_id = file_for_session(session_id);
+    if (!file_id) {
+        return std::nullopt;
+    }
+    return load_resume_state(*file_id);
 }
 
 bool ResumeManager::remove_resume_state(const std::string& file_id) {
-    // Implementation stub
-    return true;
+    std::lock_guard<std::mutex> db_lock(db_mutex_);
+    {
+        std::lock_guard<std::mutex> state_lock(state_mutex_);
+        auto it = states_.find(file_id);
+        if (it != states_.end()) {
+            session_files_.erase(it->second.info.session_id);
+            states_.erase(it);
+        }
+    }
+    
+    sqlite3_stmt* stmt = statements_[DELETE_BY_FILE];
+    if (!stmt) {
+        return false;
+    }
+    sqlite3_bind_text(stmt, 1, file_id.c_str(), -1, SQLITE_STATIC);
+    bool removed = sqlite3_step(stmt) == SQLITE_DONE;
+    sqlite3_reset(stmt);
+    return removed;
 }
 
 bool ResumeManager::remove_resume_state_by_session(const std::string& session_id) {
-    // Implementation stub
-    return true;
+    auto file_id = file_for_session(session_id);
+    return file_id && remove_resume_state(*file_id);
 }
 
 bool ResumeManager::update_chunk_completed(const std::string& file_id, uint64_t chunk_index) {
-    // Implementation stub
+    std::unique_lock<std::mutex> state_lock(state_mutex_);
+    TrackedState* state = track(state_lock, file_id);
+    if (!state) {
+        return false;
+    }
+    
+    if (state->info.completed_chunks.insert(chunk_index)) {
+        state->info.last_activity = std::chrono::system_clock::now();
+        mark_dirty(*state);
+    }
     return true;
 }
 
 bool ResumeManager::update_chunk_completed_by_session(const std::string& session_id, uint64_t chunk_index) {
-    // Implementation stub
-    return true;
+    auto file_id = file_for_session(session_id);
+    return file_id && update_chunk_completed(*file_id, chunk_index);
 }
 
-std::set<uint64_t> ResumeManager::get_completed_chunks(const std::string& file_id) {
-    // Implementation stub
-    return {};
+ChunkBitmap ResumeManager::get_completed_chunks(const std::string& file_id) {
+    std::unique_lock<std::mutex> state_lock(state_mutex_);
+    TrackedState* state = track(state_lock, file_id);
+    return state ? state->info.completed_chunks : ChunkBitmap();
 }
 
 std::vector<uint64_t> ResumeManager::get_missing_chunks(const std::string& file_id, uint64_t total_chunks) {
-    // Implementation stub
-    return {};
+    std::unique_lock<std::mutex> state_lock(state_mutex_);
+    TrackedState* state = track(state_lock, file_id);
+    if (!state) {
+        return ChunkBitmap().missing(total_chunks);
+    }
+    return state->info.completed_chunks.missing(total_chunks);
 }
 
 bool ResumeManager::update_last_activity(const std::string& file_id) {
-    // Implementation stub
+    std::unique_lock<std::mutex> state_lock(state_mutex_);
+    TrackedState* state = track(state_lock, file_id);
+    if (!state) {
+        return false;
+    }
+    
+    state->info.last_activity = std::chrono::system_clock::now();
+    mark_dirty(*state);
     return true;
 }
 
 bool ResumeManager::update_last_activity_by_session(const std::string& session_id) {
-    // Implementation stub
-    return true;
+    auto file_id = file_for_session(session_id);
+    return file_id && update_last_activity(*file_id);
+}
+
+bool ResumeManager::flush() {
+    std::lock_guard<std::mutex> db_lock(db_mutex_);
+    return flush_locked();
 }
 
 void ResumeManager::cleanup_old_resume_states(std::chrono::hours max_age) {
-    // Implementation stub
+    auto cutoff = std::chrono::system_clock::now() - max_age;
+    
+    std::lock_guard<std::mutex> db_lock(db_mutex_);
+    flush_locked();
+    
+    sqlite3_stmt* stmt = statements_[DELETE_OLDER_THAN];
+    if (!stmt) {
+        return;
+    }
+    sqlite3_bind_int64(stmt, 1, to_millis(cutoff));
+    sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    
+    // States touched since the flush are dirty and get written back next commit
+    std::lock_guard<std::mutex> state_lock(state_mutex_);
+    for (auto it = states_.begin(); it != states_.end();) {
+        if (!it->second.dirty && it->second.info.last_activity < cutoff) {
+            session_files_.erase(it->second.info.session_id);
+            it = states_.erase(it);
+        } else {
+            ++it;
+        }
+    }
 }
 
 std::vector<ResumeInfo> ResumeManager::list_resumable_transfers() {
-    // Implementation stub
-    return {};
+    std::vector<ResumeInfo> transfers;
+    
+    std::lock_guard<std::mutex> db_lock(db_mutex_);
+    flush_locked();
+    
+    sqlite3_stmt* stmt = statements_[SELECT_ALL];
+    if (!stmt) {
+        return transfers;
+    }
+    while (auto info = read_state(stmt)) {
+        transfers.push_back(std::move(*info));
+    }
+    sqlite3_reset(stmt);
+    return transfers;
 }
 
 size_t ResumeManager::get_resume_state_count() const {
-    // Implementation stub
-    return 0;
+    std::lock_guard<std::mutex> db_lock(db_mutex_);
+    sqlite3_stmt* stmt = statements_[COUNT_STATES];
+    if (!stmt) {
+        return 0;
+    }
+    
+    size_t count = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int64(stmt, 0) : 0;
+    sqlite3_reset(stmt);
+    return count;
 }
 
 bool ResumeManager::is_resumable(const std::string& file_id) const {
-    // Implementation stub
+    std::lock_guard<std::mutex> db_lock(db_mutex_);
+    {
+        std::lock_guard<std::mutex> state_lock(state_mutex_);
+        if (states_.count(file_id)) {
+            return true;
+        }
+    }
+    
+    sqlite3_stmt* stmt = statements_[SELECT_BY_FILE];
+    if (!stmt) {
+        return false;
+    }
+    sqlite3_bind_text(stmt, 1, file_id.c_str(), -1, SQLITE_STATIC);
+    bool exists = sqlite3_step(stmt) == SQLITE_ROW;
+    sqlite3_reset(stmt);
+    return exists;
+}
+
+void ResumeManager::commit_loop() {
+    std::unique_lock<std::mutex> state_lock(state_mutex_);
+    while (!stopping_) {
+        commit_cv_.wait_for(state_lock, commit_interval_, [this]() {
+            return stopping_ || pending_updates_ >= MAX_PENDING_UPDATES;
+        });
+        if (stopping_ || pending_updates_ == 0) {
+            continue;
+        }
+    
+        state_lock.unlock();
+        flush();
+        state_lock.lock();
+    }
+}
+
+bool ResumeManager::flush_locked() {
+    std::vector<ResumeInfo> dirty;
+    {
+        std::lock_guard<std::mutex> state_lock(state_mutex_);
+        if (pending_updates_ == 0) {
+            return true;
+        }
+        for (auto& [file_id, state] : states_) {
+            if (state.dirty) {
+                dirty.push_back(state.info);
+                state.dirty = false;
+            }
+        }
+        pending_updates_ = 0;
+    }
+    
+    if (!db_) {
+        return false;
+    }
+    
+    // One transaction, and so one commit, for every transfer updated since the last
+    bool written = exec(db_, "BEGIN;");
+    for (const auto& info : dirty) {
+        written = written && write_state(info);
+    }
+    if (exec(db_, written ? "COMMIT;" : "ROLLBACK;") && written) {
+        return true;
+    }
+    
+    // Retried with the next commit
+    std::lock_guard<std::mutex> state_lock(state_mutex_);
+    for (const auto& info : dirty) {
+        auto it = states_.find(info.file_id);
+        if (it != states_.end() && !it->second.dirty) {
+            mark_dirty(it->second);
+        }
+    }
     return false;
 }
 
-std::vector<uint8_t> ResumeManager::serialize_completed_chunks(const std::set<uint64_t>& chunks) {
-    // Implementation stub
-    return {};
+bool ResumeManager::write_state(const ResumeInfo& info) {
+    sqlite3_stmt* stmt = statements_[UPSERT_STATE];
+    if (!stmt) {
+        return false;
+    }
+    
+    auto chunks = info.completed_chunks.serialize();
+    auto stats = serialize_session_stats(info.stats);
+    
+    sqlite3_bind_text(stmt, 1, info.file_id.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, info.session_id.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_blob(stmt, 3, chunks.data(), static_cast<int>(chunks.size()), SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 4, to_millis(info.last_activity));
+    sqlite3_bind_blob(stmt, 5, stats.data(), static_cast<int>(stats.size()), SQLITE_STATIC);
+    
+    bool written = sqlite3_step(stmt) == SQLITE_DONE;
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    return written;
+}
+
+std::optional<ResumeInfo> ResumeManager::read_state(sqlite3_stmt* stmt) {
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+        return std::nullopt;
+    }
+    
+    ResumeInfo info;
+    info.file_id = column_text(stmt, 0);
+    info.session_id = column_text(stmt, 1);
+    // An unreadable bitmap only costs refetching the chunks
+    if (auto chunks = ChunkBitmap::deserialize(column_blob(stmt, 2))) {
+        info.completed_chunks = std::move(*chunks);
+    }
+    info.last_activity = from_millis(sqlite3_column_int64(stmt, 3));
+    info.stats = deserialize_session_stats(column_blob(stmt, 4));
+    info.stats.session_id = info.session_id;
+    return info;
+}
+
+ResumeManager::TrackedState* ResumeManager::track(std::unique_lock<std::mutex>& state_lock,
+                                                  const std::string& file_id) {
+    auto it = states_.find(file_id);
+    if (it != states_.end()) {
+        return &it->second;
+    }
+    
+    state_lock.unlock();
+    std::unique_lock<std::mutex> db_lock(db_mutex_);
+    
+    std::optional<ResumeInfo> info;
+    if (sqlite3_stmt* stmt = statements_[SELECT_BY_FILE]) {
+        sqlite3_bind_text(stmt, 1, file_id.c_str(), -1, SQLITE_STATIC);
+        info = read_state(stmt);
+        sqlite3_reset(stmt);
+    }
+    
+    // Still under db_mutex_, so no removal slips in before the state is tracked
+    state_lock.lock();
+    it = states_.find(file_id);
+    if (it != states_.end()) {
+        return &it->second;
+    }
+    if (!info) {
+        return nullptr;
+    }
+    
+    session_files_[info->session_id] = file_id;
+    auto& state = states_[file_id];
+    state.info = std::move(*info);
+    return &state;
+}
+
+std::optional<std::string> ResumeManager::file_for_session(const std::string& session_id) {
+    {
+        std::lock_guard<std::mutex> state_lock(state_mutex_);
+        auto it = session_files_.find(session_id);
+        if (it != session_files_.end()) {
+            return it->second;
+        }
+    }
+    
+    std::lock_guard<std::mutex> db_lock(db_mutex_);
+    sqlite3_stmt* stmt = statements_[SELECT_FILE_BY_SESSION];
+    if (!stmt) {
+        return std::nullopt;
+    }
+    
+    std::optional<std::string> file_id;
+    sqlite3_bind_text(stmt, 1, session_id.c_str(), -1, SQLITE_STATIC);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        file_id = column_text(stmt, 0);
+    }
+    sqlite3_reset(stmt);
+    return file_id;
 }
 
-std::set<uint64_t> ResumeManager::deserialize_completed_chunks(const std::vector<uint8_t>& data) {
-    // Implementation stub
-    return {};
+void ResumeManager::mark_dirty(TrackedState& state) {
+    state.dirty = true;
+    if (++pending_updates_ == MAX_PENDING_UPDATES) {
+        commit_cv_.notify_one();
+    }
 }
 
 std::vector<uint8_t> ResumeManager::serialize_session_stats(const hypershare::transfer::SessionStats& stats) {
-    // Implementation stub
-    return {};
+    // Only the totals outlive the process; clock points are steady_clock
+    int64_t eta = stats.estimated_time_remaining.count();
+    
+    std::vector<uint8_t> data(4 * sizeof(uint64_t) + sizeof(double) + sizeof(int64_t));
+    uint8_t* out = data.data();
+    std::memcpy(out, &stats.total_bytes, sizeof(uint64_t));
+    std::memcpy(out += sizeof(uint64_t), &stats.bytes_transferred, sizeof(uint64_t));
+    std::memcpy(out += sizeof(uint64_t), &stats.current_speed_bps, sizeof(uint64_t));
+    std::memcpy(out += sizeof(uint64_t), &stats.average_speed_bps, sizeof(uint64_t));
+    std::memcpy(out += sizeof(uint64_t), &stats.percentage_complete, sizeof(double));
+    std::memcpy(out += sizeof(double), &eta, sizeof(int64_t));
+    return data;
 }
 
-hypershare::transfer::SessionStats ResumeManager::deserialize_session_stats(const std::vector<uint8_t>& data) {
-    // Implementation stub
-    return {};
+hypershare::transfer::SessionStats ResumeManager::deserialize_session_stats(std::span<const uint8_t> data) {
+    hypershare::transfer::SessionStats stats{};
+    if (data.size() < 4 * sizeof(uint64_t) + sizeof(double) + sizeof(int64_t)) {
+        return stats;
+    }
+    
+    int64_t eta;
+    const uint8_t* in = data.data();
+    std::memcpy(&stats.total_bytes, in, sizeof(uint64_t));
+    std::memcpy(&stats.bytes_transferred, in += sizeof(uint64_t), sizeof(uint64_t));
+    std::memcpy(&stats.current_speed_bps, in += sizeof(uint64_t), sizeof(uint64_t));
+    std::memcpy(&stats.average_speed_bps, in += sizeof(uint64_t), sizeof(uint64_t));
+    std::memcpy(&stats.percentage_complete, in += sizeof(uint64_t), sizeof(double));
+    std::memcpy(&eta, in += sizeof(double), sizeof(int64_t));
+    stats.estimated_time_remaining = std::chrono::milliseconds(eta);
+    return stats;
 }
 
-} // namespace hypershare::storage
\ No newline at end of file
+} // namespace hypershare::storage
@@ -0,0 +1,428 @@
+#include "hypershare/storage/share_watcher.hpp"
+#include "hypershare/storage/file_index.hpp"
+#include "hypershare/core/logger.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <unordered_set>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace hypershare::storage {
+
+namespace {
+
+constexpr int POLL_INTERVAL_MS = 100;
+constexpr size_t EVENT_BUFFER_SIZE = 64 * 1024;
+
+constexpr uint32_t WATCH_MASK = IN_CLOSE_WRITE | IN_MODIFY | IN_CREATE | IN_DELETE |
+                                IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR | IN_DONT_FOLLOW;
+
+std::chrono::system_clock::time_point modification_time(const struct stat& st) {
+    auto since_epoch = std::chrono::seconds(st.st_mtim.tv_sec) + std::chrono::nanoseconds(st.st_mtim.tv_nsec);
+    return std::chrono::system_clock::time_point(
+        std::chrono::duration_cast<std::chrono::system_clock::duration>(since_epoch));
+}
+
+bool is_below(const std::string& path, const std::string& directory) {
+    return path.size() > directory.size() &&
+           path.compare(0, directory.size(), directory) == 0 &&
+           path[directory.size()] == '/';
+}
+
+} // namespace
+
+ShareWatcher::ShareWatcher(std::shared_ptr<FileIndex> file_index, const StorageConfig& config,
+                           std::chrono::milliseconds debounce)
+    : file_index_(std::move(file_index))
+    , config_(config)
+    , chunk_manager_(config_)
+    , debounce_(debounce)
+    , inotify_fd_(::inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) {
+    if (inotify_fd_ < 0) {
+        LOG_ERROR("inotify_init1 failed: {}", std::strerror(errno));
+    }
+}
+
+ShareWatcher::~ShareWatcher() {
+    stop();
+    if (inotify_fd_ >= 0) {
+        ::close(inotify_fd_);
+    }
+}
+
+hypershare::crypto::CryptoResult ShareWatcher::add_root(const std::filesystem::path& root) {
+    std::error_code ec;
+    auto directory = std::filesystem::canonical(root, ec);
+    if (ec || !std::filesystem::is_directory(directory, ec)) {
+        return hypershare::crypto::CryptoResult(
+            hypershare::crypto::CryptoError::FILE_NOT_FOUND,
+            "Share root is not a directory: " + root.string()
+        );
+    }
+    if (inotify_fd_ < 0) {
+        return hypershare::crypto::CryptoResult(
+            hypershare::crypto::CryptoError::INVALID_STATE,
+            "inotify is not available"
+        );
+    }
+
+    // Files indexed by an earlier run are trusted while they have not been
+    // modified since, so a restart only stats the tree
+    std::unordered_map<std::string, TrackedFile> indexed;
+    file_index_->for_each_file([&](const FileMetadataView& file) {
+        std::string path(file.file_path());
+        if (!is_below(path, directory.string())) {
+            return;
+        }
+        TrackedFile& entry = indexed[path];
+        entry.file_hash = file.file_hash();
+        entry.file_id = file.file_id();
+        entry.file_size = file.file_size();
+        entry.modified_at = file.modified_at();
+    });
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    roots_.push_back(directory);
+    watch_tree(directory, false);
+
+    Batch batch;
+    for (auto it = std::filesystem::recursive_directory_iterator(
+             directory, std::filesystem::directory_options::skip_permission_denied, ec);
+         !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+        if (!it->is_regular_file(ec) || it->is_symlink(ec)) {
+            continue;
+        }
+
+        std::string path = it->path().string();
+        struct stat st;
+        if (::stat(path.c_str(), &st) != 0) {
+            continue;
+        }
+
+        auto entry = indexed.find(path);
+        if (entry == indexed.end()) {
+            refresh(path, batch);
+            continue;
+        }
+
+        bool unchanged = entry->second.file_size == static_cast<uint64_t>(st.st_size) &&
+                         entry->second.modified_at >= modification_time(st);
+        if (unchanged) {
+            entry->second.modified_at = modification_time(st);
+        }
+        // A stale entry is tracked first so the refresh replaces its index row
+        track(path, std::move(entry->second));
+        if (!unchanged) {
+            refresh(path, batch);
+        }
+    }
+    commit(batch);
+
+    return hypershare::crypto::CryptoResult(hypershare::crypto::CryptoError::SUCCESS);
+}
+
+bool ShareWatcher::start() {
+    if (running_) {
+        LOG_WARN("Share watcher already running");
+        return false;
+    }
+    if (inotify_fd_ < 0) {
+        return false;
+    }
+
+    running_ = true;
+    watch_thread_ = std::thread([this]() {
+        watch_loop();
+    });
+    return true;
+}
+
+void ShareWatcher::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    if (watch_thread_.joinable()) {
+        watch_thread_.join();
+    }
+}
+
+void ShareWatcher::set_update_handler(UpdateHandler handler) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    update_handler_ = std::move(handler);
+}
+
+void ShareWatcher::set_remove_handler(RemoveHandler handler) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    remove_handler_ = std::move(handler);
+}
+
+ShareWatcher::Stats ShareWatcher::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void ShareWatcher::watch_loop() {
+    while (running_) {
+        struct pollfd pfd{inotify_fd_, POLLIN, 0};
+        int ready = ::poll(&pfd, 1, POLL_INTERVAL_MS);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (ready > 0) {
+            read_events();
+        }
+        process_settled();
+    }
+}
+
+void ShareWatcher::read_events() {
+    alignas(struct inotify_event) char buffer[EVENT_BUFFER_SIZE];
+    auto settled_at = std::chrono::steady_clock::now() + debounce_;
+
+    for (;;) {
+        ssize_t length = ::read(inotify_fd_, buffer, sizeof(buffer));
+        if (length <= 0) {
+            break; // EAGAIN once drained
+        }
+
+        for (char* ptr = buffer; ptr < buffer + length;) {
+            const auto* event = reinterpret_cast<const struct inotify_event*>(ptr);
+            ptr += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                // Events were dropped: look at every known file and every root again
+                for (const auto& [path, tracked] : tracked_) {
+                    mark_pending(path, settled_at);
+                }
+                for (const auto& root : roots_) {
+                    watch_tree(root, true);
+                }
+                continue;
+            }
+            if (event->mask & IN_IGNORED) {
+                watches_.erase(event->wd);
+                continue;
+            }
+
+            auto watch = watches_.find(event->wd);
+            if (watch == watches_.end() || event->len == 0) {
+                continue;
+            }
+            auto path = watch->second / event->name;
+
+            if (event->mask & IN_ISDIR) {
+                if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    watch_tree(path, true);
+                } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                    unwatch_tree(path);
+                }
+                continue;
+            }
+            mark_pending(path.string(), settled_at);
+        }
+    }
+}
+
+void ShareWatcher::watch_tree(const std::filesystem::path& directory, bool mark_files) {
+    auto settled_at = std::chrono::steady_clock::now() + debounce_;
+    auto add_watch = [this](const std::filesystem::path& path) {
+        int wd = ::inotify_add_watch(inotify_fd_, path.c_str(), WATCH_MASK);
+        if (wd < 0) {
+            LOG_WARN("Cannot watch {}: {}", path.string(), std::strerror(errno));
+            return;
+        }
+        watches_[wd] = path;
+    };
+
+    add_watch(directory);
+    std::error_code ec;
+    for (auto it = std::filesystem::recursive_directory_iterator(
+             directory, std::filesystem::directory_options::skip_permission_denied, ec);
+         !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+        if (it->is_symlink(ec)) {
+            continue;
+        }
+        if (it->is_directory(ec)) {
+            add_watch(it->path());
+        } else if (mark_files && it->is_regular_file(ec)) {
+            mark_pending(it->path().string(), settled_at);
+        }
+    }
+}
+
+void ShareWatcher::unwatch_tree(const std::filesystem::path& directory) {
+    std::string prefix = directory.string();
+    for (auto it = watches_.begin(); it != watches_.end();) {
+        std::string path = it->second.string();
+        if (path == prefix || is_below(path, prefix)) {
+            ::inotify_rm_watch(inotify_fd_, it->first);
+            it = watches_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    // A directory moved away reports nothing for its files, they just vanish
+    auto settled_at = std::chrono::steady_clock::now() + debounce_;
+    for (const auto& [path, tracked] : tracked_) {
+        if (is_below(path, prefix)) {
+            mark_pending(path, settled_at);
+        }
+    }
+}
+
+void ShareWatcher::mark_pending(const std::string& path, std::chrono::steady_clock::time_point settled_at) {
+    // Every event pushes the deadline out, so a file is processed once writes stop
+    pending_[path] = settled_at;
+}
+
+void ShareWatcher::process_settled() {
+    auto now = std::chrono::steady_clock::now();
+    Batch batch;
+
+    for (auto it = pending_.begin(); it != pending_.end();) {
+        if (it->second <= now) {
+            refresh(it->first, batch);
+            it = pending_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    commit(batch);
+}
+
+void ShareWatcher::commit(Batch& batch) {
+    std::unordered_set<std::string> updated_hashes;
+    for (const auto& metadata : batch.updated) {
+        updated_hashes.insert(metadata.file_hash);
+    }
+
+    for (const auto& file_hash : batch.removed) {
+        // Still shared under another path, or the same content came back
+        if (updated_hashes.count(file_hash) || hash_refs_.count(file_hash)) {
+            continue;
+        }
+        file_index_->remove_file(file_hash);
+        if (remove_handler_) {
+            remove_handler_(file_hash);
+        }
+    }
+
+    if (batch.updated.empty()) {
+        return;
+    }
+    if (!file_index_->add_files(batch.updated)) {
+        LOG_ERROR("Failed to index {} changed shared files", batch.updated.size());
+        return;
+    }
+    if (update_handler_) {
+        for (const auto& metadata : batch.updated) {
+            update_handler_(metadata);
+        }
+    }
+}
+
+void ShareWatcher::refresh(const std::string& path, Batch& batch) {
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        if (tracked_.count(path)) {
+            untrack(path, batch);
+            ++stats_.files_removed;
+        }
+        return;
+    }
+
+    auto file_size = static_cast<uint64_t>(st.st_size);
+    auto modified_at = modification_time(st);
+
+    TrackedFile tracked;
+    FileMetadata metadata;
+
+    auto existing = tracked_.find(path);
+    if (existing != tracked_.end()) {
+        if (existing->second.file_size == file_size && existing->second.modified_at == modified_at) {
+            return;
+        }
+        tracked = existing->second;
+    } else {
+        tracked.file_id = std::filesystem::path(path).filename().string() + "_" +
+                          std::to_string(std::chrono::system_clock::now().time_since_epoch().count());
+    }
+
+    if (!hash_in_full(path, tracked, modified_at, metadata)) {
+        return;
+    }
+
+    untrack(path, batch);
+    tracked.file_hash = metadata.file_hash;
+    tracked.file_size = metadata.file_size;
+    tracked.modified_at = modified_at;
+    track(path, std::move(tracked));
+    batch.updated.push_back(std::move(metadata));
+}
+
+bool ShareWatcher::hash_in_full(const std::string& path, TrackedFile& tracked,
+                                std::chrono::system_clock::time_point modified_at,
+                                FileMetadata& metadata) {
+    auto result = chunk_manager_.chunk_file(path, metadata);
+    if (!result) {
+        LOG_WARN("Failed to hash shared file {}: {}", path, result.message);
+        return false;
+    }
+
+    // Keep what the user attached to the earlier version
+    if (auto previous = tracked.file_hash.empty() ? nullptr : file_index_->get_file_shared(tracked.file_hash)) {
+        metadata.file_type = previous->file_type;
+        metadata.description = previous->description;
+        metadata.tags = previous->tags;
+        metadata.created_at = previous->created_at;
+
+        // Fixed-size chunks keep their offsets, so comparing by position
+        // tells which of them the change touched
+        if (!metadata.is_content_defined() && !previous->is_content_defined() &&
+            metadata.chunk_size == previous->chunk_size) {
+            size_t shared = std::min(metadata.chunk_hashes.size(), previous->chunk_hashes.size());
+            size_t unchanged = 0;
+            for (size_t i = 0; i < shared; ++i) {
+                if (metadata.chunk_hashes[i] == previous->chunk_hashes[i]) {
+                    ++unchanged;
+                }
+            }
+            stats_.chunks_unchanged += unchanged;
+            stats_.chunks_changed += metadata.chunk_hashes.size() - unchanged;
+        }
+    }
+    metadata.file_id = tracked.file_id;
+    metadata.modified_at = modified_at;
+
+    if (tracked.file_hash.empty()) {
+        ++stats_.files_hashed;
+    } else {
+        ++stats_.files_updated;
+    }
+    return true;
+}
+
+void ShareWatcher::track(const std::string& path, TrackedFile tracked) {
+    ++hash_refs_[tracked.file_hash];
+    tracked_[path] = std::move(tracked);
+}
+
+void ShareWatcher::untrack(const std::string& path, Batch& batch) {
+    auto it = tracked_.find(path);
+    if (it == tracked_.end()) {
+        return;
+    }
+
+    auto refs = hash_refs_.find(it->second.file_hash);
+    if (refs != hash_refs_.end() && --refs->second == 0) {
+        hash_refs_.erase(refs);
+        batch.removed.insert(it->second.file_hash);
+    }
+    tracked_.erase(it);
+}
+
+} // namespace hypershare::storage
@@ -0,0 +1,232 @@
+#include "hypershare/storage/storage_accountant.hpp"
+#include <algorithm>
+
+namespace hypershare::storage {
+
+namespace {
+    constexpr std::array<StorageArea, 2> EVICTION_ORDER = {StorageArea::CHUNK_STORE, StorageArea::INCOMPLETE};
+
+    size_t index_of(StorageArea area) {
+        return static_cast<size_t>(area);
+    }
+
+    uint64_t directory_size(const std::filesystem::path& directory) {
+        uint64_t total = 0;
+        std::error_code ec;
+        for (auto it = std::filesystem::recursive_directory_iterator(
+                 directory, std::filesystem::directory_options::skip_permission_denied, ec);
+             !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+            std::error_code size_ec;
+            if (it->is_regular_file(size_ec)) {
+                auto size = it->file_size(size_ec);
+                total += size_ec ? 0 : size;
+            }
+        }
+        return total;
+    }
+
+    std::chrono::system_clock::time_point to_system_time(std::filesystem::file_time_type time) {
+        return std::chrono::time_point_cast<std::chrono::system_clock::duration>(
+            time - std::filesystem::file_time_type::clock::now() + std::chrono::system_clock::now());
+    }
+}
+
+StorageAccountant::StorageAccountant(const StorageConfig& config)
+    : config_(config)
+    , budget_(config.max_storage_size) {
+}
+
+void StorageAccountant::scan() {
+    std::array<uint64_t, AREA_COUNT> used{};
+    used[index_of(StorageArea::DOWNLOADS)] = directory_size(config_.download_directory);
+    if (!config_.chunk_store_directory.empty()) {
+        used[index_of(StorageArea::CHUNK_STORE)] = directory_size(config_.chunk_store_directory);
+    }
+
+    // Partial files are <hash>.part and per-chunk files <hash>.chunk.<n>
+    std::unordered_map<std::string, Entry> incomplete;
+    std::error_code ec;
+    for (auto it = std::filesystem::recursive_directory_iterator(
+             config_.incomplete_directory, std::filesystem::directory_options::skip_permission_denied, ec);
+         !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+        std::error_code file_ec;
+        if (!it->is_regular_file(file_ec)) {
+            continue;
+        }
+        uint64_t size = it->file_size(file_ec);
+        if (file_ec) {
+            continue;
+        }
+        used[index_of(StorageArea::INCOMPLETE)] += size;
+
+        auto filename = it->path().filename().string();
+        auto& entry = incomplete[filename.substr(0, filename.find('.'))];
+        entry.bytes += size;
+        auto modified = it->last_write_time(file_ec);
+        if (!file_ec) {
+            entry.last_used = std::max(entry.last_used, to_system_time(modified));
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    used_ = used;
+    entries_[index_of(StorageArea::INCOMPLETE)] = std::move(incomplete);
+}
+
+uint64_t StorageAccountant::used(StorageArea area) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return used_[index_of(area)];
+}
+
+uint64_t StorageAccountant::total_used() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t total = 0;
+    for (uint64_t bytes : used_) {
+        total += bytes;
+    }
+    return total;
+}
+
+void StorageAccountant::charge(StorageArea area, uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    used_[index_of(area)] += bytes;
+}
+
+void StorageAccountant::release(StorageArea area, uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& used = used_[index_of(area)];
+    used -= std::min(used, bytes);
+}
+
+void StorageAccountant::charge_entry(StorageArea area, const std::string& key, uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& entry = entries_[index_of(area)][key];
+    entry.bytes += bytes;
+    entry.last_used = std::chrono::system_clock::now();
+    used_[index_of(area)] += bytes;
+}
+
+void StorageAccountant::track_entry(StorageArea area, const std::string& key, uint64_t bytes,
+                                    std::chrono::system_clock::time_point last_used) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& entry = entries_[index_of(area)][key];
+    entry.bytes += bytes;
+    entry.last_used = std::max(entry.last_used, last_used);
+}
+
+void StorageAccountant::remove(StorageArea area, const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& entries = entries_[index_of(area)];
+    auto it = entries.find(key);
+    if (it == entries.end()) {
+        return;
+    }
+
+    auto& used = used_[index_of(area)];
+    used -= std::min(used, it->second.bytes);
+    entries.erase(it);
+}
+
+void StorageAccountant::forget(StorageArea area, const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_[index_of(area)].erase(key);
+}
+
+void StorageAccountant::touch(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto now = std::chrono::system_clock::now();
+    for (auto& entries : entries_) {
+        auto it = entries.find(key);
+        if (it != entries.end()) {
+            it->second.last_used = now;
+        }
+    }
+}
+
+void StorageAccountant::unpin(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pinned_.erase(key);
+}
+
+bool StorageAccountant::reserve(const std::string& key, uint64_t bytes) {
+    std::lock_guard<std::mutex> reserve_lock(reserve_mutex_);
+
+    uint64_t extra;
+    bool newly_pinned;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& entries = entries_[index_of(StorageArea::INCOMPLETE)];
+        auto it = entries.find(key);
+        uint64_t existing = it != entries.end() ? it->second.bytes : 0;
+        extra = bytes > existing ? bytes - existing : 0;
+        // Pinned first so making room cannot evict the download itself
+        newly_pinned = pinned_.insert(key).second;
+    }
+
+    if (!make_room(extra) || !config_.has_sufficient_space(extra)) {
+        if (newly_pinned) {
+            unpin(key);
+        }
+        return false;
+    }
+
+    charge_entry(StorageArea::INCOMPLETE, key, extra);
+    return true;
+}
+
+void StorageAccountant::set_evictor(StorageArea area, Evictor evictor) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    evictors_[index_of(area)] = std::move(evictor);
+}
+
+bool StorageAccountant::make_room(uint64_t bytes) {
+    for (;;) {
+        StorageArea area;
+        std::string key;
+        Evictor evictor;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            uint64_t total = 0;
+            for (uint64_t used : used_) {
+                total += used;
+            }
+            if (total + bytes <= budget_) {
+                return true;
+            }
+            if (!next_victim(area, key)) {
+                return false;
+            }
+            evictor = evictors_[index_of(area)];
+        }
+
+        // Evictors report back through release()/remove(), so no lock is held.
+        // The entry goes either way, a failed eviction must not be picked again.
+        if (evictor) {
+            evictor(key);
+        }
+        forget(area, key);
+    }
+}
+
+bool StorageAccountant::next_victim(StorageArea& area, std::string& key) const {
+    for (StorageArea candidate_area : EVICTION_ORDER) {
+        const auto& entries = entries_[index_of(candidate_area)];
+        const std::string* oldest = nullptr;
+        std::chrono::system_clock::time_point oldest_use;
+        for (const auto& [candidate, entry] : entries) {
+            if (pinned_.count(candidate) || (oldest && entry.last_used >= oldest_use)) {
+                continue;
+            }
+            oldest = &candidate;
+            oldest_use = entry.last_used;
+        }
+        if (oldest) {
+            area = candidate_area;
+            key = *oldest;
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace hypershare::storage
@@ -30,6 +30,12 @@ bool StorageConfig::validate() const {
         return false;
     }
     
+    if (chunking_mode == ChunkingMode::CONTENT_DEFINED &&
+        (!ContentChunker::valid_sizes(cdc_min_chunk_size, cdc_avg_chunk_size, cdc_max_chunk_size) ||
+         cdc_max_chunk_size > 1024 * 1024 * 10)) {
+        return false;
+    }
+    
     // Check if max_concurrent_transfers is reasonable
     if (max_concurrent_transfers == 0 || max_concurrent_transfers > 1000) {
         return false;
@@ -43,6 +49,10 @@ bool StorageConfig::create_directories() const {
         std::filesystem::create_directories(download_directory);
         std::filesystem::create_directories(incomplete_directory);
         
+        if (!chunk_store_directory.empty()) {
+            std::filesystem::create_directories(chunk_store_directory);
+        }
+        
         // Create database directory
         auto db_dir = database_path.parent_path();
         if (!db_dir.empty()) {
@@ -85,10 +95,17 @@ std::filesystem::path StorageConfig::get_incomplete_path(const std::string& file
     return incomplete_directory / subdir / file_hash;
 }
 
+std::filesystem::path StorageConfig::get_partial_path(const std::string& file_hash) const {
+    // Single preallocated download target, completed by renaming into download_directory
+    std::string subdir = file_hash.substr(0, 2);
+    return incomplete_directory / subdir / (file_hash + ".part");
+}
+
 void StorageConfig::set_base_directory(const std::filesystem::path& base_dir) {
     download_directory = base_dir / "downloads";
     incomplete_directory = base_dir / "incomplete";
     database_path = base_dir / "hypershare.db";
+    chunk_store_directory = base_dir / "chunks";
 }
 
 } // namespace hypershare::storage
\ No newline at end of file
@@ -0,0 +1,212 @@
+#include "hypershare/storage/write_back_buffer.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+#include <unistd.h>
+
+namespace hypershare::storage {
+
+namespace {
+    bool write_fully(int fd, const uint8_t* data, size_t size, uint64_t offset) {
+        while (size > 0) {
+            ssize_t written = ::pwrite(fd, data, size, static_cast<off_t>(offset));
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            data += written;
+            size -= static_cast<size_t>(written);
+            offset += static_cast<uint64_t>(written);
+        }
+        return true;
+    }
+
+    bool sync_data(int fd) {
+#ifdef __linux__
+        return ::fdatasync(fd) == 0;
+#else
+        return ::fsync(fd) == 0;
+#endif
+    }
+}
+
+WriteBackBuffer::WriteBackBuffer(int fd, DurabilityPolicy policy, size_t capacity, uint64_t sync_interval)
+    : fd_(fd)
+    , policy_(policy)
+    , capacity_(capacity)
+    , sync_interval_(sync_interval) {
+}
+
+void WriteBackBuffer::set_direct(int direct_fd, AlignedBufferPool* pool) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    direct_fd_ = direct_fd;
+    pool_ = pool;
+}
+
+bool WriteBackBuffer::write(size_t chunk_index, uint64_t offset, std::span<const uint8_t> data,
+                            std::vector<size_t>& durable) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // A chunk written again must not be coalesced with its earlier copy
+    if (overlaps_locked(offset, data.size()) && !flush_locked(durable)) {
+        return false;
+    }
+
+    auto next = runs_.lower_bound(offset);
+    Run* run = nullptr;
+    if (next != runs_.begin()) {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second.data.size() == offset) {
+            run = &previous->second;
+        }
+    }
+    if (!run) {
+        run = &runs_[offset];
+    }
+
+    run->data.insert(run->data.end(), data.begin(), data.end());
+    run->chunks.push_back(chunk_index);
+    buffered_bytes_ += data.size();
+    set_written_locked(chunk_index, true);
+
+    // Chunks arriving out of order can close the gap to the following run
+    if (next != runs_.end() && next->first == offset + data.size()) {
+        run->data.insert(run->data.end(), next->second.data.begin(), next->second.data.end());
+        run->chunks.insert(run->chunks.end(), next->second.chunks.begin(), next->second.chunks.end());
+        runs_.erase(next);
+    }
+
+    if (policy_ == DurabilityPolicy::PER_CHUNK || buffered_bytes_ >= capacity_) {
+        return flush_locked(durable);
+    }
+    return true;
+}
+
+void WriteBackBuffer::add_written(size_t chunk_index, size_t size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    unsynced_chunks_.push_back(chunk_index);
+    unsynced_bytes_ += size;
+    set_written_locked(chunk_index, true);
+}
+
+void WriteBackBuffer::add_durable(size_t chunk_index) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    set_written_locked(chunk_index, true);
+}
+
+bool WriteBackBuffer::flush(std::vector<size_t>& durable) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return flush_locked(durable);
+}
+
+bool WriteBackBuffer::sync(std::vector<size_t>& durable) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return flush_locked(durable) && sync_locked(durable);
+}
+
+size_t WriteBackBuffer::buffered_bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return buffered_bytes_;
+}
+
+bool WriteBackBuffer::contains(size_t chunk_index) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return chunk_index < written_.size() && written_[chunk_index];
+}
+
+bool WriteBackBuffer::flush_locked(std::vector<size_t>& durable) {
+    bool written = true;
+    for (auto& [offset, run] : runs_) {
+        if (written && !write_run(offset, run.data)) {
+            written = false;
+        }
+        if (!written) {
+            for (size_t chunk_index : run.chunks) {
+                set_written_locked(chunk_index, false);
+            }
+            continue;
+        }
+        unsynced_chunks_.insert(unsynced_chunks_.end(), run.chunks.begin(), run.chunks.end());
+        unsynced_bytes_ += run.data.size();
+    }
+    runs_.clear();
+    buffered_bytes_ = 0;
+
+    if (!written) {
+        return false;
+    }
+    if (policy_ == DurabilityPolicy::PER_CHUNK ||
+        (policy_ == DurabilityPolicy::PER_INTERVAL && unsynced_bytes_ >= sync_interval_)) {
+        return sync_locked(durable);
+    }
+    return true;
+}
+
+bool WriteBackBuffer::sync_locked(std::vector<size_t>& durable) {
+    if (unsynced_chunks_.empty()) {
+        return true;
+    }
+
+    // After a failed sync the page cache may have dropped the data, so none
+    // of these chunks can be trusted to be on disk
+    bool synced = sync_data(fd_);
+    if (synced) {
+        durable.insert(durable.end(), unsynced_chunks_.begin(), unsynced_chunks_.end());
+    } else {
+        for (size_t chunk_index : unsynced_chunks_) {
+            set_written_locked(chunk_index, false);
+        }
+    }
+    unsynced_chunks_.clear();
+    unsynced_bytes_ = 0;
+    return synced;
+}
+
+bool WriteBackBuffer::write_run(uint64_t offset, const std::vector<uint8_t>& data) {
+    size_t direct_length = 0;
+    if (direct_fd_ >= 0 && offset == AlignedBufferPool::align_down(offset)) {
+        direct_length = static_cast<size_t>(AlignedBufferPool::align_down(data.size()));
+    }
+
+    if (direct_length > 0) {
+        auto staging = pool_->acquire();
+        if (!staging) {
+            direct_length = 0;
+        }
+        for (size_t done = 0; done < direct_length; ) {
+            size_t length = std::min(staging.size(), direct_length - done);
+            std::memcpy(staging.data(), data.data() + done, length);
+            if (!write_fully(direct_fd_, staging.data(), length, offset + done)) {
+                return false;
+            }
+            done += length;
+        }
+    }
+
+    return write_fully(fd_, data.data() + direct_length, data.size() - direct_length, offset + direct_length);
+}
+
+void WriteBackBuffer::set_written_locked(size_t chunk_index, bool written) {
+    if (chunk_index >= written_.size()) {
+        if (!written) {
+            return;
+        }
+        written_.resize(chunk_index + 1);
+    }
+    written_[chunk_index] = written;
+}
+
+bool WriteBackBuffer::overlaps_locked(uint64_t offset, size_t size) const {
+    auto next = runs_.upper_bound(offset);
+    if (next != runs_.end() && next->first < offset + size) {
+        return true;
+    }
+    if (next != runs_.begin()) {
+        auto previous = std::prev(next);
+        return previous->first + previous->second.data.size() > offset;
+    }
+    return false;
+}
+
+} // namespace hypershare::storage
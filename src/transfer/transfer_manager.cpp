@@ -1,4 +1,7 @@
 #include "hypershare/transfer/transfer_manager.hpp"
+#include "hypershare/storage/chunk_manager.hpp"
+#include "hypershare/storage/resume_manager.hpp"
+#include "hypershare/storage/file_index.hpp"
 #include <random>
 #include <sstream>
 #include <iomanip>
@@ -17,6 +20,10 @@ TransferManager::TransferManager(const hypershare::storage::StorageConfig& confi
 
 TransferManager::~TransferManager() {
     std::lock_guard<std::mutex> lock(sessions_mutex_);
+    if (chunk_manager_) {
+        chunk_manager_->set_durable_handler(nullptr);
+        chunk_manager_->set_eviction_handler(nullptr);
+    }
     active_sessions_.clear();
 }
 
@@ -35,6 +42,52 @@ std::string TransferManager::start_download(const std::string& file_id, uint32_t
     return session_id;
 }
 
+std::string TransferManager::start_download(const hypershare::storage::FileMetadata& metadata, uint32_t peer_id) {
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    
+    if (!can_start_new_transfer()) {
+        return ""; // Cannot start new transfer
+    }
+    
+    // Chunk positions are derived from the announced chunk size
+    if (metadata.chunk_size == 0) {
+        return "";
+    }
+    
+    // Refused up front when the download does not fit the storage budget
+    if (chunk_manager_) {
+        auto prepared = chunk_manager_->prepare_download(metadata);
+        if (!prepared) {
+            return "";
+        }
+    }
+    
+    auto session_id = generate_session_id();
+    auto session = std::make_unique<TransferSession>(session_id, metadata.file_id, peer_id);
+    session->start_transfer(metadata);
+    
+    auto& started = *session;
+    active_sessions_[session_id] = std::move(session);
+    if (!chunk_manager_) {
+        return session_id;
+    }
+    track_download(session_id, started, metadata);
+    
+    // Chunks some local file already holds are not fetched from the peer
+    if (file_index_) {
+        std::vector<size_t> imported;
+        chunk_manager_->import_local_chunks(metadata, *file_index_, imported);
+        for (size_t chunk_index : imported) {
+            started.mark_chunk_received(static_cast<uint32_t>(chunk_index));
+        }
+    }
+    if (started.is_complete()) {
+        complete_download(session_id, started);
+    }
+    
+    return session_id;
+}
+
 std::string TransferManager::start_upload(const std::string& file_id, uint32_t peer_id) {
     std::lock_guard<std::mutex> lock(sessions_mutex_);
     
@@ -139,6 +192,13 @@ hypershare::crypto::CryptoResult TransferManager::cancel_transfer(const std::str
     it->second->set_state(TransferState::CANCELLED);
     active_sessions_.erase(it);
     
+    auto download = downloads_.find(session_id);
+    if (download != downloads_.end()) {
+        chunk_manager_->abort_download(download->second);
+        untrack_download(download->second, false);
+        downloads_.erase(download);
+    }
+    
     return hypershare::crypto::CryptoResult(hypershare::crypto::CryptoError::SUCCESS);
 }
 
@@ -164,6 +224,13 @@ hypershare::crypto::CryptoResult TransferManager::handle_chunk_request(const std
 hypershare::crypto::CryptoResult TransferManager::handle_chunk_received(const std::string& session_id,
                                                                          uint32_t chunk_index,
                                                                          const std::vector<uint8_t>& chunk_data) {
+    return handle_chunk_received(session_id, chunk_index, chunk_data, {});
+}
+
+hypershare::crypto::CryptoResult TransferManager::handle_chunk_received(const std::string& session_id,
+                                                                         uint32_t chunk_index,
+                                                                         const std::vector<uint8_t>& chunk_data,
+                                                                         std::span<const hypershare::crypto::Blake3Hash> proof) {
     std::lock_guard<std::mutex> lock(sessions_mutex_);
     
     auto it = active_sessions_.find(session_id);
@@ -175,21 +242,46 @@ hypershare::crypto::CryptoResult TransferManager::handle_chunk_received(const st
     }
     
     auto& session = it->second;
-    auto result = session->handle_chunk_received(chunk_index, chunk_data);
+    auto result = session->handle_chunk_received(chunk_index, chunk_data, proof);
+    
+    auto download = downloads_.find(session_id);
+    if (result.success() && download != downloads_.end()) {
+        result = chunk_manager_->write_chunk(download->second, chunk_index, chunk_data);
+        if (!result.success()) {
+            session->set_state(TransferState::FAILED);
+            return result;
+        }
+    }
     
     if (result.success()) {
         total_bytes_transferred_ += chunk_data.size();
         
         // Check if transfer is complete
         if (session->is_complete()) {
-            // Keep session for stats but mark as completed
-            session->set_state(TransferState::COMPLETED);
+            return complete_download(session_id, *session);
         }
     }
     
     return result;
 }
 
+void TransferManager::set_chunk_manager(std::shared_ptr<hypershare::storage::ChunkManager> chunk_manager) {
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    chunk_manager_ = std::move(chunk_manager);
+    install_chunk_handlers();
+}
+
+void TransferManager::set_resume_manager(std::shared_ptr<hypershare::storage::ResumeManager> resume_manager) {
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    resume_manager_ = std::move(resume_manager);
+    install_chunk_handlers();
+}
+
+void TransferManager::set_file_index(std::shared_ptr<hypershare::storage::FileIndex> file_index) {
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    file_index_ = std::move(file_index);
+}
+
 void TransferManager::set_max_concurrent_transfers(uint32_t max_transfers) {
     std::lock_guard<std::mutex> lock(sessions_mutex_);
     max_concurrent_transfers_ = max_transfers;
@@ -256,6 +348,99 @@ bool TransferManager::can_start_new_transfer() const {
     return active_sessions_.size() < max_concurrent_transfers_;
 }
 
+void TransferManager::install_chunk_handlers() {
+    if (!chunk_manager_ || !resume_manager_) {
+        return;
+    }
+    
+    // Chunks of downloads without resume state are not recorded
+    chunk_manager_->set_durable_handler(
+        [resume_manager = resume_manager_](const std::string& file_hash, const std::vector<size_t>& chunks) {
+            for (size_t chunk_index : chunks) {
+                if (!resume_manager->update_chunk_completed(file_hash, chunk_index)) {
+                    return;
+                }
+            }
+        });
+    
+    // An evicted target takes its chunks with it, a later start begins anew
+    chunk_manager_->set_eviction_handler([resume_manager = resume_manager_](const std::string& file_hash) {
+        resume_manager->remove_resume_state(file_hash);
+    });
+}
+
+void TransferManager::track_download(const std::string& session_id, TransferSession& session,
+                                     const hypershare::storage::FileMetadata& metadata) {
+    downloads_[session_id] = metadata;
+    if (!resume_manager_) {
+        return;
+    }
+    
+    // The state describes the download target, so it is keyed by file hash as
+    // the target is. Chunks only count once durable, so the state must exist
+    // before the first write.
+    hypershare::storage::ResumeInfo info;
+    if (auto existing = resume_manager_->load_resume_state(metadata.file_hash)) {
+        // Only chunks still intact in the target are kept, the rest is fetched again
+        std::vector<size_t> durable;
+        existing->completed_chunks.for_each([&](uint64_t chunk_index) { durable.push_back(chunk_index); });
+        std::vector<size_t> restored;
+        chunk_manager_->resume_download(metadata, durable, restored);
+        for (size_t chunk_index : restored) {
+            info.completed_chunks.insert(chunk_index);
+            session.mark_chunk_received(static_cast<uint32_t>(chunk_index));
+        }
+        info.stats = existing->stats;
+    }
+    info.file_id = metadata.file_hash;
+    info.session_id = session_id;
+    info.last_activity = std::chrono::system_clock::now();
+    resume_manager_->save_resume_state(info);
+}
+
+void TransferManager::untrack_download(const hypershare::storage::FileMetadata& metadata, bool keep_resume_state) {
+    if (resume_manager_ && !keep_resume_state) {
+        resume_manager_->remove_resume_state(metadata.file_hash);
+    }
+}
+
+hypershare::crypto::CryptoResult TransferManager::complete_download(const std::string& session_id,
+                                                                     TransferSession& session) {
+    auto download = downloads_.find(session_id);
+    if (download != downloads_.end()) {
+        auto output_path = download_path(download->second);
+        auto finalized = chunk_manager_->finalize_download(download->second, output_path);
+        // A download that failed to finalize is resumed from its target
+        untrack_download(download->second, !finalized.success());
+        if (!finalized.success()) {
+            downloads_.erase(download);
+            session.set_state(TransferState::FAILED);
+            return finalized;
+        }
+        
+        // Later downloads find the chunks of the completed file through the index
+        if (file_index_) {
+            auto completed = std::move(download->second);
+            completed.file_path = output_path.string();
+            file_index_->add_file(completed);
+        }
+        downloads_.erase(download);
+    }
+    
+    // Keep session for stats but mark as completed
+    session.set_state(TransferState::COMPLETED);
+    return hypershare::crypto::CryptoResult(hypershare::crypto::CryptoError::SUCCESS);
+}
+
+std::filesystem::path TransferManager::download_path(const hypershare::storage::FileMetadata& metadata) const {
+    // The name comes from a peer, so it may not point outside the directory
+    auto filename = std::filesystem::path(metadata.filename).filename();
+    if (filename.empty() || filename == "." || filename == "..") {
+        filename = metadata.file_hash;
+    }
+    return config_.download_directory / filename;
+}
+
 TransferSessionStats TransferManager::create_session_stats(const TransferSession& session) {
     TransferSessionStats stats;
     stats.session_id = session.get_session_id();
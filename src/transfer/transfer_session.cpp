@@ -1,4 +1,5 @@
 #include "hypershare/transfer/transfer_session.hpp"
+#include "hypershare/storage/hash_tree.hpp"
 #include "hypershare/crypto/hash.hpp"
 #include <algorithm>
 #include <random>
@@ -88,6 +89,12 @@ void TransferSession::mark_chunk_requested(uint32_t chunk_index) {
 
 hypershare::crypto::CryptoResult TransferSession::handle_chunk_received(uint32_t chunk_index,
                                                                          const std::vector<uint8_t>& chunk_data) {
+    return handle_chunk_received(chunk_index, chunk_data, {});
+}
+
+hypershare::crypto::CryptoResult TransferSession::handle_chunk_received(uint32_t chunk_index,
+                                                                         const std::vector<uint8_t>& chunk_data,
+                                                                         std::span<const hypershare::crypto::Blake3Hash> proof) {
     // Validate chunk index
     if (chunk_index >= metadata_.chunk_count) {
         return hypershare::crypto::CryptoResult(
@@ -104,17 +111,8 @@ hypershare::crypto::CryptoResult TransferSession::handle_chunk_received(uint32_t
         );
     }
     
-    // Validate chunk size (except for last chunk)
-    uint32_t expected_size = metadata_.chunk_size;
-    if (chunk_index == metadata_.chunk_count - 1) {
-        // Last chunk might be smaller
-        uint32_t remainder = metadata_.file_size % metadata_.chunk_size;
-        if (remainder != 0) {
-            expected_size = remainder;
-        }
-    }
-    
-    if (chunk_data.size() != expected_size) {
+    // Validate chunk size (last and content-defined chunks vary)
+    if (chunk_data.size() != metadata_.get_chunk_size(chunk_index)) {
         return hypershare::crypto::CryptoResult(
             hypershare::crypto::CryptoError::INVALID_STATE,
             "Chunk size mismatch"
@@ -122,7 +120,7 @@ hypershare::crypto::CryptoResult TransferSession::handle_chunk_received(uint32_t
     }
     
     // Validate chunk hash if available
-    if (!validate_chunk(chunk_index, chunk_data)) {
+    if (!validate_chunk(chunk_index, chunk_data, proof)) {
         return hypershare::crypto::CryptoResult(
             hypershare::crypto::CryptoError::VERIFICATION_FAILED,
             "Chunk hash verification failed"
@@ -143,6 +141,17 @@ hypershare::crypto::CryptoResult TransferSession::handle_chunk_received(uint32_t
     return hypershare::crypto::CryptoResult(hypershare::crypto::CryptoError::SUCCESS);
 }
 
+void TransferSession::mark_chunk_received(uint32_t chunk_index) {
+    if (chunk_index >= metadata_.chunk_count) {
+        return;
+    }
+    
+    received_chunks_.set(chunk_index);
+    if (received_chunks_.count() == metadata_.chunk_count) {
+        state_ = TransferState::COMPLETED;
+    }
+}
+
 bool TransferSession::is_chunk_requested(uint32_t chunk_index) const {
     return chunk_index < metadata_.chunk_count && requested_chunks_.test(chunk_index);
 }
@@ -190,14 +199,25 @@ void TransferSession::update_progress() {
     // This method can be extended for additional progress tracking
 }
 
-bool TransferSession::validate_chunk(uint32_t chunk_index, const std::vector<uint8_t>& chunk_data) {
+bool TransferSession::validate_chunk(uint32_t chunk_index, const std::vector<uint8_t>& chunk_data,
+                                     std::span<const hypershare::crypto::Blake3Hash> proof) {
     // If we have hash information, validate it
-    if (chunk_index < metadata_.chunk_hashes.size() && !metadata_.chunk_hashes[chunk_index].empty()) {
+    if (chunk_index < metadata_.chunk_hashes.size()) {
         std::span<const uint8_t> data_span(chunk_data.data(), chunk_data.size());
-        auto computed_hash = hypershare::crypto::Blake3Hasher::hash(data_span);
-        auto computed_hex = hypershare::crypto::hash_utils::hash_to_hex(computed_hash);
+        return hypershare::crypto::Blake3Hasher::hash(data_span) == metadata_.chunk_hashes[chunk_index];
+    }
+    
+    // Manifest with only the tree root, the chunk must prove its way up to it
+    if (metadata_.file_hash_scheme == hypershare::storage::FileHashScheme::CHUNK_TREE) {
+        auto root = hypershare::crypto::hash_utils::hash_from_hex(metadata_.file_hash);
+        if (!root) {
+            return false;
+        }
         
-        return computed_hex == metadata_.chunk_hashes[chunk_index];
+        std::span<const uint8_t> data_span(chunk_data.data(), chunk_data.size());
+        return hypershare::storage::hash_tree::verify(hypershare::crypto::Blake3Hasher::hash(data_span),
+                                                      chunk_index, metadata_.total_chunks(), metadata_.file_size,
+                                                      proof, *root);
     }
     
     // If no hash available, just validate size
@@ -0,0 +1,222 @@
+#include <benchmark/benchmark.h>
+#include "hypershare/storage/parallel_hasher.hpp"
+#include "hypershare/storage/chunk_manager.hpp"
+#include "hypershare/storage/file_index.hpp"
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <vector>
+#include <cstring>
+#include <string>
+
+using namespace hypershare::storage;
+
+namespace {
+
+constexpr size_t BENCHMARK_FILE_SIZE = 256 * 1024 * 1024; // 256MB
+
+// Shared input file, written once per process. After the first iteration it is
+// served from the page cache, so the numbers show hashing throughput per core.
+const std::filesystem::path& benchmark_file() {
+    static const std::filesystem::path path = [] {
+        auto file_path = std::filesystem::temp_directory_path() / "hypershare_hash_benchmark.bin";
+        std::ofstream file(file_path, std::ios::binary | std::ios::trunc);
+
+        std::mt19937_64 gen(42);
+        std::vector<uint64_t> block(1024 * 1024 / sizeof(uint64_t));
+        for (size_t written = 0; written < BENCHMARK_FILE_SIZE; written += block.size() * sizeof(uint64_t)) {
+            std::generate(block.begin(), block.end(), gen);
+            file.write(reinterpret_cast<const char*>(block.data()), block.size() * sizeof(uint64_t));
+        }
+        return file_path;
+    }();
+    return path;
+}
+
+// Synthetic metadata for indexing benchmarks, every chunk hash distinct
+FileMetadata index_benchmark_metadata(size_t file_number, size_t chunk_count) {
+    FileMetadata metadata("file_" + std::to_string(file_number), "benchmark.bin",
+                          chunk_count * ChunkManager::DEFAULT_CHUNK_SIZE);
+    metadata.chunk_size = ChunkManager::DEFAULT_CHUNK_SIZE;
+    metadata.chunk_count = static_cast<uint32_t>(chunk_count);
+    metadata.chunk_hashes.resize(chunk_count);
+    for (size_t i = 0; i < chunk_count; ++i) {
+        auto& hash = metadata.chunk_hashes[i];
+        std::memcpy(hash.data(), &file_number, sizeof(file_number));
+        std::memcpy(hash.data() + sizeof(file_number), &i, sizeof(i));
+    }
+    return metadata;
+}
+
+std::filesystem::path index_benchmark_db() {
+    auto db_path = std::filesystem::temp_directory_path() / "hypershare_index_benchmark.db";
+    std::filesystem::remove(db_path);
+    return db_path;
+}
+
+} // namespace
+
+// Pipelined hashing throughput (bytes/s) against worker thread count
+static void BM_ParallelFileHashing(benchmark::State& state) {
+    const auto& path = benchmark_file();
+    ParallelHasher hasher(ChunkManager::DEFAULT_CHUNK_SIZE, static_cast<size_t>(state.range(0)));
+
+    for (auto _ : state) {
+        ParallelHasher::Result result;
+        if (!hasher.hash_file(path, result)) {
+            state.SkipWithError("Failed to hash benchmark file");
+            break;
+        }
+        benchmark::DoNotOptimize(result.root);
+    }
+
+    state.SetBytesProcessed(state.iterations() * BENCHMARK_FILE_SIZE);
+    state.counters["threads"] = static_cast<double>(state.range(0));
+}
+BENCHMARK(BM_ParallelFileHashing)
+    ->RangeMultiplier(2)->Range(1, 32)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+// End-to-end share path: chunk_file with the default (parallel) StorageConfig
+static void BM_ChunkFile(benchmark::State& state) {
+    const auto& path = benchmark_file();
+    StorageConfig config;
+    config.hash_threads = static_cast<uint32_t>(state.range(0));
+    ChunkManager chunk_manager(config);
+
+    for (auto _ : state) {
+        FileMetadata metadata;
+        if (!chunk_manager.chunk_file(path.string(), metadata)) {
+            state.SkipWithError("Failed to chunk benchmark file");
+            break;
+        }
+        benchmark::DoNotOptimize(metadata.file_hash);
+    }
+
+    state.SetBytesProcessed(state.iterations() * BENCHMARK_FILE_SIZE);
+}
+BENCHMARK(BM_ChunkFile)
+    ->Arg(1)->Arg(0)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+// Indexing throughput for files of a given chunk count, one add_file each
+static void BM_FileIndexAddFile(benchmark::State& state) {
+    const size_t chunk_count = static_cast<size_t>(state.range(0));
+    auto db_path = index_benchmark_db();
+    FileIndex file_index(db_path);
+    if (!file_index.initialize()) {
+        state.SkipWithError("Failed to open benchmark index");
+        return;
+    }
+
+    size_t files = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto metadata = index_benchmark_metadata(files++, chunk_count);
+        state.ResumeTiming();
+
+        if (!file_index.add_file(metadata)) {
+            state.SkipWithError("Failed to index file");
+            break;
+        }
+    }
+
+    state.counters["files_per_second"] = benchmark::Counter(static_cast<double>(files),
+                                                            benchmark::Counter::kIsRate);
+    state.counters["chunks_per_second"] = benchmark::Counter(static_cast<double>(files * chunk_count),
+                                                             benchmark::Counter::kIsRate);
+    std::filesystem::remove(db_path);
+}
+BENCHMARK(BM_FileIndexAddFile)
+    ->Arg(16)->Arg(1024)->Arg(100000)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+// Many small files in one add_files transaction, as when a share is first scanned
+static void BM_FileIndexAddFiles(benchmark::State& state) {
+    const size_t batch_size = static_cast<size_t>(state.range(0));
+    constexpr size_t CHUNKS_PER_FILE = 16;
+    auto db_path = index_benchmark_db();
+    FileIndex file_index(db_path);
+    if (!file_index.initialize()) {
+        state.SkipWithError("Failed to open benchmark index");
+        return;
+    }
+
+    size_t files = 0;
+    std::vector<FileMetadata> batch;
+    for (auto _ : state) {
+        state.PauseTiming();
+        batch.clear();
+        for (size_t i = 0; i < batch_size; ++i) {
+            batch.push_back(index_benchmark_metadata(files++, CHUNKS_PER_FILE));
+        }
+        state.ResumeTiming();
+
+        if (!file_index.add_files(batch)) {
+            state.SkipWithError("Failed to index batch");
+            break;
+        }
+    }
+
+    state.counters["files_per_second"] = benchmark::Counter(static_cast<double>(files),
+                                                            benchmark::Counter::kIsRate);
+    state.counters["chunks_per_second"] = benchmark::Counter(static_cast<double>(files * CHUNKS_PER_FILE),
+                                                             benchmark::Counter::kIsRate);
+    std::filesystem::remove(db_path);
+}
+BENCHMARK(BM_FileIndexAddFiles)
+    ->Arg(1)->Arg(100)->Arg(1000)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+// Walking the whole catalog as an announce pass does: decoding every row with
+// list_files (0) against reading names and sizes in place with for_each_file (1)
+static void BM_FileIndexListing(benchmark::State& state) {
+    const bool in_place = state.range(0) != 0;
+    constexpr size_t FILE_COUNT = 1000;
+    constexpr size_t CHUNKS_PER_FILE = 256;
+    auto db_path = index_benchmark_db();
+    FileIndex file_index(db_path);
+    if (!file_index.initialize()) {
+        state.SkipWithError("Failed to open benchmark index");
+        return;
+    }
+
+    std::vector<FileMetadata> batch;
+    for (size_t i = 0; i < FILE_COUNT; ++i) {
+        batch.push_back(index_benchmark_metadata(i, CHUNKS_PER_FILE));
+    }
+    if (!file_index.add_files(batch)) {
+        state.SkipWithError("Failed to index catalog");
+        return;
+    }
+
+    for (auto _ : state) {
+        uint64_t total_size = 0;
+        if (in_place) {
+            file_index.for_each_file([&](const FileMetadataView& file) {
+                benchmark::DoNotOptimize(file.filename().data());
+                total_size += file.file_size();
+            });
+        } else {
+            for (const auto& file : file_index.list_files()) {
+                benchmark::DoNotOptimize(file.filename.data());
+                total_size += file.file_size;
+            }
+        }
+        benchmark::DoNotOptimize(total_size);
+    }
+
+    state.counters["files_per_second"] = benchmark::Counter(
+        static_cast<double>(state.iterations() * FILE_COUNT), benchmark::Counter::kIsRate);
+    std::filesystem::remove(db_path);
+}
+BENCHMARK(BM_FileIndexListing)
+    ->ArgName("in_place")->Arg(0)->Arg(1)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
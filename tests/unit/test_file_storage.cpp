@@ -2,13 +2,32 @@
 #include "hypershare/storage/file_metadata.hpp"
 #include "hypershare/storage/chunk_manager.hpp"
 #include "hypershare/storage/file_index.hpp"
+#include "hypershare/storage/metadata_cache.hpp"
 #include "hypershare/storage/storage_config.hpp"
+#include "hypershare/storage/hash_tree.hpp"
+#include "hypershare/storage/parallel_hasher.hpp"
+#include "hypershare/storage/chunk_store.hpp"
+#include "hypershare/storage/compression.hpp"
+#include "hypershare/storage/chunk_bitmap.hpp"
+#include "hypershare/storage/resume_manager.hpp"
+#include "hypershare/storage/share_watcher.hpp"
+#include "hypershare/storage/hash_cache.hpp"
+#include "hypershare/storage/storage_accountant.hpp"
+#include "hypershare/storage/write_back_buffer.hpp"
+#include "hypershare/storage/direct_io.hpp"
+#include "hypershare/storage/integrity_scrubber.hpp"
 #include "hypershare/crypto/hash.hpp"
+#include "hypershare/crypto/file_verification.hpp"
+#include <boost/asio.hpp>
+#include <sqlite3.h>
 #include <filesystem>
 #include <fstream>
 #include <random>
 #include <thread>
 #include <atomic>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace hypershare::storage;
 using namespace hypershare::crypto;
@@ -54,6 +73,42 @@ protected:
         test_files_[filename] = file_path;
     }
     
+    // Sequential layout written before the flat one, chunk hashes as hex
+    static std::vector<uint8_t> stream_layout_blob(const FileMetadata& metadata) {
+        std::vector<uint8_t> blob;
+        auto put = [&](const void* data, size_t size) {
+            auto bytes = static_cast<const uint8_t*>(data);
+            blob.insert(blob.end(), bytes, bytes + size);
+        };
+        auto put_string = [&](const std::string& str) {
+            uint32_t size = static_cast<uint32_t>(str.size());
+            put(&size, sizeof(size));
+            put(str.data(), str.size());
+        };
+        
+        put_string(metadata.file_id);
+        put_string(metadata.file_hash);
+        put_string(metadata.filename);
+        put_string(metadata.file_path);
+        put(&metadata.file_size, sizeof(metadata.file_size));
+        int64_t created = metadata.created_at.time_since_epoch().count();
+        int64_t modified = metadata.modified_at.time_since_epoch().count();
+        put(&created, sizeof(created));
+        put(&modified, sizeof(modified));
+        
+        uint32_t hash_count = static_cast<uint32_t>(metadata.chunk_hashes.size());
+        put(&hash_count, sizeof(hash_count));
+        for (const auto& hash : metadata.chunk_hashes) {
+            put_string(hash_utils::hash_to_hex(hash));
+        }
+        
+        put(&metadata.chunk_size, sizeof(metadata.chunk_size));
+        put(&metadata.chunk_count, sizeof(metadata.chunk_count));
+        put_string(metadata.file_type);
+        put_string(metadata.description);
+        return blob;
+    }
+    
     std::filesystem::path test_dir_;
     StorageConfig config_;
     std::map<std::string, std::filesystem::path> test_files_;
@@ -119,6 +174,314 @@ TEST_F(FileStorageTest, ChunkManager_FileChunking) {
     }
 }
 
+TEST_F(FileStorageTest, ChunkManager_StreamingHashesMatchFileContents) {
+    ChunkManager chunk_manager(config_);
+    
+    // Trailing partial chunk
+    create_test_file("uneven_file.bin", 65536 * 2 + 123);
+    auto file_path = test_files_["uneven_file.bin"];
+    
+    FileMetadata metadata;
+    ASSERT_TRUE(chunk_manager.chunk_file(file_path.string(), metadata).success());
+    ASSERT_EQ(metadata.chunk_count, 3);
+    EXPECT_EQ(metadata.file_size, 65536 * 2 + 123);
+    
+    std::ifstream file(file_path, std::ios::binary);
+    std::vector<uint8_t> contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    for (size_t i = 0; i < metadata.chunk_count; ++i) {
+        size_t offset = i * metadata.chunk_size;
+        size_t length = std::min<size_t>(metadata.chunk_size, contents.size() - offset);
+        auto expected = Blake3Hasher::hash(std::span<const uint8_t>(contents.data() + offset, length));
+        EXPECT_EQ(metadata.chunk_hashes[i], expected);
+    }
+    
+    EXPECT_EQ(metadata.file_hash_scheme, FileHashScheme::CHUNK_TREE);
+    EXPECT_EQ(metadata.file_hash, hypershare::crypto::hash_utils::hash_to_hex(hash_tree::root(metadata.chunk_hashes, metadata.file_size)));
+    EXPECT_EQ(chunk_manager.get_chunk_hashes(file_path), metadata.chunk_hashes);
+}
+
+TEST_F(FileStorageTest, ParallelHasher_ResultIndependentOfThreadCount) {
+    auto file_path = test_files_["large_file.txt"];
+    
+    // Small blocks so every worker gets several blocks to hash
+    ParallelHasher single(4096, 1, 16384);
+    ParallelHasher parallel(4096, 4, 16384);
+    
+    ParallelHasher::Result expected, actual;
+    ASSERT_TRUE(single.hash_file(file_path, expected).success());
+    ASSERT_TRUE(parallel.hash_file(file_path, actual).success());
+    
+    EXPECT_EQ(expected.chunk_hashes.size(), 256);
+    EXPECT_EQ(actual.chunk_hashes, expected.chunk_hashes);
+    EXPECT_EQ(actual.root, expected.root);
+    EXPECT_EQ(actual.bytes_hashed, 1024 * 1024);
+    
+    std::ifstream file(file_path, std::ios::binary);
+    std::vector<uint8_t> first_chunk(4096);
+    file.read(reinterpret_cast<char*>(first_chunk.data()), first_chunk.size());
+    EXPECT_EQ(actual.chunk_hashes[0], Blake3Hasher::hash(first_chunk));
+}
+
+TEST_F(FileStorageTest, HashTree_RootCombination) {
+    auto a = Blake3Hasher::hash(std::vector<uint8_t>{1});
+    auto b = Blake3Hasher::hash(std::vector<uint8_t>{2});
+    auto c = Blake3Hasher::hash(std::vector<uint8_t>{3});
+    
+    auto la = hash_tree::leaf(a);
+    auto lb = hash_tree::leaf(b);
+    auto lc = hash_tree::leaf(c);
+    EXPECT_NE(la, a);
+    
+    // Odd node is promoted to the next level, so the trees below only differ
+    // in how the roots are bound to the file's size and chunk count
+    hash_tree::Tree one(std::vector<Blake3Hash>{a}, 10);
+    hash_tree::Tree three(std::vector<Blake3Hash>{a, b, c}, 30);
+    EXPECT_EQ(three.root(), hash_tree::root(std::vector<Blake3Hash>{a, b, c}, 30));
+    EXPECT_EQ(three.proof(0), (std::vector<Blake3Hash>{lb, lc}));
+    EXPECT_EQ(three.proof(2), std::vector<Blake3Hash>{hash_tree::combine(la, lb)});
+    EXPECT_EQ(one.proof(0), std::vector<Blake3Hash>{});
+    EXPECT_NE(one.root(), la);
+    EXPECT_NE(hash_tree::combine(la, lb), hash_tree::combine(lb, la));
+    
+    // The same chunks under another size or chunk count give another root
+    EXPECT_NE(hash_tree::root(std::vector<Blake3Hash>{a, b, c}, 30),
+              hash_tree::root(std::vector<Blake3Hash>{a, b, c}, 31));
+    EXPECT_NE(hash_tree::root(std::vector<Blake3Hash>{a, b}, 20),
+              hash_tree::root(std::vector<Blake3Hash>{a}, 20));
+}
+
+TEST_F(FileStorageTest, HashTree_RejectsInnerNodeAsChunk) {
+    // A two-chunk file announced by its root
+    std::vector<uint8_t> first(64, 0xAA), second(64, 0xBB);
+    std::vector<Blake3Hash> chunk_hashes{Blake3Hasher::hash(first), Blake3Hasher::hash(second)};
+    hash_tree::Tree tree(chunk_hashes, 128);
+    
+    // A forged one-chunk manifest under the same root whose only chunk is the
+    // encoding of the root's parent node: 0x01 || left || right
+    std::vector<uint8_t> forged{0x01};
+    for (const auto& chunk_hash : chunk_hashes) {
+        auto node = hash_tree::leaf(chunk_hash);
+        forged.insert(forged.end(), node.begin(), node.end());
+    }
+    EXPECT_FALSE(hash_tree::verify(Blake3Hasher::hash(forged), 0, 1, forged.size(), {}, tree.root()));
+    
+    // Nor can the parent node itself pass as a single chunk hash
+    auto parent = hash_tree::combine(hash_tree::leaf(chunk_hashes[0]), hash_tree::leaf(chunk_hashes[1]));
+    EXPECT_FALSE(hash_tree::verify(parent, 0, 1, 128, {}, tree.root()));
+    
+    // The real chunks only verify under the real size
+    EXPECT_TRUE(hash_tree::verify(chunk_hashes[0], 0, 2, 128, tree.proof(0), tree.root()));
+    EXPECT_FALSE(hash_tree::verify(chunk_hashes[0], 0, 2, 127, tree.proof(0), tree.root()));
+}
+
+TEST_F(FileStorageTest, HashTree_ProofsVerifyEveryLeaf) {
+    for (size_t leaf_count = 1; leaf_count <= 9; ++leaf_count) {
+        std::vector<Blake3Hash> leaves;
+        for (size_t i = 0; i < leaf_count; ++i) {
+            std::vector<uint8_t> data(16, static_cast<uint8_t>(i));
+            leaves.push_back(Blake3Hasher::hash(data));
+        }
+        
+        hash_tree::Tree tree(leaves, leaf_count * 16);
+        ASSERT_EQ(tree.root(), hash_tree::root(leaves, leaf_count * 16));
+        
+        for (size_t i = 0; i < leaf_count; ++i) {
+            auto proof = tree.proof(i);
+            EXPECT_TRUE(hash_tree::verify(leaves[i], i, leaf_count, leaf_count * 16, proof, tree.root()))
+                << leaf_count << " leaves, leaf " << i;
+            
+            // Wrong leaf or wrong position must not verify
+            Blake3Hash tampered = leaves[i];
+            tampered[0] ^= 0xFF;
+            EXPECT_FALSE(hash_tree::verify(tampered, i, leaf_count, leaf_count * 16, proof, tree.root()));
+            if (leaf_count > 1) {
+                EXPECT_FALSE(hash_tree::verify(leaves[i], (i + 1) % leaf_count, leaf_count, leaf_count * 16,
+                                               proof, tree.root()));
+            }
+        }
+        EXPECT_TRUE(tree.proof(leaf_count).empty());
+    }
+}
+
+TEST_F(FileStorageTest, FileMetadata_ManifestOmitsChunkHashes) {
+    ChunkManager chunk_manager(config_);
+    
+    FileMetadata metadata;
+    ASSERT_TRUE(chunk_manager.chunk_file(test_files_["medium_file.txt"].string(), metadata).success());
+    ASSERT_EQ(metadata.file_hash_scheme, FileHashScheme::CHUNK_TREE);
+    
+    auto manifest = FileMetadata::deserialize(metadata.serialize_manifest());
+    EXPECT_TRUE(manifest.chunk_hashes.empty());
+    EXPECT_EQ(manifest.chunk_count, metadata.chunk_count);
+    EXPECT_EQ(manifest.file_hash, metadata.file_hash);
+    EXPECT_LT(metadata.serialize_manifest().size(), metadata.serialize().size());
+    
+    // Proofs from the sender's tree verify against the announced root alone
+    auto root = hash_utils::hash_from_hex(manifest.file_hash);
+    ASSERT_TRUE(root.has_value());
+    for (size_t i = 0; i < metadata.chunk_count; ++i) {
+        EXPECT_TRUE(hash_tree::verify(metadata.chunk_hashes[i], i, manifest.total_chunks(), manifest.file_size,
+                                      chunk_manager.get_chunk_proof(metadata, i), *root));
+    }
+    
+    // Sequentially hashed files still need the full list
+    metadata.file_hash_scheme = FileHashScheme::SEQUENTIAL;
+    EXPECT_EQ(FileMetadata::deserialize(metadata.serialize_manifest()).chunk_hashes, metadata.chunk_hashes);
+}
+
+TEST_F(FileStorageTest, FileMetadata_ChunkHashSerialization) {
+    FileMetadata metadata("hash", "file.bin", 3 * 1024);
+    metadata.chunk_size = 1024;
+    metadata.chunk_count = 3;
+    for (uint8_t i = 0; i < 3; ++i) {
+        std::vector<uint8_t> chunk(1024, i);
+        metadata.add_chunk_hash(Blake3Hasher::hash(chunk));
+    }
+    
+    auto deserialized = FileMetadata::deserialize(metadata.serialize());
+    EXPECT_EQ(deserialized.chunk_hashes, metadata.chunk_hashes);
+    EXPECT_EQ(deserialized.chunk_hash_hex(2), hash_utils::hash_to_hex(metadata.chunk_hashes[2]));
+    EXPECT_TRUE(deserialized.chunk_hash_hex(3).empty());
+    
+    // Blobs from before raw hashes list each hash as a length-prefixed hex string
+    auto legacy = stream_layout_blob(metadata);
+    
+    deserialized = FileMetadata::deserialize(legacy);
+    EXPECT_EQ(deserialized.chunk_hashes, metadata.chunk_hashes);
+    EXPECT_EQ(deserialized.chunk_count, 3u);
+}
+
+TEST_F(FileStorageTest, FileMetadata_ViewReadsBlobInPlace) {
+    FileMetadata metadata("view_hash", "video.mkv", 300000);
+    metadata.file_id = "view_id";
+    metadata.file_path = "/share/video.mkv";
+    metadata.file_type = "mkv";
+    metadata.description = "holiday footage";
+    metadata.tags = {"video", "2024"};
+    metadata.chunking_mode = ChunkingMode::CONTENT_DEFINED;
+    metadata.cdc_min_size = 2048;
+    metadata.cdc_avg_size = 8192;
+    metadata.chunk_size = 65536;
+    metadata.chunk_offsets = {0, 70000, 150000};
+    metadata.chunk_count = 3;
+    for (uint8_t i = 0; i < 3; ++i) {
+        metadata.add_chunk_hash(Blake3Hasher::hash(std::vector<uint8_t>(64, i)));
+    }
+    
+    auto blob = metadata.serialize();
+    auto view = FileMetadataView::parse(blob);
+    ASSERT_TRUE(view.has_value());
+    
+    // Fields point into the blob itself
+    EXPECT_EQ(view->filename(), "video.mkv");
+    EXPECT_GE(view->filename().data(), reinterpret_cast<const char*>(blob.data()));
+    EXPECT_LT(view->filename().data(), reinterpret_cast<const char*>(blob.data() + blob.size()));
+    EXPECT_EQ(view->file_id(), "view_id");
+    EXPECT_EQ(view->description(), "holiday footage");
+    EXPECT_EQ(view->file_size(), 300000u);
+    EXPECT_EQ(view->created_at(), metadata.created_at);
+    EXPECT_EQ(view->chunking_mode(), ChunkingMode::CONTENT_DEFINED);
+    ASSERT_EQ(view->tag_count(), 2u);
+    EXPECT_EQ(view->tag(1), "2024");
+    EXPECT_TRUE(view->tag(2).empty());
+    ASSERT_EQ(view->chunk_hash_count(), 3u);
+    EXPECT_EQ(view->chunk_hash(2), metadata.chunk_hashes[2]);
+    ASSERT_EQ(view->chunk_offset_count(), 3u);
+    EXPECT_EQ(view->chunk_offset(1), 70000u);
+    
+    auto copy = view->to_metadata();
+    EXPECT_EQ(copy, metadata);
+    EXPECT_EQ(copy.tags, metadata.tags);
+    EXPECT_EQ(FileMetadata::deserialize(blob).tags, metadata.tags);
+    
+    // Truncated or foreign blobs never produce a view
+    blob.pop_back();
+    EXPECT_FALSE(FileMetadataView::parse(blob).has_value());
+    EXPECT_THROW(FileMetadata::deserialize(blob), std::runtime_error);
+    EXPECT_FALSE(FileMetadataView::parse(stream_layout_blob(metadata)).has_value());
+}
+
+TEST_F(FileStorageTest, FileMetadata_HashSchemeSerialization) {
+    FileMetadata metadata("hash", "file.bin", 1024);
+    metadata.file_hash_scheme = FileHashScheme::CHUNK_TREE;
+    
+    auto serialized = metadata.serialize();
+    EXPECT_EQ(FileMetadata::deserialize(serialized).file_hash_scheme, FileHashScheme::CHUNK_TREE);
+    
+    // Blobs written before the scheme existed read back as sequential
+    EXPECT_EQ(FileMetadata::deserialize(stream_layout_blob(metadata)).file_hash_scheme, FileHashScheme::SEQUENTIAL);
+}
+
+TEST_F(FileStorageTest, ContentChunker_InsertionOnlyChangesNearbyChunks) {
+    ContentChunker chunker(2048, 8192, 32768);
+    
+    std::mt19937 rng(7);
+    std::vector<uint8_t> original(1024 * 1024);
+    std::generate(original.begin(), original.end(), [&] { return static_cast<uint8_t>(rng()); });
+    
+    auto split = [&](const std::vector<uint8_t>& data) {
+        std::vector<Blake3Hash> hashes;
+        std::span<const uint8_t> remaining(data);
+        while (!remaining.empty()) {
+            size_t length = chunker.next_boundary(remaining);
+            EXPECT_LE(length, chunker.max_size());
+            if (length < remaining.size()) {
+                EXPECT_GE(length, chunker.min_size());
+            }
+            hashes.push_back(Blake3Hasher::hash(remaining.first(length)));
+            remaining = remaining.subspan(length);
+        }
+        return hashes;
+    };
+    
+    auto before = split(original);
+    
+    auto modified = original;
+    modified.insert(modified.begin() + 100000, 0x42);
+    auto after = split(modified);
+    
+    size_t reused = std::count_if(after.begin(), after.end(), [&](const Blake3Hash& hash) {
+        return std::find(before.begin(), before.end(), hash) != before.end();
+    });
+    EXPECT_GE(reused + 3, after.size());
+}
+
+TEST_F(FileStorageTest, ChunkManager_ContentDefinedChunking) {
+    config_.chunking_mode = ChunkingMode::CONTENT_DEFINED;
+    config_.cdc_min_chunk_size = 4096;
+    config_.cdc_avg_chunk_size = 16384;
+    config_.cdc_max_chunk_size = 65536;
+    ChunkManager chunk_manager(config_);
+    
+    auto file_path = test_files_["large_file.txt"];
+    FileMetadata metadata;
+    ASSERT_TRUE(chunk_manager.chunk_file(file_path.string(), metadata).success());
+    
+    EXPECT_TRUE(metadata.is_content_defined());
+    EXPECT_EQ(metadata.chunk_size, 65536);
+    ASSERT_EQ(metadata.chunk_offsets.size(), metadata.chunk_count);
+    ASSERT_GT(metadata.chunk_count, 1);
+    EXPECT_EQ(metadata.total_chunks(), metadata.chunk_count);
+    
+    uint64_t total = 0;
+    for (size_t i = 0; i < metadata.chunk_count; ++i) {
+        EXPECT_EQ(metadata.get_chunk_offset(i), total);
+        total += metadata.get_chunk_size(i);
+        
+        std::vector<uint8_t> chunk;
+        ASSERT_TRUE(chunk_manager.read_chunk(metadata, i, chunk).success());
+        EXPECT_TRUE(chunk_manager.verify_chunk_hash(chunk, metadata.chunk_hashes[i]));
+    }
+    EXPECT_EQ(total, metadata.file_size);
+    
+    auto restored = FileMetadata::deserialize(metadata.serialize());
+    EXPECT_EQ(restored, metadata);
+    EXPECT_EQ(restored.cdc_min_size, 4096);
+    EXPECT_EQ(restored.cdc_avg_size, 16384);
+    
+    EXPECT_TRUE(FileVerifier().verify_file_metadata(file_path, metadata));
+}
+
 TEST_F(FileStorageTest, ChunkManager_ReadWriteChunks) {
     ChunkManager chunk_manager(config_);
     
@@ -145,6 +508,33 @@ TEST_F(FileStorageTest, ChunkManager_ReadWriteChunks) {
     }
 }
 
+TEST_F(FileStorageTest, ChunkManager_MergeChunkFiles) {
+    ChunkManager chunk_manager(config_);
+    auto chunk_dir = test_dir_ / "chunks";
+    std::string file_hash = "ab" + std::string(62, '0');
+    
+    // Whole chunks followed by a short tail
+    std::vector<uint8_t> expected;
+    for (size_t i = 0; i < 6; ++i) {
+        std::vector<uint8_t> chunk(i < 5 ? 65536 : 1000);
+        for (size_t j = 0; j < chunk.size(); ++j) {
+            chunk[j] = static_cast<uint8_t>(i * 37 + j * 7);
+        }
+        ASSERT_TRUE(chunk_manager.write_chunk(chunk_dir, file_hash, i, chunk));
+        expected.insert(expected.end(), chunk.begin(), chunk.end());
+    }
+    
+    auto output_path = test_dir_ / "merged.bin";
+    ASSERT_TRUE(chunk_manager.merge_chunks(chunk_dir, file_hash, output_path, 6));
+    
+    std::ifstream merged(output_path, std::ios::binary);
+    std::vector<uint8_t> actual((std::istreambuf_iterator<char>(merged)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(actual, expected);
+    
+    // A missing chunk fails the merge
+    EXPECT_FALSE(chunk_manager.merge_chunks(chunk_dir, file_hash, test_dir_ / "short.bin", 7));
+}
+
 TEST_F(FileStorageTest, ChunkManager_IncompleteFileHandling) {
     ChunkManager chunk_manager(config_);
     
@@ -177,6 +567,152 @@ TEST_F(FileStorageTest, ChunkManager_IncompleteFileHandling) {
     EXPECT_EQ(read_chunk, test_chunk);
 }
 
+TEST_F(FileStorageTest, ChunkManager_PreallocatedDownload) {
+    ChunkManager chunk_manager(config_);
+    
+    auto source_path = test_files_["medium_file.txt"];
+    FileMetadata source;
+    ASSERT_TRUE(chunk_manager.chunk_file(source_path.string(), source).success());
+    
+    // Receive chunks out of order into the preallocated target
+    FileMetadata download = source;
+    download.file_path.clear();
+    ASSERT_TRUE(chunk_manager.prepare_download(download).success());
+    
+    auto partial_path = config_.get_partial_path(download.file_hash);
+    ASSERT_TRUE(std::filesystem::exists(partial_path));
+    EXPECT_EQ(std::filesystem::file_size(partial_path), download.file_size);
+    
+    for (size_t i : {2, 0, 1}) {
+        // Chunks not yet received are not served from the zeroed target
+        std::vector<uint8_t> pending;
+        EXPECT_EQ(chunk_manager.read_chunk(download, i, pending).error, CryptoError::FILE_NOT_FOUND);
+        
+        std::vector<uint8_t> chunk;
+        ASSERT_TRUE(chunk_manager.read_chunk(source, i, chunk).success());
+        
+        // A chunk of the wrong size never reaches the target
+        std::vector<uint8_t> oversized(chunk);
+        oversized.push_back(0);
+        EXPECT_EQ(chunk_manager.write_chunk(download, i, oversized).error, CryptoError::INVALID_STATE);
+        
+        ASSERT_TRUE(chunk_manager.write_chunk(download, i, chunk).success());
+        
+        std::vector<uint8_t> written;
+        ASSERT_TRUE(chunk_manager.read_chunk(download, i, written).success());
+        EXPECT_EQ(written, chunk);
+    }
+    
+    // No per-chunk files are created
+    EXPECT_FALSE(std::filesystem::exists(
+        chunk_manager.get_chunk_path(config_.incomplete_directory, download.file_hash, 0)));
+    
+    auto output_path = config_.get_file_path(download.file_hash);
+    ASSERT_TRUE(chunk_manager.finalize_download(download, output_path).success());
+    EXPECT_FALSE(std::filesystem::exists(partial_path));
+    
+    EXPECT_TRUE(FileVerifier().verify_file_metadata(output_path, source));
+}
+
+TEST_F(FileStorageTest, ChunkManager_MappedChunkView) {
+    ChunkManager chunk_manager(config_);
+    auto cache = std::make_shared<MappedFileCache>();
+    chunk_manager.set_mapped_file_cache(cache);
+    chunk_manager.set_immutable_roots({test_dir_});
+    
+    auto file_path = test_files_["medium_file.txt"];
+    FileMetadata metadata;
+    ASSERT_TRUE(chunk_manager.chunk_file(file_path.string(), metadata).success());
+    
+    std::optional<ChunkView> held_view;
+    for (size_t i = 0; i < metadata.chunk_count; ++i) {
+        auto view = chunk_manager.read_chunk_view(metadata, i);
+        ASSERT_TRUE(view.has_value());
+        EXPECT_EQ(view->size(), metadata.get_chunk_size(i));
+        
+        std::vector<uint8_t> copied;
+        ASSERT_TRUE(chunk_manager.read_chunk(metadata, i, copied).success());
+        EXPECT_TRUE(std::equal(copied.begin(), copied.end(), view->data.begin()));
+        
+        held_view = view;
+    }
+    EXPECT_EQ(cache->size(), 1u);
+    
+    // A view keeps its mapping alive after the cache drops it
+    chunk_manager.set_mapped_file_cache(std::make_shared<MappedFileCache>());
+    EXPECT_TRUE(chunk_manager.verify_chunk_hash(
+        std::vector<uint8_t>(held_view->data.begin(), held_view->data.end()),
+        metadata.chunk_hashes.back()));
+    
+    EXPECT_FALSE(chunk_manager.read_chunk_view(metadata, metadata.chunk_count).has_value());
+}
+
+TEST_F(FileStorageTest, ChunkManager_ViewOutlivesTruncation) {
+    auto shared_dir = test_dir_ / "shared";
+    std::filesystem::create_directories(shared_dir);
+    auto file_path = shared_dir / "medium_file.txt";
+    std::filesystem::copy_file(test_files_["medium_file.txt"], file_path);
+    
+    // Only files below an immutable root are mapped
+    ChunkManager chunk_manager(config_);
+    auto cache = std::make_shared<MappedFileCache>();
+    chunk_manager.set_mapped_file_cache(cache);
+    chunk_manager.set_immutable_roots({test_dir_ / "immutable"});
+    
+    FileMetadata metadata;
+    ASSERT_TRUE(chunk_manager.chunk_file(file_path.string(), metadata).success());
+    
+    // Truncated by its owner while the view is queued for sending; a mapped
+    // view would raise SIGBUS when read
+    auto view = chunk_manager.read_chunk_view(metadata, 1);
+    ASSERT_TRUE(view.has_value());
+    EXPECT_EQ(cache->size(), 0u);
+    std::filesystem::resize_file(file_path, 0);
+    
+    EXPECT_TRUE(chunk_manager.verify_chunk_hash(
+        std::vector<uint8_t>(view->data.begin(), view->data.end()), metadata.chunk_hashes[1]));
+    EXPECT_FALSE(chunk_manager.read_chunk_view(metadata, 1).has_value());
+}
+
+TEST_F(FileStorageTest, ChunkManager_AsyncDiskEngine) {
+    boost::asio::io_context io_context;
+    ChunkManager chunk_manager(config_);
+    chunk_manager.set_disk_engine(make_disk_engine(io_context, config_.use_io_uring, 2));
+    
+    auto source_path = test_files_["medium_file.txt"];
+    FileMetadata source;
+    ASSERT_TRUE(chunk_manager.chunk_file(source_path.string(), source).success());
+    
+    FileMetadata download = source;
+    download.file_path.clear();
+    ASSERT_TRUE(chunk_manager.prepare_download(download).success());
+    
+    // Read every chunk from the shared file and write it back out of order
+    size_t written = 0;
+    for (size_t i : {1, 2, 0}) {
+        chunk_manager.async_read_chunk(source, i,
+            [&, i](CryptoResult result, std::vector<uint8_t> chunk) {
+                ASSERT_TRUE(result.success());
+                EXPECT_TRUE(chunk_manager.verify_chunk_hash(chunk, source.chunk_hashes[i]));
+                size_t written_before = written;
+                chunk_manager.async_write_chunk(download, i, std::move(chunk),
+                    [&](CryptoResult write_result) {
+                        EXPECT_TRUE(write_result.success());
+                        ++written;
+                    });
+                // Buffered with the default write-back, yet not on this thread
+                EXPECT_EQ(written, written_before);
+            });
+    }
+    io_context.run();
+    ASSERT_EQ(written, source.chunk_count);
+    
+    auto output_path = config_.get_file_path(download.file_hash);
+    ASSERT_TRUE(chunk_manager.finalize_download(download, output_path).success());
+    
+    EXPECT_TRUE(FileVerifier().verify_file_metadata(output_path, source));
+}
+
 TEST_F(FileStorageTest, ChunkManager_HashVerification) {
     ChunkManager chunk_manager(config_);
     
@@ -197,6 +733,117 @@ TEST_F(FileStorageTest, ChunkManager_HashVerification) {
 }
 
 // Test FileIndex functionality
+TEST_F(FileStorageTest, ChunkBitmap_SetOperations) {
+    ChunkBitmap bitmap;
+    EXPECT_TRUE(bitmap.insert(3));
+    EXPECT_FALSE(bitmap.insert(3));
+    EXPECT_TRUE(bitmap.insert(70000));
+    EXPECT_TRUE(bitmap.contains(3));
+    EXPECT_FALSE(bitmap.contains(4));
+    EXPECT_EQ(bitmap.cardinality(), 2u);
+    
+    // Dense containers switch to a bitmap and back
+    for (uint64_t i = 0; i < 10000; ++i) {
+        bitmap.insert(i);
+    }
+    EXPECT_EQ(bitmap.cardinality(), 10001u);
+    EXPECT_EQ(bitmap.next_missing(0), 10000u);
+    EXPECT_EQ(bitmap.next_missing(70000), 70001u);
+    for (uint64_t i = 100; i < 10000; ++i) {
+        bitmap.erase(i);
+    }
+    EXPECT_EQ(bitmap.next_missing(0), 100u);
+    EXPECT_EQ(bitmap.missing(103), std::vector<uint64_t>({100, 101, 102}));
+    
+    std::vector<uint64_t> visited;
+    bitmap.for_each([&](uint64_t index) { visited.push_back(index); });
+    ASSERT_EQ(visited.size(), 101u);
+    EXPECT_EQ(visited.back(), 70000u);
+    
+    auto restored = ChunkBitmap::deserialize(bitmap.serialize());
+    ASSERT_TRUE(restored.has_value());
+    EXPECT_EQ(*restored, bitmap);
+    
+    // A contiguous multi-million chunk prefix stores as one run per container
+    ChunkBitmap large;
+    for (uint64_t i = 0; i < 4000000; ++i) {
+        large.insert(i);
+    }
+    large.insert(5000000);
+    auto blob = large.serialize();
+    EXPECT_LT(blob.size(), 2048u);
+    restored = ChunkBitmap::deserialize(blob);
+    ASSERT_TRUE(restored.has_value());
+    EXPECT_EQ(*restored, large);
+    EXPECT_EQ(restored->next_missing(0), 4000000u);
+    
+    blob.pop_back();
+    EXPECT_FALSE(ChunkBitmap::deserialize(blob).has_value());
+    
+    // A range mostly overlapping what is already set stays an array, so it
+    // equals the same set built one insert at a time
+    ChunkBitmap ranged;
+    ChunkBitmap single;
+    ranged.insert_range(0, 3000);
+    ranged.insert_range(0, 3500);
+    for (uint64_t i = 0; i < 3500; ++i) {
+        single.insert(i);
+    }
+    EXPECT_EQ(ranged.cardinality(), 3500u);
+    EXPECT_EQ(ranged, single);
+    EXPECT_EQ(ranged.serialize(), single.serialize());
+}
+
+TEST_F(FileStorageTest, ResumeManager_PersistsProgress) {
+    auto db_path = test_dir_ / "resume.db";
+    {
+        ResumeManager resume_manager(db_path, std::chrono::hours(1));
+        ASSERT_TRUE(resume_manager.initialize());
+        
+        ResumeInfo info;
+        info.file_id = "resume_file";
+        info.session_id = "resume_session";
+        info.last_activity = std::chrono::system_clock::now();
+        info.stats.total_bytes = 1000;
+        ASSERT_TRUE(resume_manager.save_resume_state(info));
+        
+        EXPECT_FALSE(resume_manager.update_chunk_completed("unknown_file", 0));
+        for (uint64_t i = 0; i < 8; i += 2) {
+            EXPECT_TRUE(resume_manager.update_chunk_completed("resume_file", i));
+        }
+        EXPECT_TRUE(resume_manager.update_chunk_completed_by_session("resume_session", 1));
+        EXPECT_EQ(resume_manager.get_missing_chunks("resume_file", 8), std::vector<uint64_t>({3, 5, 7}));
+        
+        // Completions are group committed, not written one by one
+        ResumeManager other(db_path);
+        ASSERT_TRUE(other.initialize());
+        EXPECT_TRUE(other.get_completed_chunks("resume_file").empty());
+        
+        ASSERT_TRUE(resume_manager.flush());
+        ResumeManager flushed(db_path);
+        ASSERT_TRUE(flushed.initialize());
+        EXPECT_EQ(flushed.get_completed_chunks("resume_file").cardinality(), 5u);
+        
+        EXPECT_TRUE(resume_manager.update_chunk_completed("resume_file", 3));
+    }
+    
+    // Pending completions are written on shutdown
+    ResumeManager restarted(db_path);
+    ASSERT_TRUE(restarted.initialize());
+    EXPECT_TRUE(restarted.is_resumable("resume_file"));
+    EXPECT_EQ(restarted.get_resume_state_count(), 1u);
+    
+    auto loaded = restarted.load_resume_state_by_session("resume_session");
+    ASSERT_TRUE(loaded.has_value());
+    EXPECT_EQ(loaded->file_id, "resume_file");
+    EXPECT_EQ(loaded->stats.total_bytes, 1000u);
+    EXPECT_EQ(loaded->completed_chunks.missing(8), std::vector<uint64_t>({5, 7}));
+    
+    ASSERT_TRUE(restarted.remove_resume_state("resume_file"));
+    EXPECT_FALSE(restarted.is_resumable("resume_file"));
+    EXPECT_TRUE(restarted.list_resumable_transfers().empty());
+}
+
 TEST_F(FileStorageTest, FileIndex_BasicOperations) {
     FileIndex file_index(config_.database_path);
     
@@ -277,6 +924,197 @@ TEST_F(FileStorageTest, FileIndex_SearchFiles) {
     EXPECT_EQ(results.size(), 0);
 }
 
+TEST_F(FileStorageTest, FileIndex_FullTextSearch) {
+    FileIndex file_index(config_.database_path);
+    ASSERT_TRUE(file_index.initialize());
+    
+    FileMetadata report("report_hash", "quarterly_report.pdf", 1000);
+    report.file_type = "pdf";
+    report.tags = {"finance", "document"};
+    
+    FileMetadata scan("scan_hash", "holiday.jpg", 2000);
+    scan.file_type = "jpg";
+    scan.description = "scanned quarterly notes";
+    scan.tags = {"photo"};
+    
+    FileMetadata notes("notes_hash", "notes.txt", 3000);
+    notes.tags = {"document"};
+    
+    ASSERT_TRUE(file_index.add_files({report, scan, notes}));
+    
+    // Prefix terms; a filename hit outranks a description hit
+    auto results = file_index.search_files("quart");
+    ASSERT_EQ(results.size(), 2u);
+    EXPECT_EQ(results[0].file_hash, "report_hash");
+    EXPECT_EQ(results[1].file_hash, "scan_hash");
+    
+    EXPECT_EQ(file_index.search_files("doc").size(), 2u);
+    EXPECT_EQ(file_index.search_files("doc fin").size(), 1u); // Every term must match
+    EXPECT_EQ(file_index.search_files("phot")[0].file_hash, "scan_hash");
+    EXPECT_EQ(file_index.search_files("doc", 1).size(), 1u);
+    EXPECT_TRUE(file_index.search_files("missing").empty());
+    
+    // Query syntax in user input is taken literally
+    EXPECT_TRUE(file_index.search_files("\"doc OR *").empty());
+    
+    // Re-adding replaces the entry instead of duplicating it
+    notes.tags = {"draft"};
+    ASSERT_TRUE(file_index.add_file(notes));
+    EXPECT_EQ(file_index.search_files("doc").size(), 1u);
+    EXPECT_EQ(file_index.search_files("draft").size(), 1u);
+    
+    ASSERT_TRUE(file_index.remove_file("report_hash").success());
+    EXPECT_TRUE(file_index.search_files("finance").empty());
+}
+
+TEST_F(FileStorageTest, FileIndex_ForEachFile) {
+    FileIndex file_index(config_.database_path);
+    ASSERT_TRUE(file_index.initialize());
+    
+    FileMetadata first("first_hash", "first.txt", 100);
+    first.tags = {"text"};
+    FileMetadata second("second_hash", "second.txt", 200);
+    ASSERT_TRUE(file_index.add_files({first, second}));
+    
+    std::map<std::string, uint64_t> sizes;
+    size_t tagged = 0;
+    file_index.for_each_file([&](const FileMetadataView& file) {
+        sizes[std::string(file.filename())] = file.file_size();
+        tagged += file.tag_count();
+    });
+    
+    EXPECT_EQ(sizes.size(), 2u);
+    EXPECT_EQ(sizes["first.txt"], 100u);
+    EXPECT_EQ(sizes["second.txt"], 200u);
+    EXPECT_EQ(tagged, 1u);
+}
+
+TEST_F(FileStorageTest, FileIndex_MetadataCache) {
+    FileIndex file_index(config_.database_path);
+    ASSERT_TRUE(file_index.initialize());
+    
+    FileMetadata metadata("cached_hash", "cached.bin", 1000);
+    ASSERT_TRUE(file_index.add_file(metadata));
+    
+    auto first = file_index.get_file_shared("cached_hash");
+    ASSERT_NE(first, nullptr);
+    auto second = file_index.get_file_shared("cached_hash");
+    EXPECT_EQ(first.get(), second.get());
+    EXPECT_EQ(file_index.metadata_cache().misses(), 1u);
+    EXPECT_EQ(file_index.metadata_cache().hits(), 1u);
+    
+    // Updates replace the cached entry, earlier holders keep their snapshot
+    metadata.filename = "renamed.bin";
+    ASSERT_TRUE(file_index.add_file(metadata));
+    auto updated = file_index.get_file_shared("cached_hash");
+    ASSERT_NE(updated, nullptr);
+    EXPECT_NE(updated.get(), first.get());
+    EXPECT_EQ(updated->filename, "renamed.bin");
+    EXPECT_EQ(first->filename, "cached.bin");
+    
+    ASSERT_TRUE(file_index.remove_file("cached_hash").success());
+    EXPECT_EQ(file_index.get_file_shared("cached_hash"), nullptr);
+    
+    // Bounded LRU
+    MetadataCache cache(2);
+    auto a = std::make_shared<const FileMetadata>("a", "a.bin", 1);
+    auto b = std::make_shared<const FileMetadata>("b", "b.bin", 1);
+    auto c = std::make_shared<const FileMetadata>("c", "c.bin", 1);
+    cache.put(a, cache.generation());
+    cache.put(b, cache.generation());
+    EXPECT_NE(cache.get("a"), nullptr);
+    cache.put(c, cache.generation());
+    EXPECT_EQ(cache.size(), 2u);
+    EXPECT_EQ(cache.get("b"), nullptr);
+    EXPECT_NE(cache.get("a"), nullptr);
+    
+    // A load that raced with an invalidation is not cached
+    uint64_t generation = cache.generation();
+    cache.invalidate("c");
+    cache.put(c, generation);
+    EXPECT_EQ(cache.get("c"), nullptr);
+    
+    // Also bounded by the bytes held, chunk hashes included
+    auto large = std::make_shared<FileMetadata>("large", "large.bin", 1ULL << 30);
+    large->chunk_hashes.resize(16384);
+    MetadataCache sized(16, 1024 * 1024);
+    sized.put(a, sized.generation());
+    sized.put(b, sized.generation());
+    EXPECT_EQ(sized.size(), 2u);
+    size_t small_bytes = sized.bytes();
+    sized.put(large, sized.generation());
+    EXPECT_GT(sized.bytes(), 16384 * sizeof(hypershare::crypto::Blake3Hash));
+    sized.put(std::make_shared<const FileMetadata>(*large), sized.generation());
+    EXPECT_EQ(sized.size(), 3u);
+    
+    // The least recently used entry goes first, however small the others are
+    EXPECT_NE(sized.get("a"), nullptr);
+    EXPECT_NE(sized.get("b"), nullptr);
+    auto larger = std::make_shared<FileMetadata>("larger", "larger.bin", 1ULL << 30);
+    larger->chunk_hashes.resize(24576);
+    sized.put(larger, sized.generation());
+    EXPECT_EQ(sized.get("large"), nullptr);
+    EXPECT_NE(sized.get("larger"), nullptr);
+    EXPECT_EQ(sized.size(), 3u);
+    EXPECT_LE(sized.bytes(), 1024u * 1024u);
+    
+    sized.invalidate("larger");
+    EXPECT_EQ(sized.bytes(), small_bytes);
+    sized.clear();
+    EXPECT_EQ(sized.bytes(), 0u);
+}
+
+TEST_F(FileStorageTest, FileIndex_ReadersRunDuringBulkWrite) {
+    FileIndex file_index(config_.database_path, 2);
+    ASSERT_TRUE(file_index.initialize());
+    
+    constexpr size_t BATCHES = 20;
+    constexpr size_t BATCH_SIZE = 50;
+    
+    std::atomic<bool> writing{true};
+    std::atomic<size_t> reads{0};
+    std::atomic<bool> torn_batch{false};
+    
+    // More readers than pooled connections, so some wait for a free one
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 4; ++r) {
+        readers.emplace_back([&]() {
+            while (writing) {
+                // Batches commit atomically, a reader never sees part of one
+                auto files = file_index.list_files();
+                if (files.size() % BATCH_SIZE != 0) {
+                    torn_batch = true;
+                }
+                if (!files.empty() && !file_index.get_file(files.front().file_hash)) {
+                    torn_batch = true;
+                }
+                ++reads;
+            }
+        });
+    }
+    
+    for (size_t b = 0; b < BATCHES; ++b) {
+        std::vector<FileMetadata> batch;
+        for (size_t i = 0; i < BATCH_SIZE; ++i) {
+            FileMetadata metadata("file_" + std::to_string(b) + "_" + std::to_string(i), "bulk.bin", 1024);
+            metadata.chunk_count = 1;
+            metadata.add_chunk_hash(Blake3Hash{});
+            batch.push_back(std::move(metadata));
+        }
+        ASSERT_TRUE(file_index.add_files(batch));
+    }
+    
+    writing = false;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    
+    EXPECT_FALSE(torn_batch);
+    EXPECT_GT(reads, 0u);
+    EXPECT_EQ(file_index.get_file_count(), BATCHES * BATCH_SIZE);
+    EXPECT_EQ(file_index.search_files("bulk").size(), BATCHES * BATCH_SIZE);
+}
+
 TEST_F(FileStorageTest, FileIndex_ChunkTracking) {
     FileIndex file_index(config_.database_path);
     
@@ -311,6 +1149,769 @@ TEST_F(FileStorageTest, FileIndex_ChunkTracking) {
     EXPECT_EQ(missing.size(), 0);
 }
 
+TEST_F(FileStorageTest, FileIndex_ChunkAvailability) {
+    FileIndex file_index(config_.database_path);
+    ASSERT_TRUE(file_index.initialize());
+    
+    FileMetadata partial("partial_hash", "partial.bin", 10 * 65536);
+    ASSERT_TRUE(file_index.add_file(partial));
+    EXPECT_EQ(file_index.get_missing_chunks("partial_hash").size(), 10u);
+    EXPECT_EQ(file_index.next_missing_chunk("partial_hash"), 0u);
+    
+    auto hash = Blake3Hasher::hash(std::vector<uint8_t>{7});
+    ASSERT_TRUE(file_index.update_chunk_progress("partial_hash", 0, hash));
+    ASSERT_TRUE(file_index.mark_chunks_available("partial_hash", 1, 5));
+    EXPECT_EQ(file_index.get_available_chunks("partial_hash").cardinality(), 6u);
+    EXPECT_EQ(file_index.next_missing_chunk("partial_hash"), 6u);
+    EXPECT_EQ(file_index.find_chunk_locations(hash).size(), 1u);
+    
+    ASSERT_TRUE(file_index.mark_chunks_missing("partial_hash", 0, 2));
+    EXPECT_EQ(file_index.next_missing_chunk("partial_hash"), 0u);
+    EXPECT_EQ(file_index.next_missing_chunk("partial_hash", 2), 6u);
+    EXPECT_TRUE(file_index.find_chunk_locations(hash).empty());
+    EXPECT_FALSE(file_index.update_chunk_progress("unknown_hash", 0, hash));
+    
+    // Re-announcing the file keeps what was already downloaded
+    ASSERT_TRUE(file_index.add_file(partial));
+    EXPECT_EQ(file_index.get_missing_chunks("partial_hash").size(), 6u);
+    
+    ASSERT_TRUE(file_index.mark_chunks_available("partial_hash", 0, 10));
+    EXPECT_EQ(file_index.next_missing_chunk("partial_hash"), std::nullopt);
+    
+    // Availability alone is tracked when chunk hash rows are disabled
+    file_index.set_index_chunk_hashes(false);
+    FileMetadata silent("silent_hash", "silent.bin", 65536);
+    silent.chunk_count = 1;
+    ASSERT_TRUE(file_index.add_file(silent));
+    auto other = Blake3Hasher::hash(std::vector<uint8_t>{8});
+    ASSERT_TRUE(file_index.update_chunk_progress("silent_hash", 0, other));
+    EXPECT_TRUE(file_index.get_missing_chunks("silent_hash").empty());
+    EXPECT_TRUE(file_index.find_chunk_locations(other).empty());
+    
+    // Content-defined chunk totals come from the offsets, not the chunk size
+    FileMetadata cdc("cdc_hash", "cdc.bin", 100000);
+    cdc.chunking_mode = ChunkingMode::CONTENT_DEFINED;
+    cdc.chunk_offsets = {0, 30000, 70000};
+    cdc.chunk_count = 3;
+    ASSERT_TRUE(file_index.add_file(cdc));
+    ASSERT_TRUE(file_index.mark_chunks_available("cdc_hash", 0, 3));
+    EXPECT_TRUE(file_index.get_missing_chunks("cdc_hash").empty());
+    
+    FileMetadata stalled("stalled_hash", "stalled.bin", 100000);
+    stalled.chunking_mode = ChunkingMode::CONTENT_DEFINED;
+    stalled.chunk_offsets = {0, 50000};
+    stalled.chunk_count = 2;
+    ASSERT_TRUE(file_index.add_file(stalled));
+    ASSERT_TRUE(file_index.mark_chunks_available("stalled_hash", 0, 1));
+    
+    file_index.cleanup_incomplete_files(std::chrono::system_clock::now() + std::chrono::hours(1));
+    EXPECT_TRUE(file_index.get_file("cdc_hash").has_value());
+    EXPECT_TRUE(file_index.get_file("partial_hash").has_value());
+    EXPECT_FALSE(file_index.get_file("stalled_hash").has_value());
+}
+
+TEST_F(FileStorageTest, HashCache_SkipsUnchangedFiles) {
+    auto cache = std::make_shared<HashCache>(config_.database_path);
+    ASSERT_TRUE(cache->initialize());
+    
+    ChunkManager chunk_manager(config_);
+    chunk_manager.set_hash_cache(cache);
+    
+    // Just written: the mtime could still miss a write, so nothing is cached
+    auto file_path = test_dir_ / "medium_file.txt";
+    FileMetadata fresh;
+    ASSERT_TRUE(chunk_manager.chunk_file(file_path.string(), fresh).success());
+    EXPECT_EQ(cache->entry_count(), 0u);
+    
+    std::filesystem::last_write_time(file_path, std::filesystem::file_time_type::clock::now() - std::chrono::hours(1));
+    FileMetadata hashed;
+    ASSERT_TRUE(chunk_manager.chunk_file(file_path.string(), hashed).success());
+    EXPECT_EQ(cache->entry_count(), 1u);
+    EXPECT_EQ(hashed.file_hash, fresh.file_hash);
+    
+    // A hit is served from the entry without reading the file
+    auto stamp = FileStamp::of(file_path);
+    ASSERT_TRUE(stamp.has_value());
+    FileMetadata marked = hashed;
+    marked.file_hash = "from_cache";
+    ASSERT_TRUE(cache->store(*stamp, marked, std::chrono::system_clock::now()));
+    
+    FileMetadata reused;
+    ASSERT_TRUE(chunk_manager.chunk_file(file_path.string(), reused).success());
+    EXPECT_EQ(reused.file_hash, "from_cache");
+    EXPECT_EQ(reused.chunk_hashes, hashed.chunk_hashes);
+    EXPECT_EQ(reused.filename, "medium_file.txt");
+    
+    // Another chunk size, or a changed file, is hashed again
+    ChunkManager other_size(32768);
+    other_size.set_hash_cache(cache);
+    FileMetadata resized;
+    ASSERT_TRUE(other_size.chunk_file(file_path.string(), resized).success());
+    EXPECT_NE(resized.file_hash, "from_cache");
+    
+    {
+        std::ofstream file(file_path, std::ios::binary | std::ios::app);
+        file << "appended";
+    }
+    FileMetadata changed;
+    ASSERT_TRUE(chunk_manager.chunk_file(file_path.string(), changed).success());
+    EXPECT_NE(changed.file_hash, "from_cache");
+    EXPECT_EQ(changed.file_size, hashed.file_size + 8);
+}
+
+TEST_F(FileStorageTest, StorageAccountant_ReservesAndEvicts) {
+    config_.max_storage_size = 256 * 1024;
+    
+    // Left over from an earlier run, last touched an hour ago
+    std::string stale_hash(64, 'e');
+    auto stale_path = config_.get_partial_path(stale_hash);
+    std::filesystem::create_directories(stale_path.parent_path());
+    {
+        std::ofstream file(stale_path, std::ios::binary);
+        file << std::string(100 * 1024, 'x');
+    }
+    std::filesystem::last_write_time(stale_path, std::filesystem::file_time_type::clock::now() - std::chrono::hours(1));
+    
+    auto accountant = std::make_shared<StorageAccountant>(config_);
+    accountant->scan();
+    EXPECT_EQ(accountant->used(StorageArea::INCOMPLETE), 100u * 1024);
+    
+    ChunkManager chunk_manager(config_);
+    chunk_manager.set_storage_accountant(accountant);
+    
+    FileMetadata medium;
+    ASSERT_TRUE(chunk_manager.chunk_file((test_dir_ / "medium_file.txt").string(), medium).success());
+    FileMetadata large;
+    ASSERT_TRUE(chunk_manager.chunk_file((test_dir_ / "large_file.txt").string(), large).success());
+    large.file_path.clear();
+    
+    std::vector<std::vector<uint8_t>> chunks(medium.chunk_count);
+    for (size_t i = 0; i < medium.chunk_count; ++i) {
+        ASSERT_TRUE(chunk_manager.read_chunk(medium, i, chunks[i]).success());
+    }
+    medium.file_path.clear();
+    
+    // 192KB only fits once the stale download is evicted
+    ASSERT_TRUE(chunk_manager.prepare_download(medium).success());
+    EXPECT_FALSE(std::filesystem::exists(stale_path));
+    EXPECT_EQ(accountant->used(StorageArea::INCOMPLETE), medium.file_size);
+    
+    // The download in progress is pinned, so a larger one is refused
+    EXPECT_FALSE(chunk_manager.prepare_download(large).success());
+    EXPECT_FALSE(std::filesystem::exists(config_.get_partial_path(large.file_hash)));
+    EXPECT_TRUE(std::filesystem::exists(config_.get_partial_path(medium.file_hash)));
+    EXPECT_EQ(accountant->used(StorageArea::INCOMPLETE), medium.file_size);
+    
+    // A finished download moves from the incomplete area to downloads
+    for (size_t i = 0; i < medium.chunk_count; ++i) {
+        ASSERT_TRUE(chunk_manager.write_chunk(medium, i, chunks[i]).success());
+    }
+    ASSERT_TRUE(chunk_manager.finalize_download(medium, config_.get_file_path(medium.file_hash)).success());
+    EXPECT_EQ(accountant->used(StorageArea::INCOMPLETE), 0u);
+    EXPECT_EQ(accountant->used(StorageArea::DOWNLOADS), medium.file_size);
+    
+    // Completed downloads are never evicted, so the budget stays short
+    EXPECT_FALSE(chunk_manager.prepare_download(large).success());
+    
+    // An aborted download gives back its whole reservation
+    config_.max_storage_size = 4 * 1024 * 1024;
+    auto larger_budget = std::make_shared<StorageAccountant>(config_);
+    larger_budget->scan();
+    chunk_manager.set_storage_accountant(larger_budget);
+    ASSERT_TRUE(chunk_manager.prepare_download(large).success());
+    EXPECT_EQ(larger_budget->used(StorageArea::INCOMPLETE), large.file_size);
+    chunk_manager.abort_download(large);
+    EXPECT_EQ(larger_budget->used(StorageArea::INCOMPLETE), 0u);
+    EXPECT_FALSE(std::filesystem::exists(config_.get_partial_path(large.file_hash)));
+}
+
+TEST_F(FileStorageTest, WriteBackBuffer_ReportsChunksOnceDurable) {
+    // Out-of-order chunks are joined into one run and only durable after sync
+    auto target_path = test_dir_ / "write_back.bin";
+    int fd = ::open(target_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    ASSERT_GE(fd, 0);
+    {
+        WriteBackBuffer buffer(fd, DurabilityPolicy::ON_COMPLETION, 1024 * 1024, 0);
+        std::vector<size_t> durable;
+        for (size_t i : {2, 0, 1}) {
+            std::vector<uint8_t> chunk(1000, static_cast<uint8_t>('a' + i));
+            ASSERT_TRUE(buffer.write(i, i * 1000, chunk, durable));
+        }
+        EXPECT_EQ(buffer.buffered_bytes(), 3000u);
+        ASSERT_TRUE(buffer.flush(durable));
+        EXPECT_TRUE(durable.empty());
+        EXPECT_EQ(std::filesystem::file_size(target_path), 3000u);
+        
+        ASSERT_TRUE(buffer.sync(durable));
+        std::sort(durable.begin(), durable.end());
+        EXPECT_EQ(durable, (std::vector<size_t>{0, 1, 2}));
+    }
+    {
+        WriteBackBuffer buffer(fd, DurabilityPolicy::PER_CHUNK, 1024 * 1024, 0);
+        std::vector<size_t> durable;
+        std::vector<uint8_t> chunk(1000, 'z');
+        ASSERT_TRUE(buffer.write(1, 1000, chunk, durable));
+        EXPECT_EQ(durable, (std::vector<size_t>{1}));
+        EXPECT_EQ(buffer.buffered_bytes(), 0u);
+    }
+    ::close(fd);
+    
+    std::ifstream written(target_path, std::ios::binary);
+    std::string contents((std::istreambuf_iterator<char>(written)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(contents, std::string(1000, 'a') + std::string(1000, 'z') + std::string(1000, 'c'));
+    
+    // Through ChunkManager: a sync every 192KB with a 128KB write-back
+    config_.write_back_bytes = 128 * 1024;
+    config_.durability = DurabilityPolicy::PER_INTERVAL;
+    config_.sync_interval_bytes = 192 * 1024;
+    ChunkManager chunk_manager(config_);
+    
+    FileMetadata download;
+    ASSERT_TRUE(chunk_manager.chunk_file((test_dir_ / "medium_file.txt").string(), download).success());
+    std::vector<std::vector<uint8_t>> chunks(download.chunk_count);
+    for (size_t i = 0; i < download.chunk_count; ++i) {
+        ASSERT_TRUE(chunk_manager.read_chunk(download, i, chunks[i]).success());
+    }
+    download.file_path.clear();
+    
+    std::vector<size_t> persisted;
+    chunk_manager.set_durable_handler([&](const std::string& file_hash, const std::vector<size_t>& chunk_indexes) {
+        EXPECT_EQ(file_hash, download.file_hash);
+        persisted.insert(persisted.end(), chunk_indexes.begin(), chunk_indexes.end());
+    });
+    ASSERT_TRUE(chunk_manager.prepare_download(download).success());
+    
+    // Chunks 1 and 0 fill the buffer and go out as one write, not yet synced
+    ASSERT_TRUE(chunk_manager.write_chunk(download, 1, chunks[1]).success());
+    ASSERT_TRUE(chunk_manager.write_chunk(download, 0, chunks[0]).success());
+    ASSERT_TRUE(chunk_manager.write_chunk(download, 2, chunks[2]).success());
+    EXPECT_TRUE(persisted.empty());
+    
+    // Reading the target writes out chunk 2, which reaches the sync interval
+    std::vector<uint8_t> read_back;
+    ASSERT_TRUE(chunk_manager.read_chunk(download, 2, read_back).success());
+    EXPECT_EQ(read_back, chunks[2]);
+    std::sort(persisted.begin(), persisted.end());
+    EXPECT_EQ(persisted, (std::vector<size_t>{0, 1, 2}));
+    
+    auto output_path = config_.get_file_path(download.file_hash);
+    ASSERT_TRUE(chunk_manager.finalize_download(download, output_path).success());
+    EXPECT_EQ(persisted.size(), 3u);
+    
+    FileMetadata completed;
+    ASSERT_TRUE(chunk_manager.chunk_file(output_path.string(), completed).success());
+    EXPECT_EQ(completed.file_hash, download.file_hash);
+}
+
+TEST_F(FileStorageTest, DirectIO_ReadsAndWritesAlignedChunks) {
+    AlignedBufferPool pool(65536 * 3 + 100);
+    EXPECT_EQ(pool.buffer_size() % AlignedBufferPool::ALIGNMENT, 0u);
+    uint8_t* recycled;
+    {
+        auto buffer = pool.acquire();
+        ASSERT_TRUE(buffer);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(buffer.data()) % AlignedBufferPool::ALIGNMENT, 0u);
+        recycled = buffer.data();
+    }
+    EXPECT_EQ(pool.acquire().data(), recycled);
+    
+    // Unaligned reads across the read-ahead window, up to the end of the file
+    auto large_path = test_dir_ / "large_file.txt";
+    std::ifstream file(large_path, std::ios::binary);
+    std::vector<uint8_t> expected((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    auto reader = DirectFileReader::open(large_path, pool);
+    if (reader) {
+        for (uint64_t offset : {0ull, 1000ull, 65536ull * 3 - 10, 1024ull * 1024 - 5000}) {
+            std::vector<uint8_t> data(5000);
+            ASSERT_TRUE(reader->read(offset, data));
+            EXPECT_TRUE(std::equal(data.begin(), data.end(), expected.begin() + offset));
+        }
+        std::vector<uint8_t> past_end(10);
+        EXPECT_FALSE(reader->read(1024 * 1024 - 5, past_end));
+        
+        // Threads reading one file at once each work in their own buffer
+        std::atomic<int> mismatches{0};
+        std::vector<std::thread> threads;
+        for (uint64_t t = 0; t < 4; ++t) {
+            threads.emplace_back([&, t] {
+                std::vector<uint8_t> data(3000);
+                for (uint64_t offset = t * 7919; offset + data.size() <= expected.size(); offset += 65536 + 13) {
+                    if (!reader->read(offset, data) ||
+                        !std::equal(data.begin(), data.end(), expected.begin() + offset)) {
+                        ++mismatches;
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        EXPECT_EQ(mismatches, 0);
+    }
+    
+    // Serving and downloading through ChunkManager, falling back to buffered
+    // I/O where the filesystem has no O_DIRECT
+    config_.direct_io = true;
+    config_.direct_io_threshold = 0;
+    config_.read_ahead_chunks = 2;
+    ChunkManager chunk_manager(config_);
+    
+    FileMetadata download;
+    ASSERT_TRUE(chunk_manager.chunk_file(large_path.string(), download).success());
+    std::vector<std::vector<uint8_t>> chunks(download.chunk_count);
+    for (size_t i = 0; i < download.chunk_count; ++i) {
+        ASSERT_TRUE(chunk_manager.read_chunk(download, i, chunks[i]).success());
+        EXPECT_TRUE(std::equal(chunks[i].begin(), chunks[i].end(), expected.begin() + i * 65536));
+    }
+    download.file_path.clear();
+    
+    // Odd-sized last chunk exercises the unaligned tail
+    download.file_size -= 100;
+    chunks.back().resize(chunks.back().size() - 100);
+    ASSERT_TRUE(chunk_manager.prepare_download(download).success());
+    for (size_t i = download.chunk_count; i-- > 0; ) {
+        ASSERT_TRUE(chunk_manager.write_chunk(download, i, chunks[i]).success());
+    }
+    auto output_path = config_.get_file_path(download.file_hash);
+    ASSERT_TRUE(chunk_manager.finalize_download(download, output_path).success());
+    
+    std::ifstream output(output_path, std::ios::binary);
+    std::vector<uint8_t> downloaded((std::istreambuf_iterator<char>(output)), std::istreambuf_iterator<char>());
+    ASSERT_EQ(downloaded.size(), expected.size() - 100);
+    EXPECT_TRUE(std::equal(downloaded.begin(), downloaded.end(), expected.begin()));
+}
+
+TEST_F(FileStorageTest, IntegrityScrubber_MarksCorruptedChunksMissing) {
+    auto file_path = test_dir_ / "large_file.txt";
+    auto file_index = std::make_shared<FileIndex>(config_.database_path);
+    ASSERT_TRUE(file_index->initialize());
+    
+    ChunkManager chunk_manager(config_);
+    FileMetadata metadata;
+    ASSERT_TRUE(chunk_manager.chunk_file(file_path.string(), metadata).success());
+    ASSERT_EQ(metadata.chunk_count, 16u);
+    ASSERT_TRUE(file_index->add_file(metadata));
+    
+    // Bit rot leaves the modification time alone
+    {
+        std::fstream file(file_path, std::ios::binary | std::ios::in | std::ios::out);
+        for (uint64_t offset : {3 * 65536 + 17, 4 * 65536, 10 * 65536 + 65534}) {
+            file.seekp(static_cast<std::streamoff>(offset));
+            file.put('\x5a');
+            file.seekp(static_cast<std::streamoff>(offset + 1));
+            file.put('\xa5');
+        }
+    }
+    std::filesystem::last_write_time(file_path, std::filesystem::file_time_type::clock::now() - std::chrono::hours(1));
+    
+    IntegrityScrubber scrubber(file_index, 64 * 1024 * 1024);
+    std::vector<uint64_t> reported;
+    scrubber.set_corruption_handler([&](const FileMetadata& file, const std::vector<uint64_t>& chunks) {
+        EXPECT_EQ(file.file_hash, metadata.file_hash);
+        reported = chunks;
+    });
+    
+    EXPECT_EQ(scrubber.scrub_pass(), 3u);
+    EXPECT_EQ(reported, (std::vector<uint64_t>{3, 4, 10}));
+    EXPECT_EQ(file_index->get_missing_chunks(metadata.file_hash), (std::vector<size_t>{3, 4, 10}));
+    EXPECT_EQ(scrubber.stats().chunks_verified, 16u);
+    EXPECT_EQ(scrubber.stats().passes_completed, 1u);
+    
+    // Chunks already missing are not read again, and reads are paced
+    IntegrityScrubber slow(file_index, 2 * 1024 * 1024);
+    auto started = std::chrono::steady_clock::now();
+    EXPECT_EQ(slow.scrub_pass(), 0u);
+    EXPECT_GE(std::chrono::steady_clock::now() - started, std::chrono::milliseconds(300));
+    EXPECT_EQ(slow.stats().chunks_verified, 13u);
+    
+    // Stopping interrupts a pass waiting on the rate
+    IntegrityScrubber stalled(file_index, 16 * 1024);
+    ASSERT_TRUE(stalled.start());
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    started = std::chrono::steady_clock::now();
+    stalled.stop();
+    EXPECT_LT(std::chrono::steady_clock::now() - started, std::chrono::seconds(1));
+    EXPECT_EQ(stalled.stats().passes_completed, 0u);
+    
+    // An edited file is left to be re-shared rather than reported
+    std::filesystem::last_write_time(file_path, std::filesystem::file_time_type::clock::now() + std::chrono::hours(1));
+    EXPECT_TRUE(scrubber.scrub_file(metadata.file_hash).empty());
+    EXPECT_EQ(scrubber.stats().files_scrubbed, 1u);
+    
+    // Per-chunk report without the scrubber
+    FileVerifier verifier;
+    auto report = verifier.check_file_integrity(file_path, metadata);
+    EXPECT_TRUE(report.is_corrupted);
+    EXPECT_EQ(report.corrupted_chunks, (std::vector<uint64_t>{3, 4, 10}));
+}
+
+TEST_F(FileStorageTest, IntegrityScrubber_ComparesModificationTimeExactly) {
+    auto file_path = test_dir_ / "medium_file.txt";
+    auto file_index = std::make_shared<FileIndex>(config_.database_path);
+    ASSERT_TRUE(file_index->initialize());
+    
+    ChunkManager chunk_manager(config_);
+    FileMetadata metadata;
+    ASSERT_TRUE(chunk_manager.chunk_file(file_path.string(), metadata).success());
+    
+    {
+        std::fstream file(file_path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(65536 + 5);
+        file.put('\x5a');
+    }
+    
+    // Indexed with the file's own modification time, as the share watcher does
+    auto set_mtime = [&](long nanoseconds) {
+        struct timespec times[2] = {{0, UTIME_OMIT}, {1700000000, nanoseconds}};
+        return ::utimensat(AT_FDCWD, file_path.c_str(), times, 0) == 0;
+    };
+    ASSERT_TRUE(set_mtime(123456789));
+    metadata.modified_at = std::chrono::system_clock::time_point(
+        std::chrono::duration_cast<std::chrono::system_clock::duration>(
+            std::chrono::seconds(1700000000) + std::chrono::nanoseconds(123456789)));
+    ASSERT_TRUE(file_index->add_file(metadata));
+    
+    IntegrityScrubber scrubber(file_index, 64 * 1024 * 1024);
+    EXPECT_EQ(scrubber.scrub_file(metadata.file_hash), (std::vector<uint64_t>{1}));
+    
+    // Written a microsecond later counts as edited
+    ASSERT_TRUE(set_mtime(123457789));
+    EXPECT_TRUE(scrubber.scrub_file(metadata.file_hash).empty());
+}
+
+TEST_F(FileStorageTest, FileVerifier_StreamsChunksWithProgress) {
+    // Three 4MB hashing blocks, so progress is reported more than once
+    auto file_path = test_dir_ / "stream_file.bin";
+    {
+        std::ofstream file(file_path, std::ios::binary);
+        std::vector<char> data(12 * 1024 * 1024);
+        for (size_t i = 0; i < data.size(); ++i) {
+            data[i] = static_cast<char>((i * 131 + i / 4096) & 0xff);
+        }
+        file.write(data.data(), static_cast<std::streamsize>(data.size()));
+    }
+    
+    ChunkManager chunk_manager(config_);
+    FileMetadata metadata;
+    ASSERT_TRUE(chunk_manager.chunk_file(file_path.string(), metadata).success());
+    ASSERT_EQ(metadata.chunk_count, 192u);
+    
+    std::vector<std::string> chunk_hashes;
+    for (const auto& chunk_hash : metadata.chunk_hashes) {
+        chunk_hashes.push_back(hash_utils::hash_to_hex(chunk_hash));
+    }
+    
+    FileVerifier verifier;
+    EXPECT_TRUE(verifier.verify_all_chunks(file_path, chunk_hashes, metadata.chunk_size));
+    
+    std::vector<FileVerifier::VerificationProgress> updates;
+    EXPECT_TRUE(verifier.verify_file_with_progress(file_path, metadata,
+        [&](const FileVerifier::VerificationProgress& progress) { updates.push_back(progress); }));
+    ASSERT_EQ(updates.size(), 3u);
+    for (size_t i = 1; i < updates.size(); ++i) {
+        EXPECT_GT(updates[i].chunks_verified, updates[i - 1].chunks_verified);
+    }
+    EXPECT_EQ(updates.back().chunks_verified, 192u);
+    EXPECT_EQ(updates.back().total_chunks, 192u);
+    EXPECT_EQ(updates.back().chunks_failed, 0u);
+    EXPECT_DOUBLE_EQ(updates.back().percentage_complete, 100.0);
+    EXPECT_EQ(updates.back().estimated_remaining.count(), 0);
+    
+    // One bad chunk in the first block and one in the last
+    {
+        std::fstream file(file_path, std::ios::binary | std::ios::in | std::ios::out);
+        for (uint64_t offset : {5 * 65536 + 9, 180 * 65536 + 3}) {
+            file.seekp(static_cast<std::streamoff>(offset));
+            file.put('\x5a');
+            file.seekp(static_cast<std::streamoff>(offset + 1));
+            file.put('\xa5');
+        }
+    }
+    EXPECT_FALSE(verifier.verify_all_chunks(file_path, chunk_hashes, metadata.chunk_size));
+    
+    updates.clear();
+    EXPECT_FALSE(verifier.verify_file_with_progress(file_path, metadata,
+        [&](const FileVerifier::VerificationProgress& progress) { updates.push_back(progress); }, false));
+    ASSERT_EQ(updates.size(), 3u);
+    EXPECT_EQ(updates.back().chunks_verified, 192u);
+    EXPECT_EQ(updates.back().chunks_failed, 2u);
+    
+    // Stopping at the first mismatch; blocks already being hashed on other
+    // workers may still report
+    updates.clear();
+    EXPECT_FALSE(verifier.verify_file_with_progress(file_path, metadata,
+        [&](const FileVerifier::VerificationProgress& progress) { updates.push_back(progress); }));
+    ASSERT_FALSE(updates.empty());
+    EXPECT_GE(updates.back().chunks_failed, 1u);
+}
+
+TEST_F(FileStorageTest, ShareWatcher_RehashesChangedChunks) {
+    auto share_root = test_dir_ / "share";
+    std::filesystem::create_directories(share_root);
+    create_test_file("share/data.bin", 65536 * 4 + 1000);
+    auto file_path = share_root / "data.bin";
+    
+    auto file_index = std::make_shared<FileIndex>(config_.database_path);
+    ASSERT_TRUE(file_index->initialize());
+    
+    ShareWatcher watcher(file_index, config_, std::chrono::milliseconds(50));
+    std::atomic<int> announced{0};
+    watcher.set_update_handler([&](const FileMetadata&) { ++announced; });
+    ASSERT_TRUE(watcher.add_root(share_root).success());
+    EXPECT_EQ(watcher.stats().files_hashed, 1u);
+    EXPECT_EQ(file_index->get_file_count(), 1u);
+    EXPECT_EQ(announced, 1);
+    ASSERT_TRUE(watcher.start());
+    
+    auto wait_for = [](const std::function<bool()>& condition) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (!condition() && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return condition();
+    };
+    
+    // Overwrite a few bytes away from the start, middle and end of one chunk
+    {
+        std::fstream file(file_path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(65536 * 2 + 1000);
+        file.write("changed", 7);
+    }
+    ASSERT_TRUE(wait_for([&] { return watcher.stats().files_updated == 1; }));
+    auto stats = watcher.stats();
+    EXPECT_EQ(stats.chunks_changed, 1u);
+    EXPECT_EQ(stats.chunks_unchanged, 4u);
+    
+    ChunkManager chunk_manager(config_);
+    FileMetadata expected;
+    ASSERT_TRUE(chunk_manager.chunk_file(file_path.string(), expected).success());
+    auto updated = file_index->get_file(expected.file_hash);
+    ASSERT_TRUE(updated.has_value());
+    EXPECT_EQ(updated->chunk_hashes, expected.chunk_hashes);
+    EXPECT_EQ(file_index->get_file_count(), 1u);
+    
+    // Files in new directories are picked up, deleted ones leave the index
+    std::filesystem::create_directories(share_root / "nested");
+    create_test_file("share/nested/new.bin", 1000);
+    ASSERT_TRUE(wait_for([&] { return watcher.stats().files_hashed == 2; }));
+    
+    std::filesystem::remove(file_path);
+    ASSERT_TRUE(wait_for([&] { return watcher.stats().files_removed == 1; }));
+    EXPECT_FALSE(file_index->file_exists(expected.file_hash));
+    EXPECT_EQ(file_index->get_file_count(), 1u);
+    
+    watcher.stop();
+}
+
+TEST_F(FileStorageTest, ChunkStore_DeduplicatesByHash) {
+    ChunkStore store(test_dir_ / "chunks", config_.database_path);
+    ASSERT_TRUE(store.initialize());
+    
+    std::vector<uint8_t> data(4096, 0x5A);
+    auto chunk_hash = hash_utils::hash_to_hex(Blake3Hasher::hash(data));
+    
+    ASSERT_TRUE(store.put(chunk_hash, data, "file_a", 0).success());
+    ASSERT_TRUE(store.put(chunk_hash, data, "file_b", 3).success());
+    ASSERT_TRUE(store.put(chunk_hash, data, "file_b", 3).success()); // Same slot, no new reference
+    
+    EXPECT_EQ(store.chunk_count(), 1);
+    EXPECT_EQ(store.stored_bytes(), data.size());
+    EXPECT_EQ(store.ref_count(chunk_hash), 2);
+    
+    // Data that does not match its key is rejected
+    std::vector<uint8_t> other(4096, 0x11);
+    EXPECT_FALSE(store.put(chunk_hash, other, "file_c", 0).success());
+    
+    std::vector<uint8_t> read_back;
+    ASSERT_TRUE(store.get(chunk_hash, read_back).success());
+    EXPECT_EQ(read_back, data);
+    
+    // An unreferenced row left behind by someone else is not this file's to sweep
+    {
+        sqlite3* db = nullptr;
+        ASSERT_EQ(sqlite3_open(config_.database_path.string().c_str(), &db), SQLITE_OK);
+        EXPECT_EQ(sqlite3_exec(db, "INSERT INTO chunk_store (chunk_hash, size, ref_count, stored_at) "
+                                   "VALUES ('orphan', 10, 0, 0);", nullptr, nullptr, nullptr), SQLITE_OK);
+        sqlite3_close(db);
+    }
+    
+    EXPECT_EQ(store.release_file("file_a"), 0);
+    EXPECT_EQ(store.ref_count(chunk_hash), 1);
+    EXPECT_TRUE(store.contains("orphan"));
+    EXPECT_TRUE(std::filesystem::exists(store.chunk_path(chunk_hash)));
+    
+    EXPECT_EQ(store.release_file("file_b"), 1);
+    EXPECT_FALSE(store.contains(chunk_hash));
+    EXPECT_FALSE(std::filesystem::exists(store.chunk_path(chunk_hash)));
+}
+
+TEST_F(FileStorageTest, Compression_SkipsHighEntropyData) {
+    std::vector<uint8_t> random_data(65536);
+    std::mt19937 rng(3);
+    std::generate(random_data.begin(), random_data.end(), [&] { return static_cast<uint8_t>(rng()); });
+    
+    std::string csv;
+    for (int i = 0; i < 4000; ++i) {
+        csv += std::to_string(i) + ",2024-01-01,INFO,request served in " + std::to_string(i % 97) + "ms\n";
+    }
+    std::vector<uint8_t> text(csv.begin(), csv.end());
+    
+    EXPECT_GT(compression::sample_entropy(random_data), compression::MAX_COMPRESSIBLE_ENTROPY);
+    EXPECT_LT(compression::sample_entropy(text), compression::MAX_COMPRESSIBLE_ENTROPY);
+    EXPECT_FALSE(compression::compress(random_data).has_value());
+    
+    auto frame = compression::compress(text);
+    if (!compression::available()) {
+        EXPECT_FALSE(frame.has_value());
+        return;
+    }
+    ASSERT_TRUE(frame.has_value());
+    EXPECT_LT(frame->size(), text.size() / 4);
+    
+    std::vector<uint8_t> restored;
+    ASSERT_TRUE(compression::decompress(*frame, restored).success());
+    EXPECT_EQ(restored, text);
+    
+    // Frames claiming more than the limit are refused
+    EXPECT_FALSE(compression::decompress(*frame, restored, text.size() - 1).success());
+}
+
+TEST_F(FileStorageTest, ChunkStore_CompressedChunks) {
+    ChunkStore store(test_dir_ / "chunks", config_.database_path, true);
+    ASSERT_TRUE(store.initialize());
+    
+    std::string csv;
+    for (int i = 0; i < 2000; ++i) {
+        csv += std::to_string(i) + ",sensor,21.5\n";
+    }
+    std::vector<uint8_t> data(csv.begin(), csv.end());
+    auto chunk_hash = hash_utils::hash_to_hex(Blake3Hasher::hash(data));
+    
+    ASSERT_TRUE(store.put(chunk_hash, data, "file_a", 0).success());
+    EXPECT_EQ(std::filesystem::exists(store.compressed_chunk_path(chunk_hash)), compression::available());
+    EXPECT_EQ(store.stored_bytes(), data.size());
+    
+    std::vector<uint8_t> read_back;
+    ASSERT_TRUE(store.get(chunk_hash, read_back).success());
+    EXPECT_EQ(read_back, data);
+    
+    EXPECT_EQ(store.release_file("file_a"), 1);
+    EXPECT_FALSE(std::filesystem::exists(store.compressed_chunk_path(chunk_hash)));
+}
+
+TEST_F(FileStorageTest, ChunkManager_ImportLocalChunks) {
+    config_.preallocate_downloads = false;
+    config_.chunk_store_directory = test_dir_ / "chunks";
+    
+    FileIndex file_index(config_.database_path);
+    ASSERT_TRUE(file_index.initialize());
+    
+    auto store = std::make_shared<ChunkStore>(config_.chunk_store_directory, config_.database_path);
+    ASSERT_TRUE(store->initialize());
+    
+    ChunkManager chunk_manager(config_);
+    chunk_manager.set_chunk_store(store);
+    
+    auto file_path = test_files_["medium_file.txt"];
+    FileMetadata shared;
+    ASSERT_TRUE(chunk_manager.chunk_file(file_path.string(), shared).success());
+    ASSERT_TRUE(file_index.add_file(shared));
+    
+    // Two downloads of other files made of the same chunks
+    FileMetadata first = shared;
+    first.file_hash = "aa_first_download";
+    first.file_path.clear();
+    FileMetadata second = shared;
+    second.file_hash = "bb_second_download";
+    second.file_path.clear();
+    
+    std::vector<size_t> imported;
+    ASSERT_TRUE(chunk_manager.import_local_chunks(first, file_index, imported).success());
+    EXPECT_EQ(imported.size(), shared.chunk_count);
+    EXPECT_EQ(store->chunk_count(), shared.chunk_count);
+    
+    imported.clear();
+    ASSERT_TRUE(chunk_manager.import_local_chunks(second, file_index, imported).success());
+    EXPECT_EQ(imported.size(), shared.chunk_count);
+    EXPECT_EQ(store->chunk_count(), shared.chunk_count); // Stored once
+    EXPECT_EQ(store->ref_count(shared.chunk_hash_hex(0)), 2);
+    
+    auto output_path = test_dir_ / "downloads" / "imported.txt";
+    ASSERT_TRUE(chunk_manager.finalize_download(first, output_path).success());
+    
+    std::ifstream original(file_path, std::ios::binary);
+    std::ifstream copy(output_path, std::ios::binary);
+    std::vector<char> original_data((std::istreambuf_iterator<char>(original)), std::istreambuf_iterator<char>());
+    std::vector<char> copy_data((std::istreambuf_iterator<char>(copy)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(copy_data, original_data);
+    
+    // Still referenced by the second download until it goes away
+    EXPECT_EQ(store->chunk_count(), shared.chunk_count);
+    EXPECT_EQ(store->ref_count(shared.chunk_hash_hex(0)), 1);
+    chunk_manager.abort_download(second);
+    EXPECT_EQ(store->chunk_count(), 0);
+}
+
+TEST_F(FileStorageTest, ChunkManager_PreallocatedDownloadWritesEachChunkOnce) {
+    config_.chunk_store_directory = test_dir_ / "chunks";
+    config_.max_storage_size = 64 * 1024 * 1024;
+    
+    FileIndex file_index(config_.database_path);
+    ASSERT_TRUE(file_index.initialize());
+    
+    auto accountant = std::make_shared<StorageAccountant>(config_);
+    accountant->scan();
+    auto store = std::make_shared<ChunkStore>(config_.chunk_store_directory, config_.database_path);
+    ASSERT_TRUE(store->initialize());
+    store->set_storage_accountant(accountant);
+    
+    ChunkManager chunk_manager(config_);
+    chunk_manager.set_storage_accountant(accountant);
+    chunk_manager.set_chunk_store(store);
+    
+    auto source_path = test_files_["medium_file.txt"];
+    FileMetadata source;
+    ASSERT_TRUE(chunk_manager.chunk_file(source_path.string(), source).success());
+    uint64_t downloads_before = accountant->used(StorageArea::DOWNLOADS);
+    
+    // The target is the only copy, charged once as an incomplete download
+    FileMetadata first = source;
+    first.file_hash = "aa_first_download";
+    first.file_path.clear();
+    ASSERT_TRUE(chunk_manager.prepare_download(first).success());
+    for (size_t i = 0; i < source.chunk_count; ++i) {
+        std::vector<uint8_t> chunk;
+        ASSERT_TRUE(chunk_manager.read_chunk(source, i, chunk).success());
+        ASSERT_TRUE(chunk_manager.write_chunk(first, i, chunk).success());
+    }
+    EXPECT_EQ(store->chunk_count(), 0);
+    EXPECT_EQ(accountant->used(StorageArea::CHUNK_STORE), 0u);
+    EXPECT_EQ(accountant->used(StorageArea::INCOMPLETE), source.file_size);
+    
+    auto first_path = test_dir_ / "downloads" / "first.txt";
+    ASSERT_TRUE(chunk_manager.finalize_download(first, first_path).success());
+    EXPECT_EQ(accountant->used(StorageArea::INCOMPLETE), 0u);
+    EXPECT_EQ(accountant->used(StorageArea::DOWNLOADS), downloads_before + source.file_size);
+    
+    // A later download of the same chunks copies them from the completed file
+    first.file_path = first_path.string();
+    ASSERT_TRUE(file_index.add_file(first));
+    
+    FileMetadata second = source;
+    second.file_hash = "bb_second_download";
+    second.file_path.clear();
+    ASSERT_TRUE(chunk_manager.prepare_download(second).success());
+    
+    std::vector<size_t> imported;
+    ASSERT_TRUE(chunk_manager.import_local_chunks(second, file_index, imported).success());
+    EXPECT_EQ(imported.size(), source.chunk_count);
+    EXPECT_EQ(store->chunk_count(), 0);
+    
+    auto output_path = test_dir_ / "downloads" / "second.txt";
+    ASSERT_TRUE(chunk_manager.finalize_download(second, output_path).success());
+    EXPECT_TRUE(FileVerifier().verify_file_metadata(output_path, source));
+}
+
 // Test StorageConfig functionality
 TEST_F(FileStorageTest, StorageConfig_DefaultValues) {
     StorageConfig config("./");
@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 #include "hypershare/network/message_handler.hpp"
 #include "hypershare/network/connection.hpp"
+#include "hypershare/storage/compression.hpp"
 #include <memory>
 
 using namespace hypershare::network;
@@ -74,6 +75,43 @@ TEST_F(MessageHandlerTest, RegisterAndHandleHandshake) {
     EXPECT_EQ(received_msg.capabilities, test_msg.capabilities);
 }
 
+TEST_F(MessageHandlerTest, CompressedPayloadIsDecompressed) {
+    if (!hypershare::storage::compression::available()) {
+        GTEST_SKIP() << "Built without zstd";
+    }
+    
+    bool handler_called = false;
+    ChunkDataMessage received_msg;
+    
+    handler->register_handler<ChunkDataMessage>(MessageType::CHUNK_DATA,
+        [&](std::shared_ptr<Connection> conn, const ChunkDataMessage& msg) {
+            handler_called = true;
+            received_msg = msg;
+        });
+    
+    ChunkDataMessage test_msg;
+    test_msg.file_id = "file";
+    test_msg.chunk_index = 7;
+    test_msg.chunk_hash = "hash";
+    for (int i = 0; i < 2000; ++i) {
+        std::string line = std::to_string(i) + ",INFO,request served\n";
+        test_msg.data.insert(test_msg.data.end(), line.begin(), line.end());
+    }
+    
+    auto frame = hypershare::storage::compression::compress(test_msg.serialize());
+    ASSERT_TRUE(frame.has_value());
+    EXPECT_LT(frame->size(), test_msg.data.size());
+    
+    MessageHeader header(MessageType::CHUNK_DATA, static_cast<std::uint32_t>(frame->size()));
+    header.flags = MessageFlags::COMPRESSED;
+    
+    handler->handle_message(connection, header, *frame);
+    
+    EXPECT_TRUE(handler_called);
+    EXPECT_EQ(received_msg.chunk_index, test_msg.chunk_index);
+    EXPECT_EQ(received_msg.data, test_msg.data);
+}
+
 TEST_F(MessageHandlerTest, UnregisteredMessageType) {
     // Don't register any handlers
     HeartbeatMessage test_msg{123, 1, 1};
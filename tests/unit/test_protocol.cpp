@@ -144,6 +144,29 @@ TEST_F(ProtocolTest, ChunkDataMessageSerialization) {
     EXPECT_EQ(deserialized.chunk_hash, original.chunk_hash);
 }
 
+TEST_F(ProtocolTest, ChunkDataMessageSplitSerialization) {
+    std::vector<std::uint8_t> test_data = {0x10, 0x20, 0x30};
+    
+    ChunkDataMessage original{"file789", 7, test_data, "chunk_hash_789"};
+    
+    // Prefix + body + suffix must be byte-identical to the contiguous form
+    auto split = original.serialize_prefix(static_cast<std::uint32_t>(test_data.size()));
+    split.insert(split.end(), test_data.begin(), test_data.end());
+    auto suffix = original.serialize_suffix();
+    split.insert(split.end(), suffix.begin(), suffix.end());
+    
+    EXPECT_EQ(split, original.serialize());
+    
+    MessageHeader contiguous(MessageType::CHUNK_DATA, static_cast<std::uint32_t>(split.size()));
+    contiguous.calculate_checksum(split);
+    
+    MessageHeader scattered(MessageType::CHUNK_DATA, static_cast<std::uint32_t>(split.size()));
+    auto prefix = original.serialize_prefix(static_cast<std::uint32_t>(test_data.size()));
+    scattered.calculate_checksum({prefix, test_data, suffix});
+    
+    EXPECT_EQ(scattered.checksum, contiguous.checksum);
+}
+
 TEST_F(ProtocolTest, ErrorMessageSerialization) {
     ErrorMessage original{
         static_cast<std::uint32_t>(ErrorCode::FILE_NOT_FOUND),
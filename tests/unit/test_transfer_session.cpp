@@ -2,8 +2,17 @@
 #include "hypershare/transfer/transfer_session.hpp"
 #include "hypershare/transfer/transfer_manager.hpp"
 #include "hypershare/transfer/flow_control.hpp"
+#include "hypershare/network/protocol.hpp"
 #include "hypershare/storage/file_metadata.hpp"
+#include "hypershare/storage/hash_tree.hpp"
+#include "hypershare/storage/chunk_manager.hpp"
+#include "hypershare/storage/chunk_store.hpp"
+#include "hypershare/storage/storage_accountant.hpp"
+#include "hypershare/storage/resume_manager.hpp"
+#include "hypershare/storage/file_index.hpp"
+#include "hypershare/crypto/hash.hpp"
 #include <chrono>
+#include <fstream>
 #include <thread>
 
 using namespace hypershare::transfer;
@@ -18,12 +27,10 @@ protected:
         test_metadata_.file_size = 1024 * 1024; // 1MB
         test_metadata_.chunk_size = 64 * 1024;  // 64KB chunks
         test_metadata_.chunk_count = 16;        // 16 chunks
-        test_metadata_.chunk_hashes.resize(16);
         
-        // Fill with dummy hashes
-        for (auto& hash : test_metadata_.chunk_hashes) {
-            std::fill(hash.begin(), hash.end(), 0x42);
-        }
+        // Tests send chunks filled with 0x42, which have to match the hashes
+        std::vector<uint8_t> chunk_data(test_metadata_.chunk_size, 0x42);
+        test_metadata_.chunk_hashes.assign(16, hypershare::crypto::Blake3Hasher::hash(chunk_data));
     }
     
     FileMetadata test_metadata_;
@@ -295,6 +302,313 @@ TEST_F(TransferManagerTest, TransferManager_PauseResume) {
     EXPECT_EQ(stats.state, TransferState::TRANSFERRING);
 }
 
+TEST_F(TransferManagerTest, TransferManager_DownloadsWithinStorageBudget) {
+    // Wired as the daemon does: one accountant behind the chunk manager and store
+    StorageConfig storage(config_.download_directory / "data");
+    storage.max_storage_size = 48 * 1024;
+    ASSERT_TRUE(storage.create_directories());
+    auto accountant = std::make_shared<StorageAccountant>(storage);
+    accountant->scan();
+    auto store = std::make_shared<ChunkStore>(storage.chunk_store_directory, storage.database_path);
+    ASSERT_TRUE(store->initialize());
+    store->set_storage_accountant(accountant);
+    auto chunk_manager = std::make_shared<ChunkManager>(storage);
+    chunk_manager->set_storage_accountant(accountant);
+    chunk_manager->set_chunk_store(store);
+    
+    TransferManager manager(storage);
+    manager.set_chunk_manager(chunk_manager);
+    
+    // Larger than the whole budget: no session and no download target
+    FileMetadata too_large;
+    too_large.file_id = "too_large";
+    too_large.file_hash = "aa_too_large";
+    too_large.file_size = 128 * 1024;
+    too_large.chunk_size = 16 * 1024;
+    too_large.chunk_count = 8;
+    EXPECT_TRUE(manager.start_download(too_large, 1001).empty());
+    EXPECT_TRUE(manager.get_all_sessions().empty());
+    EXPECT_FALSE(std::filesystem::exists(storage.get_partial_path(too_large.file_hash)));
+    
+    // One that fits is written through and lands in the download directory
+    std::vector<std::vector<uint8_t>> chunks{std::vector<uint8_t>(16 * 1024, 0x11),
+                                             std::vector<uint8_t>(16 * 1024, 0x22)};
+    FileMetadata fits;
+    fits.file_id = "fits";
+    fits.filename = "fits.bin";
+    fits.file_size = 32 * 1024;
+    fits.chunk_size = 16 * 1024;
+    fits.chunk_count = 2;
+    for (const auto& chunk : chunks) {
+        fits.chunk_hashes.push_back(hypershare::crypto::Blake3Hasher::hash(chunk));
+    }
+    fits.file_hash = hypershare::crypto::hash_utils::hash_to_hex(hash_tree::root(fits.chunk_hashes, fits.file_size));
+    
+    auto session_id = manager.start_download(fits, 1001);
+    ASSERT_FALSE(session_id.empty());
+    for (uint32_t i = 0; i < 2; ++i) {
+        ASSERT_TRUE(manager.handle_chunk_request(session_id, i).success());
+        ASSERT_TRUE(manager.handle_chunk_received(session_id, i, chunks[i]).success());
+    }
+    EXPECT_EQ(manager.get_session_stats(session_id).state, TransferState::COMPLETED);
+    
+    std::ifstream file(storage.download_directory / "fits.bin", std::ios::binary);
+    std::vector<uint8_t> downloaded((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    std::vector<uint8_t> expected(chunks[0]);
+    expected.insert(expected.end(), chunks[1].begin(), chunks[1].end());
+    EXPECT_EQ(downloaded, expected);
+    
+    // Written once, to the target: nothing went into the chunk store
+    EXPECT_EQ(store->chunk_count(), 0);
+    EXPECT_EQ(accountant->used(StorageArea::CHUNK_STORE), 0u);
+    EXPECT_EQ(accountant->total_used(), fits.file_size);
+}
+
+TEST_F(TransferManagerTest, TransferManager_SeedsDownloadsFromCompletedFiles) {
+    StorageConfig storage(config_.download_directory / "data");
+    ASSERT_TRUE(storage.create_directories());
+    auto file_index = std::make_shared<FileIndex>(storage.database_path);
+    ASSERT_TRUE(file_index->initialize());
+    
+    TransferManager manager(storage);
+    manager.set_chunk_manager(std::make_shared<ChunkManager>(storage));
+    manager.set_file_index(file_index);
+    
+    std::vector<std::vector<uint8_t>> chunks{std::vector<uint8_t>(16 * 1024, 0x11),
+                                             std::vector<uint8_t>(16 * 1024, 0x22)};
+    auto make_metadata = [&](const std::string& name, const std::vector<size_t>& order) {
+        FileMetadata metadata;
+        metadata.file_id = name;
+        metadata.filename = name + ".bin";
+        metadata.file_size = order.size() * 16 * 1024;
+        metadata.chunk_size = 16 * 1024;
+        metadata.chunk_count = static_cast<uint32_t>(order.size());
+        for (size_t i : order) {
+            metadata.chunk_hashes.push_back(hypershare::crypto::Blake3Hasher::hash(chunks[i]));
+        }
+        metadata.file_hash = hypershare::crypto::hash_utils::hash_to_hex(
+            hash_tree::root(metadata.chunk_hashes, metadata.file_size));
+        return metadata;
+    };
+    
+    auto first = make_metadata("first", {0, 1});
+    auto session_id = manager.start_download(first, 1001);
+    ASSERT_FALSE(session_id.empty());
+    for (uint32_t i = 0; i < 2; ++i) {
+        ASSERT_TRUE(manager.handle_chunk_request(session_id, i).success());
+        ASSERT_TRUE(manager.handle_chunk_received(session_id, i, chunks[i]).success());
+    }
+    ASSERT_EQ(manager.get_session_stats(session_id).state, TransferState::COMPLETED);
+    EXPECT_TRUE(file_index->file_exists(first.file_hash));
+    
+    // Another file made of the same chunks needs nothing from the peer
+    auto second = make_metadata("second", {1, 0, 1});
+    session_id = manager.start_download(second, 1001);
+    ASSERT_FALSE(session_id.empty());
+    EXPECT_EQ(manager.get_session_stats(session_id).state, TransferState::COMPLETED);
+    
+    std::ifstream file(storage.download_directory / "second.bin", std::ios::binary);
+    std::vector<uint8_t> downloaded((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    std::vector<uint8_t> expected(chunks[1]);
+    expected.insert(expected.end(), chunks[0].begin(), chunks[0].end());
+    expected.insert(expected.end(), chunks[1].begin(), chunks[1].end());
+    EXPECT_EQ(downloaded, expected);
+}
+
+TEST_F(TransferManagerTest, TransferManager_ManifestOnlyDownloadVerifiedByProofs) {
+    StorageConfig storage(config_.download_directory / "data");
+    storage.default_chunk_size = 16 * 1024;
+    ASSERT_TRUE(storage.create_directories());
+    
+    // The seeder hashes a shared file; the downloader only learns its tree root
+    auto shared_path = config_.download_directory / "shared.bin";
+    std::vector<uint8_t> contents(40 * 1024);
+    for (size_t i = 0; i < contents.size(); ++i) {
+        contents[i] = static_cast<uint8_t>(i * 7 + i / 1024);
+    }
+    {
+        std::ofstream file(shared_path, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(contents.data()), contents.size());
+    }
+    ChunkManager seeder(storage);
+    FileMetadata shared;
+    ASSERT_TRUE(seeder.chunk_file(shared_path.string(), shared).success());
+    ASSERT_EQ(shared.chunk_count, 3u);
+    
+    FileMetadata manifest = shared;
+    manifest.file_id = "manifest_only";
+    manifest.filename = "manifest_only.bin";
+    manifest.file_path.clear();
+    manifest.chunk_hashes.clear();
+    
+    TransferManager manager(storage);
+    manager.set_chunk_manager(std::make_shared<ChunkManager>(storage));
+    auto session_id = manager.start_download(manifest, 1001);
+    ASSERT_FALSE(session_id.empty());
+    
+    // Each chunk travels with its proof in a ChunkDataMessage
+    auto send = [&](uint32_t chunk_index, std::vector<hypershare::crypto::Blake3Hash> proof) {
+        hypershare::network::ChunkDataMessage message;
+        message.file_id = manifest.file_id;
+        message.chunk_index = chunk_index;
+        EXPECT_TRUE(seeder.read_chunk(shared, chunk_index, message.data).success());
+        message.proof = std::move(proof);
+        auto received = hypershare::network::ChunkDataMessage::deserialize(message.serialize());
+        return manager.handle_chunk_received(session_id, static_cast<uint32_t>(received.chunk_index),
+                                             received.data, received.proof);
+    };
+    
+    for (uint32_t i = 0; i < 3; ++i) {
+        ASSERT_TRUE(manager.handle_chunk_request(session_id, i).success());
+    }
+    EXPECT_EQ(send(1, seeder.get_chunk_proof(shared, 0)).error, hypershare::crypto::CryptoError::VERIFICATION_FAILED);
+    EXPECT_EQ(send(1, {}).error, hypershare::crypto::CryptoError::VERIFICATION_FAILED);
+    for (uint32_t i = 0; i < 3; ++i) {
+        ASSERT_TRUE(send(i, seeder.get_chunk_proof(shared, i)).success()) << "chunk " << i;
+    }
+    EXPECT_EQ(manager.get_session_stats(session_id).state, TransferState::COMPLETED);
+    
+    std::ifstream file(storage.download_directory / "manifest_only.bin", std::ios::binary);
+    std::vector<uint8_t> downloaded((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(downloaded, contents);
+}
+
+TEST_F(TransferManagerTest, TransferManager_ResumeStateFollowsDurableChunks) {
+    // Chunks are written through and synced once 32KB have been written
+    StorageConfig storage(config_.download_directory / "data");
+    storage.write_back_bytes = 0;
+    storage.durability = DurabilityPolicy::PER_INTERVAL;
+    storage.sync_interval_bytes = 32 * 1024;
+    ASSERT_TRUE(storage.create_directories());
+    
+    std::vector<std::vector<uint8_t>> chunks;
+    FileMetadata metadata;
+    metadata.file_id = "resumable";
+    metadata.filename = "resumable.bin";
+    metadata.file_size = 4 * 16 * 1024;
+    metadata.chunk_size = 16 * 1024;
+    metadata.chunk_count = 4;
+    for (uint8_t i = 0; i < 4; ++i) {
+        chunks.emplace_back(16 * 1024, static_cast<uint8_t>(0x30 + i));
+        metadata.chunk_hashes.push_back(hypershare::crypto::Blake3Hasher::hash(chunks.back()));
+    }
+    metadata.file_hash = hypershare::crypto::hash_utils::hash_to_hex(
+        hash_tree::root(metadata.chunk_hashes, metadata.file_size));
+    
+    {
+        // Long commit interval: only an explicit flush reaches the database
+        auto resume_manager = std::make_shared<ResumeManager>(storage.database_path, std::chrono::hours(1));
+        ASSERT_TRUE(resume_manager->initialize());
+        TransferManager manager(storage);
+        manager.set_chunk_manager(std::make_shared<ChunkManager>(storage));
+        manager.set_resume_manager(resume_manager);
+        
+        // Interrupted with the third chunk written but not yet synced
+        auto session_id = manager.start_download(metadata, 1001);
+        ASSERT_FALSE(session_id.empty());
+        for (uint32_t i = 0; i < 3; ++i) {
+            ASSERT_TRUE(manager.handle_chunk_request(session_id, i).success());
+            ASSERT_TRUE(manager.handle_chunk_received(session_id, i, chunks[i]).success());
+        }
+        EXPECT_NE(manager.get_session_stats(session_id).state, TransferState::COMPLETED);
+        ASSERT_TRUE(resume_manager->flush());
+    }
+    
+    // After a restart only the synced chunks count as complete
+    auto reopened = std::make_shared<ResumeManager>(storage.database_path);
+    ASSERT_TRUE(reopened->initialize());
+    EXPECT_EQ(reopened->get_missing_chunks(metadata.file_hash, metadata.chunk_count), (std::vector<uint64_t>{2, 3}));
+    
+    // Starting the download again takes those chunks from the target and
+    // completes with only the missing ones
+    auto chunk_manager = std::make_shared<ChunkManager>(storage);
+    TransferManager manager(storage);
+    manager.set_chunk_manager(chunk_manager);
+    manager.set_resume_manager(reopened);
+    auto session_id = manager.start_download(metadata, 1001);
+    ASSERT_FALSE(session_id.empty());
+    EXPECT_DOUBLE_EQ(manager.get_session_stats(session_id).progress_percentage, 50.0);
+    
+    std::vector<uint8_t> restored;
+    ASSERT_TRUE(chunk_manager->read_chunk(metadata, 1, restored).success());
+    EXPECT_EQ(restored, chunks[1]);
+    EXPECT_FALSE(chunk_manager->read_chunk(metadata, 2, restored).success());
+    
+    for (uint32_t i = 2; i < 4; ++i) {
+        ASSERT_TRUE(manager.handle_chunk_request(session_id, i).success());
+        ASSERT_TRUE(manager.handle_chunk_received(session_id, i, chunks[i]).success());
+    }
+    EXPECT_EQ(manager.get_session_stats(session_id).state, TransferState::COMPLETED);
+    
+    std::ifstream file(storage.download_directory / "resumable.bin", std::ios::binary);
+    std::vector<uint8_t> downloaded((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    std::vector<uint8_t> expected;
+    for (const auto& chunk : chunks) {
+        expected.insert(expected.end(), chunk.begin(), chunk.end());
+    }
+    EXPECT_EQ(downloaded, expected);
+    EXPECT_FALSE(reopened->is_resumable(metadata.file_hash));
+}
+
+TEST_F(TransferManagerTest, TransferManager_EvictionDropsResumeState) {
+    // Every chunk is durable as soon as it is written
+    StorageConfig storage(config_.download_directory / "data");
+    storage.max_storage_size = 48 * 1024;
+    storage.write_back_bytes = 0;
+    storage.durability = DurabilityPolicy::PER_CHUNK;
+    ASSERT_TRUE(storage.create_directories());
+    
+    std::vector<uint8_t> chunk(16 * 1024, 0x5A);
+    auto make_metadata = [&](const std::string& name, uint8_t fill) {
+        FileMetadata metadata;
+        metadata.file_id = name;
+        metadata.filename = name + ".bin";
+        metadata.file_size = 32 * 1024;
+        metadata.chunk_size = 16 * 1024;
+        metadata.chunk_count = 2;
+        metadata.chunk_hashes.push_back(hypershare::crypto::Blake3Hasher::hash(chunk));
+        metadata.chunk_hashes.push_back(hypershare::crypto::Blake3Hasher::hash(std::vector<uint8_t>(16 * 1024, fill)));
+        metadata.file_hash = hypershare::crypto::hash_utils::hash_to_hex(
+            hash_tree::root(metadata.chunk_hashes, metadata.file_size));
+        return metadata;
+    };
+    auto interrupted = make_metadata("interrupted", 0x01);
+    auto next = make_metadata("next", 0x02);
+    
+    auto resume_manager = std::make_shared<ResumeManager>(storage.database_path);
+    ASSERT_TRUE(resume_manager->initialize());
+    {
+        auto accountant = std::make_shared<StorageAccountant>(storage);
+        accountant->scan();
+        auto chunk_manager = std::make_shared<ChunkManager>(storage);
+        chunk_manager->set_storage_accountant(accountant);
+        TransferManager manager(storage);
+        manager.set_chunk_manager(chunk_manager);
+        manager.set_resume_manager(resume_manager);
+        
+        auto session_id = manager.start_download(interrupted, 1001);
+        ASSERT_FALSE(session_id.empty());
+        ASSERT_TRUE(manager.handle_chunk_request(session_id, 0).success());
+        ASSERT_TRUE(manager.handle_chunk_received(session_id, 0, chunk).success());
+        ASSERT_TRUE(resume_manager->flush());
+    }
+    EXPECT_TRUE(resume_manager->get_completed_chunks(interrupted.file_hash).contains(0));
+    
+    // After a restart the interrupted download is evicted to fit the next one
+    auto accountant = std::make_shared<StorageAccountant>(storage);
+    accountant->scan();
+    auto chunk_manager = std::make_shared<ChunkManager>(storage);
+    chunk_manager->set_storage_accountant(accountant);
+    TransferManager manager(storage);
+    manager.set_chunk_manager(chunk_manager);
+    manager.set_resume_manager(resume_manager);
+    
+    ASSERT_FALSE(manager.start_download(next, 1001).empty());
+    EXPECT_FALSE(std::filesystem::exists(storage.get_partial_path(interrupted.file_hash)));
+    EXPECT_FALSE(resume_manager->is_resumable(interrupted.file_hash));
+    EXPECT_TRUE(resume_manager->is_resumable(next.file_hash));
+}
+
 // Test error conditions
 TEST_F(TransferSessionTest, ErrorHandling_InvalidChunks) {
     TransferSession session("session_123", test_metadata_.file_id, 1001);
@@ -314,6 +628,105 @@ TEST_F(TransferSessionTest, ErrorHandling_InvalidChunks) {
     EXPECT_EQ(result.error, hypershare::crypto::CryptoError::INVALID_STATE);
 }
 
+TEST_F(TransferSessionTest, TransferSession_ManifestChunksVerifiedByProof) {
+    // Five chunks with distinct contents, announced by tree root only
+    std::vector<std::vector<uint8_t>> chunks;
+    std::vector<hypershare::crypto::Blake3Hash> leaves;
+    for (uint8_t i = 0; i < 5; ++i) {
+        chunks.emplace_back(1024, static_cast<uint8_t>(i + 1));
+        leaves.push_back(hypershare::crypto::Blake3Hasher::hash(chunks.back()));
+    }
+    hash_tree::Tree tree(leaves, 5 * 1024);
+    
+    FileMetadata manifest;
+    manifest.file_id = "tree_file";
+    manifest.file_hash = hypershare::crypto::hash_utils::hash_to_hex(tree.root());
+    manifest.file_hash_scheme = FileHashScheme::CHUNK_TREE;
+    manifest.file_size = 5 * 1024;
+    manifest.chunk_size = 1024;
+    manifest.chunk_count = 5;
+    
+    TransferSession session("session_tree", manifest.file_id, 1001);
+    session.start_transfer(manifest);
+    session.request_next_chunks(5);
+    
+    // A chunk with another chunk's proof, or no proof at all, is rejected
+    auto result = session.handle_chunk_received(2, chunks[2], tree.proof(3));
+    EXPECT_EQ(result.error, hypershare::crypto::CryptoError::VERIFICATION_FAILED);
+    result = session.handle_chunk_received(2, chunks[2]);
+    EXPECT_EQ(result.error, hypershare::crypto::CryptoError::VERIFICATION_FAILED);
+    
+    for (uint32_t i = 0; i < 5; ++i) {
+        auto proof = tree.proof(i);
+        EXPECT_TRUE(session.handle_chunk_received(i, chunks[i], proof).success()) << "chunk " << i;
+    }
+    EXPECT_TRUE(session.is_complete());
+}
+
+TEST_F(TransferSessionTest, TransferSession_ForgedManifestRejected) {
+    // A genuine two-chunk file announced by tree root
+    std::vector<std::vector<uint8_t>> chunks{std::vector<uint8_t>(1024, 0xAA), std::vector<uint8_t>(1024, 0xBB)};
+    std::vector<hypershare::crypto::Blake3Hash> leaves;
+    for (const auto& chunk : chunks) {
+        leaves.push_back(hypershare::crypto::Blake3Hasher::hash(chunk));
+    }
+    hash_tree::Tree tree(leaves, 2 * 1024);
+    
+    // A peer reuses the root for a one-chunk file whose only chunk is the
+    // 65-byte encoding of the root's children, hoping it hashes to the root
+    std::vector<uint8_t> forged{0x01};
+    for (const auto& leaf : leaves) {
+        auto node = hash_tree::leaf(leaf);
+        forged.insert(forged.end(), node.begin(), node.end());
+    }
+    
+    FileMetadata manifest;
+    manifest.file_id = "forged_file";
+    manifest.file_hash = hypershare::crypto::hash_utils::hash_to_hex(tree.root());
+    manifest.file_hash_scheme = FileHashScheme::CHUNK_TREE;
+    manifest.file_size = forged.size();
+    manifest.chunk_size = 1024;
+    manifest.chunk_count = 1;
+    
+    TransferSession session("session_forged", manifest.file_id, 1001);
+    session.start_transfer(manifest);
+    session.request_next_chunks(1);
+    
+    auto result = session.handle_chunk_received(0, forged);
+    EXPECT_EQ(result.error, hypershare::crypto::CryptoError::VERIFICATION_FAILED);
+    EXPECT_FALSE(session.is_complete());
+}
+
+TEST_F(TransferSessionTest, TransferSession_ZeroChunkSizeRejected) {
+    // The chunk size of a manifest comes from the peer
+    FileMetadata manifest;
+    manifest.file_id = "zero_chunk_size";
+    manifest.file_hash = std::string(64, 'a');
+    manifest.file_hash_scheme = FileHashScheme::CHUNK_TREE;
+    manifest.file_size = 1024;
+    manifest.chunk_size = 0;
+    manifest.chunk_count = 1;
+    EXPECT_EQ(manifest.total_chunks(), 0u);
+    EXPECT_EQ(manifest.get_chunk_size(0), 0u);
+    
+    TransferSession session("session_zero", manifest.file_id, 1001);
+    session.start_transfer(manifest);
+    session.request_next_chunks(1);
+    EXPECT_FALSE(session.handle_chunk_received(0, std::vector<uint8_t>(1024, 0x01)).success());
+    EXPECT_FALSE(session.handle_chunk_received(0, {}).success());
+    
+    StorageConfig storage(std::filesystem::temp_directory_path() / "hypershare_zero_chunk_size");
+    ASSERT_TRUE(storage.create_directories());
+    TransferManager manager(storage);
+    EXPECT_TRUE(manager.start_download(manifest, 1001).empty());
+    
+    auto chunk_manager = std::make_shared<ChunkManager>(storage);
+    EXPECT_FALSE(chunk_manager->prepare_download(manifest).success());
+    manager.set_chunk_manager(chunk_manager);
+    EXPECT_TRUE(manager.start_download(manifest, 1001).empty());
+    std::filesystem::remove_all(std::filesystem::temp_directory_path() / "hypershare_zero_chunk_size");
+}
+
 TEST_F(TransferSessionTest, ErrorHandling_DuplicateChunks) {
     TransferSession session("session_123", test_metadata_.file_id, 1001);
     session.start_transfer(test_metadata_);